@@ -0,0 +1,90 @@
+#ifndef SMCODESRENDERENGINE_ACCUMULATIONBUFFER_H
+#define SMCODESRENDERENGINE_ACCUMULATIONBUFFER_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "RenderSettings.h"
+
+// First hit surface properties of a sample, the denoiser uses them to find edges
+struct FeatureSample {
+    glm::vec3 albedo = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    float depth = 0.0f; // distance to the first hit, 0 when the camera ray escaped
+};
+
+// Running sum of every sample traced per pixel. The image is the sum divided by the count,
+// which lets a render be stopped, inspected and continued at any sample
+struct AccumulationBuffer {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<glm::vec3> radianceSum;
+    std::vector<uint32_t> sampleCounts;
+
+    // feature buffers, summed the same way as the radiance
+    std::vector<glm::vec3> albedoSum;
+    std::vector<glm::vec3> normalSum;
+    std::vector<float> depthSum;
+
+    void resize(uint32_t newWidth, uint32_t newHeight) {
+        width = newWidth;
+        height = newHeight;
+        size_t pixelCount = static_cast<size_t>(width) * height;
+        radianceSum.assign(pixelCount, glm::vec3(0.0f));
+        sampleCounts.assign(pixelCount, 0);
+        albedoSum.assign(pixelCount, glm::vec3(0.0f));
+        normalSum.assign(pixelCount, glm::vec3(0.0f));
+        depthSum.assign(pixelCount, 0.0f);
+    }
+
+    void addSample(uint32_t pixelIndex, const glm::vec3 &radiance, const FeatureSample &features) {
+        radianceSum[pixelIndex] += radiance;
+        sampleCounts[pixelIndex]++;
+        albedoSum[pixelIndex] += features.albedo;
+        normalSum[pixelIndex] += features.normal;
+        depthSum[pixelIndex] += features.depth;
+    }
+
+    // adds everything accumulated in source, a buffer the size of region, into that region of this one
+    void addRegion(const ImageRegion &region, const AccumulationBuffer &source) {
+        for (uint32_t y = 0; y < region.height; y++) {
+            for (uint32_t x = 0; x < region.width; x++) {
+                uint32_t sourceIndex = y * region.width + x;
+                uint32_t pixelIndex = (region.y + y) * width + region.x + x;
+                radianceSum[pixelIndex] += source.radianceSum[sourceIndex];
+                sampleCounts[pixelIndex] += source.sampleCounts[sourceIndex];
+                albedoSum[pixelIndex] += source.albedoSum[sourceIndex];
+                normalSum[pixelIndex] += source.normalSum[sourceIndex];
+                depthSum[pixelIndex] += source.depthSum[sourceIndex];
+            }
+        }
+    }
+
+    glm::vec3 getPixel(uint32_t pixelIndex) const {
+        return average(radianceSum[pixelIndex], sampleCounts[pixelIndex]);
+    }
+
+    glm::vec3 getAlbedo(uint32_t pixelIndex) const {
+        return average(albedoSum[pixelIndex], sampleCounts[pixelIndex]);
+    }
+
+    // averaged normals are shorter than unit length along edges, which is fine for edge detection
+    glm::vec3 getNormal(uint32_t pixelIndex) const {
+        return average(normalSum[pixelIndex], sampleCounts[pixelIndex]);
+    }
+
+    float getDepth(uint32_t pixelIndex) const {
+        uint32_t count = sampleCounts[pixelIndex];
+        return count > 0 ? depthSum[pixelIndex] / static_cast<float>(count) : 0.0f;
+    }
+
+private:
+    static glm::vec3 average(const glm::vec3 &sum, uint32_t count) {
+        return count > 0 ? sum / static_cast<float>(count) : glm::vec3(0.0f);
+    }
+};
+
+
+#endif //SMCODESRENDERENGINE_ACCUMULATIONBUFFER_H
@@ -0,0 +1,89 @@
+#include "AliasTable.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// #region Constants
+
+const float ALIAS_ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+// #endregion
+
+// #region Public Methods
+
+AliasTable::AliasTable(const std::vector<float> &weights) {
+    double total = 0.0;
+    for (float weight: weights) {
+        if (weight < 0.0f) {
+            throw std::runtime_error("alias table weights can't be negative!");
+        }
+        total += weight;
+    }
+    if (total == 0.0) {
+        return;
+    }
+
+    auto size = static_cast<uint32_t>(weights.size());
+    bins.resize(size);
+
+    // scaled so the average bin is 1, those under 1 get topped up by those over it. In double, the
+    // leftovers of a few million bins would drift a long way in float
+    std::vector<double> scaled(size);
+    std::vector<uint32_t> under;
+    std::vector<uint32_t> over;
+    for (uint32_t i = 0; i < size; i++) {
+        bins[i].pmf = static_cast<float>(weights[i] / total);
+        scaled[i] = weights[i] / total * size;
+        (scaled[i] < 1.0 ? under : over).push_back(i);
+    }
+
+    while (!under.empty() && !over.empty()) {
+        uint32_t small = under.back();
+        under.pop_back();
+        uint32_t large = over.back();
+        over.pop_back();
+
+        bins[small].keepProbability = static_cast<float>(scaled[small]);
+        bins[small].alias = large;
+
+        scaled[large] -= 1.0 - scaled[small];
+        (scaled[large] < 1.0 ? under : over).push_back(large);
+    }
+
+    // whatever is left is 1 up to rounding
+    for (uint32_t i: under) {
+        bins[i].keepProbability = 1.0f;
+        bins[i].alias = i;
+    }
+    for (uint32_t i: over) {
+        bins[i].keepProbability = 1.0f;
+        bins[i].alias = i;
+    }
+}
+
+bool AliasTable::isEmpty() const {
+    return bins.empty();
+}
+
+uint32_t AliasTable::sample(float u, float &pmf) const {
+    auto size = static_cast<uint32_t>(bins.size());
+    float scaled = u * static_cast<float>(size);
+    uint32_t index = std::min(static_cast<uint32_t>(scaled), size - 1);
+    float choice = std::min(scaled - static_cast<float>(index), ALIAS_ONE_MINUS_EPSILON);
+
+    if (choice >= bins[index].keepProbability) {
+        index = bins[index].alias;
+    }
+    pmf = bins[index].pmf;
+    return index;
+}
+
+float AliasTable::pmf(uint32_t index) const {
+    return bins[index].pmf;
+}
+
+uint32_t AliasTable::getSize() const {
+    return static_cast<uint32_t>(bins.size());
+}
+
+// #endregion
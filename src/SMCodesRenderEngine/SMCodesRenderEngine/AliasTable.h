@@ -0,0 +1,39 @@
+#ifndef SMCODESRENDERENGINE_ALIASTABLE_H
+#define SMCODESRENDERENGINE_ALIASTABLE_H
+
+
+#include <cstdint>
+#include <vector>
+
+// Walker's alias method, built with Vose's algorithm. Samples a discrete distribution in constant time
+// whatever its size: every bin holds the chance of keeping itself and the bin it hands over to otherwise.
+// One float picks both the bin and the choice, which leaves plenty of bits for either up to tens of
+// thousands of bins. Bigger distributions should be split up (see EnvironmentMap's rows and columns)
+class AliasTable {
+public:
+    AliasTable() = default;
+
+    // weights don't need to sum to anything, the table is empty if they are all 0
+    explicit AliasTable(const std::vector<float> &weights);
+
+    bool isEmpty() const;
+
+    // u is in [0, 1), picks the bin and then between it and its alias
+    uint32_t sample(float u, float &pmf) const;
+
+    float pmf(uint32_t index) const;
+
+    uint32_t getSize() const;
+
+private:
+    struct Bin {
+        float keepProbability;
+        uint32_t alias;
+        float pmf;
+    };
+
+    std::vector<Bin> bins;
+};
+
+
+#endif //SMCODESRENDERENGINE_ALIASTABLE_H
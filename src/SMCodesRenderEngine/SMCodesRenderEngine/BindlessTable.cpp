@@ -0,0 +1,505 @@
+#include "BindlessTable.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "VulkanUtils.h"
+
+// #region Constants
+
+// below these the table isn't worth the update after bind restrictions, it falls back instead
+const uint32_t MIN_BINDLESS_IMAGES = 1024;
+const uint32_t MIN_BINDLESS_BUFFERS = 256;
+
+// sized to the minimum per stage limits Vulkan guarantees, so the fallback works everywhere
+const uint32_t FALLBACK_IMAGES = 16;
+const uint32_t FALLBACK_BUFFERS = 4;
+
+const VkDeviceSize DEFAULT_BUFFER_SIZE = 256;
+
+const uint32_t IMAGE_BINDING = 0;
+const uint32_t BUFFER_BINDING = 1;
+const uint32_t SAMPLER_BINDING = 2;
+
+// #endregion
+
+// #region Private Methods
+
+void BindlessTable::chooseCapacities(VkPhysicalDevice physicalDevice, uint32_t imageCapacity,
+                                     uint32_t bufferCapacity) {
+    VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+    vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &vulkan12Properties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+    const VkPhysicalDeviceLimits &limits = properties2.properties.limits;
+
+    bindless = enabled.updateAfterBind && enabled.partiallyBound && enabled.dynamicIndexing;
+    if (bindless) {
+        uint32_t bindlessImages = std::min({imageCapacity,
+                                            vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                            vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages});
+        uint32_t bindlessBuffers = std::min({bufferCapacity,
+                                             vulkan12Properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                                             vulkan12Properties.maxDescriptorSetUpdateAfterBindStorageBuffers});
+        // both arrays count towards the per stage resource limit and the pool limit
+        uint32_t resources = std::min(vulkan12Properties.maxPerStageUpdateAfterBindResources,
+                                      vulkan12Properties.maxUpdateAfterBindDescriptorsInAllPools);
+        bindlessBuffers = std::min(bindlessBuffers, resources / 4);
+        bindlessImages = std::min(bindlessImages, resources - bindlessBuffers);
+
+        if (bindlessImages >= std::min(imageCapacity, MIN_BINDLESS_IMAGES) &&
+            bindlessBuffers >= std::min(bufferCapacity, MIN_BINDLESS_BUFFERS)) {
+            images.capacity = bindlessImages;
+            buffers.capacity = bindlessBuffers;
+            return;
+        }
+
+        LOG_WARNING("update after bind limits too small, bindless table falling back to a set per frame",
+                    {{"images", bindlessImages}, {"buffers", bindlessBuffers}});
+        bindless = false;
+    } else {
+        LOG_WARNING("descriptor indexing not supported, bindless table falling back to a set per frame",
+                    {{"dynamicIndexing", enabled.dynamicIndexing}, {"partiallyBound", enabled.partiallyBound},
+                     {"updateAfterBind", enabled.updateAfterBind}});
+    }
+
+    // without dynamic indexing every shader would index the arrays with 0, so only the first slot is any use
+    if (!enabled.dynamicIndexing) {
+        images.capacity = 1;
+        buffers.capacity = 1;
+        return;
+    }
+    images.capacity = std::min({imageCapacity, FALLBACK_IMAGES, limits.maxPerStageDescriptorSampledImages});
+    buffers.capacity = std::min({bufferCapacity, FALLBACK_BUFFERS, limits.maxPerStageDescriptorStorageBuffers});
+}
+
+void BindlessTable::createLayout() {
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless sampler!");
+    }
+
+    // every image is sampled the same way, one immutable sampler next to the arrays saves pairing them up
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    bindings[0].binding = IMAGE_BINDING;
+    bindings[0].descriptorType = images.type;
+    bindings[0].descriptorCount = images.capacity;
+    bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].binding = BUFFER_BINDING;
+    bindings[1].descriptorType = buffers.type;
+    bindings[1].descriptorCount = buffers.capacity;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[2].binding = SAMPLER_BINDING;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[2].pImmutableSamplers = &sampler;
+
+    VkDescriptorBindingFlags arrayFlags = 0;
+    if (enabled.partiallyBound) {
+        arrayFlags |= VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    }
+    if (bindless) {
+        // new handles are written while frames using other slots of the same set are still in flight
+        arrayFlags |= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+    std::array<VkDescriptorBindingFlags, 3> bindingFlags = {arrayFlags, arrayFlags, 0};
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = bindless ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT : 0;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless descriptor set layout!");
+    }
+}
+
+void BindlessTable::createSets() {
+    auto setCount = static_cast<uint32_t>(sets.size());
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type = images.type;
+    poolSizes[0].descriptorCount = images.capacity * setCount;
+    poolSizes[1].type = buffers.type;
+    poolSizes[1].descriptorCount = buffers.capacity * setCount;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+    poolSizes[2].descriptorCount = setCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = bindless ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0;
+    poolInfo.maxSets = setCount;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(setCount, layout);
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = pool;
+    allocateInfo.descriptorSetCount = setCount;
+    allocateInfo.pSetLayouts = layouts.data();
+    if (vkAllocateDescriptorSets(device, &allocateInfo, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate bindless descriptor sets!");
+    }
+}
+
+void BindlessTable::createDefaults(VkPhysicalDevice physicalDevice, VkQueue queue, uint32_t queueFamily) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = {1, 1, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    createImage(physicalDevice, device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, defaultImage,
+                defaultImageMemory);
+    defaultImageView = createImageView(device, defaultImage, imageInfo.format);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = DEFAULT_BUFFER_SIZE;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &defaultBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create default bindless buffer!");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, defaultBuffer, &requirements);
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    int memoryType = findMemoryType(memoryProperties, requirements.memoryTypeBits,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (memoryType < 0) {
+        throw std::runtime_error("failed to find memory for the default bindless buffer!");
+    }
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = static_cast<uint32_t>(memoryType);
+    if (vkAllocateMemory(device, &allocateInfo, nullptr, &defaultBufferMemory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate default bindless buffer memory!");
+    }
+    vkBindBufferMemory(device, defaultBuffer, defaultBufferMemory, 0);
+
+    // white image and zeroed buffer, once at startup so a throwaway pool and a wait on the queue are fine
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+    VkCommandPool commandPool;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create bindless upload command pool!");
+    }
+
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.commandPool = commandPool;
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferInfo.commandBufferCount = 1;
+    VkCommandBuffer cmdBuffer;
+    if (vkAllocateCommandBuffers(device, &commandBufferInfo, &cmdBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate bindless upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmdBuffer, &beginInfo);
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = defaultImage;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkClearColorValue white = {{1.0f, 1.0f, 1.0f, 1.0f}};
+    vkCmdClearColorImage(cmdBuffer, defaultImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &white, 1,
+                         &barrier.subresourceRange);
+    vkCmdFillBuffer(cmdBuffer, defaultBuffer, 0, VK_WHOLE_SIZE, 0);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkEndCommandBuffer(cmdBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmdBuffer;
+    if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit bindless upload!");
+    }
+    vkQueueWaitIdle(queue);
+    vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+uint32_t BindlessTable::allocate(Array &array) {
+    uint32_t handle;
+    if (!array.freeHandles.empty()) {
+        handle = array.freeHandles.back();
+        array.freeHandles.pop_back();
+    } else if (array.used < array.capacity) {
+        handle = array.used++;
+    } else {
+        throw std::runtime_error("bindless table is full!");
+    }
+    return handle;
+}
+
+void BindlessTable::release(Array &array, uint32_t handle, uint64_t lastUsedFrame) {
+    if (handle >= array.used) {
+        throw std::runtime_error("failed to release bindless handle, it was never allocated!");
+    }
+
+    // whatever the slot pointed at is about to be destroyed, devices that need every slot valid get the default
+    if (!enabled.partiallyBound) {
+        if (array.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE) {
+            array.images[handle] = {VK_NULL_HANDLE, defaultImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        } else {
+            array.buffers[handle] = {defaultBuffer, 0, VK_WHOLE_SIZE};
+        }
+        publish(array, handle);
+    }
+    array.retired.emplace_back(lastUsedFrame, handle);
+}
+
+void BindlessTable::publish(Array &array, uint32_t handle) {
+    if (bindless) {
+        write(sets[0], array, handle);
+        return;
+    }
+    for (auto &writes: pendingWrites) {
+        writes.emplace_back(&array, handle);
+    }
+}
+
+void BindlessTable::write(VkDescriptorSet set, const Array &array, uint32_t handle) const {
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = set;
+    descriptorWrite.dstBinding = array.binding;
+    descriptorWrite.dstArrayElement = handle;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.descriptorType = array.type;
+    if (array.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE) {
+        descriptorWrite.pImageInfo = &array.images[handle];
+    } else {
+        descriptorWrite.pBufferInfo = &array.buffers[handle];
+    }
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void BindlessTable::writeDefaults(VkDescriptorSet set) const {
+    std::vector<VkDescriptorImageInfo> imageInfos(images.capacity, {VK_NULL_HANDLE, defaultImageView,
+                                                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+    std::vector<VkDescriptorBufferInfo> bufferInfos(buffers.capacity, {defaultBuffer, 0, VK_WHOLE_SIZE});
+
+    std::array<VkWriteDescriptorSet, 2> writes{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = set;
+    writes[0].dstBinding = IMAGE_BINDING;
+    writes[0].descriptorCount = images.capacity;
+    writes[0].descriptorType = images.type;
+    writes[0].pImageInfo = imageInfos.data();
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = set;
+    writes[1].dstBinding = BUFFER_BINDING;
+    writes[1].descriptorCount = buffers.capacity;
+    writes[1].descriptorType = buffers.type;
+    writes[1].pBufferInfo = bufferInfos.data();
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+// #endregion
+
+// #region Public Methods
+
+BindlessFeatures BindlessTable::enableFeatures(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures &features,
+                                               VkPhysicalDeviceVulkan12Features &vulkan12Features) {
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+    BindlessFeatures result;
+    // a material ID is the same for the whole draw, so dynamically uniform indexing is all the shaders need
+    result.dynamicIndexing = supported.features.shaderSampledImageArrayDynamicIndexing &&
+                             supported.features.shaderStorageBufferArrayDynamicIndexing;
+    result.partiallyBound = supported12.descriptorBindingPartiallyBound;
+    result.updateAfterBind = supported12.descriptorBindingSampledImageUpdateAfterBind &&
+                             supported12.descriptorBindingStorageBufferUpdateAfterBind &&
+                             supported12.descriptorBindingUpdateUnusedWhilePending;
+
+    if (result.dynamicIndexing) {
+        features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+    }
+    if (result.partiallyBound) {
+        vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+    }
+    if (result.updateAfterBind) {
+        vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    }
+    return result;
+}
+
+void BindlessTable::create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue queue,
+                           uint32_t queueFamily, const BindlessFeatures &features, uint32_t frameCount,
+                           uint32_t imageCapacity, uint32_t bufferCapacity) {
+    device = logicalDevice;
+    enabled = features;
+
+    images.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    images.binding = IMAGE_BINDING;
+    buffers.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    buffers.binding = BUFFER_BINDING;
+    chooseCapacities(physicalDevice, imageCapacity, bufferCapacity);
+    images.images.resize(images.capacity);
+    buffers.buffers.resize(buffers.capacity);
+
+    createLayout();
+    sets.resize(bindless ? 1 : frameCount);
+    pendingWrites.assign(bindless ? 0 : frameCount, {});
+    createSets();
+    createDefaults(physicalDevice, queue, queueFamily);
+
+    if (!enabled.partiallyBound) {
+        for (VkDescriptorSet set: sets) {
+            writeDefaults(set);
+        }
+    }
+
+    // handle 0, the image every material without a texture of its own samples
+    allocateImage(defaultImageView);
+
+    LOG_INFO("created bindless table", {{"bindless", bindless}, {"images", images.capacity},
+                                        {"buffers", buffers.capacity}, {"sets", sets.size()}});
+}
+
+void BindlessTable::destroy() {
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    vkDestroySampler(device, sampler, nullptr);
+    vkDestroyImageView(device, defaultImageView, nullptr);
+    vkDestroyImage(device, defaultImage, nullptr);
+    vkFreeMemory(device, defaultImageMemory, nullptr);
+    vkDestroyBuffer(device, defaultBuffer, nullptr);
+    vkFreeMemory(device, defaultBufferMemory, nullptr);
+    pool = VK_NULL_HANDLE;
+    layout = VK_NULL_HANDLE;
+    sets.clear();
+    pendingWrites.clear();
+}
+
+uint32_t BindlessTable::allocateImage(VkImageView view) {
+    uint32_t handle = allocate(images);
+    images.images[handle] = {VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    publish(images, handle);
+    return handle;
+}
+
+uint32_t BindlessTable::allocateBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    uint32_t handle = allocate(buffers);
+    buffers.buffers[handle] = {buffer, offset, range};
+    publish(buffers, handle);
+    return handle;
+}
+
+void BindlessTable::releaseImage(uint32_t handle, uint64_t lastUsedFrame) {
+    if (handle == DEFAULT_IMAGE) {
+        throw std::runtime_error("failed to release bindless handle, the default image is the table's!");
+    }
+    release(images, handle, lastUsedFrame);
+}
+
+void BindlessTable::releaseBuffer(uint32_t handle, uint64_t lastUsedFrame) {
+    release(buffers, handle, lastUsedFrame);
+}
+
+void BindlessTable::beginFrame(uint32_t slot, uint64_t completedFrame) {
+    for (Array *array: {&images, &buffers}) {
+        while (!array->retired.empty() && array->retired.front().first <= completedFrame) {
+            array->freeHandles.push_back(array->retired.front().second);
+            array->retired.pop_front();
+        }
+    }
+
+    if (bindless) {
+        currentSet = 0;
+        return;
+    }
+
+    // the frame that last used this set is done, so it can take every write since then
+    currentSet = slot;
+    for (const auto &[array, handle]: pendingWrites[slot]) {
+        write(sets[slot], *array, handle);
+    }
+    pendingWrites[slot].clear();
+}
+
+VkDescriptorSet BindlessTable::getSet() const {
+    return sets[currentSet];
+}
+
+VkDescriptorSetLayout BindlessTable::getLayout() const {
+    return layout;
+}
+
+uint32_t BindlessTable::getImageCapacity() const {
+    return images.capacity;
+}
+
+uint32_t BindlessTable::getBufferCapacity() const {
+    return buffers.capacity;
+}
+
+bool BindlessTable::isBindless() const {
+    return bindless;
+}
+
+// #endregion
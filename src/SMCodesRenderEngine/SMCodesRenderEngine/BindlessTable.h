@@ -0,0 +1,126 @@
+#ifndef SMCODESRENDERENGINE_BINDLESSTABLE_H
+#define SMCODESRENDERENGINE_BINDLESSTABLE_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// descriptor indexing features turned on at device creation, see BindlessTable::enableFeatures()
+struct BindlessFeatures {
+    bool dynamicIndexing = false; // arrays of images and storage buffers indexed by a value the shader works out
+    bool partiallyBound = false; // slots nothing was written to can be left empty
+    bool updateAfterBind = false; // slots can be written while the set is bound and frames using it are in flight
+};
+
+// Every sampled image and storage buffer the scene draws with, in two big descriptor arrays of a single set that is
+// bound once per command buffer. Resources are referred to by handle, their index into the array, which stays the
+// same for as long as they're registered. Shaders look everything up by index (a material ID into a buffer of
+// material records, an image handle out of a record), so a whole scene draws without binding anything else.
+// Handles come off a free list. A released handle isn't handed out again until the frame that last used it is done
+// on the GPU, so its slot is never rewritten under a frame still reading it.
+// With update after bind the whole table is one set, written to as soon as a handle is allocated. Where the device
+// lacks the features or its limits are too small for the capacity asked for, the table drops to the limits every
+// device has: a small array, a set per frame in flight, and writes held back until each set's frame comes round.
+// Handles and shaders are the same either way, the array sizes reach the shaders as specialization constants
+// 0 (images) and 1 (buffers)
+class BindlessTable {
+public:
+    // image handle 0 is always there, a 1x1 white image for materials without a texture
+    static const uint32_t DEFAULT_IMAGE = 0;
+
+    // fills in the features the table wants that physicalDevice has, before the device is created with them
+    static BindlessFeatures enableFeatures(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures &features,
+                                           VkPhysicalDeviceVulkan12Features &vulkan12Features);
+
+    // capacities are clamped to the device limits. queue is only used once here, to clear the default image
+    void create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkQueue queue, uint32_t queueFamily,
+                const BindlessFeatures &features, uint32_t frameCount, uint32_t imageCapacity,
+                uint32_t bufferCapacity);
+
+    // nothing drawn with the table can still be on the GPU
+    void destroy();
+
+    // view has to be in SHADER_READ_ONLY_OPTIMAL whenever a frame samples it. Throws once the table is full
+    uint32_t allocateImage(VkImageView view);
+
+    uint32_t allocateBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+    // lastUsedFrame is the last frame (frame timeline numbering) that may have read the handle
+    void releaseImage(uint32_t handle, uint64_t lastUsedFrame);
+
+    void releaseBuffer(uint32_t handle, uint64_t lastUsedFrame);
+
+    // before recording into slot's command buffer: hands released handles back once completedFrame has passed
+    // them and brings slot's set up to date
+    void beginFrame(uint32_t slot, uint64_t completedFrame);
+
+    // the set to bind for the frame last begun
+    VkDescriptorSet getSet() const;
+
+    VkDescriptorSetLayout getLayout() const;
+
+    uint32_t getImageCapacity() const;
+
+    uint32_t getBufferCapacity() const;
+
+    // false when the table fell back to a set per frame
+    bool isBindless() const;
+
+private:
+    // one array of the table, images or buffers
+    struct Array {
+        VkDescriptorType type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        uint32_t binding = 0;
+        uint32_t capacity = 0;
+        uint32_t used = 0; // handles below this have been handed out at some point
+        std::vector<uint32_t> freeHandles;
+        std::deque<std::pair<uint64_t, uint32_t>> retired; // last used frame and handle, oldest first
+        std::vector<VkDescriptorImageInfo> images; // what each slot holds, by handle
+        std::vector<VkDescriptorBufferInfo> buffers;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    BindlessFeatures enabled;
+    bool bindless = false;
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> sets; // one with update after bind, otherwise one per frame in flight
+    std::vector<std::vector<std::pair<Array *, uint32_t>>> pendingWrites; // per set, slots written since it was last
+    uint32_t currentSet = 0;
+    Array images;
+    Array buffers;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    // what empty slots point at when the device can't leave them unbound
+    VkImage defaultImage = VK_NULL_HANDLE;
+    VkImageView defaultImageView = VK_NULL_HANDLE;
+    VkDeviceMemory defaultImageMemory = VK_NULL_HANDLE;
+    VkBuffer defaultBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory defaultBufferMemory = VK_NULL_HANDLE;
+
+    void chooseCapacities(VkPhysicalDevice physicalDevice, uint32_t imageCapacity, uint32_t bufferCapacity);
+
+    void createLayout();
+
+    void createSets();
+
+    void createDefaults(VkPhysicalDevice physicalDevice, VkQueue queue, uint32_t queueFamily);
+
+    uint32_t allocate(Array &array);
+
+    void release(Array &array, uint32_t handle, uint64_t lastUsedFrame);
+
+    // writes what the slot holds now into every set, straight away with update after bind or queued otherwise
+    void publish(Array &array, uint32_t handle);
+
+    void write(VkDescriptorSet set, const Array &array, uint32_t handle) const;
+
+    // fills every slot of set with the defaults, for devices that need the whole array bound
+    void writeDefaults(VkDescriptorSet set) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_BINDLESSTABLE_H
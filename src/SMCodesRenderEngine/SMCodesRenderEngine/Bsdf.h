@@ -0,0 +1,325 @@
+#ifndef SMCODESRENDERENGINE_BSDF_H
+#define SMCODESRENDERENGINE_BSDF_H
+
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "MaterialTable.h"
+#include "Sampling.h"
+
+// BSDF kernels, one struct per MaterialType. The integrator is a template over the kernel (Integrator::shadeWith)
+// so every material type gets its own copy of the shading code with the kernel's calls inlined, and the type is
+// switched on once per hit in the megakernel or once per run of hits in the wavefront, never inside the maths.
+// A kernel is built for one hit from the MaterialTable, the (textured) albedo and the normal on the side the ray
+// came from, and has
+//  - IS_DELTA         every direction it picks is a single direction, no next event estimation and no MIS
+//  - HAS_LOBE_CHOICE  sample() picks between lobes with uLobe, which is only drawn for these kernels
+//  - evaluate(wo, wi) the BSDF value, without the cosine
+//  - pdf(wo, wi)      solid angle density sample() picks wi with
+//  - sample()         next direction, false when the path should end
+//  - getConeSpread()  radians a bounce adds to the ray cone
+// wo points away from the surface, back along the incoming ray
+
+// radians a diffuse bounce adds to the ray cone. It scatters over the whole hemisphere, so past the first hit
+// textures are only ever needed blurred
+const float DIFFUSE_CONE_SPREAD = 0.2f;
+
+// GGX alpha never goes below this, a roughness 0 metal is a very narrow lobe rather than a mirror, so the
+// conductor never needs the delta code path
+const float MIN_GGX_ALPHA = 1e-3f;
+
+// the clear coat is picked at least this often, the Fresnel term alone would almost never look for its highlight
+const float MIN_COAT_PROBABILITY = 0.25f;
+
+struct BsdfSample {
+    glm::vec3 direction;
+    glm::vec3 weight; // f * cos / pdf, what the path throughput gets multiplied by
+    float pdf; // 0 for delta lobes
+    bool transmitted; // went through the surface, the next ray starts on the far side
+};
+
+// tangent space around a normal, the normal is +z
+struct ShadingFrame {
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    glm::vec3 normal;
+
+    explicit ShadingFrame(const glm::vec3 &normal) : normal(normal) {
+        buildOrthonormalBasis(normal, tangent, bitangent);
+    }
+
+    glm::vec3 toLocal(const glm::vec3 &direction) const {
+        return {glm::dot(direction, tangent), glm::dot(direction, bitangent), glm::dot(direction, normal)};
+    }
+
+    glm::vec3 toWorld(const glm::vec3 &direction) const {
+        return tangent * direction.x + bitangent * direction.y + normal * direction.z;
+    }
+};
+
+// GGX normal distribution, cosine is between the microfacet normal and the normal
+inline float ggxDistribution(float cosine, float alpha2) {
+    float denominator = cosine * cosine * (alpha2 - 1.0f) + 1.0f;
+    return alpha2 / (PI * denominator * denominator);
+}
+
+// Smith masking for one direction, the product of both directions' terms is the shadowing-masking term
+inline float ggxMasking(float cosine, float alpha2) {
+    return 2.0f * cosine / (cosine + std::sqrt(alpha2 + (1.0f - alpha2) * cosine * cosine));
+}
+
+// microfacet normal in the local frame, pdf = D * cos(theta)
+inline glm::vec3 sampleGgxNormal(float alpha2, float u1, float u2) {
+    float cos2 = (1.0f - u1) / (1.0f + (alpha2 - 1.0f) * u1);
+    float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cos2));
+    float phi = 2.0f * PI * u2;
+    return {sinTheta * std::cos(phi), sinTheta * std::sin(phi), std::sqrt(cos2)};
+}
+
+// density of the direction mirrored about a GGX sampled microfacet normal
+inline float ggxReflectionPdf(const glm::vec3 &wo, const glm::vec3 &halfway, float alpha2) {
+    return ggxDistribution(halfway.z, alpha2) * halfway.z / (4.0f * glm::dot(wo, halfway));
+}
+
+inline glm::vec3 schlickFresnel(const glm::vec3 &f0, float cosine) {
+    float m = 1.0f - cosine;
+    float m2 = m * m;
+    return f0 + (glm::vec3(1.0f) - f0) * (m2 * m2 * m);
+}
+
+// fraction reflected at a smooth boundary, eta is the index on the far side over the index on the near side
+inline float dielectricFresnel(float cosIncident, float eta) {
+    float sin2Transmitted = (1.0f - cosIncident * cosIncident) / (eta * eta);
+    if (sin2Transmitted >= 1.0f) {
+        return 1.0f; // total internal reflection
+    }
+    float cosTransmitted = std::sqrt(1.0f - sin2Transmitted);
+    float perpendicular = (cosIncident - eta * cosTransmitted) / (cosIncident + eta * cosTransmitted);
+    float parallel = (eta * cosIncident - cosTransmitted) / (eta * cosIncident + cosTransmitted);
+    return 0.5f * (perpendicular * perpendicular + parallel * parallel);
+}
+
+struct DiffuseBsdf {
+    static constexpr bool IS_DELTA = false;
+    static constexpr bool HAS_LOBE_CHOICE = false;
+
+    glm::vec3 albedo;
+    glm::vec3 normal;
+
+    DiffuseBsdf(const MaterialTable &, uint32_t, const glm::vec3 &albedo, const glm::vec3 &normal, bool)
+            : albedo(albedo), normal(normal) {
+    }
+
+    glm::vec3 evaluate(const glm::vec3 &, const glm::vec3 &) const {
+        return albedo * INV_PI;
+    }
+
+    float pdf(const glm::vec3 &, const glm::vec3 &wi) const {
+        return std::max(glm::dot(normal, wi), 0.0f) * INV_PI;
+    }
+
+    // cosine sampling cancels the cosine and the pi of the lambert brdf
+    bool sample(const glm::vec3 &wo, const glm::vec2 &u, float, BsdfSample &sample) const {
+        sample.direction = sampleCosineHemisphere(normal, u.x, u.y);
+        sample.weight = albedo;
+        sample.pdf = pdf(wo, sample.direction);
+        sample.transmitted = false;
+        return true;
+    }
+
+    float getConeSpread() const {
+        return DIFFUSE_CONE_SPREAD;
+    }
+};
+
+struct ConductorBsdf {
+    static constexpr bool IS_DELTA = false;
+    static constexpr bool HAS_LOBE_CHOICE = false;
+
+    ShadingFrame frame;
+    glm::vec3 f0;
+    float roughness;
+    float alpha2;
+
+    ConductorBsdf(const MaterialTable &table, uint32_t material, const glm::vec3 &albedo, const glm::vec3 &normal,
+                  bool)
+            : frame(normal), f0(albedo), roughness(table.roughnesses[material]) {
+        float alpha = std::max(roughness * roughness, MIN_GGX_ALPHA);
+        alpha2 = alpha * alpha;
+    }
+
+    glm::vec3 evaluate(const glm::vec3 &wo, const glm::vec3 &wi) const {
+        glm::vec3 o = frame.toLocal(wo);
+        glm::vec3 i = frame.toLocal(wi);
+        if (o.z <= 0.0f || i.z <= 0.0f) {
+            return glm::vec3(0.0f);
+        }
+        glm::vec3 halfway = glm::normalize(o + i);
+        float specular = ggxDistribution(halfway.z, alpha2) * ggxMasking(o.z, alpha2) * ggxMasking(i.z, alpha2) /
+                         (4.0f * o.z * i.z);
+        return schlickFresnel(f0, glm::dot(o, halfway)) * specular;
+    }
+
+    float pdf(const glm::vec3 &wo, const glm::vec3 &wi) const {
+        glm::vec3 o = frame.toLocal(wo);
+        glm::vec3 i = frame.toLocal(wi);
+        if (o.z <= 0.0f || i.z <= 0.0f) {
+            return 0.0f;
+        }
+        return ggxReflectionPdf(o, glm::normalize(o + i), alpha2);
+    }
+
+    bool sample(const glm::vec3 &wo, const glm::vec2 &u, float, BsdfSample &sample) const {
+        glm::vec3 o = frame.toLocal(wo);
+        glm::vec3 halfway = sampleGgxNormal(alpha2, u.x, u.y);
+        float cosHalfway = glm::dot(o, halfway);
+        if (cosHalfway <= 0.0f) {
+            return false;
+        }
+        glm::vec3 i = halfway * (2.0f * cosHalfway) - o;
+        if (i.z <= 0.0f) {
+            return false; // reflected below the surface
+        }
+
+        // D cancels against the pdf, what is left is F * G * (wo . h) / (wo . n * h . n)
+        float masking = ggxMasking(o.z, alpha2) * ggxMasking(i.z, alpha2);
+        sample.direction = frame.toWorld(i);
+        sample.weight = schlickFresnel(f0, cosHalfway) * (masking * cosHalfway / (o.z * halfway.z));
+        sample.pdf = ggxReflectionPdf(o, halfway, alpha2);
+        sample.transmitted = false;
+        return true;
+    }
+
+    float getConeSpread() const {
+        return DIFFUSE_CONE_SPREAD * roughness;
+    }
+};
+
+// smooth glass. Radiance isn't scaled by eta^2 on the way through, it cancels out again on the way back out of a
+// closed object and the camera never sits inside one
+struct DielectricBsdf {
+    static constexpr bool IS_DELTA = true;
+    static constexpr bool HAS_LOBE_CHOICE = true;
+
+    glm::vec3 tint;
+    glm::vec3 normal;
+    float eta; // index on the far side over the index on the ray's side
+
+    DielectricBsdf(const MaterialTable &table, uint32_t material, const glm::vec3 &albedo, const glm::vec3 &normal,
+                   bool frontFace)
+            : tint(albedo), normal(normal) {
+        // the front face is the outside
+        float ior = table.iors[material];
+        eta = frontFace ? ior : 1.0f / ior;
+    }
+
+    glm::vec3 evaluate(const glm::vec3 &, const glm::vec3 &) const {
+        return glm::vec3(0.0f);
+    }
+
+    float pdf(const glm::vec3 &, const glm::vec3 &) const {
+        return 0.0f;
+    }
+
+    // reflects with the Fresnel probability, refracts otherwise, so both weights come out as 1 (times the tint)
+    bool sample(const glm::vec3 &wo, const glm::vec2 &, float uLobe, BsdfSample &sample) const {
+        float cosIncident = glm::dot(normal, wo);
+        if (uLobe < dielectricFresnel(cosIncident, eta)) {
+            sample.direction = normal * (2.0f * cosIncident) - wo;
+            sample.weight = glm::vec3(1.0f);
+            sample.transmitted = false;
+        } else {
+            float sin2Transmitted = (1.0f - cosIncident * cosIncident) / (eta * eta);
+            float cosTransmitted = std::sqrt(std::max(0.0f, 1.0f - sin2Transmitted));
+            sample.direction = glm::normalize(-wo / eta + normal * (cosIncident / eta - cosTransmitted));
+            sample.weight = tint;
+            sample.transmitted = true;
+        }
+        sample.pdf = 0.0f;
+        return true;
+    }
+
+    float getConeSpread() const {
+        return 0.0f;
+    }
+};
+
+// GGX clear coat over a lambert base. The coat reflects its Fresnel share and the base only sees what the coat
+// lets through on the way in and on the way out. Not exactly energy conserving, but cheap and plausible
+struct LayeredBsdf {
+    static constexpr bool IS_DELTA = false;
+    static constexpr bool HAS_LOBE_CHOICE = true;
+
+    ShadingFrame frame;
+    glm::vec3 albedo;
+    float ior;
+    float alpha2;
+
+    LayeredBsdf(const MaterialTable &table, uint32_t material, const glm::vec3 &albedo, const glm::vec3 &normal,
+                bool)
+            : frame(normal), albedo(albedo), ior(table.iors[material]) {
+        float roughness = table.roughnesses[material];
+        float alpha = std::max(roughness * roughness, MIN_GGX_ALPHA);
+        alpha2 = alpha * alpha;
+    }
+
+    glm::vec3 evaluate(const glm::vec3 &wo, const glm::vec3 &wi) const {
+        glm::vec3 o = frame.toLocal(wo);
+        glm::vec3 i = frame.toLocal(wi);
+        if (o.z <= 0.0f || i.z <= 0.0f) {
+            return glm::vec3(0.0f);
+        }
+        glm::vec3 halfway = glm::normalize(o + i);
+        float coat = dielectricFresnel(glm::dot(o, halfway), ior) * ggxDistribution(halfway.z, alpha2) *
+                     ggxMasking(o.z, alpha2) * ggxMasking(i.z, alpha2) / (4.0f * o.z * i.z);
+        float through = (1.0f - dielectricFresnel(o.z, ior)) * (1.0f - dielectricFresnel(i.z, ior));
+        return glm::vec3(coat) + albedo * (INV_PI * through);
+    }
+
+    float pdf(const glm::vec3 &wo, const glm::vec3 &wi) const {
+        glm::vec3 o = frame.toLocal(wo);
+        glm::vec3 i = frame.toLocal(wi);
+        if (o.z <= 0.0f || i.z <= 0.0f) {
+            return 0.0f;
+        }
+        float coatProbability = getCoatProbability(o.z);
+        return coatProbability * ggxReflectionPdf(o, glm::normalize(o + i), alpha2) +
+               (1.0f - coatProbability) * i.z * INV_PI;
+    }
+
+    // picks one of the two lobes, the weight is against the pdf of both so either pick is unbiased
+    bool sample(const glm::vec3 &wo, const glm::vec2 &u, float uLobe, BsdfSample &sample) const {
+        glm::vec3 o = frame.toLocal(wo);
+        if (uLobe < getCoatProbability(o.z)) {
+            glm::vec3 halfway = sampleGgxNormal(alpha2, u.x, u.y);
+            sample.direction = frame.toWorld(halfway * (2.0f * glm::dot(o, halfway)) - o);
+        } else {
+            sample.direction = sampleCosineHemisphere(frame.normal, u.x, u.y);
+        }
+
+        sample.pdf = pdf(wo, sample.direction);
+        if (sample.pdf <= 0.0f) {
+            return false;
+        }
+        sample.weight = evaluate(wo, sample.direction) * (glm::dot(frame.normal, sample.direction) / sample.pdf);
+        sample.transmitted = false;
+        return true;
+    }
+
+    // the base is diffuse, so the cone spreads as much as it does off a diffuse surface
+    float getConeSpread() const {
+        return DIFFUSE_CONE_SPREAD;
+    }
+
+    float getCoatProbability(float cosOutgoing) const {
+        float coat = dielectricFresnel(cosOutgoing, ior);
+        float base = (1.0f - coat) * luminance(albedo);
+        return std::clamp(coat / std::max(coat + base, 1e-6f), MIN_COAT_PROBABILITY, 1.0f - MIN_COAT_PROBABILITY);
+    }
+};
+
+
+#endif //SMCODESRENDERENGINE_BSDF_H
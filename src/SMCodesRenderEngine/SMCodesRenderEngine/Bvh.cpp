@@ -0,0 +1,674 @@
+#include "Bvh.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+
+#include "Metrics.h"
+#include "Scene.h"
+
+// #region Constants
+
+const uint32_t SAH_BIN_COUNT = 12;
+
+// traversal keeps a fixed size stack, so the tree is never allowed to get deeper than this
+const uint32_t MAX_TREE_DEPTH = 60;
+const uint32_t TRAVERSAL_STACK_SIZE = 64;
+
+// #endregion
+
+// #region Private Methods
+
+// single ray against triangle, Moller-Trumbore
+static bool intersectTriangle(const Ray &ray, const Bvh::Triangle &triangle, float tMax,
+                              float &t, float &u, float &v) {
+    glm::vec3 h = glm::cross(ray.direction, triangle.edge2);
+    float determinant = glm::dot(triangle.edge1, h);
+    if (determinant > -1e-12f && determinant < 1e-12f) {
+        return false; // ray is parallel to the triangle
+    }
+
+    float inverseDeterminant = 1.0f / determinant;
+    glm::vec3 s = ray.origin - triangle.vertex0;
+    u = inverseDeterminant * glm::dot(s, h);
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+
+    glm::vec3 q = glm::cross(s, triangle.edge1);
+    v = inverseDeterminant * glm::dot(ray.direction, q);
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+
+    t = inverseDeterminant * glm::dot(triangle.edge2, q);
+    return t > ray.tMin && t < tMax;
+}
+
+// 4 rays stored as structure of arrays so every SSE lane holds one ray
+struct RayPacket4 {
+    __m128 originX, originY, originZ;
+    __m128 directionX, directionY, directionZ;
+    __m128 inverseX, inverseY, inverseZ;
+    __m128 tMin;
+};
+
+static RayPacket4 loadPacket(const Ray *rays, uint32_t count, __m128 &closest) {
+    alignas(16) float values[11][4];
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        // unused lanes copy ray 0 so everything stays finite, tMax < tMin keeps them from hitting anything
+        const Ray &ray = rays[lane < count ? lane : 0];
+        values[0][lane] = ray.origin.x;
+        values[1][lane] = ray.origin.y;
+        values[2][lane] = ray.origin.z;
+        values[3][lane] = ray.direction.x;
+        values[4][lane] = ray.direction.y;
+        values[5][lane] = ray.direction.z;
+        values[6][lane] = safeReciprocal(ray.direction.x);
+        values[7][lane] = safeReciprocal(ray.direction.y);
+        values[8][lane] = safeReciprocal(ray.direction.z);
+        values[9][lane] = ray.tMin;
+        values[10][lane] = lane < count ? ray.tMax : -1.0f;
+    }
+
+    RayPacket4 packet{};
+    packet.originX = _mm_load_ps(values[0]);
+    packet.originY = _mm_load_ps(values[1]);
+    packet.originZ = _mm_load_ps(values[2]);
+    packet.directionX = _mm_load_ps(values[3]);
+    packet.directionY = _mm_load_ps(values[4]);
+    packet.directionZ = _mm_load_ps(values[5]);
+    packet.inverseX = _mm_load_ps(values[6]);
+    packet.inverseY = _mm_load_ps(values[7]);
+    packet.inverseZ = _mm_load_ps(values[8]);
+    packet.tMin = _mm_load_ps(values[9]);
+    closest = _mm_load_ps(values[10]);
+    return packet;
+}
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline float horizontalMin4(__m128 value) {
+    __m128 shuffled = _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 minimum = _mm_min_ps(value, shuffled);
+    shuffled = _mm_shuffle_ps(minimum, minimum, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm_cvtss_f32(_mm_min_ps(minimum, shuffled));
+}
+
+// entry distance per lane, infinity for lanes that miss the box
+static inline __m128 intersectAabb4(const RayPacket4 &packet, __m128 closest, const Bvh::Node &node) {
+    __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), packet.originX), packet.inverseX);
+    __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), packet.originX), packet.inverseX);
+    __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), packet.originY), packet.inverseY);
+    __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), packet.originY), packet.inverseY);
+    __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), packet.originZ), packet.inverseZ);
+    __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), packet.originZ), packet.inverseZ);
+
+    __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)),
+                              _mm_max_ps(_mm_min_ps(tz1, tz2), packet.tMin));
+    __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)),
+                             _mm_min_ps(_mm_max_ps(tz1, tz2), closest));
+
+    return select4(_mm_cmple_ps(tNear, tFar), tNear, _mm_set1_ps(RAY_INFINITY));
+}
+
+// one triangle against all 4 lanes, returns the mask of lanes that hit closer than closest
+static inline __m128 intersectTriangle4(const RayPacket4 &packet, const Bvh::Triangle &triangle, __m128 closest,
+                                        __m128 &t, __m128 &u, __m128 &v) {
+    __m128 edge1X = _mm_set1_ps(triangle.edge1.x);
+    __m128 edge1Y = _mm_set1_ps(triangle.edge1.y);
+    __m128 edge1Z = _mm_set1_ps(triangle.edge1.z);
+    __m128 edge2X = _mm_set1_ps(triangle.edge2.x);
+    __m128 edge2Y = _mm_set1_ps(triangle.edge2.y);
+    __m128 edge2Z = _mm_set1_ps(triangle.edge2.z);
+
+    // h = direction x edge2
+    __m128 hX = _mm_sub_ps(_mm_mul_ps(packet.directionY, edge2Z), _mm_mul_ps(packet.directionZ, edge2Y));
+    __m128 hY = _mm_sub_ps(_mm_mul_ps(packet.directionZ, edge2X), _mm_mul_ps(packet.directionX, edge2Z));
+    __m128 hZ = _mm_sub_ps(_mm_mul_ps(packet.directionX, edge2Y), _mm_mul_ps(packet.directionY, edge2X));
+
+    __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, hX), _mm_mul_ps(edge1Y, hY)),
+                                    _mm_mul_ps(edge1Z, hZ));
+    __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+    __m128 sX = _mm_sub_ps(packet.originX, _mm_set1_ps(triangle.vertex0.x));
+    __m128 sY = _mm_sub_ps(packet.originY, _mm_set1_ps(triangle.vertex0.y));
+    __m128 sZ = _mm_sub_ps(packet.originZ, _mm_set1_ps(triangle.vertex0.z));
+
+    u = _mm_mul_ps(inverseDeterminant,
+                   _mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, hX), _mm_mul_ps(sY, hY)), _mm_mul_ps(sZ, hZ)));
+
+    // q = s x edge1
+    __m128 qX = _mm_sub_ps(_mm_mul_ps(sY, edge1Z), _mm_mul_ps(sZ, edge1Y));
+    __m128 qY = _mm_sub_ps(_mm_mul_ps(sZ, edge1X), _mm_mul_ps(sX, edge1Z));
+    __m128 qZ = _mm_sub_ps(_mm_mul_ps(sX, edge1Y), _mm_mul_ps(sY, edge1X));
+
+    v = _mm_mul_ps(inverseDeterminant,
+                   _mm_add_ps(_mm_add_ps(_mm_mul_ps(packet.directionX, qX), _mm_mul_ps(packet.directionY, qY)),
+                              _mm_mul_ps(packet.directionZ, qZ)));
+    t = _mm_mul_ps(inverseDeterminant,
+                   _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)));
+
+    __m128 absDeterminant = _mm_and_ps(determinant, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+    __m128 zero = _mm_setzero_ps();
+    __m128 mask = _mm_cmpgt_ps(absDeterminant, _mm_set1_ps(1e-12f));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, packet.tMin));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(t, closest));
+    return mask;
+}
+
+void Bvh::updateNodeBounds(uint32_t nodeIndex, const std::vector<Aabb> &triangleBounds) {
+    Node &node = nodes[nodeIndex];
+    Aabb bounds;
+    for (uint32_t i = 0; i < node.triangleCount; i++) {
+        bounds.grow(triangleBounds[triangleIds[node.leftFirst + i]]);
+    }
+    node.boundsMin = bounds.min;
+    node.boundsMax = bounds.max;
+}
+
+float Bvh::findBestSplit(const Node &node, const std::vector<glm::vec3> &centroids,
+                         const std::vector<Aabb> &triangleBounds, int &axis, float &splitPosition) const {
+    float bestCost = RAY_INFINITY;
+
+    // bin over the centroid bounds rather than the node bounds, large triangles would squash the bins otherwise
+    Aabb centroidBounds;
+    for (uint32_t i = 0; i < node.triangleCount; i++) {
+        centroidBounds.grow(centroids[triangleIds[node.leftFirst + i]]);
+    }
+
+    for (int a = 0; a < 3; a++) {
+        float boundsMin = centroidBounds.min[a];
+        float boundsMax = centroidBounds.max[a];
+        if (boundsMin == boundsMax) {
+            continue;
+        }
+
+        Aabb binBounds[SAH_BIN_COUNT];
+        uint32_t binCounts[SAH_BIN_COUNT] = {};
+        float scale = static_cast<float>(SAH_BIN_COUNT) / (boundsMax - boundsMin);
+
+        for (uint32_t i = 0; i < node.triangleCount; i++) {
+            uint32_t triangleId = triangleIds[node.leftFirst + i];
+            auto bin = std::min(SAH_BIN_COUNT - 1,
+                                static_cast<uint32_t>((centroids[triangleId][a] - boundsMin) * scale));
+            binCounts[bin]++;
+            binBounds[bin].grow(triangleBounds[triangleId]);
+        }
+
+        // sweep from both sides to get the cost of every plane between bins
+        float leftArea[SAH_BIN_COUNT - 1], rightArea[SAH_BIN_COUNT - 1];
+        uint32_t leftCount[SAH_BIN_COUNT - 1], rightCount[SAH_BIN_COUNT - 1];
+        Aabb leftBox, rightBox;
+        uint32_t leftSum = 0, rightSum = 0;
+        for (uint32_t i = 0; i < SAH_BIN_COUNT - 1; i++) {
+            leftSum += binCounts[i];
+            leftCount[i] = leftSum;
+            leftBox.grow(binBounds[i]);
+            leftArea[i] = leftBox.isEmpty() ? 0.0f : leftBox.surfaceArea();
+
+            rightSum += binCounts[SAH_BIN_COUNT - 1 - i];
+            rightCount[SAH_BIN_COUNT - 2 - i] = rightSum;
+            rightBox.grow(binBounds[SAH_BIN_COUNT - 1 - i]);
+            rightArea[SAH_BIN_COUNT - 2 - i] = rightBox.isEmpty() ? 0.0f : rightBox.surfaceArea();
+        }
+
+        float binWidth = (boundsMax - boundsMin) / static_cast<float>(SAH_BIN_COUNT);
+        for (uint32_t i = 0; i < SAH_BIN_COUNT - 1; i++) {
+            float cost = static_cast<float>(leftCount[i]) * leftArea[i] +
+                         static_cast<float>(rightCount[i]) * rightArea[i];
+            if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost) {
+                bestCost = cost;
+                axis = a;
+                splitPosition = boundsMin + binWidth * static_cast<float>(i + 1);
+            }
+        }
+    }
+
+    return bestCost;
+}
+
+void Bvh::subdivide(uint32_t nodeIndex, const std::vector<Aabb> &triangleBounds,
+                    const std::vector<glm::vec3> &centroids, uint32_t depth) {
+    Node &node = nodes[nodeIndex];
+    if (node.triangleCount <= 1 || depth >= MAX_TREE_DEPTH) {
+        return;
+    }
+
+    int axis = 0;
+    float splitPosition = 0.0f;
+    float splitCost = findBestSplit(node, centroids, triangleBounds, axis, splitPosition);
+
+    Aabb nodeBounds{node.boundsMin, node.boundsMax};
+    float leafCost = static_cast<float>(node.triangleCount) * nodeBounds.surfaceArea();
+    if (splitCost >= leafCost) {
+        return; // cheaper to just test every triangle in here
+    }
+
+    // partition the triangle ids in place around the split plane
+    uint32_t first = node.leftFirst;
+    uint32_t last = first + node.triangleCount;
+    auto middle = std::partition(triangleIds.begin() + first, triangleIds.begin() + last,
+                                 [&](uint32_t id) { return centroids[id][axis] < splitPosition; });
+    auto leftCount = static_cast<uint32_t>(middle - triangleIds.begin()) - first;
+    if (leftCount == 0 || leftCount == node.triangleCount) {
+        return;
+    }
+
+    // children are always allocated as a pair, right = left + 1
+    auto leftIndex = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({{}, first, {}, leftCount});
+    nodes.push_back({{}, first + leftCount, {}, node.triangleCount - leftCount});
+
+    // push_back never reallocates (capacity reserved up front) so node is still valid
+    node.leftFirst = leftIndex;
+    node.triangleCount = 0;
+
+    updateNodeBounds(leftIndex, triangleBounds);
+    updateNodeBounds(leftIndex + 1, triangleBounds);
+    subdivide(leftIndex, triangleBounds, centroids, depth + 1);
+    subdivide(leftIndex + 1, triangleBounds, centroids, depth + 1);
+}
+
+float Bvh::intersectAabb(const Ray &ray, const glm::vec3 &inverseDirection, float tMax,
+                         const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    glm::vec3 t1 = (boundsMin - ray.origin) * inverseDirection;
+    glm::vec3 t2 = (boundsMax - ray.origin) * inverseDirection;
+
+    float tNear = std::max(std::max(std::min(t1.x, t2.x), std::min(t1.y, t2.y)),
+                           std::max(std::min(t1.z, t2.z), ray.tMin));
+    float tFar = std::min(std::min(std::max(t1.x, t2.x), std::max(t1.y, t2.y)),
+                          std::min(std::max(t1.z, t2.z), tMax));
+
+    return tNear <= tFar ? tNear : RAY_INFINITY;
+}
+
+// the leaves under a node are next to each other, so its triangles are one range in leaf order
+void Bvh::getTriangleRange(uint32_t nodeIndex, uint32_t &first, uint32_t &count) const {
+    uint32_t leftmost = nodeIndex;
+    while (!nodes[leftmost].isLeaf()) {
+        leftmost = nodes[leftmost].leftFirst;
+    }
+    uint32_t rightmost = nodeIndex;
+    while (!nodes[rightmost].isLeaf()) {
+        rightmost = nodes[rightmost].leftFirst + 1;
+    }
+    first = nodes[leftmost].leftFirst;
+    count = nodes[rightmost].leftFirst + nodes[rightmost].triangleCount - first;
+}
+
+void Bvh::splitNode(uint32_t nodeIndex, uint32_t topIndex, uint32_t maxTriangles, std::vector<Node> &topNodes,
+                    std::vector<std::vector<uint32_t>> &subtrees) const {
+    const Node &node = nodes[nodeIndex];
+    uint32_t first;
+    uint32_t count;
+    getTriangleRange(nodeIndex, first, count);
+    if (node.isLeaf() || count <= maxTriangles) {
+        topNodes[topIndex] = {node.boundsMin, static_cast<uint32_t>(subtrees.size()), node.boundsMax, 1};
+        subtrees.emplace_back(triangleIds.begin() + first, triangleIds.begin() + first + count);
+        return;
+    }
+
+    auto childIndex = static_cast<uint32_t>(topNodes.size());
+    topNodes[topIndex] = {node.boundsMin, childIndex, node.boundsMax, 0};
+    topNodes.emplace_back();
+    topNodes.emplace_back();
+    splitNode(node.leftFirst, childIndex, maxTriangles, topNodes, subtrees);
+    splitNode(node.leftFirst + 1, childIndex + 1, maxTriangles, topNodes, subtrees);
+}
+
+template<typename T>
+static void writeArray(std::ostream &stream, const std::vector<T> &values) {
+    auto count = static_cast<uint32_t>(values.size());
+    stream.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    stream.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+template<typename T>
+static void readArray(std::istream &stream, std::vector<T> &values) {
+    uint32_t count = 0;
+    stream.read(reinterpret_cast<char *>(&count), sizeof(count));
+    if (!stream) {
+        throw std::runtime_error("failed to read BVH!");
+    }
+    values.resize(count);
+    stream.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(count * sizeof(T)));
+    if (!stream) {
+        throw std::runtime_error("failed to read BVH!");
+    }
+}
+
+static std::vector<uint32_t> getAllTriangles(const Scene &scene) {
+    std::vector<uint32_t> triangles(scene.getTriangleCount());
+    std::iota(triangles.begin(), triangles.end(), 0u);
+    return triangles;
+}
+
+// #endregion
+
+// #region Public Methods
+
+Bvh::Bvh(const Scene &scene) : Bvh(scene, getAllTriangles(scene)) {
+}
+
+Bvh::Bvh(const Scene &scene, const std::vector<uint32_t> &sceneTriangles) {
+    auto start = std::chrono::steady_clock::now();
+    auto triangleCount = static_cast<uint32_t>(sceneTriangles.size());
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // built over indices into sceneTriangles, turned into scene triangle indices at the end
+    std::vector<Aabb> triangleBounds(triangleCount);
+    std::vector<glm::vec3> centroids(triangleCount);
+    triangleIds.resize(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            triangleBounds[i].grow(scene.getTriangleVertex(sceneTriangles[i], corner));
+        }
+        centroids[i] = triangleBounds[i].centre();
+        triangleIds[i] = i;
+    }
+
+    // a binary tree over N leaves never needs more than 2N - 1 nodes
+    nodes.reserve(2 * static_cast<size_t>(triangleCount));
+    nodes.push_back({{}, 0, {}, triangleCount});
+    updateNodeBounds(0, triangleBounds);
+    subdivide(0, triangleBounds, centroids, 0);
+
+    // store the triangles in leaf order so a leaf reads one contiguous block
+    triangles.resize(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        triangleIds[i] = sceneTriangles[triangleIds[i]];
+        glm::vec3 a = scene.getTriangleVertex(triangleIds[i], 0);
+        glm::vec3 b = scene.getTriangleVertex(triangleIds[i], 1);
+        glm::vec3 c = scene.getTriangleVertex(triangleIds[i], 2);
+        triangles[i] = {a, b - a, c - a};
+    }
+
+    static Histogram &buildSeconds = Metrics::histogram("smcodes_bvh_build_seconds", "Time taken to build a BVH",
+                                                        Metrics::getLatencyBounds());
+    buildSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+Bvh::Bvh(std::istream &stream) {
+    readArray(stream, nodes);
+    readArray(stream, triangles);
+    readArray(stream, triangleIds);
+}
+
+void Bvh::write(std::ostream &stream) const {
+    writeArray(stream, nodes);
+    writeArray(stream, triangles);
+    writeArray(stream, triangleIds);
+}
+
+void Bvh::split(uint32_t maxTriangles, std::vector<Node> &topNodes,
+                std::vector<std::vector<uint32_t>> &subtrees) const {
+    topNodes.clear();
+    subtrees.clear();
+    if (nodes.empty()) {
+        return;
+    }
+
+    topNodes.emplace_back();
+    splitNode(0, 0, std::max(maxTriangles, 1u), topNodes, subtrees);
+}
+
+bool Bvh::intersect(const Ray &ray, Hit &hit) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    glm::vec3 inverseDirection(safeReciprocal(ray.direction.x),
+                               safeReciprocal(ray.direction.y),
+                               safeReciprocal(ray.direction.z));
+    float closest = ray.tMax;
+    bool found = false;
+
+    if (intersectAabb(ray, inverseDirection, closest, nodes[0].boundsMin, nodes[0].boundsMax) == RAY_INFINITY) {
+        return false;
+    }
+
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    uint32_t stackSize = 0;
+    uint32_t nodeIndex = 0;
+
+    while (true) {
+        const Node &node = nodes[nodeIndex];
+        if (node.isLeaf()) {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++) {
+                float t, u, v;
+                if (intersectTriangle(ray, triangles[i], closest, t, u, v)) {
+                    closest = t;
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.triangleIndex = triangleIds[i];
+                    found = true;
+                }
+            }
+
+            if (stackSize == 0) {
+                break;
+            }
+            nodeIndex = stack[--stackSize];
+            continue;
+        }
+
+        // visit the nearer child first, the far one goes on the stack
+        uint32_t child1 = node.leftFirst;
+        uint32_t child2 = node.leftFirst + 1;
+        float distance1 = intersectAabb(ray, inverseDirection, closest, nodes[child1].boundsMin,
+                                        nodes[child1].boundsMax);
+        float distance2 = intersectAabb(ray, inverseDirection, closest, nodes[child2].boundsMin,
+                                        nodes[child2].boundsMax);
+        if (distance1 > distance2) {
+            std::swap(distance1, distance2);
+            std::swap(child1, child2);
+        }
+
+        if (distance1 == RAY_INFINITY) {
+            if (stackSize == 0) {
+                break;
+            }
+            nodeIndex = stack[--stackSize];
+        } else {
+            nodeIndex = child1;
+            if (distance2 != RAY_INFINITY) {
+                stack[stackSize++] = child2;
+            }
+        }
+    }
+
+    return found;
+}
+
+bool Bvh::occluded(const Ray &ray) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    glm::vec3 inverseDirection(safeReciprocal(ray.direction.x),
+                               safeReciprocal(ray.direction.y),
+                               safeReciprocal(ray.direction.z));
+
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node &node = nodes[stack[--stackSize]];
+        if (intersectAabb(ray, inverseDirection, ray.tMax, node.boundsMin, node.boundsMax) == RAY_INFINITY) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++) {
+                float t, u, v;
+                if (intersectTriangle(ray, triangles[i], ray.tMax, t, u, v)) {
+                    return true;
+                }
+            }
+        } else {
+            // order doesn't matter for any-hit
+            stack[stackSize++] = node.leftFirst + 1;
+            stack[stackSize++] = node.leftFirst;
+        }
+    }
+
+    return false;
+}
+
+void Bvh::intersect4(const Ray *rays, Hit *hits, uint32_t count) const {
+    if (nodes.empty()) {
+        return;
+    }
+
+    __m128 closest;
+    RayPacket4 packet = loadPacket(rays, count, closest);
+    __m128 hitU = _mm_setzero_ps();
+    __m128 hitV = _mm_setzero_ps();
+    __m128i hitIds = _mm_set1_epi32(-1);
+
+    if (horizontalMin4(intersectAabb4(packet, closest, nodes[0])) == RAY_INFINITY) {
+        return;
+    }
+
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    uint32_t stackSize = 0;
+    uint32_t nodeIndex = 0;
+
+    while (true) {
+        const Node &node = nodes[nodeIndex];
+        if (node.isLeaf()) {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++) {
+                __m128 t, u, v;
+                __m128 mask = intersectTriangle4(packet, triangles[i], closest, t, u, v);
+                if (_mm_movemask_ps(mask) != 0) {
+                    closest = select4(mask, t, closest);
+                    hitU = select4(mask, u, hitU);
+                    hitV = select4(mask, v, hitV);
+                    hitIds = _mm_castps_si128(select4(mask, _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(i))),
+                                                      _mm_castsi128_ps(hitIds)));
+                }
+            }
+
+            if (stackSize == 0) {
+                break;
+            }
+            nodeIndex = stack[--stackSize];
+            continue;
+        }
+
+        // the packet goes into whichever child any of its rays reach first
+        uint32_t child1 = node.leftFirst;
+        uint32_t child2 = node.leftFirst + 1;
+        float distance1 = horizontalMin4(intersectAabb4(packet, closest, nodes[child1]));
+        float distance2 = horizontalMin4(intersectAabb4(packet, closest, nodes[child2]));
+        if (distance1 > distance2) {
+            std::swap(distance1, distance2);
+            std::swap(child1, child2);
+        }
+
+        if (distance1 == RAY_INFINITY) {
+            if (stackSize == 0) {
+                break;
+            }
+            nodeIndex = stack[--stackSize];
+        } else {
+            nodeIndex = child1;
+            if (distance2 != RAY_INFINITY) {
+                stack[stackSize++] = child2;
+            }
+        }
+    }
+
+    alignas(16) float tValues[4], uValues[4], vValues[4];
+    alignas(16) int32_t idValues[4];
+    _mm_store_ps(tValues, closest);
+    _mm_store_ps(uValues, hitU);
+    _mm_store_ps(vValues, hitV);
+    _mm_store_si128(reinterpret_cast<__m128i *>(idValues), hitIds);
+
+    for (uint32_t lane = 0; lane < count; lane++) {
+        if (idValues[lane] >= 0) {
+            hits[lane].t = tValues[lane];
+            hits[lane].u = uValues[lane];
+            hits[lane].v = vValues[lane];
+            hits[lane].triangleIndex = triangleIds[idValues[lane]];
+        }
+    }
+}
+
+uint32_t Bvh::occluded4(const Ray *rays, uint32_t count) const {
+    if (nodes.empty()) {
+        return 0;
+    }
+
+    __m128 closest;
+    RayPacket4 packet = loadPacket(rays, count, closest);
+    const int activeMask = (1 << count) - 1;
+    int occludedMask = 0;
+
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node &node = nodes[stack[--stackSize]];
+        if (horizontalMin4(intersectAabb4(packet, closest, node)) == RAY_INFINITY) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++) {
+                __m128 t, u, v;
+                __m128 mask = intersectTriangle4(packet, triangles[i], closest, t, u, v);
+                int laneMask = _mm_movemask_ps(mask);
+                if (laneMask != 0) {
+                    occludedMask |= laneMask;
+                    if ((occludedMask & activeMask) == activeMask) {
+                        return static_cast<uint32_t>(activeMask);
+                    }
+                    // retire the occluded lanes so they stop pulling the packet into more nodes
+                    closest = select4(mask, _mm_set1_ps(-1.0f), closest);
+                }
+            }
+        } else {
+            stack[stackSize++] = node.leftFirst + 1;
+            stack[stackSize++] = node.leftFirst;
+        }
+    }
+
+    return static_cast<uint32_t>(occludedMask & activeMask);
+}
+
+uint32_t Bvh::getNodeCount() const {
+    return static_cast<uint32_t>(nodes.size());
+}
+
+const std::vector<Bvh::Node> &Bvh::getNodes() const {
+    return nodes;
+}
+
+const std::vector<uint32_t> &Bvh::getTriangleIds() const {
+    return triangleIds;
+}
+
+size_t Bvh::getMemoryUsage() const {
+    return nodes.size() * sizeof(Node) + triangles.size() * sizeof(Triangle) +
+           triangleIds.size() * sizeof(uint32_t);
+}
+
+// #endregion
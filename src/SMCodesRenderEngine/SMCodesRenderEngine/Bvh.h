@@ -0,0 +1,100 @@
+#ifndef SMCODESRENDERENGINE_BVH_H
+#define SMCODESRENDERENGINE_BVH_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+#include "RayTracing.h"
+
+struct Scene;
+
+// Binary bounding volume hierarchy over the scene triangles, built with binned SAH.
+// Supports single rays (megakernel mode) and SSE packets of 4 rays, which is what
+// the wavefront integrator feeds it once rays have been sorted into coherent groups
+class Bvh {
+public:
+    // 32 bytes, so two siblings share a 64 byte cache line
+    struct Node {
+        glm::vec3 boundsMin;
+        uint32_t leftFirst; // index of left child for interior nodes, first triangle for leaves
+        glm::vec3 boundsMax;
+        uint32_t triangleCount; // 0 for interior nodes, the right child is always leftFirst + 1
+
+        bool isLeaf() const {
+            return triangleCount > 0;
+        }
+    };
+
+    // triangle in the layout the intersection test wants, stored in leaf order
+    struct Triangle {
+        glm::vec3 vertex0;
+        glm::vec3 edge1;
+        glm::vec3 edge2;
+    };
+
+    explicit Bvh(const Scene &scene);
+
+    // only over the given scene triangles, hits still report scene triangle indices
+    Bvh(const Scene &scene, const std::vector<uint32_t> &sceneTriangles);
+
+    // reads back a tree written with write(), throws if the stream ends early
+    explicit Bvh(std::istream &stream);
+
+    void write(std::ostream &stream) const;
+
+    // cuts the tree into subtrees of at most maxTriangles triangles. topNodes gets the part above the cut, laid
+    // out like the tree itself but every leaf stands for a whole subtree, leftFirst is its index in subtrees and
+    // triangleCount is 1. subtrees gets the scene triangles under each one
+    void split(uint32_t maxTriangles, std::vector<Node> &topNodes,
+               std::vector<std::vector<uint32_t>> &subtrees) const;
+
+    // closest hit, returns true and fills hit if anything is closer than ray.tMax
+    bool intersect(const Ray &ray, Hit &hit) const;
+
+    // any hit between ray.tMin and ray.tMax
+    bool occluded(const Ray &ray) const;
+
+    // closest hit for up to 4 rays at once, traversing the tree together as a packet.
+    // Only worth it when the rays are coherent
+    void intersect4(const Ray *rays, Hit *hits, uint32_t count) const;
+
+    // any hit for up to 4 rays, bit i of the result is set when rays[i] is occluded
+    uint32_t occluded4(const Ray *rays, uint32_t count) const;
+
+    uint32_t getNodeCount() const;
+
+    const std::vector<Node> &getNodes() const;
+
+    // leaf order -> scene triangle index, a leaf covers [leftFirst, leftFirst + triangleCount) of these
+    const std::vector<uint32_t> &getTriangleIds() const;
+
+    size_t getMemoryUsage() const;
+
+    // distance along the ray to where it enters the box, RAY_INFINITY if it misses or enters past tMax
+    static float intersectAabb(const Ray &ray, const glm::vec3 &inverseDirection, float tMax,
+                               const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+private:
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> triangleIds; // leaf order -> scene triangle index
+
+    void updateNodeBounds(uint32_t nodeIndex, const std::vector<Aabb> &triangleBounds);
+
+    void subdivide(uint32_t nodeIndex, const std::vector<Aabb> &triangleBounds,
+                   const std::vector<glm::vec3> &centroids, uint32_t depth);
+
+    float findBestSplit(const Node &node, const std::vector<glm::vec3> &centroids,
+                        const std::vector<Aabb> &triangleBounds, int &axis, float &splitPosition) const;
+
+    void getTriangleRange(uint32_t nodeIndex, uint32_t &first, uint32_t &count) const;
+
+    void splitNode(uint32_t nodeIndex, uint32_t topIndex, uint32_t maxTriangles, std::vector<Node> &topNodes,
+                   std::vector<std::vector<uint32_t>> &subtrees) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_BVH_H
@@ -0,0 +1,257 @@
+#include "Checkpoint.h"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "EnvironmentMap.h"
+#include "Logger.h"
+#include "Sampler.h"
+#include "Scene.h"
+#include "Texture.h"
+
+// #region Constants
+
+const uint32_t CHECKPOINT_MAGIC = 0x4B434D53; // "SMCK"
+const uint32_t CHECKPOINT_VERSION = 2;
+
+const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+// #endregion
+
+// #region Private Methods
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+template<typename T>
+static uint64_t hashVector(uint64_t hash, const std::vector<T> &values) {
+    return hashBytes(hash, values.data(), values.size() * sizeof(T));
+}
+
+// Checkpoints are only ever read back on the kind of machine that wrote them, so values go to disk as is.
+// Everything written goes through the running checksum
+struct CheckpointStream {
+    std::fstream &file;
+    uint64_t checksum = FNV_OFFSET_BASIS;
+
+    void write(const void *data, size_t size) {
+        file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        checksum = hashBytes(checksum, data, size);
+    }
+
+    void read(void *data, size_t size) {
+        file.read(static_cast<char *>(data), static_cast<std::streamsize>(size));
+        if (!file) {
+            throw std::runtime_error("checkpoint is truncated!");
+        }
+        checksum = hashBytes(checksum, data, size);
+    }
+
+    template<typename T>
+    void writeValue(const T &value) {
+        write(&value, sizeof(T));
+    }
+
+    template<typename T>
+    T readValue() {
+        T value;
+        read(&value, sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    void writeVector(const std::vector<T> &values) {
+        write(values.data(), values.size() * sizeof(T));
+    }
+
+    template<typename T>
+    void readVector(std::vector<T> &values) {
+        read(values.data(), values.size() * sizeof(T));
+    }
+};
+
+// the settings that change what a sample adds to the accumulation buffer. samplesPerPixel only does through
+// the power of two the Sobol sampler rounds it up to, a finished render can be resumed with a higher count
+// (up to that power of two) to refine it further
+static void writeSettings(CheckpointStream &stream, const RenderSettings &settings) {
+    stream.writeValue(settings.width);
+    stream.writeValue(settings.height);
+    stream.writeValue(settings.maxDepth);
+    stream.writeValue(settings.seed);
+    stream.writeValue(static_cast<uint32_t>(settings.sampler));
+    stream.writeValue(Sampler::getLog2SamplesPerPixel(settings));
+}
+
+static bool readSettingsMatch(CheckpointStream &stream, const RenderSettings &settings) {
+    auto width = stream.readValue<uint32_t>();
+    auto height = stream.readValue<uint32_t>();
+    auto maxDepth = stream.readValue<uint32_t>();
+    auto seed = stream.readValue<uint32_t>();
+    auto sampler = stream.readValue<uint32_t>();
+    auto log2SamplesPerPixel = stream.readValue<uint32_t>();
+    return width == settings.width && height == settings.height && maxDepth == settings.maxDepth &&
+           seed == settings.seed && sampler == static_cast<uint32_t>(settings.sampler) &&
+           log2SamplesPerPixel == Sampler::getLog2SamplesPerPixel(settings);
+}
+
+void CheckpointWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this] { return hasPending || stopping; });
+        if (!hasPending) {
+            return;
+        }
+
+        // pending is left alone by write() until hasPending goes back to false
+        lock.unlock();
+        try {
+            pending.write(path, settings, sceneHash);
+        } catch (const std::exception &e) {
+            LOG_ERROR("failed to write checkpoint", {{"path", path}, {"error", e.what()}});
+        }
+        lock.lock();
+
+        hasPending = false;
+        condition.notify_all();
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+uint64_t Checkpoint::hashScene(const Scene &scene) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = hashVector(hash, scene.vertices);
+    hash = hashVector(hash, scene.uvs);
+    hash = hashVector(hash, scene.triangles);
+    hash = hashVector(hash, scene.triangleMaterials);
+    hash = hashVector(hash, scene.materials);
+    hash = hashBytes(hash, &scene.camera, sizeof(scene.camera));
+    if (scene.environment) {
+        hash = hashVector(hash, scene.environment->getPixels());
+    }
+    // by path, hashing every texel would read whole textures in just to start a render
+    for (const auto &texture: scene.textures) {
+        hash = hashBytes(hash, texture->getPath().data(), texture->getPath().size());
+    }
+    return hash;
+}
+
+bool Checkpoint::read(const std::string &path, const RenderSettings &settings, uint64_t sceneHash) {
+    std::fstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    CheckpointStream stream{file};
+    if (stream.readValue<uint32_t>() != CHECKPOINT_MAGIC) {
+        throw std::runtime_error(path + " is not a checkpoint!");
+    }
+    if (stream.readValue<uint32_t>() != CHECKPOINT_VERSION) {
+        throw std::runtime_error(path + " was written by a different version of the renderer!");
+    }
+    if (!readSettingsMatch(stream, settings) || stream.readValue<uint64_t>() != sceneHash) {
+        throw std::runtime_error(path + " is a checkpoint of a different render!");
+    }
+
+    nextSample = stream.readValue<uint32_t>();
+    if (nextSample > settings.samplesPerPixel) {
+        throw std::runtime_error(path + " has more samples than the render asks for!");
+    }
+
+    accumulation.resize(settings.width, settings.height);
+    accumulation.sampleCounts.assign(accumulation.sampleCounts.size(), nextSample);
+    stream.readVector(accumulation.radianceSum);
+    stream.readVector(accumulation.albedoSum);
+    stream.readVector(accumulation.normalSum);
+    stream.readVector(accumulation.depthSum);
+
+    uint64_t expected = stream.checksum;
+    uint64_t checksum;
+    file.read(reinterpret_cast<char *>(&checksum), sizeof(checksum));
+    if (!file || checksum != expected || file.peek() != std::char_traits<char>::eof()) {
+        throw std::runtime_error(path + " is corrupt!");
+    }
+    return true;
+}
+
+void Checkpoint::write(const std::string &path, const RenderSettings &settings, uint64_t sceneHash) const {
+    for (uint32_t count: accumulation.sampleCounts) {
+        if (count != nextSample) {
+            throw std::runtime_error("checkpoints can only be taken between passes!");
+        }
+    }
+
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::fstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file: " + temporaryPath);
+        }
+
+        CheckpointStream stream{file};
+        stream.writeValue(CHECKPOINT_MAGIC);
+        stream.writeValue(CHECKPOINT_VERSION);
+        writeSettings(stream, settings);
+        stream.writeValue(sceneHash);
+        stream.writeValue(nextSample);
+        stream.writeVector(accumulation.radianceSum);
+        stream.writeVector(accumulation.albedoSum);
+        stream.writeVector(accumulation.normalSum);
+        stream.writeVector(accumulation.depthSum);
+
+        uint64_t checksum = stream.checksum;
+        file.write(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+        file.flush();
+        if (!file) {
+            throw std::runtime_error("Failed to write file: " + temporaryPath);
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path);
+}
+
+CheckpointWriter::CheckpointWriter(const std::string &path, const RenderSettings &settings, uint64_t sceneHash)
+        : path(path), settings(settings), sceneHash(sceneHash) {
+    thread = std::thread(&CheckpointWriter::writerLoop, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    // a pending write still finishes, it is the newest progress there is
+    thread.join();
+}
+
+bool CheckpointWriter::write(const AccumulationBuffer &accumulation, uint32_t nextSample) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (hasPending) {
+            return false;
+        }
+
+        pending.nextSample = nextSample;
+        pending.accumulation = accumulation;
+        hasPending = true;
+    }
+    condition.notify_all();
+    return true;
+}
+
+void CheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !hasPending; });
+}
+
+// #endregion
@@ -0,0 +1,73 @@
+#ifndef SMCODESRENDERENGINE_CHECKPOINT_H
+#define SMCODESRENDERENGINE_CHECKPOINT_H
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "AccumulationBuffer.h"
+#include "RenderSettings.h"
+
+struct Scene;
+
+// Snapshot of a progressive render taken between passes, so a killed render can carry on where it left off.
+// Paths are seeded from the render seed, pixel and sample index, so the seed plus the next sample index is
+// the whole RNG and sampler state. Resuming adds the same samples in the same order onto the same sums,
+// which is what makes a resumed render bit-identical to one that was never stopped.
+// File layout: header (magic, version, settings, scene hash, next sample), the raw accumulation sums,
+// then a checksum of everything before it. Every pixel has the same sample count between passes
+// so the counts are stored once rather than per pixel
+struct Checkpoint {
+    uint32_t nextSample = 0;
+    AccumulationBuffer accumulation;
+
+    // fingerprint of the scene, a checkpoint is only resumed into the scene it was taken from
+    static uint64_t hashScene(const Scene &scene);
+
+    // false when there is no checkpoint at path. Throws when there is one that is corrupt or belongs to
+    // a different render, better to stop than to quietly start over and lose the work
+    bool read(const std::string &path, const RenderSettings &settings, uint64_t sceneHash);
+
+    // writes to a temporary file and renames it over path, so a crash mid write leaves the last good one
+    void write(const std::string &path, const RenderSettings &settings, uint64_t sceneHash) const;
+};
+
+// Writes checkpoints on a background thread. write() copies the buffer and returns, the render threads
+// only ever pay for that copy. If the previous checkpoint is still being written the new one is skipped
+// rather than waited on
+class CheckpointWriter {
+public:
+    CheckpointWriter(const std::string &path, const RenderSettings &settings, uint64_t sceneHash);
+
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    // false when a write is already in flight and this snapshot was dropped
+    bool write(const AccumulationBuffer &accumulation, uint32_t nextSample);
+
+    // blocks until the pending write (if any) is on disk
+    void flush();
+
+private:
+    std::string path;
+    RenderSettings settings;
+    uint64_t sceneHash;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::thread thread;
+    Checkpoint pending; // reused between writes so the copy doesn't allocate
+    bool hasPending = false;
+    bool stopping = false;
+
+    void writerLoop();
+};
+
+
+#endif //SMCODESRENDERENGINE_CHECKPOINT_H
@@ -0,0 +1,416 @@
+#include "CompressedBvh.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Scene.h"
+
+// #region Constants
+
+// a binary tree at most 60 deep collapses into at most 60 levels, each leaving up to 3 siblings on the stack
+const uint32_t WIDE_STACK_SIZE = 256;
+
+// grid steps are kept inside what a float exponent can hold, flat boxes get the smallest
+const int MIN_EXPONENT = -100;
+const int MAX_EXPONENT = 100;
+
+// #endregion
+
+// #region Private Methods
+
+// 2^exponent straight from the float's exponent bits, it runs for every node the traversal visits
+static float getStep(int exponent) {
+    auto bits = static_cast<uint32_t>(exponent + 127) << 23u;
+    float step;
+    std::memcpy(&step, &bits, sizeof(step));
+    return step;
+}
+
+// has to be the exact float expression the traversal decodes with, so the rounding checks below hold there too
+static float decode(float origin, float step, uint32_t quantised) {
+    return origin + static_cast<float>(quantised) * step;
+}
+
+// smallest power of two step that gets from origin to boundsMax in 255 steps
+static int getExponent(float origin, float boundsMax) {
+    float extent = boundsMax - origin;
+    int exponent = extent > 0.0f ? static_cast<int>(std::ceil(std::log2(extent / 255.0f))) : MIN_EXPONENT;
+    exponent = std::clamp(exponent, MIN_EXPONENT, MAX_EXPONENT);
+    while (exponent < MAX_EXPONENT && decode(origin, getStep(exponent), 255) < boundsMax) {
+        exponent++;
+    }
+    return exponent;
+}
+
+static uint8_t quantiseLower(float value, float origin, float step) {
+    float steps = std::floor((value - origin) / step);
+    auto quantised = static_cast<uint32_t>(std::clamp(steps, 0.0f, 255.0f));
+    while (quantised > 0 && decode(origin, step, quantised) > value) {
+        quantised--;
+    }
+    return static_cast<uint8_t>(quantised);
+}
+
+static uint8_t quantiseUpper(float value, float origin, float step) {
+    float steps = std::ceil((value - origin) / step);
+    auto quantised = static_cast<uint32_t>(std::clamp(steps, 0.0f, 255.0f));
+    while (quantised < 255 && decode(origin, step, quantised) < value) {
+        quantised++;
+    }
+    return static_cast<uint8_t>(quantised);
+}
+
+// single ray against triangle, Moller-Trumbore, the same maths as Bvh's so both trees report the same hits
+static bool intersectTriangle(const Ray &ray, const glm::vec3 &vertex0, const glm::vec3 &vertex1,
+                              const glm::vec3 &vertex2, float tMax, float &t, float &u, float &v) {
+    glm::vec3 edge1 = vertex1 - vertex0;
+    glm::vec3 edge2 = vertex2 - vertex0;
+    glm::vec3 h = glm::cross(ray.direction, edge2);
+    float determinant = glm::dot(edge1, h);
+    if (determinant > -1e-12f && determinant < 1e-12f) {
+        return false;
+    }
+
+    float inverseDeterminant = 1.0f / determinant;
+    glm::vec3 s = ray.origin - vertex0;
+    u = inverseDeterminant * glm::dot(s, h);
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+
+    glm::vec3 q = glm::cross(s, edge1);
+    v = inverseDeterminant * glm::dot(ray.direction, q);
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+
+    t = inverseDeterminant * glm::dot(edge2, q);
+    return t > ray.tMin && t < tMax;
+}
+
+// the 4 bytes as 4 floats
+static inline __m128 loadBytes(const uint8_t *bytes) {
+    int32_t packed;
+    std::memcpy(&packed, bytes, sizeof(packed));
+    __m128i value = _mm_cvtsi32_si128(packed);
+    value = _mm_unpacklo_epi8(value, _mm_setzero_si128());
+    value = _mm_unpacklo_epi16(value, _mm_setzero_si128());
+    return _mm_cvtepi32_ps(value);
+}
+
+// the ray, splatted across the lanes once so every node test reuses it
+struct WideRay {
+    __m128 originX, originY, originZ;
+    __m128 inverseX, inverseY, inverseZ;
+    __m128 tMin;
+};
+
+static WideRay loadWideRay(const Ray &ray) {
+    WideRay wideRay{};
+    wideRay.originX = _mm_set1_ps(ray.origin.x);
+    wideRay.originY = _mm_set1_ps(ray.origin.y);
+    wideRay.originZ = _mm_set1_ps(ray.origin.z);
+    wideRay.inverseX = _mm_set1_ps(safeReciprocal(ray.direction.x));
+    wideRay.inverseY = _mm_set1_ps(safeReciprocal(ray.direction.y));
+    wideRay.inverseZ = _mm_set1_ps(safeReciprocal(ray.direction.z));
+    wideRay.tMin = _mm_set1_ps(ray.tMin);
+    return wideRay;
+}
+
+// entry distance of each child, infinity for the ones the ray misses and the unused slots
+static inline __m128 intersectChildren(const WideRay &ray, const CompressedBvh::Node &node, float closest) {
+    __m128 stepX = _mm_set1_ps(getStep(node.exponents[0]));
+    __m128 stepY = _mm_set1_ps(getStep(node.exponents[1]));
+    __m128 stepZ = _mm_set1_ps(getStep(node.exponents[2]));
+    __m128 originX = _mm_set1_ps(node.origin.x);
+    __m128 originY = _mm_set1_ps(node.origin.y);
+    __m128 originZ = _mm_set1_ps(node.origin.z);
+
+    // decode the boxes exactly as they were rounded when building, then the usual slab test
+    __m128 lowerX = _mm_add_ps(originX, _mm_mul_ps(loadBytes(node.lowerX), stepX));
+    __m128 lowerY = _mm_add_ps(originY, _mm_mul_ps(loadBytes(node.lowerY), stepY));
+    __m128 lowerZ = _mm_add_ps(originZ, _mm_mul_ps(loadBytes(node.lowerZ), stepZ));
+    __m128 upperX = _mm_add_ps(originX, _mm_mul_ps(loadBytes(node.upperX), stepX));
+    __m128 upperY = _mm_add_ps(originY, _mm_mul_ps(loadBytes(node.upperY), stepY));
+    __m128 upperZ = _mm_add_ps(originZ, _mm_mul_ps(loadBytes(node.upperZ), stepZ));
+
+    __m128 tx1 = _mm_mul_ps(_mm_sub_ps(lowerX, ray.originX), ray.inverseX);
+    __m128 tx2 = _mm_mul_ps(_mm_sub_ps(upperX, ray.originX), ray.inverseX);
+    __m128 ty1 = _mm_mul_ps(_mm_sub_ps(lowerY, ray.originY), ray.inverseY);
+    __m128 ty2 = _mm_mul_ps(_mm_sub_ps(upperY, ray.originY), ray.inverseY);
+    __m128 tz1 = _mm_mul_ps(_mm_sub_ps(lowerZ, ray.originZ), ray.inverseZ);
+    __m128 tz2 = _mm_mul_ps(_mm_sub_ps(upperZ, ray.originZ), ray.inverseZ);
+
+    __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)),
+                              _mm_max_ps(_mm_min_ps(tz1, tz2), ray.tMin));
+    __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)),
+                             _mm_min_ps(_mm_max_ps(tz1, tz2), _mm_set1_ps(closest)));
+
+    __m128i slotBits = _mm_and_si128(_mm_set1_epi32(node.childMask), _mm_setr_epi32(1, 2, 4, 8));
+    __m128 used = _mm_castsi128_ps(_mm_cmpgt_epi32(slotBits, _mm_setzero_si128()));
+    __m128 hit = _mm_and_ps(_mm_cmple_ps(tNear, tFar), used);
+    return _mm_or_ps(_mm_and_ps(hit, tNear), _mm_andnot_ps(hit, _mm_set1_ps(RAY_INFINITY)));
+}
+
+Aabb CompressedBvh::getRangeBounds(uint32_t first, uint32_t count) const {
+    Aabb bounds;
+    for (uint32_t i = first; i < first + count; i++) {
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            bounds.grow(scene.getTriangleVertex(triangleIds[i], corner));
+        }
+    }
+    return bounds;
+}
+
+std::vector<CompressedBvh::BuildChild> CompressedBvh::splitRange(uint32_t first, uint32_t count) const {
+    std::vector<BuildChild> children;
+    uint32_t partSize = (count + 3) / 4;
+    for (uint32_t partFirst = first; partFirst < first + count; partFirst += partSize) {
+        uint32_t partCount = std::min(partSize, first + count - partFirst);
+        children.push_back({getRangeBounds(partFirst, partCount), UINT32_MAX, partFirst, partCount});
+    }
+    return children;
+}
+
+std::vector<CompressedBvh::BuildChild> CompressedBvh::collapse(uint32_t binaryNode,
+                                                               const std::vector<Bvh::Node> &binaryNodes) const {
+    auto makeChild = [&](uint32_t index) {
+        const Bvh::Node &node = binaryNodes[index];
+        return BuildChild{{node.boundsMin, node.boundsMax}, index, node.isLeaf() ? node.leftFirst : 0,
+                          node.triangleCount};
+    };
+
+    std::vector<BuildChild> children{makeChild(binaryNodes[binaryNode].leftFirst),
+                                     makeChild(binaryNodes[binaryNode].leftFirst + 1)};
+    // keep opening the biggest interior child, the one rays are most likely to go into
+    while (children.size() < 4) {
+        int widest = -1;
+        float widestArea = -1.0f;
+        for (size_t i = 0; i < children.size(); i++) {
+            if (!binaryNodes[children[i].binaryNode].isLeaf() && children[i].bounds.surfaceArea() > widestArea) {
+                widest = static_cast<int>(i);
+                widestArea = children[i].bounds.surfaceArea();
+            }
+        }
+        if (widest < 0) {
+            break;
+        }
+
+        uint32_t opened = binaryNodes[children[widest].binaryNode].leftFirst;
+        children[widest] = makeChild(opened);
+        children.push_back(makeChild(opened + 1));
+    }
+    return children;
+}
+
+void CompressedBvh::build(uint32_t nodeIndex, const Aabb &frame, const std::vector<BuildChild> &children,
+                          const std::vector<Bvh::Node> &binaryNodes) {
+    Node node{};
+    node.origin = frame.min;
+    float steps[3];
+    for (int axis = 0; axis < 3; axis++) {
+        int exponent = getExponent(frame.min[axis], frame.max[axis]);
+        node.exponents[axis] = static_cast<int8_t>(exponent);
+        steps[axis] = getStep(exponent);
+    }
+
+    struct Pending {
+        uint32_t nodeIndex;
+        Aabb frame;
+        std::vector<BuildChild> children;
+    };
+    std::vector<Pending> pending;
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(children.size()); i++) {
+        const BuildChild &child = children[i];
+        node.childMask |= static_cast<uint8_t>(1u << i);
+        node.lowerX[i] = quantiseLower(child.bounds.min.x, node.origin.x, steps[0]);
+        node.lowerY[i] = quantiseLower(child.bounds.min.y, node.origin.y, steps[1]);
+        node.lowerZ[i] = quantiseLower(child.bounds.min.z, node.origin.z, steps[2]);
+        node.upperX[i] = quantiseUpper(child.bounds.max.x, node.origin.x, steps[0]);
+        node.upperY[i] = quantiseUpper(child.bounds.max.y, node.origin.y, steps[1]);
+        node.upperZ[i] = quantiseUpper(child.bounds.max.z, node.origin.z, steps[2]);
+
+        bool isRange = child.binaryNode == UINT32_MAX || binaryNodes[child.binaryNode].isLeaf();
+        if (isRange && child.count <= MAX_LEAF_TRIANGLES) {
+            node.children[i] = child.first;
+            node.triangleCounts[i] = static_cast<uint8_t>(child.count);
+            continue;
+        }
+
+        auto childIndex = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        node.children[i] = childIndex;
+        pending.push_back({childIndex, child.bounds, isRange ? splitRange(child.first, child.count)
+                                                             : collapse(child.binaryNode, binaryNodes)});
+    }
+    nodes[nodeIndex] = node;
+
+    for (const Pending &child: pending) {
+        build(child.nodeIndex, child.frame, child.children, binaryNodes);
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+CompressedBvh::CompressedBvh(const Scene &scene, const Bvh &bvh)
+        : scene(scene), boundsMin(0.0f), boundsMax(0.0f), triangleIds(bvh.getTriangleIds()) {
+    const std::vector<Bvh::Node> &binaryNodes = bvh.getNodes();
+    if (binaryNodes.empty()) {
+        return;
+    }
+
+    const Bvh::Node &root = binaryNodes[0];
+    boundsMin = root.boundsMin;
+    boundsMax = root.boundsMax;
+    std::vector<BuildChild> children;
+    if (!root.isLeaf()) {
+        children = collapse(0, binaryNodes);
+    } else if (root.triangleCount <= MAX_LEAF_TRIANGLES) {
+        children.push_back({{root.boundsMin, root.boundsMax}, 0, root.leftFirst, root.triangleCount});
+    } else {
+        children = splitRange(root.leftFirst, root.triangleCount);
+    }
+
+    // 4 children per node, so about a quarter of the binary tree's nodes
+    nodes.reserve(binaryNodes.size() / 3 + 1);
+    nodes.emplace_back();
+    build(0, {boundsMin, boundsMax}, children, binaryNodes);
+}
+
+bool CompressedBvh::intersect(const Ray &ray, Hit &hit) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    glm::vec3 inverseDirection(safeReciprocal(ray.direction.x),
+                               safeReciprocal(ray.direction.y),
+                               safeReciprocal(ray.direction.z));
+    float closest = ray.tMax;
+    bool found = false;
+    if (Bvh::intersectAabb(ray, inverseDirection, closest, boundsMin, boundsMax) == RAY_INFINITY) {
+        return false;
+    }
+
+    WideRay wideRay = loadWideRay(ray);
+    uint32_t stack[WIDE_STACK_SIZE];
+    float stackDistances[WIDE_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize] = 0;
+    stackDistances[stackSize++] = 0.0f;
+
+    while (stackSize > 0) {
+        stackSize--;
+        if (stackDistances[stackSize] >= closest) {
+            continue; // something nearer was hit since this went on the stack
+        }
+
+        const Node &node = nodes[stack[stackSize]];
+        alignas(16) float distances[4];
+        _mm_store_ps(distances, intersectChildren(wideRay, node, closest));
+
+        // leaves are tested straight away, interior children go on the stack nearest last so it pops first
+        uint32_t interior[4];
+        uint32_t interiorCount = 0;
+        for (uint32_t i = 0; i < 4; i++) {
+            if (distances[i] == RAY_INFINITY) {
+                continue;
+            }
+            if (node.triangleCounts[i] == 0) {
+                interior[interiorCount++] = i;
+                continue;
+            }
+
+            for (uint32_t j = node.children[i]; j < node.children[i] + node.triangleCounts[i]; j++) {
+                const glm::uvec3 &triangle = scene.triangles[triangleIds[j]];
+                float t, u, v;
+                if (intersectTriangle(ray, scene.vertices[triangle.x], scene.vertices[triangle.y],
+                                      scene.vertices[triangle.z], closest, t, u, v)) {
+                    closest = t;
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.triangleIndex = triangleIds[j];
+                    found = true;
+                }
+            }
+        }
+
+        // insertion sort, farthest first. Never more than 4, std::sort's introsort is overkill here and GCC
+        // can't prove its unrolled moves stay inside the array
+        for (uint32_t i = 1; i < interiorCount; i++) {
+            uint32_t child = interior[i];
+            uint32_t j = i;
+            for (; j > 0 && distances[interior[j - 1]] < distances[child]; j--) {
+                interior[j] = interior[j - 1];
+            }
+            interior[j] = child;
+        }
+        for (uint32_t i = 0; i < interiorCount; i++) {
+            stack[stackSize] = node.children[interior[i]];
+            stackDistances[stackSize++] = distances[interior[i]];
+        }
+    }
+
+    return found;
+}
+
+bool CompressedBvh::occluded(const Ray &ray) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    glm::vec3 inverseDirection(safeReciprocal(ray.direction.x),
+                               safeReciprocal(ray.direction.y),
+                               safeReciprocal(ray.direction.z));
+    if (Bvh::intersectAabb(ray, inverseDirection, ray.tMax, boundsMin, boundsMax) == RAY_INFINITY) {
+        return false;
+    }
+
+    WideRay wideRay = loadWideRay(ray);
+    uint32_t stack[WIDE_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node &node = nodes[stack[--stackSize]];
+        alignas(16) float distances[4];
+        _mm_store_ps(distances, intersectChildren(wideRay, node, ray.tMax));
+
+        for (uint32_t i = 0; i < 4; i++) {
+            if (distances[i] == RAY_INFINITY) {
+                continue;
+            }
+            if (node.triangleCounts[i] == 0) {
+                // order doesn't matter for any-hit
+                stack[stackSize++] = node.children[i];
+                continue;
+            }
+
+            for (uint32_t j = node.children[i]; j < node.children[i] + node.triangleCounts[i]; j++) {
+                const glm::uvec3 &triangle = scene.triangles[triangleIds[j]];
+                float t, u, v;
+                if (intersectTriangle(ray, scene.vertices[triangle.x], scene.vertices[triangle.y],
+                                      scene.vertices[triangle.z], ray.tMax, t, u, v)) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+uint32_t CompressedBvh::getNodeCount() const {
+    return static_cast<uint32_t>(nodes.size());
+}
+
+size_t CompressedBvh::getMemoryUsage() const {
+    return nodes.size() * sizeof(Node) + triangleIds.size() * sizeof(uint32_t);
+}
+
+// #endregion
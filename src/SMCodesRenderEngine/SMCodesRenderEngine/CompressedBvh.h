@@ -0,0 +1,81 @@
+#ifndef SMCODESRENDERENGINE_COMPRESSEDBVH_H
+#define SMCODESRENDERENGINE_COMPRESSEDBVH_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "RayTracing.h"
+
+struct Scene;
+
+// 4 wide BVH with quantised bounds, collapsed from a binary Bvh. A node stores its 4 children's boxes as 8 bit
+// offsets on a grid over the node's own box (a float origin and a power of two step per axis), rounded outwards so
+// they only ever get looser. Leaves hold no triangle data, just a range of triangle indices into the Scene's vertex
+// and index arrays, so the geometry isn't stored twice. Nodes are 64 bytes on a 64 byte boundary, one cache line
+// each. All up it takes under a third of the memory of the binary tree (about 28 against 90 bytes per triangle).
+// Traversal tests one ray against all 4 children at once with SSE, decoding the bytes as it goes
+class CompressedBvh {
+public:
+    // largest triangle count of a single leaf, longer leaves are split up when collapsing
+    static const uint32_t MAX_LEAF_TRIANGLES = 255;
+
+    struct alignas(64) Node {
+        glm::vec3 origin; // lower corner of the grid
+        int8_t exponents[3]; // grid step on each axis is 2^exponent
+        uint8_t childMask; // bit i set when child i is in use
+        uint8_t lowerX[4];
+        uint8_t lowerY[4];
+        uint8_t lowerZ[4];
+        uint8_t upperX[4];
+        uint8_t upperY[4];
+        uint8_t upperZ[4];
+        uint32_t children[4]; // node index for interior children, first triangle index for leaves
+        uint8_t triangleCounts[4]; // 0 for interior children
+    };
+
+    // scene has to outlive the tree, leaves read its vertices
+    CompressedBvh(const Scene &scene, const Bvh &bvh);
+
+    // same contract as Bvh
+    bool intersect(const Ray &ray, Hit &hit) const;
+
+    bool occluded(const Ray &ray) const;
+
+    uint32_t getNodeCount() const;
+
+    // nodes and triangle indices, the vertices are the Scene's
+    size_t getMemoryUsage() const;
+
+private:
+    // one child while collapsing, either a node of the binary tree or a plain range of its leaf order
+    struct BuildChild {
+        Aabb bounds;
+        uint32_t binaryNode; // UINT32_MAX for a range
+        uint32_t first;
+        uint32_t count;
+    };
+
+    const Scene &scene;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> triangleIds; // leaf order -> scene triangle index
+
+    // fills in nodes[nodeIndex] with up to 4 children inside frame, recursing into the interior ones
+    void build(uint32_t nodeIndex, const Aabb &frame, const std::vector<BuildChild> &children,
+               const std::vector<Bvh::Node> &binaryNodes);
+
+    // a binary node opened up until it has as many children as fit in a node
+    std::vector<BuildChild> collapse(uint32_t binaryNode, const std::vector<Bvh::Node> &binaryNodes) const;
+
+    // a leaf too long for one child split into 4 shorter ranges
+    std::vector<BuildChild> splitRange(uint32_t first, uint32_t count) const;
+
+    Aabb getRangeBounds(uint32_t first, uint32_t count) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_COMPRESSEDBVH_H
@@ -0,0 +1,259 @@
+#include "Denoiser.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+
+#include "AccumulationBuffer.h"
+#include "ThreadPool.h"
+
+// #region Constants
+
+// B3 spline, the a-trous kernel from the paper
+const float KERNEL_WEIGHTS[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+// below this an albedo channel is treated as black and left out of the demodulation
+const float MIN_DEMODULATION_ALBEDO = 0.01f;
+
+// #endregion
+
+// #region Private Methods
+
+// exp(x) for x <= 0 to about 1e-6 relative error, 2^(x log2 e) split into integer and fraction parts.
+// Plain SSE2 maths, so every worker produces exactly the same bits
+static inline __m128 exp4(__m128 x) {
+    x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+    __m128 t = _mm_mul_ps(x, _mm_set1_ps(1.44269504f));
+
+    // floor(t), SSE2 only has truncation so step back one when truncation rounded up
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+    __m128 floored = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, t), _mm_set1_ps(1.0f)));
+    __m128 fraction = _mm_sub_ps(t, floored);
+
+    // 2^fraction on [0, 1)
+    __m128 p = _mm_set1_ps(1.3333558e-3f);
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(9.6181291e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(5.5504109e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(2.4022651e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(6.9314718e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(1.0f));
+
+    // 2^floor(t) straight into the exponent bits
+    __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(floored), _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(exponent));
+}
+
+// 4 horizontally neighbouring pixels starting at x, clamped to the edge of the image
+static inline __m128 loadPixels4(const std::vector<float> &plane, size_t rowStart, int x, int width) {
+    if (x >= 0 && x + 3 < width) {
+        return _mm_loadu_ps(plane.data() + rowStart + x);
+    }
+
+    float values[4];
+    for (int lane = 0; lane < 4; lane++) {
+        values[lane] = plane[rowStart + std::clamp(x + lane, 0, width - 1)];
+    }
+    return _mm_loadu_ps(values);
+}
+
+static inline void storePixels4(std::vector<float> &plane, size_t index, uint32_t lanes, __m128 value) {
+    if (lanes == 4) {
+        _mm_storeu_ps(plane.data() + index, value);
+        return;
+    }
+
+    float values[4];
+    _mm_storeu_ps(values, value);
+    std::copy(values, values + lanes, plane.begin() + static_cast<std::ptrdiff_t>(index));
+}
+
+// squashes hdr colours into [0, 1) so a single firefly can't block every tap around it
+static inline void compressColour(__m128 &r, __m128 &g, __m128 &b) {
+    __m128 luminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.2126f)), _mm_mul_ps(g, _mm_set1_ps(0.7152f))),
+                                  _mm_mul_ps(b, _mm_set1_ps(0.0722f)));
+    __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_set1_ps(1.0f), luminance));
+    r = _mm_mul_ps(r, scale);
+    g = _mm_mul_ps(g, scale);
+    b = _mm_mul_ps(b, scale);
+}
+
+static inline __m128 distanceSquared3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+    __m128 dx = _mm_sub_ps(ax, bx);
+    __m128 dy = _mm_sub_ps(ay, by);
+    __m128 dz = _mm_sub_ps(az, bz);
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+}
+
+void Denoiser::loadPlanes(const AccumulationBuffer &accumulation) {
+    width = accumulation.width;
+    height = accumulation.height;
+    size_t pixelCount = static_cast<size_t>(width) * height;
+
+    for (int c = 0; c < 3; c++) {
+        colour[c].resize(pixelCount);
+        filtered[c].resize(pixelCount);
+        albedo[c].resize(pixelCount);
+        normal[c].resize(pixelCount);
+        demodulation[c].resize(pixelCount);
+    }
+    depth.resize(pixelCount);
+
+    threadPool.parallelFor(height, [&](uint32_t y, uint32_t) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t i = y * width + x;
+            glm::vec3 pixelColour = accumulation.getPixel(i);
+            glm::vec3 pixelAlbedo = accumulation.getAlbedo(i);
+            glm::vec3 pixelNormal = accumulation.getNormal(i);
+
+            for (int c = 0; c < 3; c++) {
+                float divisor = 1.0f;
+                if (settings.demodulateAlbedo && pixelAlbedo[c] > MIN_DEMODULATION_ALBEDO) {
+                    divisor = pixelAlbedo[c];
+                }
+                demodulation[c][i] = divisor;
+                colour[c][i] = pixelColour[c] / divisor;
+                albedo[c][i] = pixelAlbedo[c];
+                normal[c][i] = pixelNormal[c];
+            }
+            depth[i] = accumulation.getDepth(i);
+        }
+    });
+}
+
+void Denoiser::filterRow4(uint32_t x, uint32_t y, uint32_t stepWidth, float inverseSigmaColourSquared) {
+    const int w = static_cast<int>(width);
+    const int h = static_cast<int>(height);
+    const int centreX = static_cast<int>(x);
+    const size_t centreRow = static_cast<size_t>(y) * width;
+    const uint32_t lanes = std::min(4u, width - x);
+
+    __m128 centreR = loadPixels4(colour[0], centreRow, centreX, w);
+    __m128 centreG = loadPixels4(colour[1], centreRow, centreX, w);
+    __m128 centreB = loadPixels4(colour[2], centreRow, centreX, w);
+    compressColour(centreR, centreG, centreB);
+    __m128 centreAlbedoR = loadPixels4(albedo[0], centreRow, centreX, w);
+    __m128 centreAlbedoG = loadPixels4(albedo[1], centreRow, centreX, w);
+    __m128 centreAlbedoB = loadPixels4(albedo[2], centreRow, centreX, w);
+    __m128 centreNormalX = loadPixels4(normal[0], centreRow, centreX, w);
+    __m128 centreNormalY = loadPixels4(normal[1], centreRow, centreX, w);
+    __m128 centreNormalZ = loadPixels4(normal[2], centreRow, centreX, w);
+    __m128 centreDepth = loadPixels4(depth, centreRow, centreX, w);
+
+    const __m128 inverseSigmaColour = _mm_set1_ps(inverseSigmaColourSquared);
+    const __m128 inverseSigmaNormal = _mm_set1_ps(1.0f / (settings.sigmaNormal * settings.sigmaNormal));
+    const __m128 inverseSigmaAlbedo = _mm_set1_ps(1.0f / (settings.sigmaAlbedo * settings.sigmaAlbedo));
+    // depth differences are relative to the centre, a wall far away tolerates larger steps
+    const __m128 inverseDepthScale = _mm_div_ps(_mm_set1_ps(1.0f),
+                                                _mm_mul_ps(_mm_set1_ps(settings.sigmaDepth),
+                                                           _mm_max_ps(centreDepth, _mm_set1_ps(1e-3f))));
+
+    __m128 sumR = _mm_setzero_ps();
+    __m128 sumG = _mm_setzero_ps();
+    __m128 sumB = _mm_setzero_ps();
+    __m128 sumWeight = _mm_setzero_ps();
+
+    for (int ky = 0; ky < 5; ky++) {
+        int sampleY = std::clamp(static_cast<int>(y) + (ky - 2) * static_cast<int>(stepWidth), 0, h - 1);
+        size_t row = static_cast<size_t>(sampleY) * width;
+
+        for (int kx = 0; kx < 5; kx++) {
+            int sampleX = centreX + (kx - 2) * static_cast<int>(stepWidth);
+
+            __m128 r = loadPixels4(colour[0], row, sampleX, w);
+            __m128 g = loadPixels4(colour[1], row, sampleX, w);
+            __m128 b = loadPixels4(colour[2], row, sampleX, w);
+            __m128 compressedR = r, compressedG = g, compressedB = b;
+            compressColour(compressedR, compressedG, compressedB);
+
+            __m128 colourDistance = distanceSquared3(centreR, centreG, centreB,
+                                                     compressedR, compressedG, compressedB);
+            __m128 normalDistance = distanceSquared3(centreNormalX, centreNormalY, centreNormalZ,
+                                                     loadPixels4(normal[0], row, sampleX, w),
+                                                     loadPixels4(normal[1], row, sampleX, w),
+                                                     loadPixels4(normal[2], row, sampleX, w));
+            __m128 albedoDistance = distanceSquared3(centreAlbedoR, centreAlbedoG, centreAlbedoB,
+                                                     loadPixels4(albedo[0], row, sampleX, w),
+                                                     loadPixels4(albedo[1], row, sampleX, w),
+                                                     loadPixels4(albedo[2], row, sampleX, w));
+            __m128 depthDifference = _mm_mul_ps(_mm_sub_ps(centreDepth, loadPixels4(depth, row, sampleX, w)),
+                                                inverseDepthScale);
+
+            // one exp for all four edge stopping functions
+            __m128 exponent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(colourDistance, inverseSigmaColour),
+                                                    _mm_mul_ps(normalDistance, inverseSigmaNormal)),
+                                         _mm_add_ps(_mm_mul_ps(albedoDistance, inverseSigmaAlbedo),
+                                                    _mm_mul_ps(depthDifference, depthDifference)));
+            __m128 weight = _mm_mul_ps(_mm_set1_ps(KERNEL_WEIGHTS[ky] * KERNEL_WEIGHTS[kx]),
+                                       exp4(_mm_sub_ps(_mm_setzero_ps(), exponent)));
+
+            sumR = _mm_add_ps(sumR, _mm_mul_ps(weight, r));
+            sumG = _mm_add_ps(sumG, _mm_mul_ps(weight, g));
+            sumB = _mm_add_ps(sumB, _mm_mul_ps(weight, b));
+            sumWeight = _mm_add_ps(sumWeight, weight);
+        }
+    }
+
+    // the centre tap always has weight 9/64, so this never divides by zero
+    __m128 inverseWeight = _mm_div_ps(_mm_set1_ps(1.0f), sumWeight);
+    size_t index = centreRow + x;
+    storePixels4(filtered[0], index, lanes, _mm_mul_ps(sumR, inverseWeight));
+    storePixels4(filtered[1], index, lanes, _mm_mul_ps(sumG, inverseWeight));
+    storePixels4(filtered[2], index, lanes, _mm_mul_ps(sumB, inverseWeight));
+}
+
+void Denoiser::filterTile(uint32_t tileIndex, uint32_t stepWidth, float sigmaColour) {
+    uint32_t tilesX = (width + settings.tileSize - 1) / settings.tileSize;
+    uint32_t startX = (tileIndex % tilesX) * settings.tileSize;
+    uint32_t startY = (tileIndex / tilesX) * settings.tileSize;
+    uint32_t endX = std::min(startX + settings.tileSize, width);
+    uint32_t endY = std::min(startY + settings.tileSize, height);
+    float inverseSigmaColourSquared = 1.0f / (sigmaColour * sigmaColour);
+
+    for (uint32_t y = startY; y < endY; y++) {
+        for (uint32_t x = startX; x < endX; x += 4) {
+            filterRow4(x, y, stepWidth, inverseSigmaColourSquared);
+        }
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+Denoiser::Denoiser(ThreadPool &threadPool, const DenoiserSettings &settings)
+        : threadPool(threadPool), settings(settings) {
+    // tiles start on a multiple of 4 so a vector of pixels never straddles two tiles
+    this->settings.tileSize = std::max(4u, (settings.tileSize + 3u) & ~3u);
+}
+
+void Denoiser::denoise(const AccumulationBuffer &accumulation, std::vector<glm::vec3> &output) {
+    loadPlanes(accumulation);
+
+    uint32_t tilesX = (width + settings.tileSize - 1) / settings.tileSize;
+    uint32_t tilesY = (height + settings.tileSize - 1) / settings.tileSize;
+    float sigmaColour = settings.sigmaColour;
+
+    for (uint32_t iteration = 0; iteration < settings.iterations; iteration++) {
+        uint32_t stepWidth = 1u << iteration;
+        threadPool.parallelFor(tilesX * tilesY, [&](uint32_t tileIndex, uint32_t) {
+            filterTile(tileIndex, stepWidth, sigmaColour);
+        });
+
+        for (int c = 0; c < 3; c++) {
+            colour[c].swap(filtered[c]);
+        }
+        // later iterations average over a much wider area, only let them through where colours match closely
+        sigmaColour *= 0.5f;
+    }
+
+    output.resize(static_cast<size_t>(width) * height);
+    threadPool.parallelFor(height, [&](uint32_t y, uint32_t) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t i = y * width + x;
+            output[i] = glm::vec3(colour[0][i] * demodulation[0][i],
+                                  colour[1][i] * demodulation[1][i],
+                                  colour[2][i] * demodulation[2][i]);
+        }
+    });
+}
+
+// #endregion
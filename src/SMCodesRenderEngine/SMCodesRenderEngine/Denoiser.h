@@ -0,0 +1,57 @@
+#ifndef SMCODESRENDERENGINE_DENOISER_H
+#define SMCODESRENDERENGINE_DENOISER_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+struct AccumulationBuffer;
+class ThreadPool;
+
+struct DenoiserSettings {
+    uint32_t iterations = 5; // filter footprint doubles every iteration, 5 covers 61x61 pixels
+    float sigmaColour = 0.6f; // halved every iteration
+    float sigmaNormal = 0.3f;
+    float sigmaAlbedo = 0.1f;
+    float sigmaDepth = 0.05f; // relative to the centre pixel's depth
+    bool demodulateAlbedo = true; // filter lighting only, so texture detail survives
+    uint32_t tileSize = 64;
+};
+
+// Edge-avoiding a-trous wavelet filter ("Edge-Avoiding A-Trous Wavelet Transform for fast Global
+// Illumination Filtering", Dammertz et al. 2010) run over the accumulated image.
+// Each iteration applies a 5x5 B3 spline kernel with holes 2^i pixels apart, and every tap is weighted
+// by how close its colour, albedo, normal and depth are to the centre so edges stay sharp.
+// Vectorised with SSE over 4 pixels of a row and run over tiles on the thread pool. Every output pixel
+// only depends on the previous iteration, so the result doesn't change with thread count
+class Denoiser {
+public:
+    Denoiser(ThreadPool &threadPool, const DenoiserSettings &settings = DenoiserSettings());
+
+    // filters the averaged radiance in accumulation, output gets width * height linear RGB pixels
+    void denoise(const AccumulationBuffer &accumulation, std::vector<glm::vec3> &output);
+
+private:
+    ThreadPool &threadPool;
+    DenoiserSettings settings;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    // planar (structure of arrays) copies of the buffers so 4 neighbouring pixels load as one vector
+    std::vector<float> colour[3];
+    std::vector<float> filtered[3];
+    std::vector<float> albedo[3];
+    std::vector<float> normal[3];
+    std::vector<float> depth;
+    std::vector<float> demodulation[3]; // what the filtered lighting gets multiplied back by
+
+    void loadPlanes(const AccumulationBuffer &accumulation);
+
+    void filterTile(uint32_t tileIndex, uint32_t stepWidth, float sigmaColour);
+
+    void filterRow4(uint32_t x, uint32_t y, uint32_t stepWidth, float inverseSigmaColourSquared);
+};
+
+
+#endif //SMCODESRENDERENGINE_DENOISER_H
@@ -0,0 +1,85 @@
+#include "DeviceScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// #region Constants
+
+// what a device gets before anything is known about its speed
+const uint32_t CALIBRATION_ITEMS = 4;
+
+// a device gets its share of 1 / GUIDED_DIVISOR of the remaining items per range
+const double GUIDED_DIVISOR = 2.0;
+
+// #endregion
+
+// #region Public Methods
+
+DeviceScheduler::DeviceScheduler(uint32_t itemCount, uint32_t deviceCount) : itemCount(itemCount) {
+    if (deviceCount == 0) {
+        throw std::runtime_error("Need at least one device to schedule on!");
+    }
+    throughputs.assign(deviceCount, 0.0);
+    itemsAssigned.assign(deviceCount, 0);
+}
+
+WorkRange DeviceScheduler::next(uint32_t device) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    WorkRange range;
+    range.first = nextItem;
+    uint32_t remaining = itemCount - nextItem;
+    if (remaining == 0) {
+        return range;
+    }
+
+    if (throughputs[device] <= 0.0) {
+        range.count = std::min(remaining, CALIBRATION_ITEMS);
+    } else {
+        // devices still calibrating count as average, they will be asking for more soon enough
+        double measuredTotal = 0.0;
+        uint32_t measuredDevices = 0;
+        for (double throughput: throughputs) {
+            if (throughput > 0.0) {
+                measuredTotal += throughput;
+                measuredDevices++;
+            }
+        }
+        double average = measuredTotal / measuredDevices;
+        double total = measuredTotal + average * static_cast<double>(throughputs.size() - measuredDevices);
+
+        double share = throughputs[device] / total;
+        auto count = static_cast<uint32_t>(std::ceil(remaining * share / GUIDED_DIVISOR));
+        range.count = std::clamp(count, 1u, remaining);
+    }
+
+    nextItem += range.count;
+    itemsAssigned[device] += range.count;
+    return range;
+}
+
+void DeviceScheduler::report(uint32_t device, uint64_t itemsDone, double seconds) {
+    if (itemsDone == 0 || seconds <= 0.0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    throughputs[device] = static_cast<double>(itemsDone) / seconds;
+}
+
+void DeviceScheduler::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    nextItem = itemCount;
+}
+
+double DeviceScheduler::getThroughput(uint32_t device) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return throughputs[device];
+}
+
+uint32_t DeviceScheduler::getItemsAssigned(uint32_t device) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return itemsAssigned[device];
+}
+
+// #endregion
@@ -0,0 +1,47 @@
+#ifndef SMCODESRENDERENGINE_DEVICESCHEDULER_H
+#define SMCODESRENDERENGINE_DEVICESCHEDULER_H
+
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// items first to first + count - 1, count is 0 once everything has been handed out
+struct WorkRange {
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+// Shares a batch of items (frames, camera views, tiles) between devices that run at different speeds.
+// Devices pull a range whenever they are ready for more, so a slow one can never hold up the rest by more
+// than its last range. A device that hasn't reported yet gets a small calibration range, after that the
+// range is its share of the measured throughput of half of what is left (guided scheduling), so ranges
+// shrink towards the end and every device runs out of work at about the same time
+class DeviceScheduler {
+public:
+    DeviceScheduler(uint32_t itemCount, uint32_t deviceCount);
+
+    // thread safe, every device normally calls this from a thread of its own
+    WorkRange next(uint32_t device);
+
+    // device has finished itemsDone items in total over seconds, replaces whatever it reported before
+    void report(uint32_t device, uint64_t itemsDone, double seconds);
+
+    // nothing more gets handed out, for when a device failed and the batch is given up on
+    void cancel();
+
+    // items per second, 0 until the device has reported
+    double getThroughput(uint32_t device) const;
+
+    uint32_t getItemsAssigned(uint32_t device) const;
+
+private:
+    mutable std::mutex mutex;
+    uint32_t itemCount;
+    uint32_t nextItem = 0;
+    std::vector<double> throughputs;
+    std::vector<uint32_t> itemsAssigned;
+};
+
+
+#endif //SMCODESRENDERENGINE_DEVICESCHEDULER_H
@@ -0,0 +1,264 @@
+#include "EnvironmentMap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "Sampling.h"
+
+// #region Private Methods
+
+static glm::vec3 decodeRgbe(const uint8_t *rgbe) {
+    if (rgbe[3] == 0) {
+        return glm::vec3(0.0f);
+    }
+    float scale = std::ldexp(1.0f, static_cast<int>(rgbe[3]) - (128 + 8));
+    return glm::vec3(static_cast<float>(rgbe[0]) + 0.5f, static_cast<float>(rgbe[1]) + 0.5f,
+                     static_cast<float>(rgbe[2]) + 0.5f) * scale;
+}
+
+// one scanline, run length encoded a channel at a time or (old files and narrow images) flat
+static void readScanline(std::istream &file, uint32_t width, std::vector<uint8_t> &scanline,
+                         const std::string &path) {
+    uint8_t start[4];
+    if (!file.read(reinterpret_cast<char *>(start), 4)) {
+        throw std::runtime_error(path + " ends part way through the image!");
+    }
+
+    bool runLength = width >= 8 && width < 32768 && start[0] == 2 && start[1] == 2 && (start[2] & 0x80) == 0;
+    if (!runLength) {
+        std::memcpy(scanline.data(), start, 4);
+        if (!file.read(reinterpret_cast<char *>(scanline.data() + 4), (width - 1) * 4)) {
+            throw std::runtime_error(path + " ends part way through the image!");
+        }
+        return;
+    }
+    if ((static_cast<uint32_t>(start[2]) << 8 | start[3]) != width) {
+        throw std::runtime_error(path + " has a scanline of the wrong width!");
+    }
+
+    for (uint32_t channel = 0; channel < 4; channel++) {
+        uint32_t x = 0;
+        while (x < width) {
+            int count = file.get();
+            if (count == EOF) {
+                throw std::runtime_error(path + " ends part way through the image!");
+            }
+            if (count > 128) {
+                // a run of the same byte
+                count -= 128;
+                int value = file.get();
+                if (value == EOF || x + count > width) {
+                    throw std::runtime_error(path + " has a broken run!");
+                }
+                for (int i = 0; i < count; i++) {
+                    scanline[(x++) * 4 + channel] = static_cast<uint8_t>(value);
+                }
+            } else {
+                if (count == 0 || x + count > width) {
+                    throw std::runtime_error(path + " has a broken run!");
+                }
+                for (int i = 0; i < count; i++) {
+                    int value = file.get();
+                    if (value == EOF) {
+                        throw std::runtime_error(path + " ends part way through the image!");
+                    }
+                    scanline[(x++) * 4 + channel] = static_cast<uint8_t>(value);
+                }
+            }
+        }
+    }
+}
+
+static std::shared_ptr<const EnvironmentMap> readHdr(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open environment map: " + path);
+    }
+
+    std::string line;
+    std::getline(file, line);
+    if (line.rfind("#?", 0) != 0) {
+        throw std::runtime_error(path + " is not a Radiance .hdr file!");
+    }
+    // header lines up to a blank one, then the resolution
+    while (std::getline(file, line) && !line.empty()) {
+        if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+            throw std::runtime_error(path + " is " + line.substr(7) + ", only RGBE is supported!");
+        }
+    }
+    std::getline(file, line);
+    char yAxis[3] = {};
+    char xAxis[3] = {};
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (std::sscanf(line.c_str(), "%2s %u %2s %u", yAxis, &height, xAxis, &width) != 4 ||
+        std::string(yAxis) != "-Y" || std::string(xAxis) != "+X" || width == 0 || height == 0) {
+        throw std::runtime_error(path + " has an unsupported resolution line: " + line);
+    }
+
+    std::vector<glm::vec3> pixels(static_cast<size_t>(width) * height);
+    std::vector<uint8_t> scanline(static_cast<size_t>(width) * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        readScanline(file, width, scanline, path);
+        for (uint32_t x = 0; x < width; x++) {
+            pixels[static_cast<size_t>(y) * width + x] = decodeRgbe(&scanline[x * 4]);
+        }
+    }
+    return std::make_shared<EnvironmentMap>(width, height, std::move(pixels));
+}
+
+uint32_t EnvironmentMap::getPixelIndex(const glm::vec3 &direction) const {
+    float theta = std::acos(std::clamp(direction.y, -1.0f, 1.0f));
+    float phi = std::atan2(direction.z, direction.x);
+    if (phi < 0.0f) {
+        phi += 2.0f * PI;
+    }
+    auto x = std::min(static_cast<uint32_t>(phi * INV_PI * 0.5f * static_cast<float>(width)), width - 1);
+    auto y = std::min(static_cast<uint32_t>(theta * INV_PI * static_cast<float>(height)), height - 1);
+    return y * width + x;
+}
+
+// #endregion
+
+// #region Public Methods
+
+EnvironmentMap::EnvironmentMap(uint32_t width, uint32_t height, std::vector<glm::vec3> pixels)
+        : width(width), height(height), pixels(std::move(pixels)) {
+    if (this->pixels.size() != static_cast<size_t>(width) * height) {
+        throw std::runtime_error("environment map pixels don't match its size!");
+    }
+
+    // luminance times the solid angle of the pixel, rows near the poles cover very little of the sphere
+    std::vector<float> rowWeights(height);
+    std::vector<float> weights(width);
+    columnTables.resize(height);
+    for (uint32_t y = 0; y < height; y++) {
+        float sinTheta = std::sin(PI * (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+        double rowWeight = 0.0;
+        for (uint32_t x = 0; x < width; x++) {
+            const glm::vec3 &pixel = this->pixels[static_cast<size_t>(y) * width + x];
+            weights[x] = std::max(luminance(pixel), 0.0f) * sinTheta;
+            rowWeight += weights[x];
+        }
+        rowWeights[y] = static_cast<float>(rowWeight);
+        columnTables[y] = AliasTable(weights);
+    }
+    rowTable = AliasTable(rowWeights);
+}
+
+std::shared_ptr<const EnvironmentMap> EnvironmentMap::load(const std::string &path) {
+    static std::mutex cacheMutex;
+    static std::map<std::string, std::weak_ptr<const EnvironmentMap>> cache;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (auto cached = cache[path].lock()) {
+        return cached;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const EnvironmentMap> environment = readHdr(path);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("loaded environment map", {{"path", path}, {"width", environment->width},
+                                        {"height", environment->height}, {"milliseconds", seconds * 1000.0}});
+
+    cache[path] = environment;
+    return environment;
+}
+
+std::shared_ptr<const EnvironmentMap> EnvironmentMap::createSky(uint32_t width, uint32_t height,
+                                                                const glm::vec3 &sunDirection) {
+    const float sunCosRadius = std::cos(glm::radians(1.5f));
+    const glm::vec3 sun = glm::normalize(sunDirection);
+
+    std::vector<glm::vec3> pixels(static_cast<size_t>(width) * height);
+    for (uint32_t y = 0; y < height; y++) {
+        float theta = PI * (static_cast<float>(y) + 0.5f) / static_cast<float>(height);
+        for (uint32_t x = 0; x < width; x++) {
+            float phi = 2.0f * PI * (static_cast<float>(x) + 0.5f) / static_cast<float>(width);
+            glm::vec3 direction(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+
+            glm::vec3 colour(0.25f, 0.22f, 0.2f); // ground
+            if (direction.y > 0.0f) {
+                float blend = std::sqrt(direction.y);
+                colour = glm::vec3(1.0f, 0.95f, 0.9f) * (1.0f - blend) + glm::vec3(0.35f, 0.55f, 1.0f) * blend;
+            }
+            if (glm::dot(direction, sun) > sunCosRadius) {
+                colour = glm::vec3(3000.0f, 2700.0f, 2300.0f);
+            }
+            pixels[static_cast<size_t>(y) * width + x] = colour;
+        }
+    }
+    return std::make_shared<EnvironmentMap>(width, height, std::move(pixels));
+}
+
+glm::vec3 EnvironmentMap::evaluate(const glm::vec3 &direction) const {
+    return pixels[getPixelIndex(direction)];
+}
+
+glm::vec3 EnvironmentMap::sample(float u1, float u2, float u3, float u4, glm::vec3 &radiance, float &pdf) const {
+    pdf = 0.0f;
+    if (rowTable.isEmpty()) {
+        return glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    float rowPmf;
+    float columnPmf;
+    uint32_t y = rowTable.sample(u1, rowPmf);
+    uint32_t x = columnTables[y].sample(u2, columnPmf);
+
+    // uniform in the pixel's (phi, theta) rectangle, the pdf is constant over it in those coordinates
+    float theta = PI * (static_cast<float>(y) + u4) / static_cast<float>(height);
+    float phi = 2.0f * PI * (static_cast<float>(x) + u3) / static_cast<float>(width);
+    float sinTheta = std::sin(theta);
+    if (sinTheta <= 0.0f) {
+        return glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    radiance = pixels[static_cast<size_t>(y) * width + x];
+    pdf = rowPmf * columnPmf * static_cast<float>(width) * static_cast<float>(height) /
+          (2.0f * PI * PI * sinTheta);
+    return {sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi)};
+}
+
+float EnvironmentMap::pdf(const glm::vec3 &direction) const {
+    if (rowTable.isEmpty()) {
+        return 0.0f;
+    }
+    // from x and z rather than 1 - y^2, which loses most of its digits near the poles
+    float sinTheta = std::sqrt(direction.x * direction.x + direction.z * direction.z);
+    if (sinTheta <= 0.0f) {
+        return 0.0f;
+    }
+
+    uint32_t pixelIndex = getPixelIndex(direction);
+    uint32_t y = pixelIndex / width;
+    float columnPmf = columnTables[y].isEmpty() ? 0.0f : columnTables[y].pmf(pixelIndex % width);
+    return rowTable.pmf(y) * columnPmf * static_cast<float>(width) * static_cast<float>(height) /
+           (2.0f * PI * PI * sinTheta);
+}
+
+bool EnvironmentMap::canSample() const {
+    return !rowTable.isEmpty();
+}
+
+uint32_t EnvironmentMap::getWidth() const {
+    return width;
+}
+
+uint32_t EnvironmentMap::getHeight() const {
+    return height;
+}
+
+const std::vector<glm::vec3> &EnvironmentMap::getPixels() const {
+    return pixels;
+}
+
+// #endregion
@@ -0,0 +1,57 @@
+#ifndef SMCODESRENDERENGINE_ENVIRONMENTMAP_H
+#define SMCODESRENDERENGINE_ENVIRONMENTMAP_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AliasTable.h"
+
+// HDR light from every direction rays escape to, stored as an equirectangular (latitude/longitude) image.
+// Row 0 is straight up (+y), columns go around y starting from +x towards +z.
+// Built with alias tables over its pixels weighted by luminance and solid angle, a row is picked first
+// and then a column in it, so a small bright sun gets the samples it deserves in constant time
+class EnvironmentMap {
+public:
+    EnvironmentMap(uint32_t width, uint32_t height, std::vector<glm::vec3> pixels);
+
+    // Radiance .hdr (RGBE). The map and its tables are kept per path while anything still uses them,
+    // so loading the same file again costs nothing
+    static std::shared_ptr<const EnvironmentMap> load(const std::string &path);
+
+    // a clear sky with a small, very bright sun towards sunDirection, for outdoor renders without a file
+    static std::shared_ptr<const EnvironmentMap> createSky(uint32_t width, uint32_t height,
+                                                           const glm::vec3 &sunDirection);
+
+    glm::vec3 evaluate(const glm::vec3 &direction) const;
+
+    // a direction picked in proportion to how much light comes from it, pdf is per solid angle
+    // (0 when the map is black). u1 picks the row, u2 the column and u3, u4 where in the pixel
+    glm::vec3 sample(float u1, float u2, float u3, float u4, glm::vec3 &radiance, float &pdf) const;
+
+    // solid angle density sample() would have produced for direction
+    float pdf(const glm::vec3 &direction) const;
+
+    bool canSample() const;
+
+    uint32_t getWidth() const;
+
+    uint32_t getHeight() const;
+
+    const std::vector<glm::vec3> &getPixels() const;
+
+private:
+    uint32_t width;
+    uint32_t height;
+    std::vector<glm::vec3> pixels;
+    AliasTable rowTable;
+    std::vector<AliasTable> columnTables; // one per row
+
+    uint32_t getPixelIndex(const glm::vec3 &direction) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_ENVIRONMENTMAP_H
@@ -0,0 +1,208 @@
+#include "FrameReadback.h"
+
+#include <stdexcept>
+
+#include "ImageWriter.h"
+#include "VulkanUtils.h"
+
+// #region Private Methods
+
+void FrameReadback::handOver(uint32_t index) {
+    Buffer &buffer = buffers[index];
+    if (!coherent) {
+        // make the GPU's writes visible to the CPU
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = buffer.memory;
+        range.offset = 0;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(device, 1, &range);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer.encoding = true;
+    }
+    try {
+        // can block when the writer already has as many images as it takes, that is the back pressure
+        writer->writeImage(getFramePath(buffer.imageNumber), width, height, buffer.mapped, READBACK_FLOATS_PER_PIXEL,
+                           [this, index] {
+                               {
+                                   std::lock_guard<std::mutex> lock(mutex);
+                                   buffers[index].encoding = false;
+                               }
+                               released.notify_all();
+                           });
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer.encoding = false;
+        throw;
+    }
+}
+
+std::string FrameReadback::getFramePath(uint64_t imageNumber) const {
+    std::string number = std::to_string(imageNumber);
+    if (number.size() < 4) {
+        number.insert(0, 4 - number.size(), '0');
+    }
+
+    size_t extension = path.rfind('.');
+    size_t directory = path.find_last_of("/\\");
+    if (extension == std::string::npos || (directory != std::string::npos && extension < directory)) {
+        return path + "_" + number;
+    }
+    return path.substr(0, extension) + "_" + number + path.substr(extension);
+}
+
+// #endregion
+
+// #region Public Methods
+
+void FrameReadback::create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t imageWidth,
+                           uint32_t imageHeight, uint32_t bufferCount, ImageWriter &imageWriter,
+                           const std::string &outputPath) {
+    if (bufferCount == 0) {
+        throw std::runtime_error("Need at least one readback buffer!");
+    }
+
+    device = logicalDevice;
+    writer = &imageWriter;
+    path = outputPath;
+    width = imageWidth;
+    height = imageHeight;
+    bufferSize = static_cast<VkDeviceSize>(width) * height * READBACK_FLOATS_PER_PIXEL * sizeof(float);
+    buffers.resize(bufferCount);
+    copying.clear();
+    nextBuffer = 0;
+    stallCount = 0;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    for (auto &buffer: buffers) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = bufferSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT; // only ever a copy destination
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkResult createBufferResult = vkCreateBuffer(device, &bufferInfo, nullptr, &buffer.buffer);
+        if (createBufferResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to create readback buffer!");
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device, buffer.buffer, &requirements);
+
+        // the CPU reads all of it, cached memory is much faster to read from than write combined.
+        // Coherent is only the fallback, every device has host visible coherent memory
+        int memoryType = findMemoryType(memoryProperties, requirements.memoryTypeBits,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        if (memoryType < 0) {
+            memoryType = findMemoryType(memoryProperties, requirements.memoryTypeBits,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        }
+        if (memoryType < 0) {
+            throw std::runtime_error("failed to find host visible memory for readback!");
+        }
+        coherent = memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        VkMemoryAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateInfo.allocationSize = requirements.size;
+        allocateInfo.memoryTypeIndex = static_cast<uint32_t>(memoryType);
+
+        VkResult allocateResult = vkAllocateMemory(device, &allocateInfo, nullptr, &buffer.memory);
+        if (allocateResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate readback memory!");
+        }
+        vkBindBufferMemory(device, buffer.buffer, buffer.memory, 0);
+
+        // mapped for as long as the buffer lives
+        void *mapped = nullptr;
+        VkResult mapResult = vkMapMemory(device, buffer.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+        if (mapResult != VK_SUCCESS) {
+            throw std::runtime_error("failed to map readback memory!");
+        }
+        buffer.mapped = static_cast<const float *>(mapped);
+    }
+}
+
+void FrameReadback::destroy() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [this] {
+            for (const auto &buffer: buffers) {
+                if (buffer.encoding) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    for (auto &buffer: buffers) {
+        if (buffer.memory != VK_NULL_HANDLE) {
+            vkUnmapMemory(device, buffer.memory);
+            vkFreeMemory(device, buffer.memory, nullptr);
+        }
+        vkDestroyBuffer(device, buffer.buffer, nullptr);
+    }
+    buffers.clear();
+    copying.clear();
+}
+
+VkBuffer FrameReadback::acquire(uint64_t frame, uint64_t imageNumber, const FrameTimeline &timeline) {
+    uint32_t index = nextBuffer;
+    nextBuffer = (nextBuffer + 1) % static_cast<uint32_t>(buffers.size());
+    bool stalled = false;
+
+    // buffers are used in order, so if this one is still being copied into it is the oldest copy
+    if (!copying.empty() && copying.front() == index) {
+        stalled = !timeline.isFrameComplete(buffers[index].frame);
+        timeline.waitForFrame(buffers[index].frame);
+        collect(timeline);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (buffers[index].encoding) {
+            stalled = true;
+            released.wait(lock, [this, index] { return !buffers[index].encoding; });
+        }
+    }
+    if (stalled) {
+        stallCount++;
+    }
+
+    buffers[index].frame = frame;
+    buffers[index].imageNumber = imageNumber;
+    copying.push_back(index);
+    return buffers[index].buffer;
+}
+
+void FrameReadback::collect(const FrameTimeline &timeline) {
+    uint64_t completedFrame = timeline.getCompletedFrame();
+    while (!copying.empty() && buffers[copying.front()].frame <= completedFrame) {
+        uint32_t index = copying.front();
+        copying.pop_front();
+        handOver(index);
+    }
+}
+
+void FrameReadback::flush(const FrameTimeline &timeline) {
+    if (!copying.empty()) {
+        timeline.waitForFrame(buffers[copying.back()].frame);
+    }
+    collect(timeline);
+}
+
+VkDeviceSize FrameReadback::getBufferSize() const {
+    return bufferSize;
+}
+
+uint32_t FrameReadback::getStallCount() const {
+    return stallCount;
+}
+
+// #endregion
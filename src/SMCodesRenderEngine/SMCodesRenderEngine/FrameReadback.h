@@ -0,0 +1,82 @@
+#ifndef SMCODESRENDERENGINE_FRAMEREADBACK_H
+#define SMCODESRENDERENGINE_FRAMEREADBACK_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FrameTimeline.h"
+
+class ImageWriter;
+
+// RGBA 32 bit float, what the headless render target is read back as
+const uint32_t READBACK_FLOATS_PER_PIXEL = 4;
+
+// Gets headless frames from the GPU to the image writer without stalling the next frame.
+// Every frame is copied into one of a ring of persistently mapped host visible buffers as part of its own
+// command buffer. Finished copies are found by polling the frame timeline and handed to the writer as is,
+// the encoder reads straight out of the mapped memory and gives the buffer back once it is done.
+// The renderer only waits when every buffer is either still being copied into or still being encoded
+class FrameReadback {
+public:
+    // bufferCount buffers of imageWidth x imageHeight RGBA floats. Frames are written to outputPath with
+    // their image number added before the extension (render.png -> render_0001.png)
+    void create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t imageWidth, uint32_t imageHeight,
+                uint32_t bufferCount, ImageWriter &imageWriter, const std::string &outputPath);
+
+    // waits for the encoder to give every buffer back, so flush() first or frames still on the GPU are dropped
+    void destroy();
+
+    // buffer for frame to copy into, written out as image number imageNumber. If it still holds an older frame
+    // that one is waited on and handed over first, then it waits for the encoder to be done with it
+    VkBuffer acquire(uint64_t frame, uint64_t imageNumber, const FrameTimeline &timeline);
+
+    // hands every copy the GPU has finished to the image writer, in frame order. Doesn't block on the GPU
+    void collect(const FrameTimeline &timeline);
+
+    // waits for every copy still on the GPU and hands it over
+    void flush(const FrameTimeline &timeline);
+
+    VkDeviceSize getBufferSize() const;
+
+    // how often acquire() had to wait, a sign the ring is too small or the encoder can't keep up
+    uint32_t getStallCount() const;
+
+private:
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        const float *mapped = nullptr;
+        uint64_t frame = 0;
+        uint64_t imageNumber = 0; // frame numbers are per device, this one goes in the file name
+        bool encoding = false; // guarded by mutex, the encoder gives it back from its own thread
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    ImageWriter *writer = nullptr;
+    std::string path;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VkDeviceSize bufferSize = 0;
+    bool coherent = true;
+
+    std::vector<Buffer> buffers; // never resized after create(), the release callbacks hold indices into it
+    std::deque<uint32_t> copying; // buffers the GPU may still be writing, oldest frame first
+    uint32_t nextBuffer = 0;
+    uint32_t stallCount = 0;
+
+    std::mutex mutex;
+    std::condition_variable released;
+
+    void handOver(uint32_t index);
+
+    std::string getFramePath(uint64_t imageNumber) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_FRAMEREADBACK_H
@@ -0,0 +1,95 @@
+#include "FrameTimeline.h"
+
+#include <stdexcept>
+
+// #region Public Methods
+
+void FrameTimeline::create(VkDevice logicalDevice, uint32_t frameCount) {
+    if (frameCount == 0) {
+        throw std::runtime_error("Need at least one frame in flight!");
+    }
+
+    device = logicalDevice;
+    framesInFlight = frameCount;
+    nextFrame = 1;
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0; // nothing has finished yet
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    VkResult createResult = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore);
+    if (createResult != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timeline semaphore!");
+    }
+}
+
+void FrameTimeline::destroy() {
+    if (semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device, semaphore, nullptr);
+        semaphore = VK_NULL_HANDLE;
+    }
+}
+
+uint64_t FrameTimeline::waitForNextSlot() {
+    // the slot was last used framesInFlight frames ago, the first few frames have nothing to wait for
+    if (nextFrame > framesInFlight) {
+        waitForFrame(nextFrame - framesInFlight);
+    }
+    return nextFrame;
+}
+
+void FrameTimeline::markSubmitted() {
+    nextFrame++;
+}
+
+uint32_t FrameTimeline::getNextSlot() const {
+    return static_cast<uint32_t>(nextFrame % framesInFlight);
+}
+
+uint64_t FrameTimeline::getNextFrame() const {
+    return nextFrame;
+}
+
+uint64_t FrameTimeline::getCompletedFrame() const {
+    uint64_t value = 0;
+    VkResult result = vkGetSemaphoreCounterValue(device, semaphore, &value);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to read timeline semaphore!");
+    }
+    return value;
+}
+
+bool FrameTimeline::isFrameComplete(uint64_t frame) const {
+    return getCompletedFrame() >= frame;
+}
+
+bool FrameTimeline::waitForFrame(uint64_t frame, uint64_t timeout) const {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &frame;
+
+    VkResult result = vkWaitSemaphores(device, &waitInfo, timeout);
+    if (result == VK_TIMEOUT) {
+        return false;
+    } else if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to wait on timeline semaphore!");
+    }
+    return true;
+}
+
+VkSemaphore FrameTimeline::getSemaphore() const {
+    return semaphore;
+}
+
+uint32_t FrameTimeline::getFramesInFlight() const {
+    return framesInFlight;
+}
+
+// #endregion
@@ -0,0 +1,53 @@
+#ifndef SMCODESRENDERENGINE_FRAMETIMELINE_H
+#define SMCODESRENDERENGINE_FRAMETIMELINE_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+// Frame pacing on a single timeline semaphore (Vulkan 1.2) instead of a fence per frame.
+// Frame N signals the timeline to N when the GPU is done with it, so "is frame N done" is just a
+// comparison against the counter and the CPU only ever waits when it wants to reuse the resources
+// of frame N - framesInFlight. Frame numbers start at 1, the timeline starts at 0
+class FrameTimeline {
+public:
+    void create(VkDevice logicalDevice, uint32_t frameCount);
+
+    void destroy();
+
+    // blocks until the frame that last used the next frame's slot has finished on the GPU.
+    // Returns the number of the next frame
+    uint64_t waitForNextSlot();
+
+    // the next frame has been submitted with a signal of the timeline to its number
+    void markSubmitted();
+
+    // index of the per frame resources the next frame uses, in [0, framesInFlight)
+    uint32_t getNextSlot() const;
+
+    uint64_t getNextFrame() const;
+
+    // highest frame number the GPU has finished, doesn't block
+    uint64_t getCompletedFrame() const;
+
+    // doesn't block
+    bool isFrameComplete(uint64_t frame) const;
+
+    // blocks until frame has finished, false if timeout (nanoseconds) ran out first
+    bool waitForFrame(uint64_t frame, uint64_t timeout = UINT64_MAX) const;
+
+    VkSemaphore getSemaphore() const;
+
+    uint32_t getFramesInFlight() const;
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    uint64_t nextFrame = 1;
+};
+
+
+#endif //SMCODESRENDERENGINE_FRAMETIMELINE_H
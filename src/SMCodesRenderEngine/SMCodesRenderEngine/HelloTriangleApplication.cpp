@@ -10,18 +10,27 @@
 #include <cassert>
 #include <stdexcept>
 #include <vector>
-#include <iostream>
 #include <set>
 #include <algorithm>
 #include <fstream>
+#include <chrono>
+#include <cstring>
+#include <glm/glm.hpp>
 
-// #region Constants
+#include "ImageWriter.h"
+#include "IndexedMesh.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "VulkanUtils.h"
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// #region Constants
 
 const uint32_t WIDTH = 1200;
 const uint32_t HEIGHT = 1000;
 
+// headless frames stay linear float all the way to the image writer
+const VkFormat HEADLESS_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+
 const std::vector<const char *> validationLayers = {
         "VK_LAYER_KHRONOS_validation"
 };
@@ -30,6 +39,20 @@ const std::vector<const char *> deviceExtensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
+// how often the device memory gauge is refreshed, the budget query isn't free
+const uint64_t MEMORY_METRIC_INTERVAL = 60;
+
+// per object uniforms a frame can hand out, a few hundred objects at 256 byte alignment
+const VkDeviceSize UNIFORM_RING_BYTES_PER_FRAME = 64 * 1024;
+
+// objects a frame can draw, matches the vertex shader's. 96 bytes each keeps the array inside the 16KB uniform
+// buffer range every device has
+const uint32_t OBJECT_CAPACITY = 128;
+
+// asked of the bindless table, it clamps them to what the device can do
+const uint32_t BINDLESS_IMAGE_CAPACITY = 16 * 1024;
+const uint32_t BINDLESS_BUFFER_CAPACITY = 1024;
+
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
 #else
@@ -89,7 +112,7 @@ void HelloTriangleApplication::initWindow() {
 }
 
 void HelloTriangleApplication::framebufferResizeCallback(GLFWwindow *window, int width, int height) {
-    std::cout << "Framebuffer resized" << std::endl;
+    LOG_DEBUG("framebuffer resized", {{"width", width}, {"height", height}});
 
     auto app = reinterpret_cast<HelloTriangleApplication *>(glfwGetWindowUserPointer(window));
     app->frameBufferResized = true;
@@ -101,13 +124,40 @@ void HelloTriangleApplication::initVulkan() {
     createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
+    createFrameMetrics();
     createSwapChain();
     createImageViews();
-    createRenderPass();
+    createRenderGraph();
+    createDescriptorSetLayout();
+    createBindlessTable();
+    createGraphicsPipeline();
+    createCommandPool();
+    createGeometryBuffers();
+    createMaterialBuffer();
+    createUniformRing();
+    createOcclusionCuller();
+    createCommandBuffers();
+    createSyncObjects();
+}
+
+void HelloTriangleApplication::initVulkanHeadless() {
+    // no window, surface or swap chain. The pipeline renders into images of our own instead
+    createVulkanInstance();
+    setupVulkanDebugMessenger();
+    pickPhysicalDevice();
+    createLogicalDevice();
+    createFrameMetrics();
+    createOffscreenImages();
+    createImageViews();
+    createRenderGraph();
+    createDescriptorSetLayout();
+    createBindlessTable();
     createGraphicsPipeline();
-    createFramebuffers();
     createCommandPool();
-    createVertexBuffer();
+    createGeometryBuffers();
+    createMaterialBuffer();
+    createUniformRing();
+    createOcclusionCuller();
     createCommandBuffers();
     createSyncObjects();
 }
@@ -125,20 +175,37 @@ void HelloTriangleApplication::mainLoop() {
 
 void HelloTriangleApplication::cleanUp() {
     vkDestroyBuffer(device, vertexBuffer, nullptr);
+    vkFreeMemory(device, vertexBufferMemory, nullptr);
+    vkDestroyBuffer(device, indexBuffer, nullptr);
+    vkFreeMemory(device, indexBufferMemory, nullptr);
+    vkDestroyBuffer(device, materialBuffer, nullptr);
+    vkFreeMemory(device, materialBufferMemory, nullptr);
+    uniformRing.destroy();
+    occlusionCuller.destroy();
+    bindlessTable.destroy();
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+
+    if (readbackEnabled) {
+        // waits for the encoder to be done with every buffer
+        frameReadback.destroy();
+    }
+    if (postProcessing) {
+        postProcessor.destroy();
+    }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-        vkDestroyFence(device, inFlightFences[i], nullptr);
+    for (auto semaphore: imageAvailableSemaphores) {
+        vkDestroySemaphore(device, semaphore, nullptr);
     }
+    frameTimeline.destroy();
 
     vkDestroyCommandPool(device, commandPool, nullptr);
 
     cleanupSwapChain();
 
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    pipelineManager.destroy();
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    renderGraph.destroy();
 
     vkDestroyDevice(device, nullptr);
 
@@ -150,11 +217,13 @@ void HelloTriangleApplication::cleanUp() {
     vkDestroySurfaceKHR(vulkanInstance, surface, nullptr);
     vkDestroyInstance(vulkanInstance, nullptr);
 
-    glfwDestroyWindow(window);
+    if (!headless) {
+        glfwDestroyWindow(window);
 
-    glfwTerminate();
+        glfwTerminate();
+    }
 
-    std::cout << "Cleaned Up" << std::endl;
+    LOG_INFO("cleaned up", {{"device", deviceName}});
 }
 
 void HelloTriangleApplication::createVulkanInstance() {
@@ -170,7 +239,7 @@ void HelloTriangleApplication::createVulkanInstance() {
     applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     applicationInfo.pEngineName = "No Engine";
     applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    applicationInfo.apiVersion = VK_API_VERSION_1_0;
+    applicationInfo.apiVersion = VK_API_VERSION_1_2; // timeline semaphores are core in 1.2
 
     // Tell the Vulkan driver which global extensions and validation layers we want to sue
     VkInstanceCreateInfo createInfo = VkInstanceCreateInfo();
@@ -223,20 +292,22 @@ std::vector<VkExtensionProperties> HelloTriangleApplication::getVulkanExtensions
 
     vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
 
-    std::cout << "available extensions: \n";
     for (const auto &extension: extensions) {
-        std::cout << '\t' << extension.extensionName << '\n';
+        LOG_DEBUG("available instance extension", {{"name", extension.extensionName}});
     }
 
     return extensions;
 }
 
-std::vector<const char *> HelloTriangleApplication::getRequiredExtensions() {
-    // Use GLFW extensions to interface Vulkan with the window system
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+std::vector<const char *> HelloTriangleApplication::getRequiredExtensions() const {
+    std::vector<const char *> extensions;
 
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    // Use GLFW extensions to interface Vulkan with the window system, headless doesn't have one
+    if (!headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         // enable callback to handle debug messages from Vulkan
@@ -269,7 +340,7 @@ bool HelloTriangleApplication::checkValidationLayerSupport() {
         }
     }
 
-    std::cout << "Validation layers requested are all available" << "\n";
+    LOG_DEBUG("validation layers requested are all available");
 
     return true;
 }
@@ -282,31 +353,33 @@ VkBool32 HelloTriangleApplication::debugCallback(VkDebugUtilsMessageSeverityFlag
 
     if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
         // Message is important enough to show
+        const char *type = "unknown";
         switch (messageType) {
             case VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT:
-                std::cout << "Some event has happened that is unrelated to the specification or performance"
-                          << std::endl;
+                // some event has happened that is unrelated to the specification or performance
+                type = "general";
                 break;
             case VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT:
-                std::cout << "Something has happened that violates the specification or indicates a possible mistake"
-                          << std::endl;
+                // something has happened that violates the specification or indicates a possible mistake
+                type = "validation";
                 break;
             case VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT:
-                std::cout << "Potential non-optimal use of Vulkan" << std::endl;
+                // potential non-optimal use of Vulkan
+                type = "performance";
                 break;
             case VK_DEBUG_UTILS_MESSAGE_TYPE_DEVICE_ADDRESS_BINDING_BIT_EXT:
-                std::cout
-                        << "The implementation has modified the set of GPU-visible virtual addresses associated with a Vulkan object."
-                        << std::endl;
-                break;
-            case VK_DEBUG_UTILS_MESSAGE_TYPE_FLAG_BITS_MAX_ENUM_EXT:
-                std::cout << "Not sure what this message type is, something from with flags and max enum" << std::endl;
+                // the implementation has modified the set of GPU-visible virtual addresses of a Vulkan object
+                type = "device address binding";
                 break;
             default:
                 break;
         }
 
-        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+        if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+            LOG_ERROR("validation layer", {{"type", type}, {"message", pCallbackData->pMessage}});
+        } else {
+            LOG_WARNING("validation layer", {{"type", type}, {"message", pCallbackData->pMessage}});
+        }
     }
 
     return VK_FALSE;
@@ -346,10 +419,25 @@ void HelloTriangleApplication::pickPhysicalDevice() {
     std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
     vkEnumeratePhysicalDevices(vulkanInstance, &deviceCount, physicalDevices.data());
 
-    for (const auto &physDevice: physicalDevices) {
-        if (isDeviceSuitable(physDevice)) {
-            physicalDevice = physDevice;
-            break;
+    uint32_t bestScore = 0;
+    if (requestedDeviceIndex.has_value()) {
+        uint32_t index = requestedDeviceIndex.value();
+        if (index >= deviceCount) {
+            throw std::runtime_error("There is no physical device " + std::to_string(index));
+        }
+        bestScore = rateDevice(physicalDevices[index]);
+        if (bestScore == 0) {
+            throw std::runtime_error("Physical device " + std::to_string(index) + " isn't suitable");
+        }
+        physicalDevice = physicalDevices[index];
+    } else {
+        // the highest score wins, the first one on a tie
+        for (const auto &physDevice: physicalDevices) {
+            uint32_t score = rateDevice(physDevice);
+            if (score > bestScore) {
+                bestScore = score;
+                physicalDevice = physDevice;
+            }
         }
     }
 
@@ -357,44 +445,83 @@ void HelloTriangleApplication::pickPhysicalDevice() {
         throw std::runtime_error("Failed to find a suitable GPU");
     }
 
-    std::cout << "found suitable physical device " << std::endl;
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    deviceName = deviceProperties.deviceName;
+
+    LOG_INFO("found suitable physical device", {{"device", deviceName}, {"score", bestScore}});
 }
 
 bool HelloTriangleApplication::isDeviceSuitable(VkPhysicalDevice physDevice) {
-    // unused right now but this is how you get the physDevice properties and features
     VkPhysicalDeviceProperties deviceProperties;
     vkGetPhysicalDeviceProperties(physDevice, &deviceProperties);
 
-    VkPhysicalDeviceFeatures deviceFeatures;
-    vkGetPhysicalDeviceFeatures(physDevice, &deviceFeatures);
-
-    // dedicated graphic cards that support geometry shaders
-    if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU && deviceFeatures.geometryShader) {}
-
     // check the physDevice can process the commands we want to use
     QueueFamilyIndices indices = findQueueFamilies(physDevice);
 
     // check the physDevice supports all the specified required extensions
     bool extensionsSupported = checkDeviceExtensionSupport(physDevice);
 
-    // check the physDevice adequately supports swapChain
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    // check the physDevice adequately supports swapChain, headless doesn't use one
+    bool swapChainAdequate = headless;
+    if (extensionsSupported && !headless) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physDevice);
         swapChainAdequate = swapChainSupport.isAdequate();
     }
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate;
+    // frame pacing is built on timeline semaphores
+    bool timelineSupported = false;
+    if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &vulkan12Features;
+        vkGetPhysicalDeviceFeatures2(physDevice, &features2);
+        timelineSupported = vulkan12Features.timelineSemaphore;
+    }
+
+    return indices.isComplete() && extensionsSupported && swapChainAdequate && timelineSupported;
+}
+
+uint32_t HelloTriangleApplication::rateDevice(VkPhysicalDevice physDevice) {
+    if (!isDeviceSuitable(physDevice)) {
+        return 0;
+    }
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physDevice, &deviceProperties);
+
+    // the device type says the most about speed, dedicated graphic cards first and software renderers last
+    uint32_t score = 1;
+    switch (deviceProperties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            score += 4000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            score += 2000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            score += 1000;
+            break;
+        default:
+            break;
+    }
+
+    // bigger images usually means a bigger GPU, only really breaks ties
+    score += deviceProperties.limits.maxImageDimension2D / 1024;
+    return score;
 }
 
-bool HelloTriangleApplication::checkDeviceExtensionSupport(VkPhysicalDevice physDevice) {
+bool HelloTriangleApplication::checkDeviceExtensionSupport(VkPhysicalDevice physDevice) const {
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(physDevice, nullptr, &extensionCount, nullptr);
 
     std::vector<VkExtensionProperties> availableExtensions(extensionCount);
     vkEnumerateDeviceExtensionProperties(physDevice, nullptr, &extensionCount, availableExtensions.data());
 
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+    std::vector<const char *> extensions = getDeviceExtensions();
+    std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
     for (const auto &extension: availableExtensions) {
         requiredExtensions.erase(extension.extensionName);
@@ -404,14 +531,22 @@ bool HelloTriangleApplication::checkDeviceExtensionSupport(VkPhysicalDevice phys
     bool fullySupported = requiredExtensions.empty();
 
     if (fullySupported) {
-        std::cout << "All required extensions supported" << std::endl;
+        LOG_DEBUG("all required extensions supported");
     } else {
-        std::cout << "Extension not supported: " << *requiredExtensions.begin() << std::endl;
+        LOG_INFO("extension not supported", {{"extension", *requiredExtensions.begin()}});
     }
 
     return fullySupported;
 }
 
+std::vector<const char *> HelloTriangleApplication::getDeviceExtensions() const {
+    // headless never presents, so it doesn't need the swap chain extension
+    if (headless) {
+        return {};
+    }
+    return deviceExtensions;
+}
+
 
 // need to check with queue families are supported by the physDevice and which one of these
 // supports the commands we want to use
@@ -431,11 +566,16 @@ HelloTriangleApplication::QueueFamilyIndices HelloTriangleApplication::findQueue
             indices.graphicsFamily = i;
         }
 
-        // look for a queue family that has capability of presenting to our window surface
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physDevice, i, surface, &presentSupport);
-        if (presentSupport) {
-            indices.presentFamily = i;
+        if (headless) {
+            // nothing to present to, the graphics queue stands in so nothing else has to care
+            indices.presentFamily = indices.graphicsFamily;
+        } else {
+            // look for a queue family that has capability of presenting to our window surface
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(physDevice, i, surface, &presentSupport);
+            if (presentSupport) {
+                indices.presentFamily = i;
+            }
         }
 
         if (indices.isComplete()) {
@@ -446,6 +586,23 @@ HelloTriangleApplication::QueueFamilyIndices HelloTriangleApplication::findQueue
         i++;
     }
 
+    if (indices.graphicsFamily.has_value()) {
+        uint32_t graphicsFamily = indices.graphicsFamily.value();
+        for (uint32_t family = 0; family < queueFamilyCount; family++) {
+            VkQueueFlags flags = queueFamilies[family].queueFlags;
+            if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+                // async compute family, runs alongside the graphics queue
+                indices.computeFamily = family;
+                break;
+            }
+        }
+        if (!indices.computeFamily.has_value()) {
+            // graphics families always support compute too
+            indices.computeFamily = graphicsFamily;
+            indices.computeQueueIndex = queueFamilies[graphicsFamily].queueCount > 1 ? 1 : 0;
+        }
+    }
+
     return indices;
 }
 
@@ -462,31 +619,68 @@ void HelloTriangleApplication::createLogicalDevice() {
     // because you can create all the command buffers on multiple threads and then
     // submit them all at once on the main thread with a single low-overhead call.
 
+    // post-processing wants a queue of its own, either from a compute family or a second graphics queue
+    if (postProcessing) {
+        uniqueQueueFamilies.insert(indices.computeFamily.value());
+    }
+
     // assign priorities to queues to influence the scheduling of command buffer execution.
     // This is required even if there is only a single queue
-    float queuePriority = 1.0f;
+    float queuePriorities[] = {1.0f, 1.0f};
     for (uint32_t queueFamily: uniqueQueueFamilies) {
+        uint32_t queueCount = 1;
+        if (postProcessing && queueFamily == indices.computeFamily.value()) {
+            queueCount = indices.computeQueueIndex + 1;
+        }
+
         VkDeviceQueueCreateInfo queueCreateInfo{};
         queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queueCreateInfo.queueFamilyIndex = queueFamily;
-        queueCreateInfo.queueCount = 1;
-        queueCreateInfo.pQueuePriorities = &queuePriority;
+        queueCreateInfo.queueCount = queueCount;
+        queueCreateInfo.pQueuePriorities = queuePriorities;
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
     // these are the features that we queried support for with vkGetPhysicalDeviceFeatures
-    // Right now don't need anything special, so leave everything with VK_FALSE
+    // everything is VK_FALSE apart from what the bindless table and occlusion culler turn on below
     VkPhysicalDeviceFeatures deviceFeatures{};
 
+    // 1.2 features go through pNext, isDeviceSuitable() already checked timelineSemaphore is there
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+
+    // descriptor indexing is optional, the table falls back to a set per frame without it
+    bindlessFeatures = BindlessTable::enableFeatures(physicalDevice, deviceFeatures, vulkan12Features);
+
+    // indirect draws with a first instance, without them every object is drawn every frame
+    occlusionCulling = OcclusionCuller::enableFeatures(physicalDevice, deviceFeatures);
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &vulkan12Features;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    // memory in use for the metrics, only turned on where the driver has it
+    std::vector<const char *> extensions = getDeviceExtensions();
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    memoryBudgetEnabled = std::any_of(availableExtensions.begin(), availableExtensions.end(),
+                                      [](const VkExtensionProperties &extension) {
+                                          return std::string(extension.extensionName) ==
+                                                 VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+                                      });
+    if (memoryBudgetEnabled) {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (enableValidationLayers) {
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -504,8 +698,13 @@ void HelloTriangleApplication::createLogicalDevice() {
     // only creating a single queue from this family, so simply use index 0
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    if (postProcessing) {
+        vkGetDeviceQueue(device, indices.computeFamily.value(), indices.computeQueueIndex, &computeQueue);
+    }
 
-    std::cout << "Logical Device created and graphicsQueue and presentQueue retrieved" << std::endl;
+    LOG_INFO("logical device created and queues retrieved", {{"device", deviceName},
+                                                              {"separateComputeQueue", computeQueue != VK_NULL_HANDLE &&
+                                                                                       computeQueue != graphicsQueue}});
 }
 
 void HelloTriangleApplication::createSurface() {
@@ -571,7 +770,7 @@ void HelloTriangleApplication::createSwapChain() {
         throw std::runtime_error("failed to create swap chain!");
     }
 
-    std::cout << "Swap chain successfully created" << std::endl;
+    LOG_INFO("swap chain created", {{"width", extent.width}, {"height", extent.height}});
 
     // store swapChainImages
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
@@ -592,32 +791,46 @@ void HelloTriangleApplication::recreateSwapChain() {
         glfwGetFramebufferSize(window, &width, &height);
         glfwWaitEvents();
 
-        std::cout << "Window minimized waiting for it to come back into foreground..." << std::endl;
+        LOG_DEBUG("window minimized, waiting for it to come back into foreground");
     }
 
 
     // don't touch resources that may still be in use
     vkDeviceWaitIdle(device);
 
-    std::cout << "Recreating swap chain" << std::endl;
+    LOG_INFO("recreating swap chain", {{"width", width}, {"height", height}});
 
     cleanupSwapChain();
 
     createSwapChain();
     createImageViews();
-    createFramebuffers();
+    // the graph's framebuffers point at the old image views
+    renderGraph.resize(swapChainExtent);
+    if (occlusionCulling) {
+        // and the depth pyramid matches the old depth buffer
+        occlusionCuller.resize(physicalDevice, swapChainExtent, renderGraph.getImageView(depthImage));
+    }
+    createRenderFinishedSemaphores();
 }
 
 void HelloTriangleApplication::cleanupSwapChain() {
-    for (auto framebuffer: swapChainFramebuffers) {
-        vkDestroyFramebuffer(device, framebuffer, nullptr);
+    for (auto semaphore: renderFinishedSemaphores) {
+        vkDestroySemaphore(device, semaphore, nullptr);
     }
+    renderFinishedSemaphores.clear();
 
     for (auto imageView: swapChainImageViews) {
         vkDestroyImageView(device, imageView, nullptr);
     }
 
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
+    if (headless) {
+        for (size_t i = 0; i < swapChainImages.size(); i++) {
+            vkDestroyImage(device, swapChainImages[i], nullptr);
+            vkFreeMemory(device, offscreenImageMemories[i], nullptr);
+        }
+    } else {
+        vkDestroySwapchainKHR(device, swapChain, nullptr);
+    }
 }
 
 HelloTriangleApplication::SwapChainSupportDetails
@@ -676,12 +889,13 @@ HelloTriangleApplication::chooseSwapPresentMode(const std::vector<VkPresentModeK
 
     for (const auto &availablePresentMode: availablePresentModes) {
         if (availablePresentMode == desiredPresentMode) {
-            std::cout << "Present mode: " << desiredPresentMode << " available" << std::endl;
+            LOG_DEBUG("present mode available", {{"presentMode", static_cast<int>(desiredPresentMode)}});
             return availablePresentMode;
         }
     }
 
-    std::cout << desiredPresentMode << " not available defaulting to VK_PRESENT_MODE_FIFO_KHR" << std::endl;
+    LOG_INFO("present mode not available, defaulting to VK_PRESENT_MODE_FIFO_KHR",
+             {{"presentMode", static_cast<int>(desiredPresentMode)}});
     // only the VK_PRESENT_MODE_FIFO_KHR mode is guaranteed to be available
     return VK_PRESENT_MODE_FIFO_KHR;
 }
@@ -710,6 +924,38 @@ VkExtent2D HelloTriangleApplication::chooseSwapExtent(const VkSurfaceCapabilitie
     }
 }
 
+void HelloTriangleApplication::createOffscreenImages() {
+    // one per frame in flight so frames don't wait on each other's image, swapChainExtent and
+    // swapChainImageFormat were set by runHeadless()
+    swapChainImages.resize(framesInFlight);
+    offscreenImageMemories.resize(framesInFlight);
+
+    for (size_t i = 0; i < swapChainImages.size(); i++) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = swapChainImageFormat;
+        imageInfo.extent = {swapChainExtent.width, swapChainExtent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        // rendered to, then copied out for readback or read by the post-process shader
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        if (postProcessing) {
+            imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        createImage(physicalDevice, device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i],
+                    offscreenImageMemories[i]);
+    }
+
+    LOG_INFO("created offscreen images", {{"count", swapChainImages.size()}, {"width", swapChainExtent.width},
+                                          {"height", swapChainExtent.height}});
+}
+
 void HelloTriangleApplication::createImageViews() {
     swapChainImageViews.resize(swapChainImages.size());
 
@@ -742,185 +988,93 @@ void HelloTriangleApplication::createImageViews() {
     }
 }
 
-void HelloTriangleApplication::createRenderPass() {
-    // Attachment Description
-    // just a single color buffer attachment represented by one of the images from the swap chain
-    VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = swapChainImageFormat;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT; // no multisampling right now
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;  // clear the values to a constant at the start
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // Rendered contents will be stored in memory and can be read later
-    // our app won't do anything with stencil buffer so loading and storing are irrelevant
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // Existing contents are undefined; we don't care about them
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; // Contents of the framebuffer will be undefined after the rendering operation
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // want the image to be ready for presentation using the swap chain after rendering
-
-    // Subpasses (post-processing) and attachment references 
-    VkAttachmentReference colorAttachmentRef{};
-    colorAttachmentRef.attachment = 0; // just one VkAttachmentDescription
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;  // our attachment is a color buffer
-
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-    // the index of the attachment in this array is directly referenced
-    // from the fragment shader with the layout(location = 0) out vec4 outColor
-
-    // Subpass Dependencies
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    // specify the operations to wait on and the stages in which these operations occure
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    // these settings will prevent the transition from happening until its actually necessary
-    // when we want to start writing colors to it
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    // Render pass
-    VkRenderPassCreateInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
-
-    VkResult renderPassCreateResult = vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass);
-    if (renderPassCreateResult != VK_SUCCESS) {
-        throw std::runtime_error("failed to create render pass!");
+VkFormat HelloTriangleApplication::findDepthFormat() const {
+    // the occlusion culler samples the depth buffer, D16 is the only format guaranteed to allow that
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_D32_SFLOAT, &properties);
+    VkFormatFeatureFlags wanted = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    if ((properties.optimalTilingFeatures & wanted) == wanted) {
+        return VK_FORMAT_D32_SFLOAT;
+    }
+    return VK_FORMAT_D16_UNORM;
+}
+
+void HelloTriangleApplication::createRenderGraph() {
+    // the acquire semaphore is waited on at colour output, so the first barrier on the image starts from there.
+    // The image is cleared, whatever it held before doesn't matter
+    ImageUsage before{VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0};
+
+    // ready for presentation using the swap chain after rendering
+    ImageUsage after{VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0};
+    if (headless) {
+        // headless copies the image out instead
+        after = {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT};
     }
+    if (postProcessing) {
+        // storage images have to be in GENERAL for the compute shader, the release to the compute queue waits on
+        // colour output
+        after = {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0};
+    }
+    targetImage = renderGraph.importImage("target", swapChainImageFormat, before, after);
+
+    depthImage = renderGraph.createImage("depth", findDepthFormat());
+
+    // Occlusion culling splits the scene in two around a depth pyramid: last frame's visible objects first, then
+    // whatever the pyramid built from their depth says has come into view. The culling passes don't write any
+    // images of the graph, keep() stops them being culled
+    if (occlusionCulling) {
+        uint32_t visibleCullPass = renderGraph.addPass("occlusion cull visible", [this](VkCommandBuffer cmdBuffer) {
+            occlusionCuller.recordFirstPhase(cmdBuffer, getViewProjection());
+        });
+        renderGraph.keep(visibleCullPass);
+    }
+
+    scenePass = renderGraph.addPass("scene", [this](VkCommandBuffer cmdBuffer) {
+        recordScene(cmdBuffer, 0);
+    });
+    VkClearValue clearColor = {{0.0f, 0.0f, 0.0f, 1.0f}};   // black with 100% opacity
+    renderGraph.writeAttachment(scenePass, targetImage, VK_ATTACHMENT_LOAD_OP_CLEAR, clearColor);
+    VkClearValue clearDepth{};
+    clearDepth.depthStencil = {1.0f, 0}; // as far away as it gets
+    renderGraph.writeAttachment(scenePass, depthImage, VK_ATTACHMENT_LOAD_OP_CLEAR, clearDepth);
+
+    if (occlusionCulling) {
+        uint32_t revealedCullPass = renderGraph.addPass("occlusion cull revealed", [this](VkCommandBuffer cmdBuffer) {
+            occlusionCuller.recordSecondPhase(cmdBuffer, getViewProjection());
+        });
+        renderGraph.read(revealedCullPass, depthImage, ImageAccess::Sampled);
+        renderGraph.keep(revealedCullPass);
+
+        uint32_t revealedScenePass = renderGraph.addPass("scene revealed", [this](VkCommandBuffer cmdBuffer) {
+            recordScene(cmdBuffer, 1);
+        });
+        renderGraph.writeAttachment(revealedScenePass, targetImage, VK_ATTACHMENT_LOAD_OP_LOAD);
+        renderGraph.writeAttachment(revealedScenePass, depthImage, VK_ATTACHMENT_LOAD_OP_LOAD);
+    }
+
+    renderGraph.compile(physicalDevice, device, swapChainExtent);
+    renderPass = renderGraph.getRenderPass(scenePass);
 }
 
 void HelloTriangleApplication::createGraphicsPipeline() {
-    auto vertexShader = readFile("shaders/hello_triangle_application.vert.spv");
-    auto fragmentShader = readFile("shaders/hello_triangle_application.frag.spv");
-
-    std::cout << "VertexShader Size: " << vertexShader.size() << std::endl;
-    std::cout << "FragmentShader Size: " << fragmentShader.size() << std::endl;
-
-    VkShaderModule vertShaderModule = createShaderModule(vertexShader);
-    VkShaderModule fragShaderModule = createShaderModule(fragmentShader);
-
-    // assign shaders to specific pipeline stage
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;  // vertex stage
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-    vertShaderStageInfo.pSpecializationInfo = nullptr; // Optional - Allows to specify values for shader constants
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;// fragment stage
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-    fragShaderStageInfo.pSpecializationInfo = nullptr; // Optional
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
-                                                      fragShaderStageInfo};
-
-
-    // Vertex Input
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-    auto bindingDescription = Vertex::getBindingDescription();
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-
-    auto attributeDescription = Vertex::getAttributeDescriptions();
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
-
-    // Input Assembly ( what kind of geometry will be drawn from the vertices
-    // and if primitive restart should be enabled)
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; // triangle from every 3 vertices without reuse
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    //viewportState.pViewports = &viewport; // this would be null if using dynamic states
-    viewportState.scissorCount = 1;
-    //viewportState.pScissors = &scissor; // null if using dynaimc states
-
-    // Rasterizer
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE; // discard fragments beyond near and far planes don't clamp to edge
-    rasterizer.rasterizerDiscardEnable = VK_FALSE; // if true disables any output to the frame-buffer
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL; // fill the area of the polygon with fragments
-    rasterizer.lineWidth = 1.0f; // thickness of lines
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT; // cull the back faces
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE; // vertex order of faces
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-    rasterizer.depthBiasClamp = 0.0f; // Optional
-    rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-
-    // Multisampling (anti-aliasing) for now disabled
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f; // Optional
-    multisampling.pSampleMask = nullptr; // Optional
-    multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-    multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-    // Depth and stencil testing (not implemented)
-    // ...
-
-    // Color blending
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask =
-            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE; // new color from the fragment shader is passed through unmodified
-    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{}; // fragment colors will be written to the framebuffer unmodified
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f; //optional
-    colorBlending.blendConstants[1] = 0.0f; //optional
-    colorBlending.blendConstants[2] = 0.0f; //optional
-    colorBlending.blendConstants[3] = 0.0f; //optional
-
-
-    // states that can change without having to recreate the pipeline at draw time
-    // meaning we will be required to specify the data for these values at drawing time
-    std::vector<VkDynamicState> dynamicStates = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
-    };
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicState.pDynamicStates = dynamicStates.data();
+    // the camera and the material buffer's handle go in push constants, straight into the command buffer with
+    // no memory behind them
+    VkPushConstantRange frameRange{};
+    frameRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    frameRange.offset = 0;
+    frameRange.size = sizeof(FrameConstants);
+
+    // set 0 is per object, set 1 the bindless table
+    std::array<VkDescriptorSetLayout, 2> setLayouts = {descriptorSetLayout, bindlessTable.getLayout()};
 
     // Pipeline Layout (for uniform values in shaders)
     VkPipelineLayoutCreateInfo pipelineLayoutInfo;
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0; // Optional
-    pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &frameRange;
     pipelineLayoutInfo.pNext = nullptr;  // had to add this? not sure why
     pipelineLayoutInfo.flags = VK_PIPELINE_LAYOUT_CREATE_INDEPENDENT_SETS_BIT_EXT; // had to also add this?
 
@@ -932,41 +1086,38 @@ void HelloTriangleApplication::createGraphicsPipeline() {
         throw std::runtime_error("failed to create pipeline layout");
     }
 
-    std::cout << "Successfully created pipeline layout" << std::endl;
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr; // Optional
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicState;
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0; // index of the sub pass where this graphics pipeline will be used
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional - if wanted a new graphics pipeline derived from an exisiting pipeline
-    pipelineInfo.basePipelineIndex = -1; //Optional
-
-    VkResult pipelineCreateResults = vkCreateGraphicsPipelines(device,
-                                                               VK_NULL_HANDLE,
-                                                               1,
-                                                               &pipelineInfo,
-                                                               nullptr,
-                                                               &graphicsPipeline);
-    if (pipelineCreateResults != VK_SUCCESS) {
-        throw std::runtime_error("failed to create graphics pipeline");
-    }
-
-    std::cout << "Successfully created Graphics Pipeline" << std::endl;
-
-    // can destroy shader modules after pipeline creation is finished
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    LOG_DEBUG("created pipeline layout");
+
+    GraphicsPipelineState state;
+    state.vertexShader = readFile("shaders/hello_triangle_application.vert.spv");
+    state.fragmentShader = readFile("shaders/hello_triangle_application.frag.spv");
+
+    LOG_DEBUG("loaded shaders", {{"vertexBytes", state.vertexShader.size()},
+                                 {"fragmentBytes", state.fragmentShader.size()}});
+
+    // triangles from every 3 indices, back faces culled with clockwise vertex order at the front
+    state.vertexBinding = Vertex::getBindingDescription();
+    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    state.vertexAttributes.assign(attributeDescriptions.begin(), attributeDescriptions.end());
+    state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    state.cullMode = VK_CULL_MODE_BACK_BIT;
+    state.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    // nearer objects hide farther ones whatever order they're drawn in, and the occlusion culler reads the depth
+    state.depthTest = true;
+    state.depthWrite = true;
+    // the table's array sizes, which can be smaller than asked for on devices that fall back
+    state.specializationConstants = {bindlessTable.getImageCapacity(), bindlessTable.getBufferCapacity()};
+    state.layout = pipelineLayout;
+    state.renderPass = renderPass;
+    state.subpass = 0; // index of the sub pass where this graphics pipeline will be used
+
+    // the unoptimised build is quick enough to not hold up startup, the first frames draw with it while the
+    // optimised one compiles in the background
+    pipelineManager.create(physicalDevice, device);
+    uint32_t fallbackPipeline = pipelineManager.createFallback(state);
+    graphicsPipeline = pipelineManager.request(state, fallbackPipeline);
+
+    LOG_INFO("created graphics pipeline");
 }
 
 VkShaderModule HelloTriangleApplication::createShaderModule(const std::vector<char> &shaderCode) {
@@ -987,35 +1138,6 @@ VkShaderModule HelloTriangleApplication::createShaderModule(const std::vector<ch
 }
 
 
-void HelloTriangleApplication::createFramebuffers() {
-    swapChainFramebuffers.resize(swapChainImages.size());
-    // iterate through the image views and create framebuffers from them
-    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        VkImageView attachments[] = {
-                swapChainImageViews[i]
-        };
-
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = attachments;
-        framebufferInfo.width = swapChainExtent.width;
-        framebufferInfo.height = swapChainExtent.height;
-        framebufferInfo.layers = 1;
-
-        VkResult frameBufferCreateResult = vkCreateFramebuffer(device,
-                                                               &framebufferInfo,
-                                                               nullptr,
-                                                               &swapChainFramebuffers[i]);
-        if (frameBufferCreateResult != VK_SUCCESS) {
-            throw std::runtime_error("failed to create framebuffer");
-        }
-
-        std::cout << "Created Frame Buffer for swapChainImageViews[" << i << "]" << std::endl;
-    }
-}
-
 void HelloTriangleApplication::createCommandPool() {
     QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
 
@@ -1029,12 +1151,12 @@ void HelloTriangleApplication::createCommandPool() {
         throw std::runtime_error("Failed to create command pool!");
     }
 
-    std::cout << "Successfully created Command Pool" << std::endl;
+    LOG_DEBUG("created command pool");
 }
 
 
 void HelloTriangleApplication::createCommandBuffers() {
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    commandBuffers.resize(framesInFlight);
 
     VkCommandBufferAllocateInfo allocateBufferInfo{};
     allocateBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1047,47 +1169,63 @@ void HelloTriangleApplication::createCommandBuffers() {
         throw std::runtime_error("Failed to allocate command buffers");
     }
 
-    std::cout << "Successfully allocated command buffers" << std::endl;
+    LOG_DEBUG("allocated command buffers", {{"count", commandBuffers.size()}});
 }
 
 void HelloTriangleApplication::createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    // one timeline semaphore replaces the in flight fences, frame N signals it to N when it is done
+    frameTimeline.create(device, framesInFlight);
+
+    if (headless) {
+        // nothing is acquired or presented, the timeline is all there is
+        LOG_INFO("created frame timeline", {{"framesInFlight", framesInFlight}});
+        return;
+    }
+
+    // acquiring a swap chain image still needs a binary semaphore, one per frame in flight.
+    // It is free to reuse once the timeline says the frame that last waited on it has finished
+    imageAvailableSemaphores.resize(framesInFlight);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // fence created in signaled state
-    // so that the first call to vkWaitForFences() returns immediately
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkResult createimageAvailableSemaphoreResult = vkCreateSemaphore(device,
+    for (size_t i = 0; i < framesInFlight; i++) {
+        VkResult createImageAvailableSemaphoreResult = vkCreateSemaphore(device,
                                                                          &semaphoreInfo,
                                                                          nullptr,
                                                                          &imageAvailableSemaphores[i]);
+        if (createImageAvailableSemaphoreResult != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create Semaphores. index: " + std::to_string(i));
+        }
+    }
+
+    createRenderFinishedSemaphores();
+
+    LOG_INFO("created semaphores and frame timeline", {{"framesInFlight", framesInFlight}});
+}
+
+void HelloTriangleApplication::createRenderFinishedSemaphores() {
+    // presentation waits on these and the timeline can't tell when a present is done with one,
+    // so they belong to swap chain images instead of frames: an image isn't handed out again until its
+    // previous present has finished
+    renderFinishedSemaphores.resize(swapChainImages.size());
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (size_t i = 0; i < renderFinishedSemaphores.size(); i++) {
         VkResult createRenderFinishedSemaphoreResult = vkCreateSemaphore(device,
                                                                          &semaphoreInfo,
                                                                          nullptr,
                                                                          &renderFinishedSemaphores[i]);
-        VkResult createInFlightFenceResult = vkCreateFence(device,
-                                                           &fenceInfo,
-                                                           nullptr,
-                                                           &inFlightFences[i]);
-        if (createimageAvailableSemaphoreResult != VK_SUCCESS
-            || createRenderFinishedSemaphoreResult != VK_SUCCESS
-            || createInFlightFenceResult != VK_SUCCESS) {
-            throw std::runtime_error(&"Failed to create Semaphores Or Fence. index: "[i]);
+        if (createRenderFinishedSemaphoreResult != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create Semaphores. index: " + std::to_string(i));
         }
-
     }
-
-    std::cout << "Successfully created Semaphores and Fence" << std::endl;
 }
 
-void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t imageIndex) {
+void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t imageIndex,
+                                                   VkBuffer readbackBuffer) {
     VkCommandBufferBeginInfo beginCommandBufferInfo{};
     beginCommandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginCommandBufferInfo.flags = 0; // Optional
@@ -1098,34 +1236,51 @@ void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer cmdBuffer, ui
         throw std::runtime_error("failed to begin recording command buffer");
     }
 
-    //std::cout << "Successfully began recording Command Buffer for frame " << currentFrame << std::endl;
+    LOG_TRACE("began recording command buffer", {{"image", imageIndex}});
 
-    // Start a render Pass
-    // We created a framebuffer for each swap chain image where it is specified
-    // as a color attachment, thus we need to bind the framebuffer for the swapchain image
-    // we want to draw to
-    VkRenderPassBeginInfo renderPassBeginInfo{};
-    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
-    renderPassBeginInfo.renderArea.offset = {0, 0};
-    renderPassBeginInfo.renderArea.extent = swapChainExtent;
+    // every object's uniforms for the frame, both scene passes bind them at this offset
+    void *objectData = nullptr;
+    objectsOffset = uniformRing.allocate(sizeof(ObjectUniforms) * OBJECT_CAPACITY, objectData);
+    std::memcpy(objectData, objects.data(), sizeof(ObjectUniforms) * objects.size());
 
-    // define the clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR
-    // which we used as load operation for the color attachment
-    VkClearValue clearColor = {{0.0f, 0.0f, 0.0f, 1.0f}};   // black with 100% opacity
-    renderPassBeginInfo.clearValueCount = 1;
-    renderPassBeginInfo.pClearValues = &clearColor;
+    // the graph transitions the image, begins the scene's render pass (clearing it) and calls recordScene()
+    renderGraph.setImportedImage(targetImage, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
+    renderGraph.execute(cmdBuffer);
 
-    vkCmdBeginRenderPass(cmdBuffer,
-                         &renderPassBeginInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
-    // VK_SUBPASS_CONTENTS_INLINE = render pass commands will be embedded in the primary command buffer itself
-    // and no secondary command buffers will be executed
+    if (readbackBuffer != VK_NULL_HANDLE) {
+        // the graph left the image in TRANSFER_SRC_OPTIMAL, with the colour writes made visible to the copy
+        recordReadbackCopy(cmdBuffer, swapChainImages[imageIndex], swapChainExtent, readbackBuffer);
+    } else if (postProcessing) {
+        // the compute queue takes the image from here
+        postProcessor.recordRelease(cmdBuffer, imageIndex);
+    }
 
+    // End Command Buffer
+    VkResult endCommandBufferResult = vkEndCommandBuffer(cmdBuffer);
+    if (endCommandBufferResult != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer");
+    }
+
+    LOG_TRACE("recorded command buffer", {{"image", imageIndex}});
+}
+
+glm::mat4 HelloTriangleApplication::getViewProjection() const {
+    // keeps the triangle's shape when the frame isn't square, the shorter side spans -1 to 1
+    glm::mat4 viewProjection(1.0f);
+    float aspect = static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
+    if (aspect > 1.0f) {
+        viewProjection[0][0] = 1.0f / aspect;
+    } else {
+        viewProjection[1][1] = aspect;
+    }
+    return viewProjection;
+}
+
+void HelloTriangleApplication::recordScene(VkCommandBuffer cmdBuffer, uint32_t phase) {
     // Basic Drawing commands
     // Bind the graphics pipeline
-    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    // the fallback until the optimised pipeline has compiled
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineManager.getPipeline(graphicsPipeline));
 
     // Because we specified viewport and scissor as dynamic in pipeline
     // we need to set them before issuing our draw command
@@ -1143,30 +1298,54 @@ void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer cmdBuffer, ui
     scissor.extent = swapChainExtent;
     vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
 
-    // finally the draw command for the triangle
-    uint32_t vertexCount = 3;
-    uint32_t instanceCount = 1; // used for instanced rendering, use 1 if not doing that
-    uint32_t firstVertex = 0; // Used as an offset in the vertex buffer, defines the lowest value of gl_VertexIndex
-    uint32_t firstInstance = 0; // Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex
-    vkCmdDraw(cmdBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+    FrameConstants frame{};
+    frame.viewProjection = getViewProjection();
+    frame.materialBuffer = materialBufferHandle;
+    vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(FrameConstants), &frame);
 
-    // End render pass
-    vkCmdEndRenderPass(cmdBuffer);
+    // bound once for the whole frame, every object finds its material and textures in it by index
+    VkDescriptorSet bindlessSet = bindlessTable.getSet();
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &bindlessSet,
+                            0, nullptr);
 
-    // End Command Buffer
-    VkResult endCommandBufferResult = vkEndCommandBuffer(cmdBuffer);
-    if (endCommandBufferResult != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer");
+    // the frame's objects, filled in by recordCommandBuffer(). Each draw picks its own by gl_InstanceIndex
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &objectDescriptorSet,
+                            1, &objectsOffset);
+
+    VkDeviceSize bufferOffset = 0;
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBuffer, &bufferOffset);
+    vkCmdBindIndexBuffer(cmdBuffer, indexBuffer, 0, indexType);
+
+    // the culler wrote a draw per object for this phase, the ones it culled have no instances
+    if (occlusionCulling) {
+        occlusionCuller.recordDraws(cmdBuffer, phase);
+        return;
     }
 
-    //std::cout << "Successfully Recorded Command Buffer" << std::endl;
+    // finally the draw commands for every object, shared vertices are only shaded again once they've left the
+    // post transform cache
+    uint32_t instanceCount = 1; // used for instanced rendering, use 1 if not doing that
+    uint32_t firstIndex = 0; // offset into the index buffer
+    int32_t vertexOffset = 0; // added to every index before it looks up a vertex
+    for (uint32_t i = 0; i < objects.size(); i++) {
+        // Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex
+        uint32_t firstInstance = i;
+        vkCmdDrawIndexed(cmdBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+    }
 }
 
 
 void HelloTriangleApplication::drawFrame() {
     // Rendering a frame in Vulkan consists of:
-    // - Wait for the previous frame to finish
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    // - Wait for the frame that last used this frame's resources to finish,
+    // with more frames in flight the CPU gets further ahead before this ever blocks
+    auto waitStart = std::chrono::steady_clock::now();
+    uint64_t frameNumber = frameTimeline.waitForNextSlot();
+    double waitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+    uint32_t currentFrame = frameTimeline.getNextSlot();
+    uniformRing.beginFrame(currentFrame);
+    bindlessTable.beginFrame(currentFrame, frameTimeline.getCompletedFrame());
 
     // - Acquire an image from the swap chain
     // Check if Vulkan is telling us that the swap chain is no linger adequate (i.e. window resize)
@@ -1184,9 +1363,6 @@ void HelloTriangleApplication::drawFrame() {
         throw std::runtime_error("failed to acquire swap chain image");
     }
 
-    // done waiting - only reset the fence if we are submitting work
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
-
     // - Record a command buffer which draws the scene onto that image
     vkResetCommandBuffer(commandBuffers[currentFrame], 0); // make sure command buffer is able to be recorded to
 
@@ -1208,23 +1384,37 @@ void HelloTriangleApplication::drawFrame() {
     submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
     // specify which semaphores to signal once the command buffer(s) have finished execution
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
+    // the binary one for presentation and the timeline, to this frame's number
+    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[imageIndex], frameTimeline.getSemaphore()};
+    submitInfo.signalSemaphoreCount = 2;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    VkResult queueSubmitResult = vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]);
+    // values for the binary semaphores are ignored
+    uint64_t waitValues[] = {0};
+    uint64_t signalValues[] = {0, frameNumber};
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = 2;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+    submitInfo.pNext = &timelineInfo;
+
+    VkResult queueSubmitResult = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
     if (queueSubmitResult != VK_SUCCESS) {
         throw std::runtime_error("failed to submit draw command buffer");
     }
+    frameTimeline.markSubmitted();
+    recordFrameMetrics(frameNumber, waitSeconds);
 
-    //std::cout << "Successfully submitted draw command buffer" << std::endl;
+    LOG_TRACE("submitted draw command buffer", {{"frame", frameNumber}});
 
     // - Present the swap chain image
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     // we ant to wait on the command buffer to finish execution
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = &renderFinishedSemaphores[imageIndex];
 
     // specify the swap chains to present images to 
     // and the index of the image for each swap chain
@@ -1244,27 +1434,291 @@ void HelloTriangleApplication::drawFrame() {
     } else if (queuePresentResult != VK_SUCCESS) {
         throw std::runtime_error("failed to present swap chain image");
     }
+}
+
+
+void HelloTriangleApplication::drawHeadlessFrame(uint64_t imageNumber) {
+    // same as drawFrame() without the swap chain: every frame in flight has an image of its own,
+    // so the only wait is for the frame that last used this one's image and command buffer
+    auto waitStart = std::chrono::steady_clock::now();
+    uint64_t frameNumber = frameTimeline.waitForNextSlot();
+    double waitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+    uint32_t currentFrame = frameTimeline.getNextSlot();
+    uniformRing.beginFrame(currentFrame);
+    bindlessTable.beginFrame(currentFrame, frameTimeline.getCompletedFrame());
+
+    // only blocks when every readback buffer is still on the GPU or with the encoder
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    if (readbackEnabled) {
+        readbackBuffer = frameReadback.acquire(frameNumber, imageNumber, frameTimeline);
+    }
+
+    // when post-processing, the readback copies the compute shader's output instead of the render
+    vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+    recordCommandBuffer(commandBuffers[currentFrame], currentFrame, postProcessing ? VK_NULL_HANDLE : readbackBuffer);
+
+    // nothing to wait on, only a timeline to signal. The frame timeline, or the post-processor's
+    // rendered semaphore when the frame still has to go through the compute queue
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &frameNumber;
+
+    VkSemaphore timelineSemaphore = frameTimeline.getSemaphore();
+    if (postProcessing) {
+        timelineSemaphore = postProcessor.getRenderedSemaphore();
+    }
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timelineSemaphore;
+
+    VkResult queueSubmitResult = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    if (queueSubmitResult != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer");
+    }
+    if (postProcessing) {
+        // waits on the GPU for the render, so this doesn't block and the next frame can start rendering
+        postProcessor.submit(currentFrame, frameNumber, frameTimeline.getSemaphore(), readbackBuffer);
+    }
+    frameTimeline.markSubmitted();
+    recordFrameMetrics(frameNumber, waitSeconds);
+
+    // hand whatever earlier frames have finished to the encoder, without waiting for the rest
+    if (readbackEnabled) {
+        frameReadback.collect(frameTimeline);
+    }
+}
+
+void HelloTriangleApplication::createFrameMetrics() {
+    MetricLabels labels = {{"device", deviceName}};
+    framesCounter = &Metrics::counter("smcodes_frames_total", "Frames submitted to the GPU", labels);
+    frameSeconds = &Metrics::histogram("smcodes_frame_seconds", "Time between one frame being submitted and the next",
+                                       Metrics::getLatencyBounds(), labels);
+    frameWaitSeconds = &Metrics::histogram("smcodes_frame_wait_seconds",
+                                           "Time a frame waited on the GPU for a free frame in flight",
+                                           Metrics::getLatencyBounds(), labels);
+    deviceMemoryGauge = &Metrics::gauge("smcodes_device_memory_bytes",
+                                        "Device local memory in use by this process", labels);
+    lastFrameSubmitted = std::chrono::steady_clock::now();
+
+    if (!memoryBudgetEnabled) {
+        LOG_INFO("device memory won't be reported, VK_EXT_memory_budget isn't supported", {{"device", deviceName}});
+    }
+}
+
+void HelloTriangleApplication::recordFrameMetrics(uint64_t frameNumber, double waitSeconds) {
+    auto now = std::chrono::steady_clock::now();
+    framesCounter->add();
+    frameSeconds->observe(std::chrono::duration<double>(now - lastFrameSubmitted).count());
+    frameWaitSeconds->observe(waitSeconds);
+    lastFrameSubmitted = now;
+
+    if (frameNumber % MEMORY_METRIC_INTERVAL == 1) {
+        updateDeviceMemoryMetric();
+    }
+}
+
+void HelloTriangleApplication::updateDeviceMemoryMetric() {
+    if (!memoryBudgetEnabled) {
+        return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+    memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+
+    // heapUsage is this process's use of each heap, host visible system memory isn't counted
+    VkDeviceSize used = 0;
+    for (uint32_t heap = 0; heap < memoryProperties.memoryProperties.memoryHeapCount; heap++) {
+        if (memoryProperties.memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            used += budget.heapUsage[heap];
+        }
+    }
+    deviceMemoryGauge->set(static_cast<double>(used));
+}
+
+void HelloTriangleApplication::createGeometryBuffers() {
+    // the import step, done once at load: duplicate vertices welded, triangles ordered for the post transform cache
+    // and vertices for fetching
+    IndexedMesh mesh = buildIndexedMesh(vertices.data(), static_cast<uint32_t>(vertices.size()), sizeof(Vertex));
+    std::vector<uint8_t> indexBytes = mesh.packIndices();
+    indexType = mesh.hasShortIndices() ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+    // centred on the middle of the vertices, loose but cheap and the culler only needs it to be conservative
+    glm::vec3 centre(0.0f);
+    for (const Vertex &vertex: vertices) {
+        centre += glm::vec3(vertex.pos, 0.0f);
+    }
+    centre /= static_cast<float>(std::max<size_t>(vertices.size(), 1));
+    float radius = 0.0f;
+    for (const Vertex &vertex: vertices) {
+        radius = std::max(radius, glm::length(glm::vec3(vertex.pos, 0.0f) - centre));
+    }
+    meshBounds = glm::vec4(centre, radius);
+
+    createDeviceLocalBuffer(physicalDevice, device, graphicsQueue, commandPool, mesh.vertices.data(),
+                            mesh.vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer,
+                            vertexBufferMemory);
+    createDeviceLocalBuffer(physicalDevice, device, graphicsQueue, commandPool, indexBytes.data(),
+                            indexBytes.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexBufferMemory);
+
+    LOG_INFO("created geometry buffers", {{"sourceVertices", vertices.size()},
+                                          {"vertices", mesh.getVertexCount()},
+                                          {"triangles", indexCount / 3},
+                                          {"indexBytes", indexBytes.size()},
+                                          {"cacheMissRatio", getAverageCacheMissRatio(mesh.indices,
+                                                                                      mesh.getVertexCount())}});
+}
 
-    // advance to the next frame
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+void HelloTriangleApplication::createDescriptorSetLayout() {
+    // per object uniforms, a dynamic buffer so every object can sit at its own offset of the same set
+    VkDescriptorSetLayoutBinding objectBinding{};
+    objectBinding.binding = 0;
+    objectBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    objectBinding.descriptorCount = 1;
+    objectBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &objectBinding;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
 }
 
+void HelloTriangleApplication::createBindlessTable() {
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    bindlessTable.create(physicalDevice, device, graphicsQueue, indices.graphicsFamily.value(), bindlessFeatures,
+                         framesInFlight, BINDLESS_IMAGE_CAPACITY, BINDLESS_BUFFER_CAPACITY);
+}
+
+void HelloTriangleApplication::createMaterialBuffer() {
+    VkDeviceSize size = sizeof(materials[0]) * materials.size();
 
-void HelloTriangleApplication::createVertexBuffer() {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = sizeof(vertices[0]) * vertices.size(); // size of the buffer in bytes
-    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    // just like images in the swap chain, buffers can also be owned by a specific queue family
-    // or be shared between multiple at the same time
-    // for now buffer will only be used form the graphics queue, so we can stick to exclusive access
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &materialBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create material buffer!");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, materialBuffer, &requirements);
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    // written once here, small enough that reading it from host memory doesn't matter
+    int memoryType = findMemoryType(memoryProperties, requirements.memoryTypeBits,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (memoryType < 0) {
+        throw std::runtime_error("failed to find host visible memory for the material buffer!");
+    }
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = static_cast<uint32_t>(memoryType);
+    if (vkAllocateMemory(device, &allocateInfo, nullptr, &materialBufferMemory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate material buffer memory!");
+    }
+    vkBindBufferMemory(device, materialBuffer, materialBufferMemory, 0);
+
+    void *data = nullptr;
+    if (vkMapMemory(device, materialBufferMemory, 0, size, 0, &data) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map material buffer memory!");
+    }
+    std::memcpy(data, materials.data(), static_cast<size_t>(size));
+    vkUnmapMemory(device, materialBufferMemory);
+
+    materialBufferHandle = bindlessTable.allocateBuffer(materialBuffer, 0, size);
+}
+
+void HelloTriangleApplication::createUniformRing() {
+    uniformRing.create(physicalDevice, device, UNIFORM_RING_BYTES_PER_FRAME, framesInFlight);
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSize.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &descriptorSetLayout;
+    if (vkAllocateDescriptorSets(device, &allocateInfo, &objectDescriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+
+    // one set for every frame, written once. The range is the whole array of objects, where it starts is the
+    // dynamic offset given at bind time
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = uniformRing.getBuffer();
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(ObjectUniforms) * OBJECT_CAPACITY;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = objectDescriptorSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+
+void HelloTriangleApplication::createOcclusionCuller() {
+    if (!occlusionCulling) {
+        LOG_INFO("occlusion culling unavailable, drawing every object");
+        return;
+    }
 
-    VkResult createVertexBufferResult = vkCreateBuffer(device, &bufferInfo, nullptr, &vertexBuffer);
-    if (createVertexBufferResult != VK_SUCCESS) {
-        throw std::runtime_error("failed to create vertex buffer!");
+    auto pyramidShader = readFile("shaders/depth_pyramid.comp.spv");
+    auto cullShader = readFile("shaders/occlusion_cull.comp.spv");
+    VkShaderModule pyramidShaderModule = createShaderModule(pyramidShader);
+    VkShaderModule cullShaderModule = createShaderModule(cullShader);
+    occlusionCuller.create(physicalDevice, device, pyramidShaderModule, cullShaderModule, OBJECT_CAPACITY);
+    vkDestroyShaderModule(device, pyramidShaderModule, nullptr);
+    vkDestroyShaderModule(device, cullShaderModule, nullptr);
+
+    occlusionCuller.resize(physicalDevice, swapChainExtent, renderGraph.getImageView(depthImage));
+
+    // the mesh's bounds moved by each object's model matrix, the radius grown by its largest scale so the sphere
+    // still covers it
+    std::vector<CullObject> cullObjects;
+    for (const ObjectUniforms &object: objects) {
+        float scale = std::max({glm::length(glm::vec3(object.model[0])), glm::length(glm::vec3(object.model[1])),
+                                glm::length(glm::vec3(object.model[2]))});
+        CullObject cullObject{};
+        cullObject.sphere = glm::vec4(glm::vec3(object.model * glm::vec4(glm::vec3(meshBounds), 1.0f)),
+                                      meshBounds.w * scale);
+        cullObject.indexCount = indexCount;
+        cullObject.firstIndex = 0;
+        cullObject.vertexOffset = 0;
+        cullObjects.push_back(cullObject);
     }
+    occlusionCuller.setObjects(cullObjects);
 
+    LOG_INFO("created occlusion culler", {{"objects", occlusionCuller.getObjectCount()}});
 }
 
 
@@ -1272,6 +1726,12 @@ void HelloTriangleApplication::createVertexBuffer() {
 // #endregion
 
 // #region Public Methods
+HelloTriangleApplication::HelloTriangleApplication(uint32_t framesInFlight) : framesInFlight(framesInFlight) {
+    if (framesInFlight == 0) {
+        throw std::runtime_error("Need at least one frame in flight!");
+    }
+}
+
 void HelloTriangleApplication::run() {
     initWindow();
     initVulkan();
@@ -1279,4 +1739,131 @@ void HelloTriangleApplication::run() {
     cleanUp();
 }
 
+void HelloTriangleApplication::runHeadless(const HeadlessSettings &settings, ImageWriter &imageWriter) {
+    beginHeadless(settings, imageWriter);
+
+    auto start = std::chrono::steady_clock::now();
+    renderHeadlessFrames(1, settings.frameCount);
+    finishHeadless();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG_INFO("rendered headless", {{"frames", settings.frameCount}, {"seconds", seconds},
+                                   {"framesPerSecond", settings.frameCount / seconds}});
+
+    endHeadless();
+}
+
+void HelloTriangleApplication::beginHeadless(const HeadlessSettings &settings, ImageWriter &imageWriter) {
+    headless = true;
+    swapChainExtent = {settings.width, settings.height};
+    swapChainImageFormat = HEADLESS_FORMAT;
+    postProcessing = settings.postProcess;
+    requestedDeviceIndex = settings.deviceIndex;
+
+    initVulkanHeadless();
+
+    VkExtent2D outputExtent = swapChainExtent;
+    if (postProcessing) {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        PostProcessQueues queues;
+        queues.computeQueue = computeQueue;
+        queues.computeFamily = indices.computeFamily.value();
+        queues.graphicsFamily = indices.graphicsFamily.value();
+        queues.shared = computeQueue == graphicsQueue;
+
+        auto computeShader = readFile("shaders/post_process.comp.spv");
+        VkShaderModule computeShaderModule = createShaderModule(computeShader);
+        postProcessor.create(physicalDevice, device, queues, swapChainImages, swapChainImageViews, swapChainExtent,
+                             computeShaderModule, settings.postProcessSettings);
+        vkDestroyShaderModule(device, computeShaderModule, nullptr);
+
+        outputExtent = postProcessor.getOutputExtent();
+    }
+
+    readbackEnabled = !settings.outputPath.empty();
+    if (readbackEnabled) {
+        uint32_t bufferCount = settings.readbackBuffers > 0 ? settings.readbackBuffers : framesInFlight + 2;
+        frameReadback.create(physicalDevice, device, outputExtent.width, outputExtent.height, bufferCount,
+                             imageWriter, settings.outputPath);
+    }
+}
+
+void HelloTriangleApplication::renderHeadlessFrames(uint64_t firstImage, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        drawHeadlessFrame(firstImage + i);
+    }
+}
+
+void HelloTriangleApplication::finishHeadless() {
+    if (readbackEnabled) {
+        frameReadback.flush(frameTimeline);
+    }
+    vkDeviceWaitIdle(device);
+}
+
+void HelloTriangleApplication::endHeadless() {
+    if (readbackEnabled) {
+        LOG_INFO("readback stalls", {{"device", deviceName}, {"stalls", frameReadback.getStallCount()}});
+    }
+
+    cleanUp();
+}
+
+std::vector<DeviceCandidate> HelloTriangleApplication::findHeadlessDevices() {
+    // an instance of its own just to look, every application opens its device on a separate one
+    HelloTriangleApplication probe(1);
+    probe.headless = true;
+    probe.createVulkanInstance();
+
+    std::vector<DeviceCandidate> candidates;
+    try {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(probe.vulkanInstance, &deviceCount, nullptr);
+        std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+        vkEnumeratePhysicalDevices(probe.vulkanInstance, &deviceCount, physicalDevices.data());
+
+        for (uint32_t i = 0; i < deviceCount; i++) {
+            uint32_t score = probe.rateDevice(physicalDevices[i]);
+            if (score == 0) {
+                continue;
+            }
+
+            VkPhysicalDeviceProperties deviceProperties;
+            vkGetPhysicalDeviceProperties(physicalDevices[i], &deviceProperties);
+
+            DeviceCandidate candidate;
+            candidate.index = i;
+            candidate.name = deviceProperties.deviceName;
+            candidate.type = deviceProperties.deviceType;
+            candidate.score = score;
+            candidates.push_back(candidate);
+        }
+    } catch (...) {
+        vkDestroyInstance(probe.vulkanInstance, nullptr);
+        throw;
+    }
+    vkDestroyInstance(probe.vulkanInstance, nullptr);
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const DeviceCandidate &a, const DeviceCandidate &b) {
+        return a.score > b.score;
+    });
+    return candidates;
+}
+
+const std::string &HelloTriangleApplication::getDeviceName() const {
+    return deviceName;
+}
+
+bool HelloTriangleApplication::isFrameComplete(uint64_t frame) const {
+    return frameTimeline.isFrameComplete(frame);
+}
+
+uint64_t HelloTriangleApplication::getNextFrame() const {
+    return frameTimeline.getNextFrame();
+}
+
+uint64_t HelloTriangleApplication::getCompletedFrame() const {
+    return frameTimeline.getCompletedFrame();
+}
+
 // #endregion
@@ -10,22 +10,97 @@
 #include <vector>
 #include <optional>
 #include <string>
+#include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <array>
+#include <chrono>
+
+#include "BindlessTable.h"
+#include "FrameReadback.h"
+#include "FrameTimeline.h"
+#include "OcclusionCuller.h"
+#include "PipelineManager.h"
+#include "PostProcessor.h"
+#include "RenderGraph.h"
+#include "UniformRing.h"
 
 class GLFWwindow;
 
+class ImageWriter;
+
+class Counter;
+
+class Gauge;
+
+class Histogram;
+
+struct HeadlessSettings {
+    uint32_t width = 1200;
+    uint32_t height = 1000;
+    uint32_t frameCount = 100;
+    std::string outputPath; // empty renders without reading anything back, for raw throughput
+    uint32_t readbackBuffers = 0; // 0 uses framesInFlight + 2, enough to keep the GPU and the encoder busy
+    bool postProcess = false; // runs post_process.comp on the compute queue before the readback
+    PostProcessSettings postProcessSettings;
+    std::optional<uint32_t> deviceIndex; // physical device to open, the highest scoring one when empty
+};
+
+// a physical device headless rendering can run on
+struct DeviceCandidate {
+    uint32_t index = 0; // in vkEnumeratePhysicalDevices order
+    std::string name;
+    VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+    uint32_t score = 0;
+};
+
 class HelloTriangleApplication {
 
 
 public:
+    // framesInFlight is how many frames the CPU can record and submit before it has to wait on the GPU
+    explicit HelloTriangleApplication(uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT);
+
     void run();
 
+    // renders settings.frameCount frames without a window or swap chain, as fast as the GPU takes them.
+    // With an output path every frame is read back and written through imageWriter
+    void runHeadless(const HeadlessSettings &settings, ImageWriter &imageWriter);
+
+    // runHeadless() in steps, so several applications (one per device) can share out the frames.
+    // beginHeadless() opens the device, renderHeadlessFrames() submits count frames numbered from firstImage
+    // without waiting for them, finishHeadless() waits for everything and endHeadless() cleans up
+    void beginHeadless(const HeadlessSettings &settings, ImageWriter &imageWriter);
+
+    void renderHeadlessFrames(uint64_t firstImage, uint32_t count);
+
+    void finishHeadless();
+
+    void endHeadless();
+
+    // every physical device that can render headless, best score first
+    static std::vector<DeviceCandidate> findHeadlessDevices();
+
+    const std::string &getDeviceName() const;
+
+    // doesn't block, frames are numbered from 1 in submission order
+    bool isFrameComplete(uint64_t frame) const;
+
+    // number the next submitted frame will get
+    uint64_t getNextFrame() const;
+
+    // doesn't block, every frame up to this one is done
+    uint64_t getCompletedFrame() const;
+
 private:
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        // a compute only family if there is one, so post-processing can overlap the next frame's render.
+        // Falls back to a second queue of the graphics family, then to the graphics queue itself
+        std::optional<uint32_t> computeFamily;
+        uint32_t computeQueueIndex = 0;
 
         bool isComplete() const {
             return graphicsFamily.has_value() && presentFamily.has_value();
@@ -42,30 +117,60 @@ private:
         }
     };
 
-    GLFWwindow *window;
+    GLFWwindow *window = nullptr;
     VkInstance vulkanInstance;
     VkDebugUtilsMessengerEXT vulkanDebugMessenger;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    std::optional<uint32_t> requestedDeviceIndex; // pickPhysicalDevice() takes this one instead of the best
+    std::string deviceName;
     VkDevice device;
     VkQueue graphicsQueue;
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
     VkQueue presentQueue;
-    VkSwapchainKHR swapChain;
-    std::vector<VkImage> swapChainImages;
+    VkQueue computeQueue = VK_NULL_HANDLE; // only fetched when post-processing
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    std::vector<VkImage> swapChainImages; // headless: offscreen images, one per frame in flight
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     std::vector<VkImageView> swapChainImageViews;
-    VkRenderPass renderPass;
+    RenderGraph renderGraph; // the frame's passes, their render passes, barriers and transient images
+    uint32_t targetImage; // swap chain (or offscreen) image being drawn, imported into renderGraph
+    uint32_t depthImage; // transient, sampled by the occlusion culler between the two scene passes
+    uint32_t scenePass; // what was visible last frame, or everything without occlusion culling
+    VkRenderPass renderPass; // scenePass's, the pipeline is built against it
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet objectDescriptorSet; // binding 0 is the uniform ring, every object of the frame at once
+    UniformRing uniformRing;
+    uint32_t objectsOffset = 0; // dynamic offset of this frame's objects in the ring
+    OcclusionCuller occlusionCuller;
+    bool occlusionCulling = false; // the device has what the culler needs, objects are all drawn without it
+    BindlessTable bindlessTable; // set 1, every image and storage buffer the shaders index by handle
+    BindlessFeatures bindlessFeatures; // what createLogicalDevice() could turn on for it
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
+    PipelineManager pipelineManager;
+    uint32_t graphicsPipeline; // handle into pipelineManager
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
-    std::vector<VkSemaphore> imageAvailableSemaphores;
-    std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    uint32_t currentFrame = 0;
+    std::vector<VkSemaphore> imageAvailableSemaphores; // per frame in flight
+    std::vector<VkSemaphore> renderFinishedSemaphores; // per swap chain image, presentation still needs binary semaphores
+    FrameTimeline frameTimeline;
+    uint32_t framesInFlight;
+    bool headless = false;
+    std::vector<VkDeviceMemory> offscreenImageMemories;
+    FrameReadback frameReadback;
+    bool readbackEnabled = false;
+    PostProcessor postProcessor;
+    bool postProcessing = false;
     bool frameBufferResized = false;
+    bool memoryBudgetEnabled = false; // VK_EXT_memory_budget is optional, without it memory in use isn't reported
+
+    // looked up by createFrameMetrics() once the device is known, the series are labelled with its name
+    Counter *framesCounter = nullptr;
+    Histogram *frameSeconds = nullptr;
+    Histogram *frameWaitSeconds = nullptr;
+    Gauge *deviceMemoryGauge = nullptr;
+    std::chrono::steady_clock::time_point lastFrameSubmitted;
 
     void initWindow();
 
@@ -73,6 +178,8 @@ private:
 
     void initVulkan();
 
+    void initVulkanHeadless();
+
     void mainLoop();
 
     void cleanUp();
@@ -83,7 +190,7 @@ private:
 
     static std::vector<VkExtensionProperties> getVulkanExtensions();
 
-    static std::vector<const char *> getRequiredExtensions();
+    std::vector<const char *> getRequiredExtensions() const;
 
     static bool checkValidationLayerSupport();
 
@@ -107,12 +214,24 @@ private:
 
     bool isDeviceSuitable(VkPhysicalDevice physDevice);
 
-    static bool checkDeviceExtensionSupport(VkPhysicalDevice physDevice);
+    // 0 when the device isn't suitable, otherwise higher is likely faster
+    uint32_t rateDevice(VkPhysicalDevice physDevice);
+
+    bool checkDeviceExtensionSupport(VkPhysicalDevice physDevice) const;
+
+    std::vector<const char *> getDeviceExtensions() const;
 
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physDevice);
 
     void createLogicalDevice();
 
+    void createFrameMetrics();
+
+    // waitSeconds is how long the frame was held up waiting for a free slot
+    void recordFrameMetrics(uint64_t frameNumber, double waitSeconds);
+
+    void updateDeviceMemoryMetric();
+
     void createSurface();
 
     void createSwapChain();
@@ -129,26 +248,44 @@ private:
 
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
 
+    void createOffscreenImages();
+
     void createImageViews();
 
-    void createRenderPass();
+    VkFormat findDepthFormat() const;
+
+    void createRenderGraph();
+
+    void createDescriptorSetLayout();
+
+    void createBindlessTable();
 
     void createGraphicsPipeline();
 
     VkShaderModule createShaderModule(const std::vector<char> &shaderCode);
 
-    void createFramebuffers();
-
     void createCommandPool();
 
     void createCommandBuffers();
 
-    void recordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t imageIndex);
+    // with a readbackBuffer the finished image also gets copied into it
+    void recordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t imageIndex, VkBuffer readbackBuffer = VK_NULL_HANDLE);
+
+    // the frame's camera, shared by the scene and the occlusion culler
+    glm::mat4 getViewProjection() const;
+
+    // phase 0 is scenePass, phase 1 the objects the occlusion culler found revealed after it. Recorded inside their
+    // render passes by the graph
+    void recordScene(VkCommandBuffer cmdBuffer, uint32_t phase);
 
     void drawFrame();
 
+    void drawHeadlessFrame(uint64_t imageNumber);
+
     void createSyncObjects();
 
+    void createRenderFinishedSemaphores();
+
 private:
     struct Vertex {
         glm::vec2 pos;
@@ -196,9 +333,59 @@ private:
             {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
             {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}
     };
+    // vertices welded and reordered for the caches by buildIndexedMesh(), drawn through the index buffer
     VkBuffer vertexBuffer;
+    VkDeviceMemory vertexBufferMemory;
+    VkBuffer indexBuffer;
+    VkDeviceMemory indexBufferMemory;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    uint32_t indexCount = 0;
+    glm::vec4 meshBounds{}; // centre and radius of a sphere around the vertices
+
+    // push constants, std430 layout matches the shaders' Frame block
+    struct FrameConstants {
+        glm::mat4 viewProjection;
+        uint32_t materialBuffer; // bindless handle of the material records
+    };
+
+    // std140, matches the vertex shader's ObjectUniforms
+    struct ObjectUniforms {
+        glm::mat4 model;
+        glm::vec4 tint;
+        uint32_t materialIndex; // into the material records
+        uint32_t padding[3];
+    };
+
+    // every one draws the mesh, object i is drawn as instance i
+    const std::vector<ObjectUniforms> objects = {
+            {glm::mat4(1.0f), glm::vec4(1.0f), 0, {}}
+    };
+
+    // std430, matches the fragment shader's MaterialRecord
+    struct MaterialRecord {
+        glm::vec4 albedo;
+        uint32_t albedoImage; // bindless image handle, BindlessTable::DEFAULT_IMAGE for none
+        uint32_t padding[3];
+    };
+
+    const std::vector<MaterialRecord> materials = {
+            {{1.0f, 1.0f, 1.0f, 1.0f}, BindlessTable::DEFAULT_IMAGE, {}}
+    };
+    VkBuffer materialBuffer;
+    VkDeviceMemory materialBufferMemory;
+    uint32_t materialBufferHandle = 0; // in bindlessTable
+
+    // the vertex and index buffer, in device local memory
+    void createGeometryBuffers();
+
+    // every material's record in one storage buffer, registered with the bindless table
+    void createMaterialBuffer();
+
+    // the ring and the descriptor set that points into it
+    void createUniformRing();
 
-    void createVertexBuffer();
+    // the depth pyramid and culling pipelines, and every object's bounds
+    void createOcclusionCuller();
 };
 
 
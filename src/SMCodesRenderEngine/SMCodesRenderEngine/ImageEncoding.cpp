@@ -0,0 +1,522 @@
+#include "ImageEncoding.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+// #region Constants
+
+const uint8_t PNG_SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+const uint32_t PNG_BYTES_PER_PIXEL = 3;
+
+// deflate, 32K window, default compression
+const uint8_t ZLIB_HEADER[] = {0x78, 0x9C};
+
+const uint32_t EXR_MAGIC = 20000630;
+const uint32_t EXR_VERSION = 2; // single part scanline image
+const uint8_t EXR_ZIP_COMPRESSION = 3;
+const uint32_t EXR_HALF = 1;
+const uint32_t EXR_CHANNEL_COUNT = 3;
+
+// #endregion
+
+// #region Private Methods
+
+static void appendBytes(std::vector<uint8_t> &out, const void *data, size_t size) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+static void appendUInt32BigEndian(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void appendUInt32(std::vector<uint8_t> &out, uint32_t value) {
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static void appendUInt64(std::vector<uint8_t> &out, uint64_t value) {
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static void appendFloat(std::vector<uint8_t> &out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appendUInt32(out, bits);
+}
+
+static void appendString(std::vector<uint8_t> &out, const char *value) {
+    appendBytes(out, value, std::strlen(value) + 1);
+}
+
+static void appendPngChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t size) {
+    appendUInt32BigEndian(out, static_cast<uint32_t>(size));
+    size_t typeStart = out.size();
+    appendBytes(out, type, 4);
+    appendBytes(out, data, size);
+
+    // the crc covers the type and the data, not the length
+    uLong crc = crc32(0L, out.data() + typeStart, static_cast<uInt>(out.size() - typeStart));
+    appendUInt32BigEndian(out, static_cast<uint32_t>(crc));
+}
+
+static void appendExrAttribute(std::vector<uint8_t> &out, const char *name, const char *type,
+                               const std::vector<uint8_t> &value) {
+    appendString(out, name);
+    appendString(out, type);
+    appendUInt32(out, static_cast<uint32_t>(value.size()));
+    appendBytes(out, value.data(), value.size());
+}
+
+static uint8_t linearToSrgb8(float linear) {
+    if (!(linear > 0.0f)) {
+        return 0; // negatives and NaNs
+    }
+    float value = std::min(linear, 1.0f);
+    float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::lround(srgb * 255.0f));
+}
+
+// IEEE 754 single to half precision, rounding to nearest even
+static uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+    if (magnitude >= 0x7F800000u) {
+        // infinity stays infinity, NaN stays a (quiet) NaN
+        return sign | 0x7C00u | (magnitude > 0x7F800000u ? 0x0200u : 0u);
+    }
+    if (magnitude >= 0x477FF000u) {
+        return sign | 0x7C00u; // rounds past the largest half
+    }
+    if (magnitude < 0x38800000u) {
+        // below the smallest normal half, becomes a subnormal or zero
+        if (magnitude < 0x33000000u) {
+            return sign;
+        }
+        uint32_t exponent = magnitude >> 23;
+        uint32_t mantissa = (magnitude & 0x007FFFFFu) | 0x00800000u;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+            half++;
+        }
+        return sign | static_cast<uint16_t>(half);
+    }
+
+    // rebias the exponent from 127 to 15 and drop 13 bits of mantissa
+    uint32_t half = (magnitude - 0x38000000u) >> 13;
+    uint32_t remainder = magnitude & 0x1FFFu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+        half++;
+    }
+    return sign | static_cast<uint16_t>(half);
+}
+
+static uint8_t paethPredictor(int left, int up, int upLeft) {
+    int estimate = left + up - upLeft;
+    int distanceLeft = std::abs(estimate - left);
+    int distanceUp = std::abs(estimate - up);
+    int distanceUpLeft = std::abs(estimate - upLeft);
+    if (distanceLeft <= distanceUp && distanceLeft <= distanceUpLeft) {
+        return static_cast<uint8_t>(left);
+    }
+    return static_cast<uint8_t>(distanceUp <= distanceUpLeft ? up : upLeft);
+}
+
+// applies PNG filter type to row, previous is nullptr for the first row of a band
+static void filterPngRow(uint8_t type, const uint8_t *row, const uint8_t *previous, size_t size, uint8_t *out) {
+    for (size_t i = 0; i < size; i++) {
+        int left = i >= PNG_BYTES_PER_PIXEL ? row[i - PNG_BYTES_PER_PIXEL] : 0;
+        int up = previous != nullptr ? previous[i] : 0;
+        int upLeft = previous != nullptr && i >= PNG_BYTES_PER_PIXEL ? previous[i - PNG_BYTES_PER_PIXEL] : 0;
+
+        int predicted = 0;
+        switch (type) {
+            case 1:
+                predicted = left;
+                break;
+            case 2:
+                predicted = up;
+                break;
+            case 3:
+                predicted = (left + up) / 2;
+                break;
+            case 4:
+                predicted = paethPredictor(left, up, upLeft);
+                break;
+            default:
+                break;
+        }
+        out[i] = static_cast<uint8_t>(row[i] - predicted);
+    }
+}
+
+static uint32_t readUInt32BigEndian(const uint8_t *bytes) {
+    return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+           (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+}
+
+// undoes filterPngRow in place, previous is nullptr for the first row
+static void unfilterPngRow(uint8_t type, uint8_t *row, const uint8_t *previous, size_t size, size_t pixelSize) {
+    for (size_t i = 0; i < size; i++) {
+        int left = i >= pixelSize ? row[i - pixelSize] : 0;
+        int up = previous != nullptr ? previous[i] : 0;
+        int upLeft = previous != nullptr && i >= pixelSize ? previous[i - pixelSize] : 0;
+
+        int predicted = 0;
+        switch (type) {
+            case 0:
+                break;
+            case 1:
+                predicted = left;
+                break;
+            case 2:
+                predicted = up;
+                break;
+            case 3:
+                predicted = (left + up) / 2;
+                break;
+            case 4:
+                predicted = paethPredictor(left, up, upLeft);
+                break;
+            default:
+                throw std::runtime_error("PNG row has an unknown filter type!");
+        }
+        row[i] = static_cast<uint8_t>(row[i] + predicted);
+    }
+}
+
+static EncodedBand encodePngBand(const float *pixels, uint32_t pixelStride, uint32_t width, uint32_t height,
+                                 uint32_t firstRow, uint32_t rowCount) {
+    size_t rowSize = static_cast<size_t>(width) * PNG_BYTES_PER_PIXEL;
+    std::vector<uint8_t> srgb(rowSize * rowCount);
+    for (size_t i = 0; i < static_cast<size_t>(width) * rowCount; i++) {
+        const float *pixel = pixels + i * pixelStride;
+        srgb[i * 3 + 0] = linearToSrgb8(pixel[0]);
+        srgb[i * 3 + 1] = linearToSrgb8(pixel[1]);
+        srgb[i * 3 + 2] = linearToSrgb8(pixel[2]);
+    }
+
+    // every row gets whichever filter leaves the smallest sum of absolute (signed) bytes, the usual heuristic
+    std::vector<uint8_t> filtered((rowSize + 1) * rowCount);
+    std::vector<uint8_t> candidate(rowSize);
+    for (uint32_t row = 0; row < rowCount; row++) {
+        const uint8_t *current = &srgb[row * rowSize];
+        const uint8_t *previous = row > 0 ? &srgb[(row - 1) * rowSize] : nullptr;
+        uint8_t *out = &filtered[row * (rowSize + 1)];
+
+        uint64_t bestCost = UINT64_MAX;
+        uint8_t filterCount = previous != nullptr ? 5 : 2; // up, average and paeth need the row above
+        for (uint8_t type = 0; type < filterCount; type++) {
+            filterPngRow(type, current, previous, rowSize, candidate.data());
+            uint64_t cost = 0;
+            for (uint8_t value: candidate) {
+                cost += static_cast<uint64_t>(std::abs(static_cast<int>(static_cast<int8_t>(value))));
+            }
+            if (cost < bestCost) {
+                bestCost = cost;
+                out[0] = type;
+                std::memcpy(out + 1, candidate.data(), rowSize);
+            }
+        }
+    }
+
+    EncodedBand band;
+    band.rawSize = filtered.size();
+    band.adler = static_cast<uint32_t>(adler32(1L, filtered.data(), static_cast<uInt>(filtered.size())));
+
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("failed to start deflate!");
+    }
+    // sync flush leaves the stream byte aligned and open for the next band, only the last band finishes it
+    bool lastBand = firstRow + rowCount == height;
+    band.bytes.resize(deflateBound(&stream, static_cast<uLong>(filtered.size())) + 16);
+    stream.next_in = filtered.data();
+    stream.avail_in = static_cast<uInt>(filtered.size());
+    stream.next_out = band.bytes.data();
+    stream.avail_out = static_cast<uInt>(band.bytes.size());
+    int result = deflate(&stream, lastBand ? Z_FINISH : Z_SYNC_FLUSH);
+    band.bytes.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (result != (lastBand ? Z_STREAM_END : Z_OK) || stream.avail_in != 0) {
+        throw std::runtime_error("failed to deflate PNG band!");
+    }
+    return band;
+}
+
+// one ZIP block of up to 16 scanlines, chunk header included
+static void encodeExrBlock(const float *pixels, uint32_t pixelStride, uint32_t width, uint32_t firstRow,
+                           uint32_t rowCount, std::vector<uint8_t> &raw, std::vector<uint8_t> &predicted,
+                           EncodedBand &band) {
+    // per scanline every channel in turn, in alphabetical order (B, G, R)
+    size_t lineHalfs = static_cast<size_t>(width) * EXR_CHANNEL_COUNT;
+    raw.resize(lineHalfs * rowCount * sizeof(uint16_t));
+    uint8_t *out = raw.data();
+    for (uint32_t row = 0; row < rowCount; row++) {
+        const float *line = pixels + static_cast<size_t>(row) * width * pixelStride;
+        for (int channel = 2; channel >= 0; channel--) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint16_t half = floatToHalf(line[x * pixelStride + channel]);
+                *out++ = static_cast<uint8_t>(half);
+                *out++ = static_cast<uint8_t>(half >> 8);
+            }
+        }
+    }
+
+    // ZIP preprocessing: low bytes then high bytes, then each byte stored as the difference to the one before
+    predicted.resize(raw.size());
+    size_t halfSize = (raw.size() + 1) / 2;
+    for (size_t i = 0; i < raw.size(); i++) {
+        predicted[(i & 1) == 0 ? i / 2 : halfSize + i / 2] = raw[i];
+    }
+    for (size_t i = predicted.size() - 1; i > 0; i--) {
+        predicted[i] = static_cast<uint8_t>(predicted[i] - predicted[i - 1] + 128);
+    }
+
+    uLongf compressedSize = compressBound(static_cast<uLong>(predicted.size()));
+    size_t chunkStart = band.bytes.size();
+    band.bytes.resize(chunkStart + 8 + compressedSize);
+    if (compress(band.bytes.data() + chunkStart + 8, &compressedSize, predicted.data(),
+                 static_cast<uLong>(predicted.size())) != Z_OK) {
+        throw std::runtime_error("failed to compress EXR block!");
+    }
+
+    // a block that doesn't get smaller is stored as is
+    size_t dataSize = compressedSize;
+    if (compressedSize >= raw.size()) {
+        dataSize = raw.size();
+        std::memcpy(band.bytes.data() + chunkStart + 8, raw.data(), raw.size());
+    }
+    band.bytes.resize(chunkStart + 8 + dataSize);
+
+    std::vector<uint8_t> header;
+    appendUInt32(header, firstRow);
+    appendUInt32(header, static_cast<uint32_t>(dataSize));
+    std::memcpy(band.bytes.data() + chunkStart, header.data(), header.size());
+    band.chunkSizes.push_back(static_cast<uint32_t>(8 + dataSize));
+}
+
+static EncodedBand encodeExrBand(const float *pixels, uint32_t pixelStride, uint32_t width, uint32_t firstRow,
+                                 uint32_t rowCount) {
+    if (firstRow % EXR_LINES_PER_BLOCK != 0) {
+        throw std::runtime_error("EXR bands have to start on a 16 scanline block!");
+    }
+
+    EncodedBand band;
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> predicted;
+    for (uint32_t row = 0; row < rowCount; row += EXR_LINES_PER_BLOCK) {
+        encodeExrBlock(pixels + static_cast<size_t>(row) * width * pixelStride, pixelStride, width, firstRow + row,
+                       std::min(EXR_LINES_PER_BLOCK, rowCount - row), raw, predicted, band);
+    }
+    return band;
+}
+
+static std::vector<uint8_t> encodePngHeader(uint32_t width, uint32_t height) {
+    std::vector<uint8_t> header(std::begin(PNG_SIGNATURE), std::end(PNG_SIGNATURE));
+
+    std::vector<uint8_t> imageHeader;
+    appendUInt32BigEndian(imageHeader, width);
+    appendUInt32BigEndian(imageHeader, height);
+    imageHeader.push_back(8); // bits per channel
+    imageHeader.push_back(2); // RGB
+    imageHeader.push_back(0); // deflate
+    imageHeader.push_back(0); // adaptive filtering
+    imageHeader.push_back(0); // not interlaced
+    appendPngChunk(header, "IHDR", imageHeader.data(), imageHeader.size());
+    return header;
+}
+
+static std::vector<uint8_t> encodeExrHeader(uint32_t width, uint32_t height) {
+    std::vector<uint8_t> header;
+    appendUInt32(header, EXR_MAGIC);
+    appendUInt32(header, EXR_VERSION);
+
+    std::vector<uint8_t> channels;
+    for (const char *name: {"B", "G", "R"}) {
+        appendString(channels, name);
+        appendUInt32(channels, EXR_HALF);
+        appendUInt32(channels, 0); // pLinear and reserved
+        appendUInt32(channels, 1); // x sampling
+        appendUInt32(channels, 1); // y sampling
+    }
+    channels.push_back(0);
+    appendExrAttribute(header, "channels", "chlist", channels);
+
+    appendExrAttribute(header, "compression", "compression", {EXR_ZIP_COMPRESSION});
+
+    std::vector<uint8_t> window;
+    appendUInt32(window, 0);
+    appendUInt32(window, 0);
+    appendUInt32(window, width - 1);
+    appendUInt32(window, height - 1);
+    appendExrAttribute(header, "dataWindow", "box2i", window);
+    appendExrAttribute(header, "displayWindow", "box2i", window);
+
+    appendExrAttribute(header, "lineOrder", "lineOrder", {0}); // increasing y
+
+    std::vector<uint8_t> one;
+    appendFloat(one, 1.0f);
+    appendExrAttribute(header, "pixelAspectRatio", "float", one);
+
+    std::vector<uint8_t> centre;
+    appendFloat(centre, 0.0f);
+    appendFloat(centre, 0.0f);
+    appendExrAttribute(header, "screenWindowCenter", "v2f", centre);
+    appendExrAttribute(header, "screenWindowWidth", "float", one);
+
+    header.push_back(0); // end of header
+    return header;
+}
+
+// #endregion
+
+// #region Public Methods
+
+ImageFormat getImageFormat(const std::string &path) {
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char character) { return static_cast<char>(std::tolower(character)); });
+    if (extension == "png") {
+        return ImageFormat::Png;
+    }
+    if (extension == "exr") {
+        return ImageFormat::OpenExr;
+    }
+    throw std::runtime_error("Unsupported image format: " + path);
+}
+
+std::vector<uint8_t> encodeImageHeader(ImageFormat format, uint32_t width, uint32_t height) {
+    return format == ImageFormat::Png ? encodePngHeader(width, height) : encodeExrHeader(width, height);
+}
+
+EncodedBand encodeImageBand(ImageFormat format, const float *pixels, uint32_t pixelStride, uint32_t width,
+                            uint32_t height, uint32_t firstRow, uint32_t rowCount) {
+    if (format == ImageFormat::Png) {
+        return encodePngBand(pixels, pixelStride, width, height, firstRow, rowCount);
+    }
+    return encodeExrBand(pixels, pixelStride, width, firstRow, rowCount);
+}
+
+std::vector<uint8_t> encodePngData(const EncodedBand &band, bool firstBand) {
+    std::vector<uint8_t> data;
+    if (firstBand) {
+        data.assign(std::begin(ZLIB_HEADER), std::end(ZLIB_HEADER));
+    }
+    appendBytes(data, band.bytes.data(), band.bytes.size());
+
+    std::vector<uint8_t> chunk;
+    appendPngChunk(chunk, "IDAT", data.data(), data.size());
+    return chunk;
+}
+
+std::vector<uint8_t> encodePngEnd(uint32_t adler) {
+    std::vector<uint8_t> checksum;
+    appendUInt32BigEndian(checksum, adler);
+
+    std::vector<uint8_t> end;
+    appendPngChunk(end, "IDAT", checksum.data(), checksum.size());
+    appendPngChunk(end, "IEND", nullptr, 0);
+    return end;
+}
+
+uint32_t combinePngAdler(uint32_t adler, const EncodedBand &band) {
+    return static_cast<uint32_t>(adler32_combine(adler, band.adler, static_cast<z_off_t>(band.rawSize)));
+}
+
+uint32_t getExrChunkCount(uint32_t height) {
+    return (height + EXR_LINES_PER_BLOCK - 1) / EXR_LINES_PER_BLOCK;
+}
+
+std::vector<uint8_t> encodeExrOffsetTable(const std::vector<uint64_t> &offsets) {
+    std::vector<uint8_t> table;
+    for (uint64_t offset: offsets) {
+        appendUInt64(table, offset);
+    }
+    return table;
+}
+
+std::vector<uint8_t> decodePng(const std::vector<uint8_t> &bytes, uint32_t &width, uint32_t &height) {
+    if (bytes.size() < sizeof(PNG_SIGNATURE) || std::memcmp(bytes.data(), PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) != 0) {
+        throw std::runtime_error("not a PNG file!");
+    }
+
+    uint8_t colourType = 0;
+    std::vector<uint8_t> compressed;
+    width = 0;
+    height = 0;
+    for (size_t offset = sizeof(PNG_SIGNATURE); offset + 12 <= bytes.size();) {
+        uint32_t length = readUInt32BigEndian(&bytes[offset]);
+        const uint8_t *type = &bytes[offset + 4];
+        const uint8_t *data = &bytes[offset + 8];
+        if (length > bytes.size() - offset - 12) {
+            throw std::runtime_error("PNG chunk runs past the end of the file!");
+        }
+
+        if (std::memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+            width = readUInt32BigEndian(data);
+            height = readUInt32BigEndian(data + 4);
+            colourType = data[9];
+            // 8 bit grey, RGB, grey + alpha or RGBA without interlacing, which is what image tools write by default
+            bool supported = data[8] == 8 && (colourType == 0 || colourType == 2 || colourType == 4 ||
+                                              colourType == 6) && data[12] == 0;
+            if (!supported) {
+                throw std::runtime_error("only 8 bit, non interlaced, non palette PNGs are supported!");
+            }
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            compressed.insert(compressed.end(), data, data + length);
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+        offset += 12 + static_cast<size_t>(length);
+    }
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("PNG has no image header!");
+    }
+
+    size_t channels = colourType == 0 ? 1 : colourType == 4 ? 2 : colourType == 2 ? 3 : 4;
+    size_t rowSize = static_cast<size_t>(width) * channels;
+    std::vector<uint8_t> filtered((rowSize + 1) * height);
+    uLongf filteredSize = static_cast<uLongf>(filtered.size());
+    if (uncompress(filtered.data(), &filteredSize, compressed.data(), static_cast<uLong>(compressed.size())) != Z_OK ||
+        filteredSize != filtered.size()) {
+        throw std::runtime_error("failed to inflate PNG data!");
+    }
+
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *row = &filtered[y * (rowSize + 1) + 1];
+        const uint8_t *previous = y > 0 ? &filtered[(y - 1) * (rowSize + 1) + 1] : nullptr;
+        unfilterPngRow(row[-1], row, previous, rowSize, channels);
+
+        for (uint32_t x = 0; x < width; x++) {
+            const uint8_t *in = &row[x * channels];
+            uint8_t *out = &rgba[(static_cast<size_t>(y) * width + x) * 4];
+            bool grey = channels < 3;
+            out[0] = in[0];
+            out[1] = grey ? in[0] : in[1];
+            out[2] = grey ? in[0] : in[2];
+            out[3] = channels == 2 ? in[1] : channels == 4 ? in[3] : 255;
+        }
+    }
+    return rgba;
+}
+
+// #endregion
@@ -0,0 +1,67 @@
+#ifndef SMCODESRENDERENGINE_IMAGEENCODING_H
+#define SMCODESRENDERENGINE_IMAGEENCODING_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Encoders for the image formats the renderer writes (Idea.md step 5). Images are encoded in bands of rows
+// that don't depend on each other, so every band can be compressed on a different thread and written
+// out in order as soon as it is ready.
+//  - PNG: 8 bit sRGB. Every band is its own deflate block ending on a byte boundary (a sync flush),
+//    so the bands just get concatenated into one zlib stream, with their adler32s combined at the end.
+//    The first row of a band can't be filtered against the band above
+//  - OpenEXR: half float linear RGB, ZIP compressed in blocks of 16 scanlines. Chunk offsets come before
+//    the chunks in the file, so that table gets space reserved and is filled in once the last band is written
+
+enum class ImageFormat {
+    Png,
+    OpenExr
+};
+
+// EXR ZIP compression works on blocks of 16 scanlines, bands have to be cut on block boundaries
+const uint32_t EXR_LINES_PER_BLOCK = 16;
+
+struct EncodedBand {
+    std::vector<uint8_t> bytes;
+
+    // PNG: adler32 and length of the uncompressed (filtered) rows, to combine into the stream's checksum
+    uint32_t adler = 1;
+    size_t rawSize = 0;
+
+    // EXR: size of every chunk in bytes, header included, for the offset table
+    std::vector<uint32_t> chunkSizes;
+};
+
+// from the file extension (.png or .exr), throws for anything else
+ImageFormat getImageFormat(const std::string &path);
+
+// everything before the first band: PNG signature and IHDR, or the EXR header
+std::vector<uint8_t> encodeImageHeader(ImageFormat format, uint32_t width, uint32_t height);
+
+// rows [firstRow, firstRow + rowCount) of a width wide image of linear RGB pixels, pixels points at firstRow.
+// Pixels are pixelStride floats apart, RGB first: 3 for glm::vec3, 4 for RGBA straight from a GPU readback
+EncodedBand encodeImageBand(ImageFormat format, const float *pixels, uint32_t pixelStride, uint32_t width,
+                            uint32_t height, uint32_t firstRow, uint32_t rowCount);
+
+// PNG: wraps band bytes in an IDAT chunk, the first one also starts the zlib stream
+std::vector<uint8_t> encodePngData(const EncodedBand &band, bool firstBand);
+
+// PNG: adler32 of the whole stream and IEND
+std::vector<uint8_t> encodePngEnd(uint32_t adler);
+
+// combines the running adler32 of the stream with the next band's
+uint32_t combinePngAdler(uint32_t adler, const EncodedBand &band);
+
+// EXR: one 64 bit offset per chunk, reserved up front and rewritten at the end
+uint32_t getExrChunkCount(uint32_t height);
+
+std::vector<uint8_t> encodeExrOffsetTable(const std::vector<uint64_t> &offsets);
+
+// The one decoder, for importing textures: an 8 bit PNG (grey, RGB or either with alpha) as RGBA8 rows,
+// top row first. Throws for anything it can't read
+std::vector<uint8_t> decodePng(const std::vector<uint8_t> &bytes, uint32_t &width, uint32_t &height);
+
+
+#endif //SMCODESRENDERENGINE_IMAGEENCODING_H
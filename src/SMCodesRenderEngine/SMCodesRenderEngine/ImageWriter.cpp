@@ -0,0 +1,309 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "AccumulationBuffer.h"
+
+// #region Private Methods
+
+uint32_t ImageWriter::getBandCount(const Image &image) const {
+    return (image.height + settings.bandHeight - 1) / settings.bandHeight;
+}
+
+void ImageWriter::rethrowError() {
+    if (firstException) {
+        std::rethrow_exception(std::exchange(firstException, nullptr));
+    }
+}
+
+void ImageWriter::encoderLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+            return;
+        }
+
+        BandJob job = jobs.front();
+        jobs.pop_front();
+        lock.unlock();
+        encodeBand(job);
+        lock.lock();
+    }
+}
+
+void ImageWriter::encodeBand(const BandJob &job) {
+    Image &image = *job.image;
+    uint32_t firstRow = job.band * settings.bandHeight;
+    uint32_t rowCount = std::min(settings.bandHeight, image.height - firstRow);
+
+    EncodedBand encoded;
+    std::exception_ptr error;
+    try {
+        const float *pixels = image.borrowedPixels != nullptr ? image.borrowedPixels
+                                                              : reinterpret_cast<const float *>(image.pixels.data());
+        pixels += static_cast<size_t>(firstRow) * image.width * image.pixelStride;
+        encoded = encodeImageBand(image.format, pixels, image.pixelStride, image.width, image.height, firstRow,
+                                  rowCount);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    bool imageDone;
+    {
+        std::lock_guard<std::mutex> writeLock(image.writeMutex);
+        if (!error && !image.failed) {
+            image.encodedBands[job.band] = std::move(encoded);
+            image.bandsEncoded[job.band] = true;
+            try {
+                writeReadyBands(image);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        if (error) {
+            image.failed = true;
+            image.file.close();
+        }
+
+        // the last band in also writes every band still waiting on it, so the file is complete
+        image.bandsFinished++;
+        imageDone = image.bandsFinished == getBandCount(image);
+    }
+
+    if (imageDone && image.release) {
+        image.release();
+    }
+    if (error || imageDone) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error && !firstException) {
+            firstException = error;
+        }
+        if (imageDone) {
+            images.erase(image.id);
+        }
+    }
+    if (error || imageDone) {
+        imageCondition.notify_all();
+    }
+}
+
+void ImageWriter::writeReadyBands(Image &image) {
+    uint32_t bandCount = getBandCount(image);
+    while (image.nextBandToWrite < bandCount && image.bandsEncoded[image.nextBandToWrite]) {
+        EncodedBand &band = image.encodedBands[image.nextBandToWrite];
+
+        if (image.format == ImageFormat::Png) {
+            bool firstBand = image.nextBandToWrite == 0;
+            std::vector<uint8_t> chunk = encodePngData(band, firstBand);
+            image.file.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+            image.adler = firstBand ? band.adler : combinePngAdler(image.adler, band);
+        } else {
+            auto offset = static_cast<uint64_t>(image.file.tellp());
+            for (uint32_t chunkSize: band.chunkSizes) {
+                image.chunkOffsets.push_back(offset);
+                offset += chunkSize;
+            }
+            image.file.write(reinterpret_cast<const char *>(band.bytes.data()),
+                             static_cast<std::streamsize>(band.bytes.size()));
+        }
+
+        band = EncodedBand();
+        image.nextBandToWrite++;
+    }
+
+    if (image.nextBandToWrite == bandCount) {
+        if (image.format == ImageFormat::Png) {
+            std::vector<uint8_t> end = encodePngEnd(image.adler);
+            image.file.write(reinterpret_cast<const char *>(end.data()), static_cast<std::streamsize>(end.size()));
+        } else {
+            std::vector<uint8_t> table = encodeExrOffsetTable(image.chunkOffsets);
+            image.file.seekp(image.offsetTablePosition);
+            image.file.write(reinterpret_cast<const char *>(table.data()), static_cast<std::streamsize>(table.size()));
+        }
+        image.file.close();
+    }
+
+    if (image.file.fail()) {
+        throw std::runtime_error("Failed to write image: " + image.path);
+    }
+}
+
+std::unique_ptr<ImageWriter::Image> ImageWriter::createImage(const std::string &path, uint32_t width,
+                                                            uint32_t height) const {
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("Can't write an empty image: " + path);
+    }
+
+    auto image = std::make_unique<Image>();
+    image->path = path;
+    image->format = getImageFormat(path);
+    image->width = width;
+    image->height = height;
+
+    uint32_t bandCount = getBandCount(*image);
+    image->encodedBands.resize(bandCount);
+    image->bandsEncoded.assign(bandCount, false);
+    image->bandPixelsMissing.resize(bandCount);
+    for (uint32_t band = 0; band < bandCount; band++) {
+        uint32_t rows = std::min(settings.bandHeight, height - band * settings.bandHeight);
+        image->bandPixelsMissing[band] = rows * width;
+    }
+    return image;
+}
+
+uint32_t ImageWriter::addImage(std::unique_ptr<Image> image) {
+    const std::string &path = image->path;
+    uint32_t width = image->width;
+    uint32_t height = image->height;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    imageCondition.wait(lock, [this] { return images.size() < settings.maxImagesInFlight || firstException; });
+    rethrowError();
+
+    image->file.open(path, std::ios::binary | std::ios::trunc);
+    if (!image->file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    std::vector<uint8_t> header = encodeImageHeader(image->format, width, height);
+    image->file.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+    if (image->format == ImageFormat::OpenExr) {
+        // space for the offset table, filled in once every chunk has been written
+        image->offsetTablePosition = image->file.tellp();
+        std::vector<uint8_t> placeholder(getExrChunkCount(height) * sizeof(uint64_t), 0);
+        image->file.write(reinterpret_cast<const char *>(placeholder.data()),
+                          static_cast<std::streamsize>(placeholder.size()));
+    }
+
+    image->id = nextImageId++;
+    uint32_t imageId = image->id;
+    images[imageId] = std::move(image);
+    return imageId;
+}
+
+// #endregion
+
+// #region Public Methods
+
+ImageWriter::ImageWriter(const ImageWriterSettings &settings) : settings(settings) {
+    // whole EXR blocks per band, PNG doesn't mind
+    uint32_t blocks = std::max(1u, (settings.bandHeight + EXR_LINES_PER_BLOCK - 1) / EXR_LINES_PER_BLOCK);
+    this->settings.bandHeight = blocks * EXR_LINES_PER_BLOCK;
+
+    for (uint32_t i = 0; i < std::max(1u, settings.threadCount); i++) {
+        threads.emplace_back(&ImageWriter::encoderLoop, this);
+    }
+}
+
+ImageWriter::~ImageWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    // queued bands still get encoded and written before the threads exit
+    jobCondition.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
+
+uint32_t ImageWriter::beginImage(const std::string &path, uint32_t width, uint32_t height) {
+    std::unique_ptr<Image> image = createImage(path, width, height);
+    image->pixels.resize(static_cast<size_t>(width) * height);
+    return addImage(std::move(image));
+}
+
+void ImageWriter::submitRegion(uint32_t imageId, const ImageRegion &region, const glm::vec3 *pixels) {
+    Image *image;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = images.find(imageId);
+        if (it == images.end()) {
+            throw std::runtime_error("Image " + std::to_string(imageId) + " is not being written");
+        }
+        image = it->second.get();
+    }
+    if (image->borrowedPixels != nullptr) {
+        throw std::runtime_error("Image " + image->path + " already has all of its pixels");
+    }
+    if (region.x + region.width > image->width || region.y + region.height > image->height) {
+        throw std::runtime_error("Region is outside of image " + image->path);
+    }
+
+    // regions never overlap, so the copy doesn't need the lock
+    for (uint32_t y = 0; y < region.height; y++) {
+        std::copy(pixels + static_cast<size_t>(y) * region.width, pixels + static_cast<size_t>(y + 1) * region.width,
+                  image->pixels.begin() + static_cast<size_t>(region.y + y) * image->width + region.x);
+    }
+
+    uint32_t firstBand = region.y / settings.bandHeight;
+    uint32_t lastBand = (region.y + region.height - 1) / settings.bandHeight;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint32_t band = firstBand; band <= lastBand; band++) {
+            uint32_t bandStart = std::max(region.y, band * settings.bandHeight);
+            uint32_t bandEnd = std::min(region.y + region.height, (band + 1) * settings.bandHeight);
+            uint32_t pixelCount = (bandEnd - bandStart) * region.width;
+            if (pixelCount > image->bandPixelsMissing[band]) {
+                throw std::runtime_error("Region was submitted twice to image " + image->path);
+            }
+
+            image->bandPixelsMissing[band] -= pixelCount;
+            if (image->bandPixelsMissing[band] == 0) {
+                jobs.push_back(BandJob{image, band});
+            }
+        }
+    }
+    jobCondition.notify_all();
+}
+
+void ImageWriter::writeImage(const std::string &path, uint32_t width, uint32_t height,
+                             const std::vector<glm::vec3> &pixels) {
+    if (pixels.size() != static_cast<size_t>(width) * height) {
+        throw std::runtime_error("Pixel count doesn't match the size of image " + path);
+    }
+    uint32_t imageId = beginImage(path, width, height);
+    submitRegion(imageId, ImageRegion{0, 0, width, height}, pixels.data());
+}
+
+void ImageWriter::writeImage(const std::string &path, const AccumulationBuffer &accumulation) {
+    std::vector<glm::vec3> pixels(static_cast<size_t>(accumulation.width) * accumulation.height);
+    for (uint32_t i = 0; i < static_cast<uint32_t>(pixels.size()); i++) {
+        pixels[i] = accumulation.getPixel(i);
+    }
+    writeImage(path, accumulation.width, accumulation.height, pixels);
+}
+
+void ImageWriter::writeImage(const std::string &path, uint32_t width, uint32_t height, const float *pixels,
+                             uint32_t pixelStride, std::function<void()> release) {
+    if (pixelStride < 3) {
+        throw std::runtime_error("Pixels need at least RGB for image " + path);
+    }
+    std::unique_ptr<Image> image = createImage(path, width, height);
+    image->borrowedPixels = pixels;
+    image->pixelStride = pixelStride;
+    image->release = std::move(release);
+    std::fill(image->bandPixelsMissing.begin(), image->bandPixelsMissing.end(), 0);
+
+    Image *borrowed = image.get();
+    uint32_t bandCount = getBandCount(*borrowed);
+    addImage(std::move(image));
+    {
+        // every band is ready straight away, the image can't finish (and be erased) before they are all queued
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint32_t band = 0; band < bandCount; band++) {
+            jobs.push_back(BandJob{borrowed, band});
+        }
+    }
+    jobCondition.notify_all();
+}
+
+void ImageWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    imageCondition.wait(lock, [this] { return images.empty() || firstException; });
+    rethrowError();
+}
+
+// #endregion
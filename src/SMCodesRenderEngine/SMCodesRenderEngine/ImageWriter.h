@@ -0,0 +1,130 @@
+#ifndef SMCODESRENDERENGINE_IMAGEWRITER_H
+#define SMCODESRENDERENGINE_IMAGEWRITER_H
+
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ImageEncoding.h"
+#include "RenderSettings.h"
+
+struct AccumulationBuffer;
+
+struct ImageWriterSettings {
+    uint32_t threadCount = 2; // encoder threads, kept low so they don't take much from the renderer
+    uint32_t maxImagesInFlight = 2; // beginImage() blocks once this many are still being encoded
+    uint32_t bandHeight = 64; // rows compressed together, rounded up to a whole EXR block
+};
+
+// Output stage for finished renders (Idea.md step 5, "screenshots"). The renderer hands over whole frames
+// or finished regions and carries on, encoder threads compress every band of rows as soon as all of its
+// pixels have arrived, and the bands get streamed to disk in order as they complete.
+// The queue is bounded by images rather than bands, so a renderer that outruns the encoders waits
+// instead of piling up frames in memory
+class ImageWriter {
+public:
+    explicit ImageWriter(const ImageWriterSettings &settings = ImageWriterSettings());
+
+    // finishes every image still in flight
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter &) = delete;
+
+    ImageWriter &operator=(const ImageWriter &) = delete;
+
+    // starts a width x height image at path, .png or .exr. Returns the id to submit regions to
+    uint32_t beginImage(const std::string &path, uint32_t width, uint32_t height);
+
+    // copies in a finished region of linear RGB pixels, region.width * region.height of them.
+    // Every pixel of the image has to be submitted exactly once
+    void submitRegion(uint32_t imageId, const ImageRegion &region, const glm::vec3 *pixels);
+
+    // a whole frame at once
+    void writeImage(const std::string &path, uint32_t width, uint32_t height, const std::vector<glm::vec3> &pixels);
+
+    // the averaged radiance of accumulation as a whole frame
+    void writeImage(const std::string &path, const AccumulationBuffer &accumulation);
+
+    // a whole frame without copying it, pixels are pixelStride floats apart with RGB first.
+    // pixels has to stay valid until release gets called, from an encoder thread once the last band is done
+    // with it (written or not). If this throws, release won't be called and the caller keeps the pixels
+    void writeImage(const std::string &path, uint32_t width, uint32_t height, const float *pixels,
+                    uint32_t pixelStride, std::function<void()> release);
+
+    // blocks until everything submitted so far is on disk, rethrows the first encoding or write error
+    void flush();
+
+private:
+    struct Image {
+        uint32_t id = 0;
+        std::string path;
+        ImageFormat format;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<glm::vec3> pixels;
+        const float *borrowedPixels = nullptr; // encoded in place of pixels when set
+        uint32_t pixelStride = 3;
+        std::function<void()> release; // gives borrowedPixels back
+        std::vector<uint32_t> bandPixelsMissing; // band gets queued for encoding when this reaches 0
+        std::vector<EncodedBand> encodedBands;
+        std::vector<bool> bandsEncoded;
+
+        // only touched by whichever encoder thread holds writeMutex
+        std::mutex writeMutex;
+        std::ofstream file;
+        uint32_t nextBandToWrite = 0;
+        uint32_t bandsFinished = 0; // encoded and written, or dropped after a failure
+        bool failed = false;
+        uint32_t adler = 1; // PNG
+        std::vector<uint64_t> chunkOffsets; // EXR
+        std::streampos offsetTablePosition; // EXR
+    };
+
+    struct BandJob {
+        Image *image;
+        uint32_t band;
+    };
+
+    ImageWriterSettings settings;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable jobCondition;
+    std::condition_variable imageCondition; // an image finished, or something failed
+    std::deque<BandJob> jobs;
+    std::map<uint32_t, std::unique_ptr<Image>> images;
+    uint32_t nextImageId = 0;
+    bool stopping = false;
+    std::exception_ptr firstException;
+
+    // an image with its bands set up but no pixels or file yet
+    std::unique_ptr<Image> createImage(const std::string &path, uint32_t width, uint32_t height) const;
+
+    // waits for room, opens the file and writes everything before the first band
+    uint32_t addImage(std::unique_ptr<Image> image);
+
+    void encoderLoop();
+
+    void encodeBand(const BandJob &job);
+
+    // writes every band from nextBandToWrite on that is ready, closes the file after the last one
+    void writeReadyBands(Image &image);
+
+    uint32_t getBandCount(const Image &image) const;
+
+    void rethrowError();
+};
+
+
+#endif //SMCODESRENDERENGINE_IMAGEWRITER_H
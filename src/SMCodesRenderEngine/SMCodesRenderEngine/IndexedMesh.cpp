@@ -0,0 +1,262 @@
+#include "IndexedMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// #region Constants
+
+// the cache the triangle order is tuned for, bigger than most real ones so the order degrades gently on them
+const uint32_t MODELLED_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+// vertices of the triangle just drawn, lower than the next few slots so strips don't double back on themselves
+const float LAST_TRIANGLE_SCORE = 0.75f;
+// pushes for vertices with few triangles left, so none get left behind to be shaded again later
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// #endregion
+
+// #region Private Methods
+
+// FNV-1a
+static uint64_t hashBytes(const uint8_t *bytes, uint32_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// numbers the distinct vertices in the order they first turn up, remap takes every vertex to its distinct one and
+// firstVertices every distinct one back to where it first turned up
+static void weldVertices(const uint8_t *vertices, uint32_t vertexCount, uint32_t vertexSize,
+                         std::vector<uint32_t> &remap, std::vector<uint32_t> &firstVertices) {
+    // open addressing at under half full, entries are the first vertex with those bytes
+    size_t tableSize = 16;
+    while (tableSize < static_cast<size_t>(vertexCount) * 2) {
+        tableSize *= 2;
+    }
+    std::vector<uint32_t> table(tableSize, UINT32_MAX);
+
+    remap.assign(vertexCount, UINT32_MAX);
+    firstVertices.clear();
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        const uint8_t *vertex = vertices + static_cast<size_t>(i) * vertexSize;
+        size_t slot = hashBytes(vertex, vertexSize) & (tableSize - 1);
+        while (table[slot] != UINT32_MAX) {
+            if (std::memcmp(vertices + static_cast<size_t>(table[slot]) * vertexSize, vertex, vertexSize) == 0) {
+                remap[i] = remap[table[slot]];
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (remap[i] == UINT32_MAX) {
+            table[slot] = i;
+            remap[i] = static_cast<uint32_t>(firstVertices.size());
+            firstVertices.push_back(i);
+        }
+    }
+}
+
+// how much drawing a triangle that uses the vertex is worth, -1 once it has none left
+static float getVertexScore(int32_t cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0 && cachePosition < 3) {
+        score = LAST_TRIANGLE_SCORE;
+    } else if (cachePosition >= 3) {
+        float age = static_cast<float>(cachePosition - 3) / static_cast<float>(MODELLED_CACHE_SIZE - 3);
+        score = std::pow(1.0f - age, CACHE_DECAY_POWER);
+    }
+    return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+// Forsyth's greedy order: every step draws the best scoring triangle of the ones using a cached vertex, only the
+// scores around the cache change so each step costs the same however big the mesh is
+static std::vector<uint32_t> optimiseVertexCache(const std::vector<uint32_t> &indices, uint32_t vertexCount) {
+    auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+    // the triangles around each vertex that haven't been drawn, packed one vertex after the other
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index: indices) {
+        remaining[index]++;
+    }
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        offsets[i + 1] = offsets[i] + remaining[i];
+    }
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < triangleCount * 3; i++) {
+        vertexTriangles[filled[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        vertexScores[i] = getVertexScore(-1, remaining[i]);
+    }
+    std::vector<float> triangleScores(triangleCount);
+    int64_t best = -1;
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] +
+                            vertexScores[indices[i * 3 + 2]];
+        if (best < 0 || triangleScores[i] > triangleScores[best]) {
+            best = i;
+        }
+    }
+
+    std::vector<bool> drawn(triangleCount, false);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    std::vector<uint32_t> ordered;
+    ordered.reserve(indices.size());
+    uint32_t nextUndrawn = 0;
+    while (ordered.size() < indices.size()) {
+        // nothing in the cache has triangles left, carry on from the first one not drawn yet
+        if (best < 0) {
+            while (drawn[nextUndrawn]) {
+                nextUndrawn++;
+            }
+            best = nextUndrawn;
+        }
+
+        auto triangle = static_cast<uint32_t>(best);
+        drawn[triangle] = true;
+        newCache.clear();
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            uint32_t vertex = indices[triangle * 3 + corner];
+            ordered.push_back(vertex);
+            newCache.push_back(vertex);
+
+            uint32_t *first = vertexTriangles.data() + offsets[vertex];
+            uint32_t *last = first + remaining[vertex] - 1;
+            for (uint32_t *it = first; it <= last; it++) {
+                if (*it == triangle) {
+                    std::swap(*it, *last);
+                    break;
+                }
+            }
+            remaining[vertex]--;
+        }
+
+        // the triangle's vertices move to the front, everything else moves back and the oldest fall off the end
+        for (uint32_t vertex: cache) {
+            if (vertex != newCache[0] && vertex != newCache[1] && vertex != newCache[2]) {
+                newCache.push_back(vertex);
+            }
+        }
+        for (uint32_t i = 0; i < newCache.size(); i++) {
+            uint32_t vertex = newCache[i];
+            cachePositions[vertex] = i < MODELLED_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+            vertexScores[vertex] = getVertexScore(cachePositions[vertex], remaining[vertex]);
+        }
+
+        best = -1;
+        for (uint32_t vertex: newCache) {
+            for (uint32_t i = offsets[vertex]; i < offsets[vertex] + remaining[vertex]; i++) {
+                uint32_t other = vertexTriangles[i];
+                triangleScores[other] = vertexScores[indices[other * 3]] + vertexScores[indices[other * 3 + 1]] +
+                                        vertexScores[indices[other * 3 + 2]];
+                if (best < 0 || triangleScores[other] > triangleScores[best]) {
+                    best = other;
+                }
+            }
+        }
+
+        newCache.resize(std::min<size_t>(newCache.size(), MODELLED_CACHE_SIZE));
+        std::swap(cache, newCache);
+    }
+    return ordered;
+}
+
+// #endregion
+
+// #region Public Methods
+
+uint32_t IndexedMesh::getVertexCount() const {
+    return vertexSize == 0 ? 0 : static_cast<uint32_t>(vertices.size() / vertexSize);
+}
+
+bool IndexedMesh::hasShortIndices() const {
+    return getVertexCount() <= 0x10000;
+}
+
+std::vector<uint8_t> IndexedMesh::packIndices() const {
+    std::vector<uint8_t> bytes;
+    if (hasShortIndices()) {
+        bytes.resize(indices.size() * sizeof(uint16_t));
+        for (size_t i = 0; i < indices.size(); i++) {
+            auto index = static_cast<uint16_t>(indices[i]);
+            std::memcpy(bytes.data() + i * sizeof(uint16_t), &index, sizeof(uint16_t));
+        }
+    } else {
+        bytes.resize(indices.size() * sizeof(uint32_t));
+        std::memcpy(bytes.data(), indices.data(), bytes.size());
+    }
+    return bytes;
+}
+
+IndexedMesh buildIndexedMesh(const void *vertices, uint32_t vertexCount, uint32_t vertexSize,
+                             const std::vector<uint32_t> &indices) {
+    const auto *bytes = static_cast<const uint8_t *>(vertices);
+    std::vector<uint32_t> remap;
+    std::vector<uint32_t> firstVertices;
+    weldVertices(bytes, vertexCount, vertexSize, remap, firstVertices);
+
+    // welding can leave two corners of a triangle on one vertex, those never cover a pixel
+    std::vector<uint32_t> welded;
+    welded.reserve(indices.empty() ? vertexCount : indices.size());
+    uint32_t cornerCount = indices.empty() ? vertexCount - vertexCount % 3 : static_cast<uint32_t>(indices.size());
+    for (uint32_t i = 0; i + 2 < cornerCount; i += 3) {
+        uint32_t a = remap[indices.empty() ? i : indices[i]];
+        uint32_t b = remap[indices.empty() ? i + 1 : indices[i + 1]];
+        uint32_t c = remap[indices.empty() ? i + 2 : indices[i + 2]];
+        if (a != b && b != c && c != a) {
+            welded.insert(welded.end(), {a, b, c});
+        }
+    }
+
+    std::vector<uint32_t> ordered = optimiseVertexCache(welded, static_cast<uint32_t>(firstVertices.size()));
+
+    IndexedMesh mesh;
+    mesh.vertexSize = vertexSize;
+    mesh.indices.reserve(ordered.size());
+    std::vector<uint32_t> fetchOrder(firstVertices.size(), UINT32_MAX);
+    uint32_t nextVertex = 0;
+    for (uint32_t index: ordered) {
+        if (fetchOrder[index] == UINT32_MAX) {
+            fetchOrder[index] = nextVertex++;
+            const uint8_t *vertex = bytes + static_cast<size_t>(firstVertices[index]) * vertexSize;
+            mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + vertexSize);
+        }
+        mesh.indices.push_back(fetchOrder[index]);
+    }
+    return mesh;
+}
+
+float getAverageCacheMissRatio(const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize) {
+    if (indices.size() < 3) {
+        return 0.0f;
+    }
+
+    // a FIFO cache: a vertex is still in it while fewer than cacheSize misses have happened since it went in
+    std::vector<uint64_t> insertedAt(vertexCount, 0);
+    std::vector<bool> seen(vertexCount, false);
+    uint64_t misses = 0;
+    for (uint32_t index: indices) {
+        if (!seen[index] || misses - insertedAt[index] >= cacheSize) {
+            seen[index] = true;
+            insertedAt[index] = misses;
+            misses++;
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+// #endregion
@@ -0,0 +1,40 @@
+#ifndef SMCODESRENDERENGINE_INDEXEDMESH_H
+#define SMCODESRENDERENGINE_INDEXEDMESH_H
+
+
+#include <cstdint>
+#include <vector>
+
+// Triangles as indices into unique vertices, laid out the way buildIndexedMesh() leaves them. Vertices are raw
+// bytes so any vertex format can go through the same import
+struct IndexedMesh {
+    std::vector<uint8_t> vertices; // vertexSize bytes each
+    std::vector<uint32_t> indices; // three per triangle
+    uint32_t vertexSize = 0;
+
+    uint32_t getVertexCount() const;
+
+    // when every vertex can be reached with 16 bit indices, which halves the index buffer
+    bool hasShortIndices() const;
+
+    // the index buffer's contents, 2 or 4 bytes an index depending on hasShortIndices()
+    std::vector<uint8_t> packIndices() const;
+};
+
+// The import step for geometry the rasteriser draws:
+// - vertices that are the same byte for byte are welded into one, so it's fetched and shaded once however many
+//   triangles share it
+// - triangles are reordered with Forsyth's linear speed vertex cache optimisation, so the vertices they share are
+//   still in the post transform cache the next time they come up
+// - vertices are renumbered in the order the reordered triangles first use them, so fetching walks forward through
+//   the vertex buffer
+// Empty indices treats vertices as a triangle list that shares nothing, like a non-indexed draw
+IndexedMesh buildIndexedMesh(const void *vertices, uint32_t vertexCount, uint32_t vertexSize,
+                             const std::vector<uint32_t> &indices = {});
+
+// vertices shaded per triangle drawn with a FIFO post transform cache of cacheSize entries. 3 is no reuse at all,
+// a regular grid gets down to about 0.6
+float getAverageCacheMissRatio(const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+
+#endif //SMCODESRENDERENGINE_INDEXEDMESH_H
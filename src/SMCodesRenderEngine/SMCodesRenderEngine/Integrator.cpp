@@ -0,0 +1,362 @@
+#include "Integrator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Bsdf.h"
+#include "Bvh.h"
+#include "CompressedBvh.h"
+#include "EnvironmentMap.h"
+#include "LightSampler.h"
+#include "PagedBvh.h"
+#include "Sampling.h"
+#include "Scene.h"
+#include "Texture.h"
+
+// #region Constants
+
+// bounce after which russian roulette may start killing low throughput paths
+const uint32_t RUSSIAN_ROULETTE_DEPTH = 3;
+
+// #endregion
+
+// #region Private Methods
+
+template<typename Bsdf>
+bool Integrator::shadeWith(PathState &path, const Hit &hit, uint32_t materialIndex, ShadowRay &shadowRay,
+                           bool &hasShadowRay) const {
+    hasShadowRay = false;
+
+    glm::vec3 position = path.ray.origin + path.ray.direction * hit.t;
+    glm::vec3 normal = scene.getTriangleNormal(hit.triangleIndex);
+    bool frontFace = glm::dot(normal, path.ray.direction) < 0.0f;
+    if (!frontFace) {
+        normal = -normal; // surfaces reflect on both sides, lights only emit from the front
+    }
+
+    float coneWidth = path.coneWidth + path.coneSpread * hit.t;
+    glm::vec3 albedo = materials.albedos[materialIndex];
+    uint32_t albedoTexture = materials.albedoTextures[materialIndex];
+    if (albedoTexture != NO_TEXTURE) {
+        // the cone's cross section stretches out over a surface seen at an angle
+        float cosine = std::max(std::abs(glm::dot(normal, path.ray.direction)), 1e-4f);
+        float footprint = coneWidth / cosine * scene.getTriangleUvScale(hit.triangleIndex);
+        albedo *= scene.textures[albedoTexture]->sample(
+                scene.getTriangleUv(hit.triangleIndex, hit.u, hit.v), footprint);
+    }
+
+    if (path.depth == 0) {
+        path.features.albedo = albedo;
+        path.features.normal = normal;
+        path.features.depth = hit.t;
+    }
+
+    if (materials.isEmissive(materialIndex) && frontFace) {
+        float weight = 1.0f;
+        if (path.bsdfPdf > 0.0f) {
+            // next event estimation could have found this light too, weight against it
+            float cosLight = -glm::dot(normal, path.ray.direction);
+            float lightPdf = (1.0f - environmentProbability) *
+                             lightSampler.pdfArea(path.ray.origin, path.bounceNormal, hit.triangleIndex) *
+                             hit.t * hit.t / cosLight;
+            weight = powerHeuristic(path.bsdfPdf, lightPdf);
+        }
+        path.radiance += path.throughput * materials.emissions[materialIndex] * weight;
+    }
+
+    if (path.depth >= settings.maxDepth) {
+        return false;
+    }
+
+    Bsdf bsdf(materials, materialIndex, albedo, normal, frontFace);
+    glm::vec3 wo = -path.ray.direction;
+    glm::vec3 origin = position + normal * RAY_EPSILON;
+
+    // next event estimation, a delta lobe would never line up with the light
+    if (!Bsdf::IS_DELTA && (lightSampler.hasLights() || environmentProbability > 0.0f)) {
+        float uLight = path.sampler.get1D();
+        glm::vec2 uPosition = path.sampler.get2D();
+        // only drawn with an environment, so scenes without one keep their random sequence
+        bool sampleEnvironment = false;
+        float uPixel = 0.0f;
+        if (scene.environment) {
+            uPixel = path.sampler.get1D();
+            sampleEnvironment = path.sampler.get1D() < environmentProbability;
+        }
+
+        if (sampleEnvironment) {
+            glm::vec3 radiance(0.0f);
+            float environmentPdf;
+            glm::vec3 direction = scene.environment->sample(uPosition.x, uPosition.y, uLight, uPixel,
+                                                            radiance, environmentPdf);
+            environmentPdf *= environmentProbability;
+            float cosSurface = glm::dot(normal, direction);
+
+            if (environmentPdf > 0.0f && cosSurface > 0.0f) {
+                float weight = powerHeuristic(environmentPdf, bsdf.pdf(wo, direction));
+
+                shadowRay.ray.origin = origin;
+                shadowRay.ray.direction = direction;
+                shadowRay.ray.tMin = 0.0f;
+                shadowRay.ray.tMax = RAY_INFINITY;
+                shadowRay.contribution = path.throughput * bsdf.evaluate(wo, direction) * radiance *
+                                         (cosSurface * weight / environmentPdf);
+                hasShadowRay = true;
+            }
+        } else {
+            LightSample lightSample = lightSampler.sample(origin, normal, uLight, uPosition.x, uPosition.y);
+
+            glm::vec3 toLight = lightSample.position - origin;
+            float distanceSquared = glm::dot(toLight, toLight);
+            float distance = std::sqrt(distanceSquared);
+            glm::vec3 direction = toLight / distance;
+            float cosSurface = glm::dot(normal, direction);
+            float cosLight = -glm::dot(lightSample.normal, direction);
+
+            if (lightSample.pdfArea > 0.0f && cosSurface > 0.0f && cosLight > 0.0f) {
+                float lightPdf = (1.0f - environmentProbability) * lightSample.pdfArea * distanceSquared / cosLight;
+                float weight = powerHeuristic(lightPdf, bsdf.pdf(wo, direction));
+
+                shadowRay.ray.origin = origin;
+                shadowRay.ray.direction = direction;
+                shadowRay.ray.tMin = 0.0f;
+                shadowRay.ray.tMax = distance - 2.0f * RAY_EPSILON;
+                shadowRay.contribution = path.throughput * bsdf.evaluate(wo, direction) * lightSample.emission *
+                                         (cosSurface * weight / lightPdf);
+                hasShadowRay = true;
+            }
+        }
+    }
+
+    // continue the path
+    glm::vec2 uDirection = path.sampler.get2D();
+    // only drawn by kernels with more than one lobe, so diffuse surfaces keep their random sequence
+    float uLobe = 0.0f;
+    if constexpr (Bsdf::HAS_LOBE_CHOICE) {
+        uLobe = path.sampler.get1D();
+    }
+    BsdfSample sample{};
+    if (!bsdf.sample(wo, uDirection, uLobe, sample)) {
+        return false;
+    }
+    path.throughput *= sample.weight;
+    path.bsdfPdf = sample.pdf; // 0 after a delta bounce, so a light it hits counts in full
+    path.bounceNormal = normal;
+    path.coneWidth = coneWidth;
+    path.coneSpread += bsdf.getConeSpread();
+    path.depth++;
+    path.ray.origin = sample.transmitted ? position - normal * RAY_EPSILON : origin;
+    path.ray.direction = sample.direction;
+    path.ray.tMin = 0.0f;
+    path.ray.tMax = RAY_INFINITY;
+
+    if (path.depth >= RUSSIAN_ROULETTE_DEPTH) {
+        float survival = std::clamp(std::max(path.throughput.x, std::max(path.throughput.y, path.throughput.z)),
+                                    0.05f, 0.95f);
+        if (path.sampler.get1D() >= survival) {
+            return false;
+        }
+        path.throughput /= survival;
+    }
+
+    return path.throughput.x > 0.0f || path.throughput.y > 0.0f || path.throughput.z > 0.0f;
+}
+
+template<typename Bsdf>
+void Integrator::shadeRun(uint32_t materialIndex, const uint32_t *queueIndices, uint32_t count, const Hit *hits,
+                          const uint32_t *hitPaths, PathState *paths, std::vector<uint32_t> &continuing,
+                          std::vector<ShadowRay> &shadowRays) const {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t queueIndex = queueIndices[i];
+        uint32_t pathIndex = hitPaths[queueIndex];
+
+        ShadowRay shadowRay{};
+        bool hasShadowRay;
+        if (shadeWith<Bsdf>(paths[pathIndex], hits[queueIndex], materialIndex, shadowRay, hasShadowRay)) {
+            continuing.push_back(pathIndex);
+        }
+        if (hasShadowRay) {
+            shadowRay.pathIndex = pathIndex;
+            shadowRays.push_back(shadowRay);
+        }
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+Integrator::Integrator(const Scene &scene, const Bvh *bvh, const CompressedBvh *compressedBvh,
+                       const PagedBvh *pagedBvh, const LightSampler &lightSampler, const RenderSettings &settings)
+        : scene(scene), bvh(bvh), compressedBvh(compressedBvh), pagedBvh(pagedBvh), lightSampler(lightSampler),
+          settings(settings), materials(scene.materials) {
+    // an even split when there are both, neither knows how bright the other is
+    if (scene.environment && scene.environment->canSample()) {
+        environmentProbability = lightSampler.hasLights() ? 0.5f : 1.0f;
+    }
+}
+
+PathState Integrator::generatePath(uint32_t x, uint32_t y, uint32_t sampleIndex) const {
+    PathState path{};
+    path.pixelIndex = y * settings.width + x;
+    // seeded from pixel and sample only, so a sample comes out the same no matter who traces it
+    path.sampler = Sampler(settings, x, y, sampleIndex);
+    path.throughput = glm::vec3(1.0f);
+    path.radiance = glm::vec3(0.0f);
+    path.depth = 0;
+    path.bsdfPdf = 0.0f;
+    path.bounceNormal = glm::vec3(0.0f);
+    path.coneWidth = 0.0f;
+    path.coneSpread = 2.0f * std::tan(glm::radians(scene.camera.verticalFov) * 0.5f) /
+                      static_cast<float>(settings.height);
+
+    // jitter inside the pixel for anti-aliasing
+    glm::vec2 jitter = path.sampler.get2D();
+    path.ray = scene.camera.generateRay((static_cast<float>(x) + jitter.x) / static_cast<float>(settings.width),
+                                        (static_cast<float>(y) + jitter.y) / static_cast<float>(settings.height),
+                                        settings.getAspectRatio());
+    return path;
+}
+
+bool Integrator::shade(PathState &path, const Hit &hit, ShadowRay &shadowRay, bool &hasShadowRay) const {
+    uint32_t materialIndex = scene.triangleMaterials[hit.triangleIndex];
+    switch (materials.types[materialIndex]) {
+        case MaterialType::Conductor:
+            return shadeWith<ConductorBsdf>(path, hit, materialIndex, shadowRay, hasShadowRay);
+        case MaterialType::Dielectric:
+            return shadeWith<DielectricBsdf>(path, hit, materialIndex, shadowRay, hasShadowRay);
+        case MaterialType::Layered:
+            return shadeWith<LayeredBsdf>(path, hit, materialIndex, shadowRay, hasShadowRay);
+        case MaterialType::Diffuse:
+        default:
+            return shadeWith<DiffuseBsdf>(path, hit, materialIndex, shadowRay, hasShadowRay);
+    }
+}
+
+void Integrator::shadeBatch(uint32_t materialIndex, const uint32_t *queueIndices, uint32_t count, const Hit *hits,
+                            const uint32_t *hitPaths, PathState *paths, std::vector<uint32_t> &continuing,
+                            std::vector<ShadowRay> &shadowRays) const {
+    switch (materials.types[materialIndex]) {
+        case MaterialType::Conductor:
+            shadeRun<ConductorBsdf>(materialIndex, queueIndices, count, hits, hitPaths, paths, continuing,
+                                    shadowRays);
+            break;
+        case MaterialType::Dielectric:
+            shadeRun<DielectricBsdf>(materialIndex, queueIndices, count, hits, hitPaths, paths, continuing,
+                                     shadowRays);
+            break;
+        case MaterialType::Layered:
+            shadeRun<LayeredBsdf>(materialIndex, queueIndices, count, hits, hitPaths, paths, continuing,
+                                  shadowRays);
+            break;
+        case MaterialType::Diffuse:
+        default:
+            shadeRun<DiffuseBsdf>(materialIndex, queueIndices, count, hits, hitPaths, paths, continuing,
+                                  shadowRays);
+            break;
+    }
+}
+
+void Integrator::miss(PathState &path) const {
+    if (!scene.environment) {
+        return;
+    }
+
+    float weight = 1.0f;
+    if (path.bsdfPdf > 0.0f) {
+        // next event estimation could have picked this direction too
+        float environmentPdf = environmentProbability * scene.environment->pdf(path.ray.direction);
+        weight = powerHeuristic(path.bsdfPdf, environmentPdf);
+    }
+    path.radiance += path.throughput * scene.environment->evaluate(path.ray.direction) * weight;
+}
+
+PathState Integrator::tracePath(uint32_t x, uint32_t y, uint32_t sampleIndex, RayStats &stats) const {
+    PathState path = generatePath(x, y, sampleIndex);
+
+    while (true) {
+        Hit hit;
+        stats.rays++;
+        if (!intersect(path.ray, hit)) {
+            miss(path);
+            break;
+        }
+
+        ShadowRay shadowRay{};
+        bool hasShadowRay;
+        bool continues = shade(path, hit, shadowRay, hasShadowRay);
+
+        if (hasShadowRay) {
+            stats.shadowRays++;
+            if (!occluded(shadowRay.ray)) {
+                path.radiance += shadowRay.contribution;
+            }
+        }
+
+        if (!continues) {
+            break;
+        }
+    }
+
+    return path;
+}
+
+bool Integrator::intersect(const Ray &ray, Hit &hit) const {
+    if (pagedBvh) {
+        return pagedBvh->intersect(ray, hit);
+    }
+    if (compressedBvh) {
+        return compressedBvh->intersect(ray, hit);
+    }
+    return bvh->intersect(ray, hit);
+}
+
+bool Integrator::occluded(const Ray &ray) const {
+    if (pagedBvh) {
+        return pagedBvh->occluded(ray);
+    }
+    if (compressedBvh) {
+        return compressedBvh->occluded(ray);
+    }
+    return bvh->occluded(ray);
+}
+
+void Integrator::intersect(const Ray *rays, Hit *hits, uint32_t count) const {
+    if (pagedBvh) {
+        // batched by page, so each missing page is read once for the whole queue
+        pagedBvh->intersect(rays, hits, count);
+    } else if (compressedBvh) {
+        // the wide tree already fills the SSE lanes with one ray's 4 children
+        for (uint32_t i = 0; i < count; i++) {
+            compressedBvh->intersect(rays[i], hits[i]);
+        }
+    } else {
+        for (uint32_t i = 0; i < count; i += 4) {
+            bvh->intersect4(&rays[i], &hits[i], std::min(4u, count - i));
+        }
+    }
+}
+
+void Integrator::occluded(const Ray *rays, uint8_t *occluded, uint32_t count) const {
+    if (pagedBvh) {
+        pagedBvh->occluded(rays, occluded, count);
+    } else if (compressedBvh) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (compressedBvh->occluded(rays[i])) {
+                occluded[i] = 1;
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < count; i += 4) {
+            uint32_t packetSize = std::min(4u, count - i);
+            uint32_t occludedMask = bvh->occluded4(&rays[i], packetSize);
+            for (uint32_t lane = 0; lane < packetSize; lane++) {
+                if ((occludedMask & (1u << lane)) != 0) {
+                    occluded[i + lane] = 1;
+                }
+            }
+        }
+    }
+}
+
+// #endregion
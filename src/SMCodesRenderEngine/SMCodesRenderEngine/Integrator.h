@@ -0,0 +1,113 @@
+#ifndef SMCODESRENDERENGINE_INTEGRATOR_H
+#define SMCODESRENDERENGINE_INTEGRATOR_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "AccumulationBuffer.h"
+#include "MaterialTable.h"
+#include "RayTracing.h"
+#include "RenderSettings.h"
+#include "Sampler.h"
+
+struct Scene;
+class Bvh;
+class CompressedBvh;
+class LightSampler;
+class PagedBvh;
+
+// Everything a path needs to carry from one bounce to the next
+struct PathState {
+    Ray ray;
+    glm::vec3 throughput;
+    glm::vec3 radiance;
+    Sampler sampler;
+    uint32_t pixelIndex;
+    uint32_t depth;
+    float bsdfPdf; // solid angle density of the bounce that produced ray, 0 for camera rays
+    glm::vec3 bounceNormal; // at the vertex ray left from, light selection there depended on it
+    // ray cone, a cheap stand in for ray differentials that picks texture mip levels. Its width at the ray
+    // origin grows by coneSpread per unit of distance
+    float coneWidth;
+    float coneSpread;
+    FeatureSample features; // filled in at the first hit
+};
+
+// next event estimation ray towards a light, contribution is added to the path if nothing blocks it
+struct ShadowRay {
+    Ray ray;
+    glm::vec3 contribution;
+    uint32_t pathIndex;
+};
+
+// padded so per thread counters never share a cache line
+struct alignas(64) RayStats {
+    uint64_t rays = 0;
+    uint64_t shadowRays = 0;
+};
+
+// Unidirectional path tracer with next event estimation (area lights and the environment map),
+// MIS between light and BSDF sampling, and russian roulette. Split into generate/shade steps so the megakernel loop and the
+// wavefront queues run exactly the same maths and consume random numbers in the same order. The shading code is a
+// template over the BSDF kernels in Bsdf.h, one copy per material type
+class Integrator {
+public:
+    // rays are traced against whichever one of bvh, compressedBvh (both in memory) and pagedBvh (out of core)
+    // isn't null
+    Integrator(const Scene &scene, const Bvh *bvh, const CompressedBvh *compressedBvh, const PagedBvh *pagedBvh,
+               const LightSampler &lightSampler, const RenderSettings &settings);
+
+    PathState generatePath(uint32_t x, uint32_t y, uint32_t sampleIndex) const;
+
+    // adds light emitted at the hit, builds the shadow ray towards a light (hasShadowRay) and picks the next
+    // bounce direction. Returns false once the path is finished
+    bool shade(PathState &path, const Hit &hit, ShadowRay &shadowRay, bool &hasShadowRay) const;
+
+    // shade() for a run of hits that all have materialIndex, the kernel is picked once for the whole run.
+    // Hit i is hits[queueIndices[i]] on paths[hitPaths[queueIndices[i]]]. Paths that carry on are appended to
+    // continuing, shadow rays (with their pathIndex) to shadowRays
+    void shadeBatch(uint32_t materialIndex, const uint32_t *queueIndices, uint32_t count, const Hit *hits,
+                    const uint32_t *hitPaths, PathState *paths, std::vector<uint32_t> &continuing,
+                    std::vector<ShadowRay> &shadowRays) const;
+
+    // adds the environment light a ray that hit nothing escapes to
+    void miss(PathState &path) const;
+
+    // megakernel mode, traces a whole path on the calling thread
+    PathState tracePath(uint32_t x, uint32_t y, uint32_t sampleIndex, RayStats &stats) const;
+
+    // closest hit, same contract as Bvh::intersect
+    bool intersect(const Ray &ray, Hit &hit) const;
+
+    bool occluded(const Ray &ray) const;
+
+    // a whole queue of rays, sorted so neighbours are coherent. hits[i] is only written when rays[i] hits something
+    void intersect(const Ray *rays, Hit *hits, uint32_t count) const;
+
+    // occluded[i] is set to 1 when rays[i] is blocked, left alone otherwise
+    void occluded(const Ray *rays, uint8_t *occluded, uint32_t count) const;
+
+private:
+    const Scene &scene;
+    const Bvh *bvh;
+    const CompressedBvh *compressedBvh;
+    const PagedBvh *pagedBvh;
+    const LightSampler &lightSampler;
+    const RenderSettings &settings;
+    MaterialTable materials;
+    float environmentProbability = 0.0f; // chance next event estimation goes for the environment over a light
+
+    template<typename Bsdf>
+    bool shadeWith(PathState &path, const Hit &hit, uint32_t materialIndex, ShadowRay &shadowRay,
+                   bool &hasShadowRay) const;
+
+    template<typename Bsdf>
+    void shadeRun(uint32_t materialIndex, const uint32_t *queueIndices, uint32_t count, const Hit *hits,
+                  const uint32_t *hitPaths, PathState *paths, std::vector<uint32_t> &continuing,
+                  std::vector<ShadowRay> &shadowRays) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_INTEGRATOR_H
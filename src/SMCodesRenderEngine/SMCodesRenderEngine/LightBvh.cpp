@@ -0,0 +1,353 @@
+#include "LightBvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Sampling.h"
+
+// #region Constants
+
+const uint32_t LIGHT_BVH_BUCKET_COUNT = 12;
+const float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+// trails are 64 bits, one per level, so nothing can be deeper than that
+const uint32_t LIGHT_BVH_MAX_DEPTH = 64;
+
+// #endregion
+
+// #region Private Methods
+
+static float safeSqrt(float value) {
+    return std::sqrt(std::max(value, 0.0f));
+}
+
+static float safeAcos(float value) {
+    return std::acos(std::clamp(value, -1.0f, 1.0f));
+}
+
+// cos(max(0, a - b)) from the sines and cosines of a and b
+static float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB) {
+        return 1.0f;
+    }
+    return cosA * cosB + sinA * sinB;
+}
+
+// sin(max(0, a - b))
+static float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB) {
+        return 0.0f;
+    }
+    return sinA * cosB - cosA * sinB;
+}
+
+// acos(dot(a, b)) loses everything near 0 and pi, this doesn't
+static float angleBetween(const glm::vec3 &a, const glm::vec3 &b) {
+    if (glm::dot(a, b) < 0.0f) {
+        return PI - 2.0f * std::asin(std::min(glm::length(a + b) * 0.5f, 1.0f));
+    }
+    return 2.0f * std::asin(std::min(glm::length(b - a) * 0.5f, 1.0f));
+}
+
+static uint32_t ceilLog2(uint32_t value) {
+    uint32_t bits = 0;
+    while ((1ull << bits) < value) {
+        bits++;
+    }
+    return bits;
+}
+
+// surface area orientation heuristic, how likely a group is to matter to a random shading point
+static float evaluateCost(const LightBounds &group, const Aabb &parentBounds, int axis) {
+    if (group.bounds.isEmpty()) {
+        return 0.0f;
+    }
+    float thetaO = safeAcos(group.cosThetaO);
+    float thetaE = safeAcos(group.cosThetaE);
+    float thetaW = std::min(thetaO + thetaE, PI);
+    float sinThetaO = safeSqrt(1.0f - group.cosThetaO * group.cosThetaO);
+    // solid angle the emission cone covers, weighted by cosine
+    float orientationMeasure = 2.0f * PI * (1.0f - group.cosThetaO) +
+                               PI / 2.0f * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) -
+                                            2.0f * thetaO * sinThetaO + group.cosThetaO);
+
+    // long thin splits are penalised so the tree doesn't slice the same axis forever
+    glm::vec3 extent = parentBounds.extent();
+    float regularity = std::max(extent.x, std::max(extent.y, extent.z)) / extent[axis];
+    return group.power * orientationMeasure * regularity * group.bounds.surfaceArea();
+}
+
+uint32_t LightBvh::build(std::vector<uint32_t> &lightIndices, const std::vector<LightBounds> &lights, uint32_t begin,
+                         uint32_t end, uint64_t trail, uint32_t depth) {
+    auto nodeIndex = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({});
+
+    if (end - begin == 1) {
+        uint32_t light = lightIndices[begin];
+        nodes[nodeIndex] = {lights[light], light, true};
+        lightTrails[light] = trail;
+        return nodeIndex;
+    }
+
+    LightBounds bounds;
+    Aabb centroidBounds;
+    for (uint32_t i = begin; i < end; i++) {
+        bounds = LightBounds::merge(bounds, lights[lightIndices[i]]);
+        centroidBounds.grow(lights[lightIndices[i]].bounds.centre());
+    }
+
+    auto bucketOf = [&](uint32_t light, int axis) {
+        float offset = (lights[light].bounds.centre()[axis] - centroidBounds.min[axis]) /
+                       (centroidBounds.max[axis] - centroidBounds.min[axis]);
+        return std::min(static_cast<uint32_t>(offset * LIGHT_BVH_BUCKET_COUNT), LIGHT_BVH_BUCKET_COUNT - 1);
+    };
+
+    float bestCost = RAY_INFINITY;
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    // close to the depth limit the rest gets split down the middle, which is as shallow as it goes
+    if (depth + ceilLog2(end - begin) < LIGHT_BVH_MAX_DEPTH - 1) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (centroidBounds.max[axis] == centroidBounds.min[axis]) {
+                continue;
+            }
+
+            LightBounds buckets[LIGHT_BVH_BUCKET_COUNT];
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t bucket = bucketOf(lightIndices[i], axis);
+                buckets[bucket] = LightBounds::merge(buckets[bucket], lights[lightIndices[i]]);
+            }
+
+            for (uint32_t split = 1; split < LIGHT_BVH_BUCKET_COUNT; split++) {
+                LightBounds below;
+                LightBounds above;
+                for (uint32_t bucket = 0; bucket < split; bucket++) {
+                    below = LightBounds::merge(below, buckets[bucket]);
+                }
+                for (uint32_t bucket = split; bucket < LIGHT_BVH_BUCKET_COUNT; bucket++) {
+                    above = LightBounds::merge(above, buckets[bucket]);
+                }
+                float cost = evaluateCost(below, bounds.bounds, axis) + evaluateCost(above, bounds.bounds, axis);
+                if (cost > 0.0f && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+    }
+
+    uint32_t mid = begin;
+    if (bestAxis >= 0) {
+        auto middle = std::partition(lightIndices.begin() + begin, lightIndices.begin() + end, [&](uint32_t light) {
+            return bucketOf(light, bestAxis) < bestSplit;
+        });
+        mid = static_cast<uint32_t>(middle - lightIndices.begin());
+    }
+    if (mid == begin || mid == end) {
+        // every centroid in the same place, or no split worth having. Halve along the widest axis
+        glm::vec3 extent = centroidBounds.extent();
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        mid = (begin + end) / 2;
+        std::nth_element(lightIndices.begin() + begin, lightIndices.begin() + mid, lightIndices.begin() + end,
+                         [&](uint32_t a, uint32_t b) {
+                             return lights[a].bounds.centre()[axis] < lights[b].bounds.centre()[axis];
+                         });
+    }
+
+    build(lightIndices, lights, begin, mid, trail, depth + 1);
+    uint32_t secondChild = build(lightIndices, lights, mid, end, trail | (1ull << depth), depth + 1);
+    nodes[nodeIndex] = {bounds, secondChild, false};
+    return nodeIndex;
+}
+
+// #endregion
+
+// #region Public Methods
+
+float LightBounds::importance(const glm::vec3 &point, const glm::vec3 &normal) const {
+    glm::vec3 centre = bounds.centre();
+    glm::vec3 extent = bounds.extent();
+    glm::vec3 toPoint = point - centre;
+    float distanceSquared = glm::dot(toPoint, toPoint);
+    float radiusSquared = glm::dot(extent, extent) * 0.25f;
+
+    // keeps lights right next to the point from taking every sample
+    float clampedDistanceSquared = std::max(distanceSquared, std::sqrt(radiusSquared));
+
+    // inside the bounding sphere any direction is possible
+    if (distanceSquared <= radiusSquared) {
+        return power / clampedDistanceSquared;
+    }
+
+    glm::vec3 toPointDirection = toPoint / std::sqrt(distanceSquared);
+    float cosThetaW = glm::dot(direction, toPointDirection);
+    float sinThetaW = safeSqrt(1.0f - cosThetaW * cosThetaW);
+
+    // half angle of the cone around the centre that holds the whole bounding sphere
+    float sinThetaBSquared = radiusSquared / distanceSquared;
+    float sinThetaB = std::sqrt(sinThetaBSquared);
+    float cosThetaB = safeSqrt(1.0f - sinThetaBSquared);
+
+    // smallest angle between the point and any emitter normal, then how much of that emission can reach it
+    float sinThetaO = safeSqrt(1.0f - cosThetaO * cosThetaO);
+    float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= cosThetaE) {
+        return 0.0f;
+    }
+
+    float result = power * cosThetaP / clampedDistanceSquared;
+    if (normal != glm::vec3(0.0f)) {
+        float cosThetaI = std::abs(glm::dot(toPointDirection, normal));
+        float sinThetaI = safeSqrt(1.0f - cosThetaI * cosThetaI);
+        result *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    }
+    return std::max(result, 0.0f);
+}
+
+LightBounds LightBounds::merge(const LightBounds &a, const LightBounds &b) {
+    if (a.bounds.isEmpty()) {
+        return b;
+    }
+    if (b.bounds.isEmpty()) {
+        return a;
+    }
+
+    LightBounds merged;
+    merged.bounds = a.bounds;
+    merged.bounds.grow(b.bounds);
+    merged.power = a.power + b.power;
+    merged.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+
+    // smallest cone holding both normal cones
+    float thetaA = safeAcos(a.cosThetaO);
+    float thetaB = safeAcos(b.cosThetaO);
+    float thetaD = angleBetween(a.direction, b.direction);
+    if (std::min(thetaD + thetaB, PI) <= thetaA) {
+        merged.direction = a.direction;
+        merged.cosThetaO = a.cosThetaO;
+        return merged;
+    }
+    if (std::min(thetaD + thetaA, PI) <= thetaB) {
+        merged.direction = b.direction;
+        merged.cosThetaO = b.cosThetaO;
+        return merged;
+    }
+
+    float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+    glm::vec3 axis = glm::cross(a.direction, b.direction);
+    if (thetaO >= PI || glm::dot(axis, axis) == 0.0f) {
+        merged.direction = a.direction;
+        merged.cosThetaO = -1.0f; // every direction
+        return merged;
+    }
+
+    // rotate a's direction towards b's until the cone reaches both
+    float thetaR = thetaO - thetaA;
+    axis = glm::normalize(axis);
+    merged.direction = glm::normalize(a.direction * std::cos(thetaR) +
+                                      glm::cross(axis, a.direction) * std::sin(thetaR));
+    merged.cosThetaO = std::cos(thetaO);
+    return merged;
+}
+
+LightBvh::LightBvh(const std::vector<LightBounds> &lights) {
+    if (lights.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> lightIndices(lights.size());
+    for (uint32_t i = 0; i < lightIndices.size(); i++) {
+        lightIndices[i] = i;
+    }
+    lightTrails.resize(lights.size());
+    nodes.reserve(2 * lights.size() - 1);
+    build(lightIndices, lights, 0, static_cast<uint32_t>(lights.size()), 0, 0);
+}
+
+bool LightBvh::isEmpty() const {
+    return nodes.empty();
+}
+
+bool LightBvh::sample(const glm::vec3 &point, const glm::vec3 &normal, float u, uint32_t &lightIndex,
+                      float &pmf) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    uint32_t nodeIndex = 0;
+    pmf = 1.0f;
+    while (true) {
+        const Node &node = nodes[nodeIndex];
+        if (node.isLeaf) {
+            // a lone light at the root is the only place its importance hasn't been checked yet
+            if (nodeIndex > 0 || node.lightBounds.importance(point, normal) > 0.0f) {
+                lightIndex = node.childOrLight;
+                return true;
+            }
+            return false;
+        }
+
+        float first = nodes[nodeIndex + 1].lightBounds.importance(point, normal);
+        float second = nodes[node.childOrLight].lightBounds.importance(point, normal);
+        if (first == 0.0f && second == 0.0f) {
+            return false;
+        }
+
+        // one number all the way down, stretched back over [0, 1) after every choice
+        float firstProbability = first / (first + second);
+        if (u < firstProbability) {
+            u = std::min(u / firstProbability, ONE_MINUS_EPSILON);
+            pmf *= firstProbability;
+            nodeIndex++;
+        } else {
+            u = std::min((u - firstProbability) / (1.0f - firstProbability), ONE_MINUS_EPSILON);
+            pmf *= 1.0f - firstProbability;
+            nodeIndex = node.childOrLight;
+        }
+    }
+}
+
+float LightBvh::pmf(const glm::vec3 &point, const glm::vec3 &normal, uint32_t lightIndex) const {
+    if (nodes.empty()) {
+        return 0.0f;
+    }
+
+    // the trail says which way sample() had to go, only the probabilities along it are needed
+    uint64_t trail = lightTrails[lightIndex];
+    uint32_t nodeIndex = 0;
+    float pmf = 1.0f;
+    while (true) {
+        const Node &node = nodes[nodeIndex];
+        if (node.isLeaf) {
+            if (nodeIndex > 0 || node.lightBounds.importance(point, normal) > 0.0f) {
+                return pmf;
+            }
+            return 0.0f;
+        }
+
+        float first = nodes[nodeIndex + 1].lightBounds.importance(point, normal);
+        float second = nodes[node.childOrLight].lightBounds.importance(point, normal);
+        if (first == 0.0f && second == 0.0f) {
+            return 0.0f;
+        }
+
+        float firstProbability = first / (first + second);
+        if (trail & 1) {
+            pmf *= 1.0f - firstProbability;
+            nodeIndex = node.childOrLight;
+        } else {
+            pmf *= firstProbability;
+            nodeIndex++;
+        }
+        trail >>= 1;
+    }
+}
+
+uint32_t LightBvh::getNodeCount() const {
+    return static_cast<uint32_t>(nodes.size());
+}
+
+// #endregion
@@ -0,0 +1,64 @@
+#ifndef SMCODESRENDERENGINE_LIGHTBVH_H
+#define SMCODESRENDERENGINE_LIGHTBVH_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "RayTracing.h"
+
+// Conservative description of one emitter or a group of them: where they are, how much they emit
+// and which way. Every normal lies within acos(cosThetaO) of direction, and light leaves a surface at
+// most acos(cosThetaE) away from its normal (0, so 90 degrees, for the one sided diffuse emitters here)
+struct LightBounds {
+    Aabb bounds;
+    glm::vec3 direction = glm::vec3(0.0f, 0.0f, 1.0f);
+    float power = 0.0f;
+    float cosThetaO = 1.0f;
+    float cosThetaE = 0.0f;
+
+    // upper bound style estimate of how much these lights can contribute at point on a surface facing
+    // normal (a zero normal skips the surface term). Only ever 0 where none of them can reach
+    float importance(const glm::vec3 &point, const glm::vec3 &normal) const;
+
+    static LightBounds merge(const LightBounds &a, const LightBounds &b);
+};
+
+// Light BVH for many-light sampling ("Importance Sampling of Many Lights with Adaptive Tree Splitting",
+// Conty Estevez & Kulla 2018, in the form pbrt-v4 uses). Lights are picked by walking down from the root,
+// choosing a child with probability proportional to its importance at the shading point, so lights that
+// are close, bright and facing the point get most of the samples however many others there are.
+// Built with the surface area orientation heuristic, one light per leaf
+class LightBvh {
+public:
+    LightBvh() = default;
+
+    explicit LightBvh(const std::vector<LightBounds> &lights);
+
+    bool isEmpty() const;
+
+    // false when no light can reach point. u is in [0, 1) and gets reused for every level
+    bool sample(const glm::vec3 &point, const glm::vec3 &normal, float u, uint32_t &lightIndex, float &pmf) const;
+
+    // probability sample() picks lightIndex at point
+    float pmf(const glm::vec3 &point, const glm::vec3 &normal, uint32_t lightIndex) const;
+
+    uint32_t getNodeCount() const;
+
+private:
+    struct Node {
+        LightBounds lightBounds;
+        uint32_t childOrLight; // second child of an interior node (the first follows it), or the light of a leaf
+        bool isLeaf;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint64_t> lightTrails; // per light, bit n says which child to take at depth n to reach its leaf
+
+    uint32_t build(std::vector<uint32_t> &lightIndices, const std::vector<LightBounds> &lights, uint32_t begin,
+                   uint32_t end, uint64_t trail, uint32_t depth);
+};
+
+
+#endif //SMCODESRENDERENGINE_LIGHTBVH_H
@@ -0,0 +1,99 @@
+#include "LightSampler.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "Metrics.h"
+#include "Sampling.h"
+#include "Scene.h"
+
+// #region Public Methods
+
+LightSampler::LightSampler(const Scene &scene, LightSelection selection) : scene(scene), selection(selection) {
+    for (uint32_t i = 0; i < scene.getTriangleCount(); i++) {
+        if (scene.getTriangleMaterial(i).isEmissive() && scene.getTriangleArea(i) > 0.0f) {
+            lightIndices[i] = static_cast<uint32_t>(emissiveTriangles.size());
+            emissiveTriangles.push_back(i);
+        }
+    }
+
+    if (selection == LightSelection::Bvh && !emissiveTriangles.empty()) {
+        auto start = std::chrono::steady_clock::now();
+
+        // one sided diffuse emitters, the whole hemisphere in front of the triangle
+        std::vector<LightBounds> lights(emissiveTriangles.size());
+        for (size_t i = 0; i < emissiveTriangles.size(); i++) {
+            uint32_t triangleIndex = emissiveTriangles[i];
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                lights[i].bounds.grow(scene.getTriangleVertex(triangleIndex, corner));
+            }
+            lights[i].direction = scene.getTriangleNormal(triangleIndex);
+            lights[i].power = luminance(scene.getTriangleMaterial(triangleIndex).emission) *
+                              scene.getTriangleArea(triangleIndex);
+            lights[i].cosThetaO = 1.0f;
+            lights[i].cosThetaE = 0.0f;
+        }
+        lightBvh = LightBvh(lights);
+
+        static Histogram &buildSeconds = Metrics::histogram("smcodes_light_bvh_build_seconds",
+                                                            "Time taken to build a light BVH",
+                                                            Metrics::getLatencyBounds());
+        buildSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+bool LightSampler::hasLights() const {
+    return !emissiveTriangles.empty();
+}
+
+uint32_t LightSampler::getLightCount() const {
+    return static_cast<uint32_t>(emissiveTriangles.size());
+}
+
+LightSample LightSampler::sample(const glm::vec3 &point, const glm::vec3 &normal, float u1, float u2,
+                                 float u3) const {
+    LightSample lightSample;
+    auto lightCount = static_cast<uint32_t>(emissiveTriangles.size());
+    uint32_t pick;
+    float pmf;
+    if (selection == LightSelection::Bvh) {
+        if (!lightBvh.sample(point, normal, u1, pick, pmf)) {
+            return lightSample; // no light can reach the point
+        }
+    } else {
+        pick = std::min(static_cast<uint32_t>(u1 * static_cast<float>(lightCount)), lightCount - 1);
+        pmf = 1.0f / static_cast<float>(lightCount);
+    }
+    uint32_t triangleIndex = emissiveTriangles[pick];
+
+    glm::vec2 barycentric = sampleUniformTriangle(u2, u3);
+    glm::vec3 a = scene.getTriangleVertex(triangleIndex, 0);
+    glm::vec3 b = scene.getTriangleVertex(triangleIndex, 1);
+    glm::vec3 c = scene.getTriangleVertex(triangleIndex, 2);
+
+    lightSample.position = a * barycentric.x + b * barycentric.y + c * (1.0f - barycentric.x - barycentric.y);
+    lightSample.normal = scene.getTriangleNormal(triangleIndex);
+    lightSample.emission = scene.getTriangleMaterial(triangleIndex).emission;
+    lightSample.pdfArea = pmf / scene.getTriangleArea(triangleIndex);
+    lightSample.triangleIndex = triangleIndex;
+    return lightSample;
+}
+
+float LightSampler::pdfArea(const glm::vec3 &point, const glm::vec3 &normal, uint32_t triangleIndex) const {
+    auto light = lightIndices.find(triangleIndex);
+    if (light == lightIndices.end()) {
+        return 0.0f;
+    }
+
+    float pmf = 1.0f / static_cast<float>(emissiveTriangles.size());
+    if (selection == LightSelection::Bvh) {
+        pmf = lightBvh.pmf(point, normal, light->second);
+    }
+    return pmf / scene.getTriangleArea(triangleIndex);
+}
+
+const LightBvh &LightSampler::getLightBvh() const {
+    return lightBvh;
+}
+
+// #endregion
@@ -0,0 +1,55 @@
+#ifndef SMCODESRENDERENGINE_LIGHTSAMPLER_H
+#define SMCODESRENDERENGINE_LIGHTSAMPLER_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "LightBvh.h"
+
+struct Scene;
+
+struct LightSample {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    glm::vec3 emission = glm::vec3(0.0f);
+    float pdfArea = 0.0f; // probability density with respect to area on the light, 0 when nothing was picked
+    uint32_t triangleIndex = 0;
+};
+
+enum class LightSelection {
+    // every emitter has the same chance, noise grows with the number of lights
+    Uniform,
+    // walks a light BVH towards the emitters that matter most at the shading point
+    Bvh
+};
+
+// Picks a point on an emissive triangle for next event estimation
+class LightSampler {
+public:
+    explicit LightSampler(const Scene &scene, LightSelection selection = LightSelection::Bvh);
+
+    bool hasLights() const;
+
+    uint32_t getLightCount() const;
+
+    // point and normal are the shading point, the light BVH picks lights by how much they can give it
+    LightSample sample(const glm::vec3 &point, const glm::vec3 &normal, float u1, float u2, float u3) const;
+
+    // area density sample() would have produced at point for a point on triangleIndex
+    float pdfArea(const glm::vec3 &point, const glm::vec3 &normal, uint32_t triangleIndex) const;
+
+    const LightBvh &getLightBvh() const;
+
+private:
+    const Scene &scene;
+    LightSelection selection;
+    std::vector<uint32_t> emissiveTriangles;
+    std::unordered_map<uint32_t, uint32_t> lightIndices; // triangle to its place in emissiveTriangles
+    LightBvh lightBvh;
+};
+
+
+#endif //SMCODESRENDERENGINE_LIGHTSAMPLER_H
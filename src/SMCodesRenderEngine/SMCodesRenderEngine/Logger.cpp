@@ -0,0 +1,369 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// #region Constants
+
+const uint32_t LOG_RING_SIZE = 256; // records per thread
+const uint32_t LOG_MAX_FIELDS = 8; // any more get left off
+const uint32_t LOG_TEXT_SIZE = 512; // bytes for every string field of a record together, the rest gets cut off
+
+const char *const LOG_LEVEL_NAMES[] = {"trace", "debug", "info", "warning", "error", "off"};
+
+// #endregion
+
+// #region Private Types
+
+struct Logger::Record {
+    struct Field {
+        const char *key;
+        LogField::Type type;
+        uint16_t textOffset;
+        uint16_t textLength;
+        uint64_t value; // bits of whichever union member the type says
+    };
+
+    int64_t time; // nanoseconds since the epoch
+    const char *message;
+    LogLevel level;
+    uint32_t fieldCount;
+    Field fields[LOG_MAX_FIELDS];
+    char text[LOG_TEXT_SIZE];
+};
+
+struct Logger::Ring {
+    std::unique_ptr<Record[]> records = std::make_unique<Record[]>(LOG_RING_SIZE);
+    uint32_t threadId = 0;
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> abandoned{false}; // the thread has exited, the ring goes once it is empty
+
+    // own cache lines, one is only moved by the logging thread and the other only by the writer
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+struct Logger::RingHandle {
+    std::shared_ptr<Ring> ring;
+
+    ~RingHandle() {
+        if (ring) {
+            ring->abandoned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+// #endregion
+
+// #region Private Methods
+
+static void appendString(std::string &out, std::string_view text) {
+    out += '"';
+    for (char c: text) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+// ISO 8601 in UTC to the microsecond
+static void appendTime(std::string &out, int64_t time) {
+    std::chrono::sys_time<std::chrono::nanoseconds> timePoint{std::chrono::nanoseconds(time)};
+    auto day = std::chrono::floor<std::chrono::days>(timePoint);
+    std::chrono::year_month_day date(day);
+    int64_t nanoseconds = (timePoint - day).count();
+
+    char buffer[40];
+    std::snprintf(buffer, sizeof(buffer), "\"%04d-%02u-%02uT%02d:%02d:%02d.%06dZ\"", static_cast<int>(date.year()),
+                  static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()),
+                  static_cast<int>(nanoseconds / 3600000000000), static_cast<int>(nanoseconds / 60000000000 % 60),
+                  static_cast<int>(nanoseconds / 1000000000 % 60), static_cast<int>(nanoseconds / 1000 % 1000000));
+    out += buffer;
+}
+
+template<typename T>
+static void appendNumber(std::string &out, T value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+static void appendLinePrefix(std::string &out, int64_t time, LogLevel level, uint32_t threadId,
+                             const char *message) {
+    out += "{\"time\":";
+    appendTime(out, time);
+    out += ",\"level\":\"";
+    out += LOG_LEVEL_NAMES[static_cast<uint8_t>(level)];
+    out += "\",\"thread\":";
+    appendNumber(out, threadId);
+    out += ",\"message\":";
+    appendString(out, message);
+}
+
+static int64_t getTime() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+Logger::Logger() {
+    thread = std::thread(&Logger::writerLoop, this);
+}
+
+Logger &Logger::get() {
+    static Logger logger;
+    return logger;
+}
+
+std::shared_ptr<Logger::Ring> Logger::addRing() {
+    auto ring = std::make_shared<Ring>();
+    std::lock_guard<std::mutex> lock(mutex);
+    ring->threadId = nextThreadId++;
+    rings.push_back(ring);
+    return ring;
+}
+
+void Logger::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeCondition.wait_for(lock, std::chrono::milliseconds(flushIntervalMs), [this] {
+            return stopping || flushRequested != flushed;
+        });
+        uint64_t request = flushRequested;
+        bool stop = stopping;
+        std::vector<std::shared_ptr<Ring>> snapshot = rings;
+        lock.unlock();
+
+        drain(snapshot);
+
+        lock.lock();
+        // threads that have exited and have nothing left in their ring
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring> &ring) {
+            return ring->abandoned.load(std::memory_order_acquire) &&
+                   ring->head.load(std::memory_order_acquire) == ring->tail.load(std::memory_order_relaxed);
+        }), rings.end());
+        flushed = request;
+        flushedCondition.notify_all();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+void Logger::drain(const std::vector<std::shared_ptr<Ring>> &snapshot) {
+    struct Entry {
+        const Record *record;
+        uint32_t threadId;
+    };
+    std::vector<Entry> entries;
+    std::vector<uint64_t> heads(snapshot.size());
+    std::string out;
+
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        Ring &ring = *snapshot[i];
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        heads[i] = ring.head.load(std::memory_order_acquire);
+        for (uint64_t index = tail; index < heads[i]; index++) {
+            entries.push_back({&ring.records[index % LOG_RING_SIZE], ring.threadId});
+        }
+
+        uint64_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            appendLinePrefix(out, getTime(), LogLevel::Warning, ring.threadId, "log records dropped, ring was full");
+            out += ",\"count\":";
+            appendNumber(out, dropped);
+            out += "}\n";
+        }
+    }
+
+    // every ring is in order already, this only interleaves the threads
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.record->time < b.record->time;
+    });
+
+    for (const auto &entry: entries) {
+        const Record &record = *entry.record;
+        appendLinePrefix(out, record.time, record.level, entry.threadId, record.message);
+
+        for (uint32_t i = 0; i < record.fieldCount; i++) {
+            const Record::Field &field = record.fields[i];
+            out += ',';
+            appendString(out, field.key);
+            out += ':';
+
+            switch (field.type) {
+                case LogField::Type::Int: {
+                    int64_t value;
+                    std::memcpy(&value, &field.value, sizeof(value));
+                    appendNumber(out, value);
+                    break;
+                }
+                case LogField::Type::UInt:
+                    appendNumber(out, field.value);
+                    break;
+                case LogField::Type::Double: {
+                    double value;
+                    std::memcpy(&value, &field.value, sizeof(value));
+                    if (std::isfinite(value)) {
+                        appendNumber(out, value);
+                    } else {
+                        out += "null"; // JSON has no inf or nan
+                    }
+                    break;
+                }
+                case LogField::Type::Bool:
+                    out += field.value != 0 ? "true" : "false";
+                    break;
+                case LogField::Type::String:
+                    appendString(out, std::string_view(record.text + field.textOffset, field.textLength));
+                    break;
+            }
+        }
+        out += "}\n";
+    }
+
+    if (!out.empty()) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::fwrite(out.data(), 1, out.size(), output);
+        std::fflush(output);
+    }
+
+    // the records have been formatted, the threads can have the slots back
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        snapshot[i]->tail.store(heads[i], std::memory_order_release);
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    // the last pass drains whatever is left
+    wakeCondition.notify_one();
+    thread.join();
+
+    if (output != stdout) {
+        std::fclose(output);
+    }
+}
+
+void Logger::configure(const LoggerSettings &settings) {
+    Logger &logger = get();
+    // everything so far goes to where it was meant to
+    flush();
+
+    std::FILE *file = stdout;
+    if (!settings.path.empty()) {
+        file = std::fopen(settings.path.c_str(), "a");
+        if (file == nullptr) {
+            throw std::runtime_error("Failed to open log file: " + settings.path);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(logger.outputMutex);
+        if (logger.output != stdout) {
+            std::fclose(logger.output);
+        }
+        logger.output = file;
+    }
+    {
+        std::lock_guard<std::mutex> lock(logger.mutex);
+        logger.flushIntervalMs = std::max(1u, settings.flushIntervalMs);
+    }
+    minimumLevel.store(static_cast<uint8_t>(settings.level), std::memory_order_relaxed);
+}
+
+void Logger::flush() {
+    Logger &logger = get();
+    std::unique_lock<std::mutex> lock(logger.mutex);
+    uint64_t request = ++logger.flushRequested;
+    logger.wakeCondition.notify_one();
+    logger.flushedCondition.wait(lock, [&logger, request] { return logger.flushed >= request; });
+}
+
+void Logger::log(LogLevel level, const char *message, std::initializer_list<LogField> fields) {
+    thread_local RingHandle handle;
+    if (!handle.ring) {
+        // the only time logging takes a lock, once per thread
+        handle.ring = get().addRing();
+    }
+    Ring &ring = *handle.ring;
+
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Record &record = ring.records[head % LOG_RING_SIZE];
+    record.time = getTime();
+    record.message = message;
+    record.level = level;
+    record.fieldCount = 0;
+
+    uint32_t textUsed = 0;
+    for (const auto &field: fields) {
+        if (record.fieldCount == LOG_MAX_FIELDS) {
+            break;
+        }
+        Record::Field &stored = record.fields[record.fieldCount++];
+        stored.key = field.key;
+        stored.type = field.type;
+        stored.textOffset = 0;
+        stored.textLength = 0;
+        std::memcpy(&stored.value, &field.uintValue, sizeof(stored.value));
+
+        if (field.type == LogField::Type::String) {
+            auto length = static_cast<uint32_t>(std::min<size_t>(field.text.size(), LOG_TEXT_SIZE - textUsed));
+            std::memcpy(record.text + textUsed, field.text.data(), length);
+            stored.textOffset = static_cast<uint16_t>(textUsed);
+            stored.textLength = static_cast<uint16_t>(length);
+            textUsed += length;
+        }
+    }
+
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+LogLevel Logger::parseLevel(const std::string &name) {
+    for (uint8_t level = 0; level <= static_cast<uint8_t>(LogLevel::Off); level++) {
+        if (name == LOG_LEVEL_NAMES[level]) {
+            return static_cast<LogLevel>(level);
+        }
+    }
+    throw std::runtime_error("Unknown log level: " + name);
+}
+
+// #endregion
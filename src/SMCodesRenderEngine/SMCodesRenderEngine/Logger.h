@@ -0,0 +1,151 @@
+#ifndef SMCODESRENDERENGINE_LOGGER_H
+#define SMCODESRENDERENGINE_LOGGER_H
+
+
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class LogLevel : uint8_t {
+    Trace,
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off
+};
+
+// levels below this are compiled out entirely, set with -DSMCODES_LOG_COMPILE_LEVEL=<0 trace .. 5 off>
+#ifndef SMCODES_LOG_COMPILE_LEVEL
+#define SMCODES_LOG_COMPILE_LEVEL 1
+#endif
+
+struct LoggerSettings {
+    LogLevel level = LogLevel::Info; // levels below this are dropped at runtime
+    std::string path; // JSON lines get appended to this file, empty writes them to stdout
+    uint32_t flushIntervalMs = 20; // how long records can sit in the rings before the writer looks
+};
+
+// A key and value attached to a log record. Numbers are kept as they are and strings get copied into the
+// record, turning any of it into text is left to the writer thread. The key has to be a string literal
+struct LogField {
+    enum class Type : uint8_t {
+        Int,
+        UInt,
+        Double,
+        Bool,
+        String
+    };
+
+    const char *key;
+    Type type;
+    union {
+        int64_t intValue;
+        uint64_t uintValue;
+        double doubleValue;
+    };
+    std::string_view text;
+
+    LogField(const char *key, bool value) : key(key), type(Type::Bool), uintValue(value ? 1 : 0) {}
+
+    template<std::signed_integral T>
+    LogField(const char *key, T value) : key(key), type(Type::Int), intValue(value) {}
+
+    template<std::unsigned_integral T>
+    LogField(const char *key, T value) : key(key), type(Type::UInt), uintValue(value) {}
+
+    template<std::floating_point T>
+    LogField(const char *key, T value) : key(key), type(Type::Double), doubleValue(value) {}
+
+    LogField(const char *key, const char *value) : key(key), type(Type::String), uintValue(0), text(value) {}
+
+    LogField(const char *key, std::string_view value) : key(key), type(Type::String), uintValue(0), text(value) {}
+
+    LogField(const char *key, const std::string &value) : key(key), type(Type::String), uintValue(0), text(value) {}
+};
+
+// Structured logging that stays off the calling thread's critical path. Every thread that logs gets a ring
+// of fixed size records of its own (single producer, single consumer, no locks), a record is the message
+// pointer, a timestamp and the raw field values. A background thread drains every ring, orders the records
+// by time and writes them out as JSON lines:
+//  {"time":"2026-10-19T08:30:00.123456Z","level":"info","thread":2,"message":"...","frames":100}
+// A full ring drops the record rather than waiting, the writer reports how many went missing.
+// Use the LOG_* macros, they skip everything (even evaluating the fields) for filtered out levels
+class Logger {
+public:
+    // can be called again at any point, records already logged go to the old destination
+    static void configure(const LoggerSettings &settings);
+
+    // blocks until everything logged so far (by any thread) has been written
+    static void flush();
+
+    static bool isEnabled(LogLevel level) {
+        return static_cast<uint8_t>(level) >= minimumLevel.load(std::memory_order_relaxed);
+    }
+
+    // message has to be a string literal (or outlive the logger), anything that changes goes in fields:
+    //  LOG_INFO("rendered frame", {{"frame", frame}, {"device", deviceName}});
+    static void log(LogLevel level, const char *message, std::initializer_list<LogField> fields = {});
+
+    static LogLevel parseLevel(const std::string &name);
+
+    ~Logger();
+
+private:
+    struct Record;
+    struct Ring;
+    struct RingHandle;
+
+    inline static std::atomic<uint8_t> minimumLevel{static_cast<uint8_t>(LogLevel::Info)};
+
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable flushedCondition;
+    std::vector<std::shared_ptr<Ring>> rings;
+    uint32_t nextThreadId = 0;
+    uint64_t flushRequested = 0;
+    uint64_t flushed = 0;
+    bool stopping = false;
+    uint32_t flushIntervalMs = 20;
+    std::mutex outputMutex; // held while writing, configure() swaps output under it
+    std::FILE *output = stdout;
+    std::thread thread;
+
+    Logger();
+
+    static Logger &get();
+
+    std::shared_ptr<Ring> addRing();
+
+    void writerLoop();
+
+    // writes out every record that is in the rings right now
+    void drain(const std::vector<std::shared_ptr<Ring>> &snapshot);
+};
+
+#define SMCODES_LOG(level, ...)                                                        \
+    do {                                                                               \
+        if constexpr (static_cast<int>(level) >= SMCODES_LOG_COMPILE_LEVEL) {          \
+            if (Logger::isEnabled(level)) {                                            \
+                Logger::log(level, __VA_ARGS__);                                       \
+            }                                                                          \
+        }                                                                              \
+    } while (false)
+
+#define LOG_TRACE(...) SMCODES_LOG(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) SMCODES_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) SMCODES_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARNING(...) SMCODES_LOG(LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) SMCODES_LOG(LogLevel::Error, __VA_ARGS__)
+
+
+#endif //SMCODESRENDERENGINE_LOGGER_H
@@ -0,0 +1,28 @@
+#include "MaterialTable.h"
+
+// #region Public Methods
+
+MaterialTable::MaterialTable(const std::vector<Material> &materials) {
+    types.reserve(materials.size());
+    albedos.reserve(materials.size());
+    emissions.reserve(materials.size());
+    albedoTextures.reserve(materials.size());
+    roughnesses.reserve(materials.size());
+    iors.reserve(materials.size());
+
+    for (const auto &material: materials) {
+        types.push_back(material.type);
+        albedos.push_back(material.albedo);
+        emissions.push_back(material.emission);
+        albedoTextures.push_back(material.albedoTexture);
+        roughnesses.push_back(material.roughness);
+        iors.push_back(material.ior);
+    }
+}
+
+bool MaterialTable::isEmissive(uint32_t material) const {
+    const glm::vec3 &emission = emissions[material];
+    return emission.x > 0.0f || emission.y > 0.0f || emission.z > 0.0f;
+}
+
+// #endregion
@@ -0,0 +1,28 @@
+#ifndef SMCODESRENDERENGINE_MATERIALTABLE_H
+#define SMCODESRENDERENGINE_MATERIALTABLE_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Scene.h"
+
+// The scene's materials split into one array per parameter, indexed by material. Shading goes through the
+// materials one run at a time and each BSDF kernel only reads the columns it needs, rather than dragging whole
+// Material structs through the cache for a field or two
+struct MaterialTable {
+    std::vector<MaterialType> types;
+    std::vector<glm::vec3> albedos;
+    std::vector<glm::vec3> emissions;
+    std::vector<uint32_t> albedoTextures;
+    std::vector<float> roughnesses;
+    std::vector<float> iors;
+
+    explicit MaterialTable(const std::vector<Material> &materials);
+
+    bool isEmissive(uint32_t material) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_MATERIALTABLE_H
@@ -0,0 +1,450 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+// #region Constants
+
+// a plane across an open or material border edge weighs as much as this many edge length squared patches of surface
+const double BORDER_WEIGHT = 100.0;
+
+// collapses turning a triangle's normal by more than about 80 degrees are skipped
+const double FLIP_COS_THRESHOLD = 0.2;
+
+// a level keeping more than this fraction of the one before's triangles ends the chain, the rest is all borders
+const float MIN_LEVEL_REDUCTION = 0.9f;
+
+// #endregion
+
+// #region Private Methods
+
+// symmetric 4x4 matrix of summed planes, evaluate(p) is the weighted sum of squared distances from p to them
+struct Quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+    double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+    double a22 = 0.0, a23 = 0.0;
+    double a33 = 0.0;
+    double area = 0.0; // of the triangle planes only, turns the summed error back into a squared distance
+
+    // the plane dot(normal, p) + distance = 0, normal is unit length
+    static Quadric fromPlane(const glm::dvec3 &normal, double distance, double weight) {
+        Quadric quadric;
+        quadric.a00 = weight * normal.x * normal.x;
+        quadric.a01 = weight * normal.x * normal.y;
+        quadric.a02 = weight * normal.x * normal.z;
+        quadric.a03 = weight * normal.x * distance;
+        quadric.a11 = weight * normal.y * normal.y;
+        quadric.a12 = weight * normal.y * normal.z;
+        quadric.a13 = weight * normal.y * distance;
+        quadric.a22 = weight * normal.z * normal.z;
+        quadric.a23 = weight * normal.z * distance;
+        quadric.a33 = weight * distance * distance;
+        return quadric;
+    }
+
+    void add(const Quadric &other) {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a03 += other.a03;
+        a11 += other.a11;
+        a12 += other.a12;
+        a13 += other.a13;
+        a22 += other.a22;
+        a23 += other.a23;
+        a33 += other.a33;
+        area += other.area;
+    }
+
+    double evaluate(const glm::dvec3 &p) const {
+        return a00 * p.x * p.x + 2.0 * a01 * p.x * p.y + 2.0 * a02 * p.x * p.z + 2.0 * a03 * p.x +
+               a11 * p.y * p.y + 2.0 * a12 * p.y * p.z + 2.0 * a13 * p.y +
+               a22 * p.z * p.z + 2.0 * a23 * p.z + a33;
+    }
+
+    // the point evaluate() is smallest at, false when the planes don't pin one down (a flat patch or a ridge)
+    bool minimise(glm::dvec3 &p) const {
+        // Cramer's rule on the symmetric 3x3 part
+        double c00 = a11 * a22 - a12 * a12;
+        double c01 = a02 * a12 - a01 * a22;
+        double c02 = a01 * a12 - a02 * a11;
+        double determinant = a00 * c00 + a01 * c01 + a02 * c02;
+        double trace = a00 + a11 + a22;
+        if (std::abs(determinant) <= 1e-9 * trace * trace * trace) {
+            return false;
+        }
+        double c11 = a00 * a22 - a02 * a02;
+        double c12 = a01 * a02 - a00 * a12;
+        double c22 = a00 * a11 - a01 * a01;
+        glm::dvec3 b(-a03, -a13, -a23);
+        p = glm::dvec3(c00 * b.x + c01 * b.y + c02 * b.z,
+                       c01 * b.x + c11 * b.y + c12 * b.z,
+                       c02 * b.x + c12 * b.y + c22 * b.z) / determinant;
+        return true;
+    }
+};
+
+// where the merged vertex of an edge collapse goes
+struct Collapse {
+    glm::dvec3 position;
+    double t = 0.0; // along the edge, for the uv
+    double cost = 0.0;
+};
+
+// waiting in the queue, stale once either vertex has been collapsed since
+struct EdgeCandidate {
+    double cost;
+    uint32_t a;
+    uint32_t b;
+    uint32_t versionA;
+    uint32_t versionB;
+
+    bool operator>(const EdgeCandidate &other) const {
+        return cost > other.cost;
+    }
+};
+
+// the cheaper of the quadric's own minimum and the ends and middle of the edge. The minimum is only trusted when it
+// lands near the edge, far off it the solve was badly conditioned
+static Collapse findCollapse(const Quadric &quadric, const glm::dvec3 &a, const glm::dvec3 &b) {
+    Collapse best;
+    best.cost = std::numeric_limits<double>::infinity();
+    auto consider = [&](const glm::dvec3 &position, double t) {
+        double cost = quadric.evaluate(position);
+        if (cost < best.cost) {
+            best.position = position;
+            best.t = t;
+            best.cost = cost;
+        }
+    };
+    consider(a, 0.0);
+    consider(b, 1.0);
+    consider((a + b) * 0.5, 0.5);
+
+    glm::dvec3 optimal;
+    if (quadric.minimise(optimal)) {
+        glm::dvec3 edge = b - a;
+        double lengthSquared = glm::dot(edge, edge);
+        double t = lengthSquared > 0.0 ? std::clamp(glm::dot(optimal - a, edge) / lengthSquared, 0.0, 1.0) : 0.0;
+        glm::dvec3 offset = optimal - (a + edge * t);
+        if (glm::dot(offset, offset) <= lengthSquared) {
+            consider(optimal, t);
+        }
+    }
+    best.cost = std::max(best.cost, 0.0);
+    return best;
+}
+
+static glm::dvec3 getNormal(const std::vector<glm::dvec3> &positions, const glm::uvec3 &triangle) {
+    return glm::cross(positions[triangle.y] - positions[triangle.x], positions[triangle.z] - positions[triangle.x]);
+}
+
+// whether moving vertex to position turns any of its triangles over, the ones shared with other are about to go
+static bool flipsTriangles(const std::vector<glm::dvec3> &positions, const std::vector<glm::uvec3> &triangles,
+                           const std::vector<uint32_t> &vertexTriangles, uint32_t vertex, uint32_t other,
+                           const glm::dvec3 &position) {
+    for (uint32_t triangleIndex: vertexTriangles) {
+        const glm::uvec3 &triangle = triangles[triangleIndex];
+        if (triangle.x == other || triangle.y == other || triangle.z == other) {
+            continue;
+        }
+        glm::dvec3 before = getNormal(positions, triangle);
+        double beforeLength = glm::length(before);
+        if (beforeLength <= 0.0) {
+            continue;
+        }
+
+        glm::dvec3 corners[3] = {positions[triangle.x], positions[triangle.y], positions[triangle.z]};
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            if (triangle[corner] == vertex) {
+                corners[corner] = position;
+            }
+        }
+        glm::dvec3 after = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+        double afterLength = glm::length(after);
+        if (afterLength <= 1e-12 * beforeLength ||
+            glm::dot(before, after) < FLIP_COS_THRESHOLD * beforeLength * afterLength) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void getNeighbours(const std::vector<glm::uvec3> &triangles, const std::vector<uint32_t> &vertexTriangles,
+                          uint32_t vertex, std::vector<uint32_t> &neighbours) {
+    neighbours.clear();
+    for (uint32_t triangleIndex: vertexTriangles) {
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            if (triangles[triangleIndex][corner] != vertex) {
+                neighbours.push_back(triangles[triangleIndex][corner]);
+            }
+        }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+}
+
+// #endregion
+
+// #region Public Methods
+
+float LodChain::getError(uint32_t level) const {
+    return level == 0 ? 0.0f : levels[level - 1].error;
+}
+
+uint32_t LodChain::selectLevel(const glm::vec3 &viewPosition, float verticalFov, uint32_t imageHeight,
+                               float pixelError) const {
+    float distance = glm::length(viewPosition - centre) - radius;
+    if (distance <= 0.0f || pixelError <= 0.0f) {
+        return 0;
+    }
+
+    // pixels one world unit at distance covers on screen
+    float pixelsPerUnit = static_cast<float>(imageHeight) /
+                          (2.0f * std::tan(glm::radians(verticalFov) * 0.5f) * distance);
+    uint32_t level = 0;
+    // errors only grow down the chain
+    while (level + 1 < getLevelCount() && getError(level + 1) * pixelsPerUnit <= pixelError) {
+        level++;
+    }
+    return level;
+}
+
+MeshLevel simplifyMesh(const MeshLevel &mesh, uint32_t targetTriangleCount) {
+    auto vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    uint32_t triangleCount = mesh.getTriangleCount();
+    std::vector<glm::dvec3> positions(mesh.vertices.begin(), mesh.vertices.end());
+    std::vector<glm::vec2> uvs = mesh.uvs;
+    uvs.resize(vertexCount, glm::vec2(0.0f));
+    std::vector<glm::uvec3> triangles = mesh.triangles;
+    std::vector<bool> triangleAlive(triangleCount, true);
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+
+    // triangles that repeat a vertex (or point past the last one) cover nothing, but uploaded models do have
+    // them. They're dropped up front so every triangle is in each of its vertices' lists exactly once
+    uint32_t liveTriangles = 0;
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        const glm::uvec3 &triangle = triangles[i];
+        if (triangle.x == triangle.y || triangle.y == triangle.z || triangle.z == triangle.x ||
+            triangle.x >= vertexCount || triangle.y >= vertexCount || triangle.z >= vertexCount) {
+            triangleAlive[i] = false;
+            continue;
+        }
+        liveTriangles++;
+
+        glm::dvec3 normal = getNormal(positions, triangle);
+        double length = glm::length(normal);
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            vertexTriangles[triangle[corner]].push_back(i);
+        }
+        if (length <= 0.0) {
+            continue;
+        }
+        normal /= length;
+        Quadric quadric = Quadric::fromPlane(normal, -glm::dot(normal, positions[triangle.x]), length * 0.5);
+        quadric.area = length * 0.5;
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            quadrics[triangle[corner]].add(quadric);
+        }
+    }
+
+    // every edge once with a triangle on it, so borders can be found and the queue filled
+    struct EdgeSides {
+        uint32_t triangle;
+        uint32_t count;
+        bool materialBorder;
+    };
+    std::unordered_map<uint64_t, EdgeSides> edges;
+    edges.reserve(static_cast<size_t>(triangleCount) * 2);
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        if (!triangleAlive[i]) {
+            continue;
+        }
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            uint32_t a = triangles[i][corner];
+            uint32_t b = triangles[i][(corner + 1) % 3];
+            uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+            auto [it, inserted] = edges.try_emplace(key, EdgeSides{i, 0, false});
+            it->second.count++;
+            if (!inserted && mesh.triangleMaterials[it->second.triangle] != mesh.triangleMaterials[i]) {
+                it->second.materialBorder = true;
+            }
+        }
+    }
+
+    // open edges (and the odd non-manifold one) and material borders get a plane through the edge, standing
+    // upright on the triangle, so sliding off the edge costs far more than sliding along it
+    for (const auto &[key, sides]: edges) {
+        if (sides.count == 2 && !sides.materialBorder) {
+            continue;
+        }
+        auto a = static_cast<uint32_t>(key >> 32);
+        auto b = static_cast<uint32_t>(key);
+        glm::dvec3 edge = positions[b] - positions[a];
+        glm::dvec3 normal = glm::cross(edge, getNormal(positions, triangles[sides.triangle]));
+        double length = glm::length(normal);
+        if (length <= 0.0) {
+            continue;
+        }
+        normal /= length;
+        Quadric quadric = Quadric::fromPlane(normal, -glm::dot(normal, positions[a]),
+                                             BORDER_WEIGHT * glm::dot(edge, edge));
+        quadrics[a].add(quadric);
+        quadrics[b].add(quadric);
+    }
+
+    std::vector<uint32_t> versions(vertexCount, 0);
+    std::vector<bool> vertexAlive(vertexCount, true);
+    std::priority_queue<EdgeCandidate, std::vector<EdgeCandidate>, std::greater<>> queue;
+    auto pushEdge = [&](uint32_t a, uint32_t b) {
+        if (a == b) {
+            return;
+        }
+        Quadric quadric = quadrics[a];
+        quadric.add(quadrics[b]);
+        double cost = findCollapse(quadric, positions[a], positions[b]).cost;
+        queue.push({cost, a, b, versions[a], versions[b]});
+    };
+    for (const auto &[key, sides]: edges) {
+        pushEdge(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key));
+    }
+    edges.clear();
+
+    double error = 0.0;
+    std::vector<uint32_t> neighboursA;
+    std::vector<uint32_t> neighboursB;
+    while (liveTriangles > targetTriangleCount && !queue.empty()) {
+        EdgeCandidate candidate = queue.top();
+        queue.pop();
+        uint32_t a = candidate.a;
+        uint32_t b = candidate.b;
+        if (!vertexAlive[a] || !vertexAlive[b] || versions[a] != candidate.versionA ||
+            versions[b] != candidate.versionB) {
+            continue;
+        }
+
+        // the two ends can only share the vertices across the triangles on the edge, more and the collapse would
+        // pinch the surface into a non-manifold fold
+        getNeighbours(triangles, vertexTriangles[a], a, neighboursA);
+        getNeighbours(triangles, vertexTriangles[b], b, neighboursB);
+        uint32_t shared = 0;
+        for (uint32_t triangleIndex: vertexTriangles[b]) {
+            const glm::uvec3 &triangle = triangles[triangleIndex];
+            shared += triangle.x == a || triangle.y == a || triangle.z == a ? 1 : 0;
+        }
+        uint32_t commonCount = 0;
+        for (uint32_t neighbour: neighboursA) {
+            commonCount += std::binary_search(neighboursB.begin(), neighboursB.end(), neighbour) ? 1 : 0;
+        }
+        if (commonCount > shared) {
+            continue;
+        }
+
+        Quadric quadric = quadrics[a];
+        quadric.add(quadrics[b]);
+        Collapse collapse = findCollapse(quadric, positions[a], positions[b]);
+        if (flipsTriangles(positions, triangles, vertexTriangles[a], a, b, collapse.position) ||
+            flipsTriangles(positions, triangles, vertexTriangles[b], b, a, collapse.position)) {
+            continue;
+        }
+
+        // a stays, moved to the collapse, and takes over b's triangles. The ones on the edge go
+        positions[a] = collapse.position;
+        uvs[a] = glm::mix(uvs[a], uvs[b], static_cast<float>(collapse.t));
+        quadrics[a] = quadric;
+        for (uint32_t triangleIndex: vertexTriangles[b]) {
+            glm::uvec3 &triangle = triangles[triangleIndex];
+            if (triangle.x == a || triangle.y == a || triangle.z == a) {
+                triangleAlive[triangleIndex] = false;
+                liveTriangles--;
+                continue;
+            }
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                if (triangle[corner] == b) {
+                    triangle[corner] = a;
+                }
+            }
+            vertexTriangles[a].push_back(triangleIndex);
+        }
+        std::erase_if(vertexTriangles[a], [&](uint32_t triangleIndex) { return !triangleAlive[triangleIndex]; });
+        vertexAlive[b] = false;
+        std::vector<uint32_t>().swap(vertexTriangles[b]);
+        versions[a]++;
+        if (quadric.area > 0.0) {
+            error = std::max(error, std::sqrt(collapse.cost / quadric.area));
+        }
+
+        // the edges around a cost something else now
+        getNeighbours(triangles, vertexTriangles[a], a, neighboursA);
+        for (uint32_t neighbour: neighboursA) {
+            pushEdge(a, neighbour);
+        }
+    }
+
+    // what's left, with vertices renumbered in their old order
+    MeshLevel simplified;
+    std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        if (triangleAlive[i]) {
+            remap[triangles[i].x] = remap[triangles[i].y] = remap[triangles[i].z] = 0;
+        }
+    }
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        if (remap[i] != UINT32_MAX) {
+            remap[i] = static_cast<uint32_t>(simplified.vertices.size());
+            simplified.vertices.emplace_back(positions[i]);
+            simplified.uvs.push_back(uvs[i]);
+        }
+    }
+    simplified.triangles.reserve(liveTriangles);
+    simplified.triangleMaterials.reserve(liveTriangles);
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        if (triangleAlive[i]) {
+            simplified.triangles.emplace_back(remap[triangles[i].x], remap[triangles[i].y], remap[triangles[i].z]);
+            simplified.triangleMaterials.push_back(mesh.triangleMaterials[i]);
+        }
+    }
+    simplified.error = static_cast<float>(error);
+    return simplified;
+}
+
+LodChain buildLodChain(const MeshLevel &mesh, uint32_t maxLevels, uint32_t minTriangleCount) {
+    LodChain chain;
+    if (mesh.vertices.empty()) {
+        return chain;
+    }
+
+    glm::vec3 boundsMin = mesh.vertices[0];
+    glm::vec3 boundsMax = mesh.vertices[0];
+    for (const glm::vec3 &vertex: mesh.vertices) {
+        boundsMin = glm::min(boundsMin, vertex);
+        boundsMax = glm::max(boundsMax, vertex);
+    }
+    chain.centre = (boundsMin + boundsMax) * 0.5f;
+    for (const glm::vec3 &vertex: mesh.vertices) {
+        chain.radius = std::max(chain.radius, glm::length(vertex - chain.centre));
+    }
+
+    // every level is simplified from the one before, cheaper than going back to the full mesh each time and the
+    // errors just add up
+    chain.levels.reserve(maxLevels);
+    const MeshLevel *previous = &mesh;
+    while (chain.levels.size() < maxLevels && previous->getTriangleCount() > minTriangleCount) {
+        uint32_t previousCount = previous->getTriangleCount();
+        MeshLevel level = simplifyMesh(*previous, previousCount / 2);
+        if (static_cast<float>(level.getTriangleCount()) > static_cast<float>(previousCount) * MIN_LEVEL_REDUCTION) {
+            break;
+        }
+        level.error += previous->error;
+        chain.levels.push_back(std::move(level));
+        previous = &chain.levels.back();
+    }
+    return chain;
+}
+
+// #endregion
@@ -0,0 +1,57 @@
+#ifndef SMCODESRENDERENGINE_MESHSIMPLIFIER_H
+#define SMCODESRENDERENGINE_MESHSIMPLIFIER_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// an indexed triangle mesh on its own, the way a mesh is handed to Scene::addMesh() and one level of its LOD chain
+struct MeshLevel {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs; // one per vertex
+    std::vector<glm::uvec3> triangles;
+    std::vector<uint32_t> triangleMaterials;
+    // how far, in world units, the surface may have moved from the full detail mesh. The root mean square distance
+    // to the planes each collapse merged, summed over the levels in between, so a bound in practice rather than a
+    // guarantee
+    float error = 0.0f;
+
+    uint32_t getTriangleCount() const {
+        return static_cast<uint32_t>(triangles.size());
+    }
+};
+
+// Coarser and coarser versions of one mesh, each about half the triangles of the one before. Only the simplified
+// levels are kept here, level 0 is the full detail mesh wherever its owner keeps it
+struct LodChain {
+    std::vector<MeshLevel> levels; // levels[i] is level i + 1
+    glm::vec3 centre = glm::vec3(0.0f); // bounding sphere of the full detail mesh
+    float radius = 0.0f;
+
+    uint32_t getLevelCount() const {
+        return static_cast<uint32_t>(levels.size()) + 1;
+    }
+
+    float getError(uint32_t level) const;
+
+    // the coarsest level whose error, seen from viewPosition through a camera of verticalFov degrees rendering
+    // imageHeight rows, covers at most pixelError pixels. The error is projected from the nearest point of the
+    // bounding sphere, from inside it everything is full detail
+    uint32_t selectLevel(const glm::vec3 &viewPosition, float verticalFov, uint32_t imageHeight,
+                         float pixelError) const;
+};
+
+// Garland and Heckbert's quadric error metric: every vertex carries the sum of the (area weighted) planes of the
+// triangles around it, and the edge whose collapse moves its merged vertex least from those planes goes first.
+// Open edges and edges between two materials get a steep plane across them too, so outlines and material borders
+// stay put while the surfaces either side thin out. Collapses that would flip a triangle over are skipped.
+// Vertices are never welded, so a uv seam is an open edge on both sides and holds just like an outline
+MeshLevel simplifyMesh(const MeshLevel &mesh, uint32_t targetTriangleCount);
+
+// halves mesh until a level gets under minTriangleCount triangles, stops shrinking by much or there are maxLevels
+// simplified levels
+LodChain buildLodChain(const MeshLevel &mesh, uint32_t maxLevels = 8, uint32_t minTriangleCount = 64);
+
+
+#endif //SMCODESRENDERENGINE_MESHSIMPLIFIER_H
@@ -0,0 +1,211 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+// #region Private Methods
+
+static std::string formatValue(double value) {
+    if (std::isnan(value)) {
+        return "NaN";
+    }
+    if (std::isinf(value)) {
+        return value > 0 ? "+Inf" : "-Inf";
+    }
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return {buffer, result.ptr};
+}
+
+static void appendEscaped(std::string &out, const std::string &text, bool escapeQuotes) {
+    for (char c: text) {
+        if (c == '\\') {
+            out += "\\\\";
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '"' && escapeQuotes) {
+            out += "\\\"";
+        } else {
+            out += c;
+        }
+    }
+}
+
+static void appendSample(std::string &out, const MetricSample &sample) {
+    out += sample.name;
+    if (!sample.labels.empty()) {
+        out += '{';
+        for (size_t i = 0; i < sample.labels.size(); i++) {
+            if (i > 0) {
+                out += ',';
+            }
+            out += sample.labels[i].first;
+            out += "=\"";
+            appendEscaped(out, sample.labels[i].second, true);
+            out += '"';
+        }
+        out += '}';
+    }
+    out += ' ';
+    out += formatValue(sample.value);
+    out += '\n';
+}
+
+Metrics &Metrics::get() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Series &Metrics::findSeries(const std::string &name, const std::string &help, Type type,
+                                     const MetricLabels &labels, const std::vector<double> &bounds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [it, added] = families.try_emplace(name);
+    Family &family = it->second;
+    if (added) {
+        family.type = type;
+        family.help = help;
+    } else if (family.type != type) {
+        throw std::runtime_error("Metric " + name + " was already registered as a different type!");
+    }
+
+    for (auto &series: family.series) {
+        if (series->labels == labels) {
+            return *series;
+        }
+    }
+    // the metric is made here under the lock and never replaced, so callers and the exposition can use it without
+    // taking the lock again
+    auto series = std::make_unique<Series>();
+    series->labels = labels;
+    if (type == Type::Counter) {
+        series->counter = std::make_unique<Counter>();
+    } else if (type == Type::Gauge) {
+        series->gauge = std::make_unique<Gauge>();
+    } else {
+        series->histogram = std::make_unique<Histogram>(bounds);
+    }
+    family.series.push_back(std::move(series));
+    return *family.series.back();
+}
+
+void Metrics::appendSamples(const std::string &name, const Family &family, std::vector<MetricSample> &samples) {
+    for (const auto &series: family.series) {
+        if (series->counter) {
+            samples.push_back({name, series->labels, series->counter->getValue()});
+        } else if (series->gauge) {
+            samples.push_back({name, series->labels, series->gauge->getValue()});
+        } else if (series->histogram) {
+            const Histogram &histogram = *series->histogram;
+            std::vector<uint64_t> counts = histogram.getBucketCounts();
+
+            // cumulative in the exposition, so +Inf is the count
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                cumulative += counts[i];
+                MetricLabels labels = series->labels;
+                labels.emplace_back("le", i < histogram.getBounds().size() ? formatValue(histogram.getBounds()[i])
+                                                                           : "+Inf");
+                samples.push_back({name + "_bucket", labels, static_cast<double>(cumulative)});
+            }
+            samples.push_back({name + "_sum", series->labels, histogram.getSum()});
+            samples.push_back({name + "_count", series->labels, static_cast<double>(cumulative)});
+        }
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+Histogram::Histogram(std::vector<double> bounds) : bounds(std::move(bounds)) {
+    if (!std::is_sorted(this->bounds.begin(), this->bounds.end())) {
+        throw std::runtime_error("Histogram bucket bounds have to be ascending!");
+    }
+    bucketCounts = std::make_unique<std::atomic<uint64_t>[]>(this->bounds.size() + 1);
+}
+
+void Histogram::observe(double value) {
+    // first bucket whose upper bound is at least value, Prometheus buckets are "less than or equal"
+    auto bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+    bucketCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+const std::vector<double> &Histogram::getBounds() const {
+    return bounds;
+}
+
+std::vector<uint64_t> Histogram::getBucketCounts() const {
+    std::vector<uint64_t> counts(bounds.size() + 1);
+    for (size_t i = 0; i < counts.size(); i++) {
+        counts[i] = bucketCounts[i].load(std::memory_order_relaxed);
+    }
+    return counts;
+}
+
+uint64_t Histogram::getCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+double Histogram::getSum() const {
+    return sum.load(std::memory_order_relaxed);
+}
+
+Counter &Metrics::counter(const std::string &name, const std::string &help, const MetricLabels &labels) {
+    return *get().findSeries(name, help, Type::Counter, labels).counter;
+}
+
+Gauge &Metrics::gauge(const std::string &name, const std::string &help, const MetricLabels &labels) {
+    return *get().findSeries(name, help, Type::Gauge, labels).gauge;
+}
+
+Histogram &Metrics::histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds,
+                              const MetricLabels &labels) {
+    return *get().findSeries(name, help, Type::Histogram, labels, bounds).histogram;
+}
+
+std::vector<MetricSample> Metrics::snapshot() {
+    Metrics &metrics = get();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+
+    std::vector<MetricSample> samples;
+    for (const auto &[name, family]: metrics.families) {
+        appendSamples(name, family, samples);
+    }
+    return samples;
+}
+
+std::string Metrics::renderPrometheus() {
+    Metrics &metrics = get();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+
+    std::string out;
+    std::vector<MetricSample> samples;
+    for (const auto &[name, family]: metrics.families) {
+        const char *type = "histogram";
+        if (family.type == Type::Counter) {
+            type = "counter";
+        } else if (family.type == Type::Gauge) {
+            type = "gauge";
+        }
+        out += "# HELP " + name + " ";
+        appendEscaped(out, family.help, false);
+        out += "\n# TYPE " + name + " " + type + "\n";
+
+        samples.clear();
+        appendSamples(name, family, samples);
+        for (const auto &sample: samples) {
+            appendSample(out, sample);
+        }
+    }
+    return out;
+}
+
+std::vector<double> Metrics::getLatencyBounds() {
+    return {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0, 120.0};
+}
+
+// #endregion
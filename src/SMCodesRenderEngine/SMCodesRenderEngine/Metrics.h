@@ -0,0 +1,138 @@
+#ifndef SMCODESRENDERENGINE_METRICS_H
+#define SMCODESRENDERENGINE_METRICS_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// name/value pairs that tell the series of one metric apart, e.g. {{"device", "RTX 4090"}}
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+// only ever goes up, rates (rays/s, frames/s) come from how fast it does
+class Counter {
+public:
+    void add(double amount = 1.0) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    double getValue() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> value{0.0};
+};
+
+// a value that is set rather than added to, memory in use, progress
+class Gauge {
+public:
+    void set(double newValue) {
+        value.store(newValue, std::memory_order_relaxed);
+    }
+
+    void add(double amount) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    double getValue() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> value{0.0};
+};
+
+// observations counted into fixed buckets (upper bounds, ascending) plus their sum, for latencies
+class Histogram {
+public:
+    explicit Histogram(std::vector<double> bounds);
+
+    void observe(double value);
+
+    const std::vector<double> &getBounds() const;
+
+    // per bucket, not cumulative. One more than there are bounds, the last one is everything above
+    std::vector<uint64_t> getBucketCounts() const;
+
+    uint64_t getCount() const;
+
+    double getSum() const;
+
+private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> bucketCounts;
+    std::atomic<uint64_t> count{0};
+    std::atomic<double> sum{0.0};
+};
+
+// one sample line of the exposition, histograms expand into _bucket (with an "le" label), _sum and _count
+struct MetricSample {
+    std::string name;
+    MetricLabels labels;
+    double value = 0.0;
+};
+
+// Process wide registry of everything the engine measures. Looking a metric up takes a lock, so the
+// places that update one often look it up once and keep the reference, which stays valid for the life of
+// the process. Updating is a relaxed atomic, cheap enough for per tile and per frame updates.
+// Read through snapshot() in process, or over HTTP in the Prometheus text format (see MetricsServer)
+class Metrics {
+public:
+    // the same name and labels always give back the same metric. Names follow Prometheus conventions,
+    // smcodes_ prefixed with the unit last (_seconds, _bytes) and _total on counters
+    static Counter &counter(const std::string &name, const std::string &help, const MetricLabels &labels = {});
+
+    static Gauge &gauge(const std::string &name, const std::string &help, const MetricLabels &labels = {});
+
+    // the bounds of the first lookup are used from then on
+    static Histogram &histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds,
+                                const MetricLabels &labels = {});
+
+    static std::vector<MetricSample> snapshot();
+
+    // text exposition format 0.0.4
+    static std::string renderPrometheus();
+
+    // buckets for durations from a millisecond to a couple of minutes
+    static std::vector<double> getLatencyBounds();
+
+private:
+    enum class Type {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    struct Series {
+        MetricLabels labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    struct Family {
+        Type type;
+        std::string help;
+        std::vector<std::unique_ptr<Series>> series;
+    };
+
+    std::mutex mutex;
+    std::map<std::string, Family> families; // sorted, so the exposition comes out in the same order every time
+
+    static Metrics &get();
+
+    // creates the series and its metric the first time, bounds are only used for histograms
+    Series &findSeries(const std::string &name, const std::string &help, Type type, const MetricLabels &labels,
+                       const std::vector<double> &bounds = {});
+
+    static void appendSamples(const std::string &name, const Family &family, std::vector<MetricSample> &samples);
+};
+
+
+#endif //SMCODESRENDERENGINE_METRICS_H
@@ -0,0 +1,87 @@
+#include "MetricsServer.h"
+
+#include <exception>
+#include <string>
+
+#include "Logger.h"
+#include "Metrics.h"
+
+// #region Constants
+
+const uint32_t METRICS_ACCEPT_POLL_MS = 100; // how quickly the server notices it is being destroyed
+const uint32_t METRICS_RECEIVE_TIMEOUT_MS = 5000;
+const size_t METRICS_MAX_REQUEST_SIZE = 8192; // headers included, a scrape is a few hundred bytes
+
+// #endregion
+
+// #region Private Methods
+
+static void sendResponse(Socket &connection, const char *status, const std::string &contentType,
+                         const std::string &body) {
+    std::string response = std::string("HTTP/1.1 ") + status + "\r\n" +
+                           "Content-Type: " + contentType + "\r\n" +
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                           "Connection: close\r\n\r\n" + body;
+    connection.sendAll(response.data(), response.size());
+}
+
+void MetricsServer::serve() {
+    while (!stopping.load(std::memory_order_relaxed)) {
+        try {
+            if (listener.waitReadable(METRICS_ACCEPT_POLL_MS)) {
+                Socket connection = listener.accept();
+                answer(connection);
+            }
+        } catch (const std::exception &e) {
+            // a scraper that hangs up early shouldn't take the endpoint down with it
+            LOG_WARNING("metrics request failed", {{"error", e.what()}});
+        }
+    }
+}
+
+void MetricsServer::answer(Socket &connection) {
+    connection.setReceiveTimeout(METRICS_RECEIVE_TIMEOUT_MS);
+
+    // only the request line matters, but the headers get read too so closing doesn't reset the connection
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        if (request.size() >= METRICS_MAX_REQUEST_SIZE) {
+            sendResponse(connection, "431 Request Header Fields Too Large", "text/plain", "request too large\n");
+            return;
+        }
+        size_t count = connection.receive(buffer, sizeof(buffer));
+        if (count == 0) {
+            return;
+        }
+        request.append(buffer, count);
+    }
+
+    std::string requestLine = request.substr(0, request.find("\r\n"));
+    if (requestLine.starts_with("GET /metrics ") || requestLine.starts_with("GET /metrics?")) {
+        sendResponse(connection, "200 OK", "text/plain; version=0.0.4; charset=utf-8", Metrics::renderPrometheus());
+    } else {
+        sendResponse(connection, "404 Not Found", "text/plain", "metrics are at /metrics\n");
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+MetricsServer::MetricsServer(uint16_t port) : listener(Socket::listen(port)) {
+    this->port = listener.getLocalPort();
+    thread = std::thread(&MetricsServer::serve, this);
+    LOG_INFO("serving metrics", {{"port", this->port}, {"path", "/metrics"}});
+}
+
+MetricsServer::~MetricsServer() {
+    stopping.store(true, std::memory_order_relaxed);
+    thread.join();
+}
+
+uint16_t MetricsServer::getPort() const {
+    return port;
+}
+
+// #endregion
@@ -0,0 +1,39 @@
+#ifndef SMCODESRENDERENGINE_METRICSSERVER_H
+#define SMCODESRENDERENGINE_METRICSSERVER_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "Socket.h"
+
+// Smallest HTTP server that Prometheus can scrape. Answers GET /metrics with Metrics::renderPrometheus()
+// from a thread of its own, one connection at a time, everything else gets a 404.
+// Serves until it is destroyed
+class MetricsServer {
+public:
+    // port 0 lets the OS pick a free one (see getPort())
+    explicit MetricsServer(uint16_t port);
+
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    uint16_t getPort() const;
+
+private:
+    Socket listener;
+    uint16_t port;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    void serve();
+
+    static void answer(Socket &connection);
+};
+
+
+#endif //SMCODESRENDERENGINE_METRICSSERVER_H
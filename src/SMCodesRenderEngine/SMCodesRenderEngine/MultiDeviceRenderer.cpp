@@ -0,0 +1,103 @@
+#include "MultiDeviceRenderer.h"
+
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "DeviceScheduler.h"
+#include "Logger.h"
+
+// #region Public Methods
+
+MultiDeviceRenderer::MultiDeviceRenderer(const HeadlessSettings &settings, std::vector<uint32_t> deviceIndices,
+                                         uint32_t framesInFlight)
+        : settings(settings), deviceIndices(std::move(deviceIndices)), framesInFlight(framesInFlight) {
+}
+
+void MultiDeviceRenderer::render(ImageWriter &imageWriter) {
+    if (deviceIndices.empty()) {
+        for (const auto &candidate: HelloTriangleApplication::findHeadlessDevices()) {
+            LOG_INFO("found headless device", {{"index", candidate.index}, {"device", candidate.name},
+                                               {"score", candidate.score}});
+            deviceIndices.push_back(candidate.index);
+        }
+    }
+    if (deviceIndices.empty()) {
+        throw std::runtime_error("Failed to find a suitable GPU");
+    }
+
+    // opened one after the other, device creation isn't worth overlapping
+    try {
+        for (uint32_t deviceIndex: deviceIndices) {
+            HeadlessSettings deviceSettings = settings;
+            deviceSettings.deviceIndex = deviceIndex;
+
+            auto application = std::make_unique<HelloTriangleApplication>(framesInFlight);
+            application->beginHeadless(deviceSettings, imageWriter);
+            applications.push_back(std::move(application));
+        }
+    } catch (...) {
+        for (auto &application: applications) {
+            application->endHeadless();
+        }
+        applications.clear();
+        throw;
+    }
+
+    auto deviceCount = static_cast<uint32_t>(applications.size());
+    DeviceScheduler scheduler(settings.frameCount, deviceCount);
+    std::vector<double> deviceSeconds(deviceCount, 0.0);
+    std::vector<std::exception_ptr> errors(deviceCount);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t device = 0; device < deviceCount; device++) {
+        threads.emplace_back([&, device] {
+            HelloTriangleApplication &application = *applications[device];
+            try {
+                // renderHeadlessFrames() only waits for frames in flight, so the completed frame (every frame
+                // on this device is part of the batch) trails what was submitted by no more than that
+                for (WorkRange range = scheduler.next(device); range.count > 0; range = scheduler.next(device)) {
+                    application.renderHeadlessFrames(range.first + 1, range.count);
+
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    scheduler.report(device, application.getCompletedFrame(), seconds);
+                }
+                application.finishHeadless();
+            } catch (...) {
+                errors[device] = std::current_exception();
+                // the batch can't be completed anymore, let the other devices stop early
+                scheduler.cancel();
+            }
+            deviceSeconds[device] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (uint32_t device = 0; device < deviceCount; device++) {
+        uint32_t frames = scheduler.getItemsAssigned(device);
+        LOG_INFO("device rendered", {{"device", applications[device]->getDeviceName()},
+                                     {"index", deviceIndices[device]}, {"frames", frames},
+                                     {"framesPerSecond", frames / deviceSeconds[device]}});
+    }
+    LOG_INFO("rendered headless", {{"frames", settings.frameCount}, {"devices", deviceCount}, {"seconds", seconds},
+                                   {"framesPerSecond", settings.frameCount / seconds}});
+
+    for (auto &application: applications) {
+        application->endHeadless();
+    }
+    applications.clear();
+
+    for (const auto &error: errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// #endregion
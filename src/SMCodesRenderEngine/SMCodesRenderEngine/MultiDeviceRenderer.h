@@ -0,0 +1,35 @@
+#ifndef SMCODESRENDERENGINE_MULTIDEVICERENDERER_H
+#define SMCODESRENDERENGINE_MULTIDEVICERENDERER_H
+
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "HelloTriangleApplication.h"
+
+class ImageWriter;
+
+// Renders one headless batch across several Vulkan devices at once. Every entry of deviceIndices gets an
+// application of its own (instance, logical device, queues, memory) driven by its own thread, and the
+// frames are handed out by a DeviceScheduler weighted by how fast each device turns out to be.
+// A physical device can be listed more than once to get several logical devices on it, which is also
+// how this gets tested on a machine with a single (or a software) device
+class MultiDeviceRenderer {
+public:
+    // empty deviceIndices opens every suitable physical device once
+    MultiDeviceRenderer(const HeadlessSettings &settings, std::vector<uint32_t> deviceIndices,
+                        uint32_t framesInFlight);
+
+    // renders settings.frameCount frames, output files are numbered the same as with a single device
+    void render(ImageWriter &imageWriter);
+
+private:
+    HeadlessSettings settings;
+    std::vector<uint32_t> deviceIndices;
+    uint32_t framesInFlight;
+    std::vector<std::unique_ptr<HelloTriangleApplication>> applications;
+};
+
+
+#endif //SMCODESRENDERENGINE_MULTIDEVICERENDERER_H
@@ -0,0 +1,456 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#include "VulkanUtils.h"
+
+// #region Constants
+
+const VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+
+// a 64K x 64K depth buffer, far past anything the pyramid gets built for
+const uint32_t MAX_PYRAMID_LEVELS = 16;
+
+// local sizes of depth_pyramid.comp and occlusion_cull.comp
+const uint32_t PYRAMID_GROUP_SIZE = 8;
+const uint32_t CULL_GROUP_SIZE = 64;
+
+// #endregion
+
+// #region Private Methods
+
+static uint32_t previousPowerOfTwo(uint32_t value) {
+    uint32_t power = 1;
+    while (power * 2 <= value) {
+        power *= 2;
+    }
+    return power;
+}
+
+// everything the culler writes before whatever reads it next, one global barrier is all a compute pass needs
+static void recordMemoryBarrier(VkCommandBuffer cmdBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+                                VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(cmdBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void OcclusionCuller::createBuffers(VkPhysicalDevice physicalDevice) {
+    createBuffer(physicalDevice, device, sizeof(CullObject) * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, objectBuffer,
+                 objectMemory);
+    createBuffer(physicalDevice, device, sizeof(uint32_t) * capacity,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibilityBuffer, visibilityMemory);
+    createBuffer(physicalDevice, device, sizeof(VkDrawIndexedIndirectCommand) * capacity * 2,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawBuffer, drawMemory);
+}
+
+void OcclusionCuller::createPipelines(VkShaderModule pyramidShader, VkShaderModule cullShader) {
+    // pyramid: the level above (or the depth buffer) sampled, the level being built as a storage image
+    std::array<VkDescriptorSetLayoutBinding, 2> pyramidBindings{};
+    pyramidBindings[0].binding = 0;
+    pyramidBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pyramidBindings[0].descriptorCount = 1;
+    pyramidBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pyramidBindings[1].binding = 1;
+    pyramidBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pyramidBindings[1].descriptorCount = 1;
+    pyramidBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    // cull: objects, visibility and draws, then the whole pyramid
+    std::array<VkDescriptorSetLayoutBinding, 4> cullBindings{};
+    for (uint32_t i = 0; i < 3; i++) {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    cullBindings[3].binding = 3;
+    cullBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    cullBindings[3].descriptorCount = 1;
+    cullBindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(pyramidBindings.size());
+    layoutInfo.pBindings = pyramidBindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &pyramidSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid descriptor set layout!");
+    }
+    layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+    layoutInfo.pBindings = cullBindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create occlusion cull descriptor set layout!");
+    }
+
+    // a set per pyramid level and the cull set, all allocated again on every resize()
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_PYRAMID_LEVELS + 1};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_PYRAMID_LEVELS};
+    poolSizes[2] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3};
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = MAX_PYRAMID_LEVELS + 1;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create occlusion cull descriptor pool!");
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &pyramidSetLayout;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pyramidLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullConstants);
+    pipelineLayoutInfo.pSetLayouts = &cullSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create occlusion cull pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = pyramidShader;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pyramidLayout;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pyramidPipeline) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid pipeline!");
+    }
+    pipelineInfo.stage.module = cullShader;
+    pipelineInfo.layout = cullLayout;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &cullPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create occlusion cull pipeline!");
+    }
+}
+
+void OcclusionCuller::destroyPyramid() {
+    for (VkImageView view: levelViews) {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    levelViews.clear();
+    levelExtents.clear();
+    vkDestroyImageView(device, pyramidView, nullptr);
+    vkDestroyImage(device, pyramid, nullptr);
+    vkFreeMemory(device, pyramidMemory, nullptr);
+    pyramidView = VK_NULL_HANDLE;
+    pyramid = VK_NULL_HANDLE;
+    pyramidMemory = VK_NULL_HANDLE;
+}
+
+void OcclusionCuller::recordCull(VkCommandBuffer cmdBuffer, const glm::mat4 &viewProjection, uint32_t phase) const {
+    if (objectCount == 0) {
+        return;
+    }
+
+    CullConstants constants{};
+    constants.viewProjection = viewProjection;
+    constants.objectCount = objectCount;
+    constants.phase = phase;
+    constants.drawOffset = phase * capacity;
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &cullSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+    vkCmdDispatch(cmdBuffer, (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+// #endregion
+
+// #region Public Methods
+
+bool OcclusionCuller::enableFeatures(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures &features) {
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supported);
+
+    // the object index rides in firstInstance, which indirect draws can only set with this
+    if (!supported.drawIndirectFirstInstance) {
+        return false;
+    }
+    features.drawIndirectFirstInstance = VK_TRUE;
+    // without it every object is its own indirect draw, slower to submit but still culled
+    features.multiDrawIndirect = supported.multiDrawIndirect;
+    return true;
+}
+
+void OcclusionCuller::create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkShaderModule pyramidShader,
+                             VkShaderModule cullShader, uint32_t objectCapacity) {
+    device = logicalDevice;
+    capacity = std::max(objectCapacity, 1u);
+
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supported);
+    multiDraw = supported.multiDrawIndirect == VK_TRUE;
+
+    createBuffers(physicalDevice);
+    createPipelines(pyramidShader, cullShader);
+
+    // texelFetch only, the sampler is there because combined image samplers need one
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid sampler!");
+    }
+
+    // the visibility buffer starts out as garbage
+    resetVisibility = true;
+}
+
+void OcclusionCuller::destroy() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    destroyPyramid();
+    vkDestroySampler(device, sampler, nullptr);
+    vkDestroyPipeline(device, pyramidPipeline, nullptr);
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(device, pyramidLayout, nullptr);
+    vkDestroyPipelineLayout(device, cullLayout, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, pyramidSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+    vkDestroyBuffer(device, objectBuffer, nullptr);
+    vkFreeMemory(device, objectMemory, nullptr);
+    vkDestroyBuffer(device, visibilityBuffer, nullptr);
+    vkFreeMemory(device, visibilityMemory, nullptr);
+    vkDestroyBuffer(device, drawBuffer, nullptr);
+    vkFreeMemory(device, drawMemory, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+void OcclusionCuller::resize(VkPhysicalDevice physicalDevice, VkExtent2D extent, VkImageView depthView) {
+    destroyPyramid();
+
+    // level 0 is the power of two at or under the depth buffer, so every level after halves exactly and a texel
+    // of it never covers more than 2x2 of the one above. Level 0 itself takes up to 3x3 depth texels
+    VkExtent2D levelExtent = {previousPowerOfTwo(std::max(extent.width, 1u)),
+                              previousPowerOfTwo(std::max(extent.height, 1u))};
+    while (levelExtents.size() < MAX_PYRAMID_LEVELS) {
+        levelExtents.push_back(levelExtent);
+        if (levelExtent.width == 1 && levelExtent.height == 1) {
+            break;
+        }
+        levelExtent = {std::max(levelExtent.width / 2, 1u), std::max(levelExtent.height / 2, 1u)};
+    }
+    auto levelCount = static_cast<uint32_t>(levelExtents.size());
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = PYRAMID_FORMAT;
+    imageInfo.extent = {levelExtents[0].width, levelExtents[0].height, 1};
+    imageInfo.mipLevels = levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    createImage(physicalDevice, device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pyramid, pyramidMemory);
+    pyramidView = createImageView(device, pyramid, PYRAMID_FORMAT);
+
+    for (uint32_t level = 0; level < levelCount; level++) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = pyramid;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = PYRAMID_FORMAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        VkImageView view;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth pyramid level view!");
+        }
+        levelViews.push_back(view);
+    }
+
+    // every set points at the new views
+    vkResetDescriptorPool(device, descriptorPool, 0);
+    std::vector<VkDescriptorSetLayout> layouts(levelCount, pyramidSetLayout);
+    layouts.push_back(cullSetLayout);
+    std::vector<VkDescriptorSet> sets(layouts.size());
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = descriptorPool;
+    allocateInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocateInfo.pSetLayouts = layouts.data();
+    if (vkAllocateDescriptorSets(device, &allocateInfo, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate occlusion cull descriptor sets!");
+    }
+    pyramidSets.assign(sets.begin(), sets.end() - 1);
+    cullSet = sets.back();
+
+    // kept in GENERAL, the pyramid is written and read by compute shaders and nothing else
+    std::vector<VkDescriptorImageInfo> sourceInfos(levelCount);
+    std::vector<VkDescriptorImageInfo> destinationInfos(levelCount);
+    std::vector<VkWriteDescriptorSet> writes;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        sourceInfos[level].sampler = sampler;
+        sourceInfos[level].imageView = level == 0 ? depthView : levelViews[level - 1];
+        sourceInfos[level].imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                                    : VK_IMAGE_LAYOUT_GENERAL;
+        destinationInfos[level].imageView = levelViews[level];
+        destinationInfos[level].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = pyramidSets[level];
+        write.descriptorCount = 1;
+        write.dstBinding = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &sourceInfos[level];
+        writes.push_back(write);
+        write.dstBinding = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        write.pImageInfo = &destinationInfos[level];
+        writes.push_back(write);
+    }
+
+    std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+    bufferInfos[0] = {objectBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[1] = {visibilityBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = {drawBuffer, 0, VK_WHOLE_SIZE};
+    for (uint32_t i = 0; i < 3; i++) {
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = cullSet;
+        write.dstBinding = i;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &bufferInfos[i];
+        writes.push_back(write);
+    }
+    VkDescriptorImageInfo pyramidInfo{sampler, pyramidView, VK_IMAGE_LAYOUT_GENERAL};
+    VkWriteDescriptorSet pyramidWrite{};
+    pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    pyramidWrite.dstSet = cullSet;
+    pyramidWrite.dstBinding = 3;
+    pyramidWrite.descriptorCount = 1;
+    pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pyramidWrite.pImageInfo = &pyramidInfo;
+    writes.push_back(pyramidWrite);
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void OcclusionCuller::setObjects(const std::vector<CullObject> &objects) {
+    if (objects.size() > capacity) {
+        throw std::runtime_error("failed to set occlusion cull objects, there are more than its capacity!");
+    }
+    objectCount = static_cast<uint32_t>(objects.size());
+    resetVisibility = true;
+    if (objects.empty()) {
+        return;
+    }
+
+    VkDeviceSize size = sizeof(CullObject) * objects.size();
+    void *data = nullptr;
+    if (vkMapMemory(device, objectMemory, 0, size, 0, &data) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map occlusion cull object memory!");
+    }
+    std::memcpy(data, objects.data(), static_cast<size_t>(size));
+    vkUnmapMemory(device, objectMemory);
+}
+
+void OcclusionCuller::recordFirstPhase(VkCommandBuffer cmdBuffer, const glm::mat4 &viewProjection) {
+    // a new set of objects hasn't been seen yet, so all of it goes in the first phase
+    if (resetVisibility) {
+        recordMemoryBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdFillBuffer(cmdBuffer, visibilityBuffer, 0, VK_WHOLE_SIZE, 1);
+        recordMemoryBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        resetVisibility = false;
+    }
+
+    // last frame's second phase wrote the visibility this reads, and its draws read the commands this overwrites
+    recordMemoryBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                        VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    recordCull(cmdBuffer, viewProjection, 0);
+    recordMemoryBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+void OcclusionCuller::recordSecondPhase(VkCommandBuffer cmdBuffer, const glm::mat4 &viewProjection) {
+    // last frame's pyramid is thrown away, its cull only has to be done reading it
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = pyramid;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    // one level at a time, each one has to be written before the next reads it
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline);
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    for (uint32_t level = 0; level < levelExtents.size(); level++) {
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidLayout, 0, 1, &pyramidSets[level],
+                                0, nullptr);
+        vkCmdDispatch(cmdBuffer, (levelExtents[level].width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+                      (levelExtents[level].height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    recordCull(cmdBuffer, viewProjection, 1);
+    recordMemoryBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+void OcclusionCuller::recordDraws(VkCommandBuffer cmdBuffer, uint32_t phase) const {
+    if (objectCount == 0) {
+        return;
+    }
+
+    // culled objects are draws of no instances, the GPU skips them without touching their vertices
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    VkDeviceSize offset = static_cast<VkDeviceSize>(phase) * capacity * stride;
+    if (multiDraw) {
+        vkCmdDrawIndexedIndirect(cmdBuffer, drawBuffer, offset, objectCount, stride);
+        return;
+    }
+    for (uint32_t i = 0; i < objectCount; i++) {
+        vkCmdDrawIndexedIndirect(cmdBuffer, drawBuffer, offset + static_cast<VkDeviceSize>(i) * stride, 1, stride);
+    }
+}
+
+uint32_t OcclusionCuller::getObjectCount() const {
+    return objectCount;
+}
+
+// #endregion
@@ -0,0 +1,112 @@
+#ifndef SMCODESRENDERENGINE_OCCLUSIONCULLER_H
+#define SMCODESRENDERENGINE_OCCLUSIONCULLER_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <cstdint>
+#include <vector>
+
+// one object the culler decides to draw or not, std430 to match occlusion_cull.comp
+struct CullObject {
+    glm::vec4 sphere; // world space centre and radius of its bounds
+    uint32_t indexCount; // the indexed draw it's made of
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t padding;
+};
+
+// Two phase occlusion culling against a hierarchical depth buffer, all on the GPU with no readback:
+// 1. recordFirstPhase() writes draws for the objects that were visible last frame and are in the frustum, which
+//    get drawn with recordDraws(cmdBuffer, 0). They're nearly always most of what ends up on screen, so the depth
+//    buffer afterwards is close to final
+// 2. recordSecondPhase() builds a depth pyramid from that depth buffer, every level keeping the farthest depth of
+//    the texels it covers, and tests every object's bounds against the level where they cover about a texel.
+//    Whatever passes is this frame's visible set, and draws for the ones the first phase left out are written for
+//    recordDraws(cmdBuffer, 1)
+// Objects behind walls only cost a few texel fetches, and nothing pops in when the camera turns: an object
+// revealed this frame is drawn this frame by the second phase.
+// Every object has a draw command in both phases whether it's drawn or not (instance count 0 or 1), its index
+// reaches the shaders as gl_InstanceIndex
+class OcclusionCuller {
+public:
+    // turns on the features the culler needs, false if the device is missing one and objects have to be drawn
+    // without it
+    static bool enableFeatures(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures &features);
+
+    // the shader modules are only used during create()
+    void create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkShaderModule pyramidShader,
+                VkShaderModule cullShader, uint32_t objectCapacity);
+
+    void destroy();
+
+    // the pyramid for depth buffers of extent, depthView is sampled in SHADER_READ_ONLY_OPTIMAL by the second
+    // phase. Nothing using the old pyramid can still be on the GPU
+    void resize(VkPhysicalDevice physicalDevice, VkExtent2D extent, VkImageView depthView);
+
+    // replaces every object, all of them count as visible for the next frame. Nothing culled with the old ones can
+    // still be on the GPU
+    void setObjects(const std::vector<CullObject> &objects);
+
+    // outside of a render pass, before the first phase's draws
+    void recordFirstPhase(VkCommandBuffer cmdBuffer, const glm::mat4 &viewProjection);
+
+    // outside of a render pass, once the first phase's depth is written and readable by compute shaders
+    void recordSecondPhase(VkCommandBuffer cmdBuffer, const glm::mat4 &viewProjection);
+
+    // phase 0 or 1's draws, inside the render pass with the pipeline and vertex and index buffers bound
+    void recordDraws(VkCommandBuffer cmdBuffer, uint32_t phase) const;
+
+    uint32_t getObjectCount() const;
+
+private:
+    // push constants of occlusion_cull.comp
+    struct CullConstants {
+        glm::mat4 viewProjection;
+        uint32_t objectCount;
+        uint32_t phase;
+        uint32_t drawOffset; // where the phase's commands start, in commands
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t capacity = 0;
+    uint32_t objectCount = 0;
+    bool multiDraw = false; // one indirect call per phase instead of one per object
+    bool resetVisibility = false; // every object visible again, done at the start of the next first phase
+
+    VkBuffer objectBuffer = VK_NULL_HANDLE; // host visible, written by setObjects()
+    VkDeviceMemory objectMemory = VK_NULL_HANDLE;
+    VkBuffer visibilityBuffer = VK_NULL_HANDLE; // a uint per object, whether it passed the last second phase
+    VkDeviceMemory visibilityMemory = VK_NULL_HANDLE;
+    VkBuffer drawBuffer = VK_NULL_HANDLE; // capacity commands for each phase
+    VkDeviceMemory drawMemory = VK_NULL_HANDLE;
+
+    VkImage pyramid = VK_NULL_HANDLE;
+    VkDeviceMemory pyramidMemory = VK_NULL_HANDLE;
+    VkImageView pyramidView = VK_NULL_HANDLE; // every level, for the cull shader
+    std::vector<VkImageView> levelViews; // one level each, for building
+    std::vector<VkExtent2D> levelExtents;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout pyramidSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> pyramidSets; // per level, reading the one above (the depth buffer for level 0)
+    VkDescriptorSet cullSet = VK_NULL_HANDLE;
+    VkPipelineLayout pyramidLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullLayout = VK_NULL_HANDLE;
+    VkPipeline pyramidPipeline = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+
+    void createBuffers(VkPhysicalDevice physicalDevice);
+
+    void createPipelines(VkShaderModule pyramidShader, VkShaderModule cullShader);
+
+    void destroyPyramid();
+
+    void recordCull(VkCommandBuffer cmdBuffer, const glm::mat4 &viewProjection, uint32_t phase) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_OCCLUSIONCULLER_H
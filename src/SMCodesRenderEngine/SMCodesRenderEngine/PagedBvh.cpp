@@ -0,0 +1,442 @@
+#include "PagedBvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "Metrics.h"
+#include "Scene.h"
+
+// #region Constants
+
+const uint32_t GEOMETRY_MAGIC = 0x50474D53; // "SMGP"
+const uint32_t GEOMETRY_VERSION = 1;
+
+// pages start on a boundary of this, the usual virtual memory page size
+const uint64_t GEOMETRY_PAGE_ALIGNMENT = 4096;
+
+// the top tree is only a few levels deep, the cut happens long before the page trees get deep
+const uint32_t TOP_STACK_SIZE = 64;
+
+// #endregion
+
+// #region Private Methods
+
+template<typename T>
+static void writeValue(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template<typename T>
+static T readValue(std::ifstream &file, const std::string &path) {
+    T value;
+    file.read(reinterpret_cast<char *>(&value), sizeof(value));
+    if (!file) {
+        throw std::runtime_error(path + " is truncated!");
+    }
+    return value;
+}
+
+static glm::vec3 getInverseDirection(const Ray &ray) {
+    return {safeReciprocal(ray.direction.x), safeReciprocal(ray.direction.y), safeReciprocal(ray.direction.z)};
+}
+
+void PagedBvh::findPages(const Ray &ray, uint32_t rayIndex, std::vector<PageRequest> &requests) const {
+    glm::vec3 inverseDirection = getInverseDirection(ray);
+    uint32_t stack[TOP_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Bvh::Node &node = topNodes[stack[--stackSize]];
+        float tEntry = Bvh::intersectAabb(ray, inverseDirection, ray.tMax, node.boundsMin, node.boundsMax);
+        if (tEntry == RAY_INFINITY) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            requests.push_back({node.leftFirst, rayIndex, tEntry});
+        } else {
+            stack[stackSize++] = node.leftFirst + 1;
+            stack[stackSize++] = node.leftFirst;
+        }
+    }
+}
+
+std::shared_ptr<const Bvh> PagedBvh::acquire(uint32_t page) const {
+    {
+        std::lock_guard<std::mutex> lock(residencyMutex);
+        if (resident[page]) {
+            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, recentlyUsedPositions[page]);
+            return resident[page];
+        }
+    }
+
+    // read outside the residency lock so threads tracing against resident pages don't wait on the disk
+    faults.add();
+    std::shared_ptr<const Bvh> loaded;
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(pages[page].offset));
+        loaded = std::make_shared<const Bvh>(file);
+    }
+
+    std::lock_guard<std::mutex> lock(residencyMutex);
+    if (resident[page]) {
+        // another thread read it in at the same time
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, recentlyUsedPositions[page]);
+        return resident[page];
+    }
+
+    uint64_t size = loaded->getMemoryUsage();
+    while (residentBytes + size > budget && !recentlyUsed.empty()) {
+        uint32_t victim = recentlyUsed.back();
+        recentlyUsed.pop_back();
+        residentBytes -= resident[victim]->getMemoryUsage();
+        resident[victim].reset();
+        evictions.add();
+    }
+
+    resident[page] = loaded;
+    recentlyUsed.push_front(page);
+    recentlyUsedPositions[page] = recentlyUsed.begin();
+    residentBytes += size;
+    residentBytesGauge.set(static_cast<double>(residentBytes));
+    return loaded;
+}
+
+void PagedBvh::orderRequests(std::vector<PageRequest> &requests, std::vector<uint32_t> &pageStarts) const {
+    // pages in memory sort first, the deferred ones after them. Stable so each page's rays keep the
+    // coherent order the wavefront sorted them into
+    std::vector<uint32_t> keys(pages.size());
+    {
+        std::lock_guard<std::mutex> lock(residencyMutex);
+        for (const PageRequest &request: requests) {
+            keys[request.page] = request.page | (resident[request.page] ? 0u : 0x80000000u);
+        }
+    }
+    std::stable_sort(requests.begin(), requests.end(), [&](const PageRequest &a, const PageRequest &b) {
+        return keys[a.page] < keys[b.page];
+    });
+
+    uint64_t deferred = 0;
+    pageStarts.clear();
+    for (uint32_t i = 0; i < static_cast<uint32_t>(requests.size()); i++) {
+        if (i == 0 || requests[i].page != requests[i - 1].page) {
+            pageStarts.push_back(i);
+        }
+        if ((keys[requests[i].page] & 0x80000000u) != 0) {
+            deferred++;
+        }
+    }
+    pageStarts.push_back(static_cast<uint32_t>(requests.size()));
+    deferredRays.add(static_cast<double>(deferred));
+}
+
+// #endregion
+
+// #region Public Methods
+
+void PagedBvh::write(const Scene &scene, const std::string &path, uint32_t trianglesPerPage) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Bvh::Node> topNodes;
+    std::vector<std::vector<uint32_t>> subtrees;
+    Bvh(scene).split(trianglesPerPage, topNodes, subtrees);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to create geometry pages: " + path);
+    }
+    writeValue(file, GEOMETRY_MAGIC);
+    writeValue(file, GEOMETRY_VERSION);
+    writeValue(file, scene.getTriangleCount());
+    writeValue(file, static_cast<uint32_t>(topNodes.size()));
+    writeValue(file, static_cast<uint32_t>(subtrees.size()));
+    file.write(reinterpret_cast<const char *>(topNodes.data()),
+               static_cast<std::streamsize>(topNodes.size() * sizeof(Bvh::Node)));
+
+    // the page table is filled in once the pages are written and their offsets are known
+    std::streamoff tableOffset = file.tellp();
+    std::vector<PageEntry> entries(subtrees.size());
+    for (const Bvh::Node &node: topNodes) {
+        if (node.isLeaf()) {
+            // the top tree's leaves keep the bounds of the subtree they stand for
+            entries[node.leftFirst].boundsMin = node.boundsMin;
+            entries[node.leftFirst].boundsMax = node.boundsMax;
+        }
+    }
+    file.write(reinterpret_cast<const char *>(entries.data()),
+               static_cast<std::streamsize>(entries.size() * sizeof(PageEntry)));
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(subtrees.size()); i++) {
+        auto offset = static_cast<uint64_t>(file.tellp());
+        uint64_t aligned = (offset + GEOMETRY_PAGE_ALIGNMENT - 1) / GEOMETRY_PAGE_ALIGNMENT * GEOMETRY_PAGE_ALIGNMENT;
+        for (; offset < aligned; offset++) {
+            file.put(0);
+        }
+
+        Bvh page(scene, subtrees[i]);
+        page.write(file);
+        auto end = static_cast<uint64_t>(file.tellp());
+
+        entries[i].offset = aligned;
+        entries[i].size = end - aligned;
+        entries[i].triangleCount = static_cast<uint32_t>(subtrees[i].size());
+    }
+
+    file.seekp(tableOffset);
+    file.write(reinterpret_cast<const char *>(entries.data()),
+               static_cast<std::streamsize>(entries.size() * sizeof(PageEntry)));
+    if (!file) {
+        throw std::runtime_error("failed to write geometry pages " + path + "!");
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("wrote geometry pages", {{"path", path}, {"triangles", scene.getTriangleCount()},
+                                      {"pages", subtrees.size()}, {"topNodes", topNodes.size()},
+                                      {"milliseconds", seconds * 1000.0}});
+}
+
+PagedBvh::PagedBvh(const Scene &scene, const std::string &path, uint64_t budget)
+        : path(path),
+          budget(budget),
+          faults(Metrics::counter("smcodes_geometry_page_faults_total", "Geometry pages read in from disk")),
+          evictions(Metrics::counter("smcodes_geometry_page_evictions_total",
+                                     "Geometry pages dropped to stay in the memory budget")),
+          deferredRays(Metrics::counter("smcodes_geometry_deferred_rays_total",
+                                        "Rays held back until the geometry page they need was read in")),
+          residentBytesGauge(Metrics::gauge("smcodes_geometry_resident_bytes",
+                                            "Memory held by resident geometry pages")) {
+    file.open(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open geometry pages: " + path);
+    }
+    if (readValue<uint32_t>(file, path) != GEOMETRY_MAGIC) {
+        throw std::runtime_error(path + " is not a geometry page file!");
+    }
+    if (readValue<uint32_t>(file, path) != GEOMETRY_VERSION) {
+        throw std::runtime_error(path + " was written by a different version of the renderer!");
+    }
+    if (readValue<uint32_t>(file, path) != scene.getTriangleCount()) {
+        throw std::runtime_error(path + " was written for a different scene!");
+    }
+    uint32_t topNodeCount = readValue<uint32_t>(file, path);
+    uint32_t pageCount = readValue<uint32_t>(file, path);
+
+    topNodes.resize(topNodeCount);
+    file.read(reinterpret_cast<char *>(topNodes.data()),
+              static_cast<std::streamsize>(topNodes.size() * sizeof(Bvh::Node)));
+    pages.resize(pageCount);
+    file.read(reinterpret_cast<char *>(pages.data()), static_cast<std::streamsize>(pages.size() * sizeof(PageEntry)));
+    if (!file) {
+        throw std::runtime_error(path + " is truncated!");
+    }
+
+    resident.resize(pageCount);
+    recentlyUsedPositions.resize(pageCount);
+
+    LOG_INFO("opened geometry pages", {{"path", path}, {"pages", pageCount}, {"topNodes", topNodeCount},
+                                       {"budgetMegabytes", budget / 1048576.0}});
+}
+
+bool PagedBvh::intersect(const Ray &ray, Hit &hit) const {
+    if (topNodes.empty()) {
+        return false;
+    }
+
+    // front to back through the top tree, so pages behind the closest hit so far are never read in
+    glm::vec3 inverseDirection = getInverseDirection(ray);
+    Ray pageRay = ray;
+    bool found = false;
+
+    uint32_t stack[TOP_STACK_SIZE];
+    float stackDistances[TOP_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize] = 0;
+    stackDistances[stackSize++] = Bvh::intersectAabb(ray, inverseDirection, ray.tMax, topNodes[0].boundsMin,
+                                                     topNodes[0].boundsMax);
+
+    while (stackSize > 0) {
+        stackSize--;
+        if (stackDistances[stackSize] >= pageRay.tMax) {
+            continue;
+        }
+
+        const Bvh::Node &node = topNodes[stack[stackSize]];
+        if (node.isLeaf()) {
+            Hit pageHit;
+            if (acquire(node.leftFirst)->intersect(pageRay, pageHit)) {
+                hit = pageHit;
+                pageRay.tMax = pageHit.t;
+                found = true;
+            }
+            continue;
+        }
+
+        uint32_t child1 = node.leftFirst;
+        uint32_t child2 = node.leftFirst + 1;
+        float distance1 = Bvh::intersectAabb(ray, inverseDirection, pageRay.tMax, topNodes[child1].boundsMin,
+                                             topNodes[child1].boundsMax);
+        float distance2 = Bvh::intersectAabb(ray, inverseDirection, pageRay.tMax, topNodes[child2].boundsMin,
+                                             topNodes[child2].boundsMax);
+        if (distance1 > distance2) {
+            std::swap(distance1, distance2);
+            std::swap(child1, child2);
+        }
+        // far child underneath, so the near one is popped first
+        if (distance2 != RAY_INFINITY) {
+            stack[stackSize] = child2;
+            stackDistances[stackSize++] = distance2;
+        }
+        if (distance1 != RAY_INFINITY) {
+            stack[stackSize] = child1;
+            stackDistances[stackSize++] = distance1;
+        }
+    }
+
+    return found;
+}
+
+bool PagedBvh::occluded(const Ray &ray) const {
+    if (topNodes.empty()) {
+        return false;
+    }
+
+    glm::vec3 inverseDirection = getInverseDirection(ray);
+    uint32_t stack[TOP_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Bvh::Node &node = topNodes[stack[--stackSize]];
+        if (Bvh::intersectAabb(ray, inverseDirection, ray.tMax, node.boundsMin, node.boundsMax) == RAY_INFINITY) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            if (acquire(node.leftFirst)->occluded(ray)) {
+                return true;
+            }
+        } else {
+            stack[stackSize++] = node.leftFirst + 1;
+            stack[stackSize++] = node.leftFirst;
+        }
+    }
+
+    return false;
+}
+
+void PagedBvh::intersect(const Ray *rays, Hit *hits, uint32_t count) const {
+    if (topNodes.empty()) {
+        return;
+    }
+
+    std::vector<PageRequest> requests;
+    for (uint32_t i = 0; i < count; i++) {
+        findPages(rays[i], i, requests);
+    }
+    std::vector<uint32_t> pageStarts;
+    orderRequests(requests, pageStarts);
+
+    std::vector<Ray> pageRays;
+    std::vector<Hit> pageHits;
+    std::vector<uint32_t> pageRayIndices;
+    for (size_t group = 0; group + 1 < pageStarts.size(); group++) {
+        // rays that already hit something nearer than the page don't need it anymore, when that is all of them
+        // the page isn't read in at all
+        pageRays.clear();
+        pageRayIndices.clear();
+        for (uint32_t i = pageStarts[group]; i < pageStarts[group + 1]; i++) {
+            const PageRequest &request = requests[i];
+            float closest = hits[request.ray].isValid() ? hits[request.ray].t : rays[request.ray].tMax;
+            if (request.tEntry < closest) {
+                pageRays.push_back(rays[request.ray]);
+                pageRays.back().tMax = closest;
+                pageRayIndices.push_back(request.ray);
+            }
+        }
+        if (pageRays.empty()) {
+            continue;
+        }
+
+        std::shared_ptr<const Bvh> page = acquire(requests[pageStarts[group]].page);
+        auto pageRayCount = static_cast<uint32_t>(pageRays.size());
+        pageHits.assign(pageRayCount, Hit{});
+        for (uint32_t i = 0; i < pageRayCount; i += 4) {
+            page->intersect4(&pageRays[i], &pageHits[i], std::min(4u, pageRayCount - i));
+        }
+        for (uint32_t i = 0; i < pageRayCount; i++) {
+            if (pageHits[i].isValid()) {
+                hits[pageRayIndices[i]] = pageHits[i];
+            }
+        }
+    }
+}
+
+void PagedBvh::occluded(const Ray *rays, uint8_t *occluded, uint32_t count) const {
+    if (topNodes.empty()) {
+        return;
+    }
+
+    std::vector<PageRequest> requests;
+    for (uint32_t i = 0; i < count; i++) {
+        findPages(rays[i], i, requests);
+    }
+    std::vector<uint32_t> pageStarts;
+    orderRequests(requests, pageStarts);
+
+    std::vector<Ray> pageRays;
+    std::vector<uint32_t> pageRayIndices;
+    for (size_t group = 0; group + 1 < pageStarts.size(); group++) {
+        // rays blocked by an earlier page are done
+        pageRays.clear();
+        pageRayIndices.clear();
+        for (uint32_t i = pageStarts[group]; i < pageStarts[group + 1]; i++) {
+            if (occluded[requests[i].ray] == 0) {
+                pageRays.push_back(rays[requests[i].ray]);
+                pageRayIndices.push_back(requests[i].ray);
+            }
+        }
+        if (pageRays.empty()) {
+            continue;
+        }
+
+        std::shared_ptr<const Bvh> page = acquire(requests[pageStarts[group]].page);
+        auto pageRayCount = static_cast<uint32_t>(pageRays.size());
+        for (uint32_t i = 0; i < pageRayCount; i += 4) {
+            uint32_t packetSize = std::min(4u, pageRayCount - i);
+            uint32_t occludedMask = page->occluded4(&pageRays[i], packetSize);
+            for (uint32_t lane = 0; lane < packetSize; lane++) {
+                if ((occludedMask & (1u << lane)) != 0) {
+                    occluded[pageRayIndices[i + lane]] = 1;
+                }
+            }
+        }
+    }
+}
+
+GeometryPageStats PagedBvh::getStats() const {
+    GeometryPageStats stats;
+    stats.faults = static_cast<uint64_t>(faults.getValue());
+    stats.evictions = static_cast<uint64_t>(evictions.getValue());
+    stats.deferredRays = static_cast<uint64_t>(deferredRays.getValue());
+    stats.budget = budget;
+    stats.pageCount = static_cast<uint32_t>(pages.size());
+
+    std::lock_guard<std::mutex> lock(residencyMutex);
+    stats.residentBytes = residentBytes;
+    stats.residentPages = static_cast<uint32_t>(recentlyUsed.size());
+    return stats;
+}
+
+void PagedBvh::logStats() const {
+    GeometryPageStats stats = getStats();
+    LOG_INFO("geometry pages", {{"path", path}, {"faults", stats.faults}, {"evictions", stats.evictions},
+                                {"deferredRays", stats.deferredRays}, {"residentPages", stats.residentPages},
+                                {"pages", stats.pageCount}, {"megabytes", stats.residentBytes / 1048576.0},
+                                {"budgetMegabytes", stats.budget / 1048576.0}});
+}
+
+// #endregion
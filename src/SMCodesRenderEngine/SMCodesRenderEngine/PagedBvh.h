@@ -0,0 +1,111 @@
+#ifndef SMCODESRENDERENGINE_PAGEDBVH_H
+#define SMCODESRENDERENGINE_PAGEDBVH_H
+
+
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Bvh.h"
+#include "RayTracing.h"
+
+class Counter;
+class Gauge;
+struct Scene;
+
+struct GeometryPageStats {
+    uint64_t faults = 0;
+    uint64_t evictions = 0;
+    uint64_t deferredRays = 0;
+    uint64_t residentBytes = 0;
+    uint64_t budget = 0;
+    uint32_t residentPages = 0;
+    uint32_t pageCount = 0;
+};
+
+// Out of core version of Bvh: the scene's tree is cut into subtrees of a few thousand triangles, each written to
+// its own page of a geometry file by write(). Only the small tree above the cut stays in memory, pages are read in
+// the first time a ray reaches them and evicted least recently used first to stay inside a memory budget.
+// Batches of rays (the wavefront queues) are tested against the pages already in memory first and deferred on the
+// rest, every missing page is then read once for all the rays waiting on it, so the I/O is amortised over the batch.
+// Only the intersection data is paged, normals, uvs and materials for shading still come from the Scene.
+// File layout: magic, version, scene triangle count, the top tree, the page table, then the pages, each one a
+// serialised Bvh starting on a 4KB boundary so it can be mapped on its own
+class PagedBvh {
+public:
+    // builds the scene's BVH and writes it out in pages of at most trianglesPerPage triangles
+    static void write(const Scene &scene, const std::string &path, uint32_t trianglesPerPage);
+
+    // reads the header and page table, scene is only checked against what the file was written from
+    PagedBvh(const Scene &scene, const std::string &path, uint64_t budget);
+
+    // same contract as Bvh, pages the ray reaches are read in as it gets to them
+    bool intersect(const Ray &ray, Hit &hit) const;
+
+    bool occluded(const Ray &ray) const;
+
+    // closest hit for every ray, hits[i] is only written when something is closer than rays[i].tMax
+    void intersect(const Ray *rays, Hit *hits, uint32_t count) const;
+
+    // occluded[i] is set to 1 when rays[i] is blocked, left alone otherwise
+    void occluded(const Ray *rays, uint8_t *occluded, uint32_t count) const;
+
+    GeometryPageStats getStats() const;
+
+    // one log line with the stats, at the end of a render
+    void logStats() const;
+
+private:
+    struct PageEntry {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t triangleCount;
+    };
+
+    // a ray reaching a page, tEntry is where it enters the page's bounds
+    struct PageRequest {
+        uint32_t page;
+        uint32_t ray;
+        float tEntry;
+    };
+
+    std::string path;
+    std::vector<Bvh::Node> topNodes;
+    std::vector<PageEntry> pages;
+    uint64_t budget;
+
+    // pages are read with a seek and a read, one at a time
+    mutable std::mutex fileMutex;
+    mutable std::ifstream file;
+
+    // residency, resident[i] is empty while page i is on disk. Handed out as shared pointers, a page evicted
+    // while a thread still traces against it stays alive until that thread lets go
+    mutable std::mutex residencyMutex;
+    mutable std::vector<std::shared_ptr<const Bvh>> resident;
+    mutable std::list<uint32_t> recentlyUsed; // most recently used first
+    mutable std::vector<std::list<uint32_t>::iterator> recentlyUsedPositions;
+    mutable uint64_t residentBytes = 0;
+
+    Counter &faults;
+    Counter &evictions;
+    Counter &deferredRays;
+    Gauge &residentBytesGauge;
+
+    // appends every page whose bounds the ray goes through
+    void findPages(const Ray &ray, uint32_t rayIndex, std::vector<PageRequest> &requests) const;
+
+    // reads the page in if it isn't resident yet and evicts others to make room
+    std::shared_ptr<const Bvh> acquire(uint32_t page) const;
+
+    // groups requests by page, pages in memory first, the deferred ones after
+    void orderRequests(std::vector<PageRequest> &requests, std::vector<uint32_t> &pageStarts) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_PAGEDBVH_H
@@ -0,0 +1,222 @@
+#include "PathTracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+
+#include "Checkpoint.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Scene.h"
+
+// #region Private Methods
+
+static std::unique_ptr<Bvh> buildBvh(const Scene &scene, const RenderSettings &settings) {
+    if (!settings.geometryPagePath.empty() || settings.bvhLayout != BvhLayout::Binary) {
+        return nullptr;
+    }
+    return std::make_unique<Bvh>(scene);
+}
+
+// collapsed from a binary tree that is freed again straight away
+static std::unique_ptr<CompressedBvh> buildCompressedBvh(const Scene &scene, const RenderSettings &settings) {
+    if (!settings.geometryPagePath.empty() || settings.bvhLayout != BvhLayout::Compressed) {
+        return nullptr;
+    }
+    return std::make_unique<CompressedBvh>(scene, Bvh(scene));
+}
+
+// the page file is written from the scene the first time, later runs of the same scene reuse it
+static std::unique_ptr<PagedBvh> openPagedBvh(const Scene &scene, const RenderSettings &settings) {
+    if (settings.geometryPagePath.empty()) {
+        return nullptr;
+    }
+    if (!std::filesystem::exists(settings.geometryPagePath)) {
+        PagedBvh::write(scene, settings.geometryPagePath, settings.trianglesPerPage);
+    }
+    return std::make_unique<PagedBvh>(scene, settings.geometryPagePath, settings.geometryBudget);
+}
+
+void PathTracer::renderMegakernelPass(const ImageRegion &region, uint32_t sampleIndex, AccumulationBuffer &target) {
+    uint32_t tilesX = (region.width + settings.tileSize - 1) / settings.tileSize;
+    uint32_t tilesY = (region.height + settings.tileSize - 1) / settings.tileSize;
+
+    threadPool.parallelFor(tilesX * tilesY, [&](uint32_t tileIndex, uint32_t threadIndex) {
+        uint32_t startX = (tileIndex % tilesX) * settings.tileSize;
+        uint32_t startY = (tileIndex / tilesX) * settings.tileSize;
+        uint32_t endX = std::min(startX + settings.tileSize, region.width);
+        uint32_t endY = std::min(startY + settings.tileSize, region.height);
+
+        for (uint32_t y = startY; y < endY; y++) {
+            for (uint32_t x = startX; x < endX; x++) {
+                PathState path = integrator.tracePath(region.x + x, region.y + y, sampleIndex,
+                                                      threadStats[threadIndex]);
+                target.addSample(y * region.width + x, path.radiance, path.features);
+            }
+        }
+    });
+}
+
+void PathTracer::renderWavefrontPass(const ImageRegion &region, uint32_t sampleIndex, AccumulationBuffer &target) {
+    // contiguous runs of pixels, so no two threads ever write the same pixel.
+    // Small regions (a worker's tile) get split so every thread still has a batch
+    uint32_t pixelCount = region.getPixelCount();
+    uint32_t threadShare = (pixelCount + threadPool.getThreadCount() - 1) / threadPool.getThreadCount();
+    uint32_t batchSize = std::max(1u, std::min(settings.wavefrontSize, threadShare));
+    uint32_t batchCount = (pixelCount + batchSize - 1) / batchSize;
+
+    threadPool.parallelFor(batchCount, [&](uint32_t batchIndex, uint32_t threadIndex) {
+        uint32_t firstPixel = batchIndex * batchSize;
+        uint32_t count = std::min(batchSize, pixelCount - firstPixel);
+        wavefronts[threadIndex]->trace(region, firstPixel, count, sampleIndex, target, threadStats[threadIndex]);
+    });
+}
+
+// #endregion
+
+// #region Public Methods
+
+PathTracer::PathTracer(const Scene &scene, const RenderSettings &settings)
+        : scene(scene),
+          settings(settings),
+          bvh(buildBvh(scene, settings)),
+          compressedBvh(buildCompressedBvh(scene, settings)),
+          pagedBvh(openPagedBvh(scene, settings)),
+          lightSampler(scene),
+          integrator(scene, bvh.get(), compressedBvh.get(), pagedBvh.get(), lightSampler, this->settings),
+          threadPool(settings.threadCount) {
+    threadStats.resize(threadPool.getThreadCount());
+
+    if (settings.mode == RenderMode::Wavefront) {
+        for (uint32_t i = 0; i < threadPool.getThreadCount(); i++) {
+            wavefronts.push_back(std::make_unique<WavefrontIntegrator>(scene, integrator, this->settings));
+        }
+    }
+
+    if (bvh) {
+        LOG_INFO("built BVH", {{"nodes", bvh->getNodeCount()}, {"triangles", scene.getTriangleCount()},
+                               {"megabytes", bvh->getMemoryUsage() / 1048576.0}});
+    } else if (compressedBvh) {
+        LOG_INFO("built compressed BVH", {{"nodes", compressedBvh->getNodeCount()},
+                                          {"triangles", scene.getTriangleCount()},
+                                          {"megabytes", compressedBvh->getMemoryUsage() / 1048576.0}});
+    }
+}
+
+void PathTracer::render() {
+    uint32_t firstSample = 0;
+    std::unique_ptr<CheckpointWriter> checkpointWriter;
+    if (!settings.checkpointPath.empty()) {
+        uint64_t sceneHash = Checkpoint::hashScene(scene);
+        Checkpoint checkpoint;
+        if (checkpoint.read(settings.checkpointPath, settings, sceneHash)) {
+            accumulation = std::move(checkpoint.accumulation);
+            firstSample = checkpoint.nextSample;
+            LOG_INFO("resuming from checkpoint", {{"path", settings.checkpointPath}, {"sample", firstSample}});
+        }
+        checkpointWriter = std::make_unique<CheckpointWriter>(settings.checkpointPath, settings, sceneHash);
+    }
+
+    LOG_INFO("rendering", {{"width", settings.width}, {"height", settings.height},
+                           {"samplesPerPixel", settings.samplesPerPixel},
+                           {"mode", settings.mode == RenderMode::Wavefront ? "wavefront" : "megakernel"},
+                           {"threads", threadPool.getThreadCount()}});
+
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    const std::chrono::seconds checkpointInterval(settings.checkpointInterval);
+
+    Gauge &progress = Metrics::gauge("smcodes_job_progress", "Fraction of the current render that is done");
+    progress.set(static_cast<double>(firstSample) / std::max(1u, settings.samplesPerPixel));
+
+    for (uint32_t sampleIndex = firstSample; sampleIndex < settings.samplesPerPixel; sampleIndex++) {
+        renderPass(sampleIndex);
+        progress.set(static_cast<double>(sampleIndex + 1) / settings.samplesPerPixel);
+
+        if (checkpointWriter && std::chrono::steady_clock::now() - lastCheckpoint >= checkpointInterval) {
+            // skipped if the last one is still being written, next pass tries again
+            if (checkpointWriter->write(accumulation, sampleIndex + 1)) {
+                lastCheckpoint = std::chrono::steady_clock::now();
+            }
+        }
+    }
+
+    if (checkpointWriter) {
+        // a rerun of a finished render then has nothing left to do
+        checkpointWriter->flush();
+        checkpointWriter->write(accumulation, settings.samplesPerPixel);
+        checkpointWriter->flush();
+    }
+
+    if (pagedBvh) {
+        pagedBvh->logStats();
+    }
+}
+
+void PathTracer::renderPass(uint32_t sampleIndex) {
+    // allocated on first use, workers only ever render into their own region sized buffers
+    if (accumulation.sampleCounts.empty()) {
+        accumulation.resize(settings.width, settings.height);
+    }
+    renderRegion(ImageRegion{0, 0, settings.width, settings.height}, sampleIndex, 1, accumulation);
+}
+
+void PathTracer::renderRegion(const ImageRegion &region, uint32_t firstSample, uint32_t sampleCount,
+                              AccumulationBuffer &target) {
+    if (target.width != region.width || target.height != region.height) {
+        throw std::runtime_error("accumulation buffer does not match the region being rendered");
+    }
+
+    static Counter &pathRays = Metrics::counter("smcodes_rays_total", "Rays traced on the CPU",
+                                                {{"kind", "path"}});
+    static Counter &shadowRays = Metrics::counter("smcodes_rays_total", "Rays traced on the CPU",
+                                                  {{"kind", "shadow"}});
+    static Counter &samples = Metrics::counter("smcodes_samples_total", "Pixel samples completed on the CPU");
+    static Gauge &raysPerSecond = Metrics::gauge("smcodes_rays_per_second",
+                                                 "Rays per second over the last region rendered");
+
+    RayStats before = getStats();
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t sampleIndex = firstSample; sampleIndex < firstSample + sampleCount; sampleIndex++) {
+        if (settings.mode == RenderMode::Wavefront) {
+            renderWavefrontPass(region, sampleIndex, target);
+        } else {
+            renderMegakernelPass(region, sampleIndex, target);
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    RayStats after = getStats();
+    auto traced = static_cast<double>(after.rays - before.rays);
+    auto tracedShadows = static_cast<double>(after.shadowRays - before.shadowRays);
+    pathRays.add(traced);
+    shadowRays.add(tracedShadows);
+    samples.add(static_cast<double>(region.getPixelCount()) * sampleCount);
+    if (seconds > 0.0) {
+        raysPerSecond.set((traced + tracedShadows) / seconds);
+    }
+}
+
+const AccumulationBuffer &PathTracer::getAccumulation() const {
+    return accumulation;
+}
+
+const RenderSettings &PathTracer::getSettings() const {
+    return settings;
+}
+
+ThreadPool &PathTracer::getThreadPool() {
+    return threadPool;
+}
+
+RayStats PathTracer::getStats() const {
+    RayStats total;
+    for (const auto &stats: threadStats) {
+        total.rays += stats.rays;
+        total.shadowRays += stats.shadowRays;
+    }
+    return total;
+}
+
+// #endregion
@@ -0,0 +1,68 @@
+#ifndef SMCODESRENDERENGINE_PATHTRACER_H
+#define SMCODESRENDERENGINE_PATHTRACER_H
+
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "AccumulationBuffer.h"
+#include "Bvh.h"
+#include "CompressedBvh.h"
+#include "Integrator.h"
+#include "LightSampler.h"
+#include "PagedBvh.h"
+#include "RenderSettings.h"
+#include "ThreadPool.h"
+#include "WavefrontIntegrator.h"
+
+struct Scene;
+
+// CPU path tracer that renders a scene progressively, one sample per pixel per pass,
+// into an accumulation buffer. This is the renderer the "fully spec'd out" machines run (Idea.md step 3)
+class PathTracer {
+public:
+    PathTracer(const Scene &scene, const RenderSettings &settings);
+
+    // runs every pass up to settings.samplesPerPixel
+    void render();
+
+    // adds sample sampleIndex to every pixel
+    void renderPass(uint32_t sampleIndex);
+
+    // adds samples [firstSample, firstSample + sampleCount) to every pixel of region.
+    // target is sized to the region, this is how workers render the tiles they get handed
+    void renderRegion(const ImageRegion &region, uint32_t firstSample, uint32_t sampleCount,
+                      AccumulationBuffer &target);
+
+    const AccumulationBuffer &getAccumulation() const;
+
+    const RenderSettings &getSettings() const;
+
+    RayStats getStats() const;
+
+    // shared with the stages that run after accumulation, e.g. the denoiser
+    ThreadPool &getThreadPool();
+
+private:
+    const Scene &scene;
+    RenderSettings settings;
+    // only one of these is built, pagedBvh when settings.geometryPagePath is set, otherwise settings.bvhLayout's
+    std::unique_ptr<Bvh> bvh;
+    std::unique_ptr<CompressedBvh> compressedBvh;
+    std::unique_ptr<PagedBvh> pagedBvh;
+    LightSampler lightSampler;
+    Integrator integrator;
+    ThreadPool threadPool;
+    AccumulationBuffer accumulation;
+
+    std::vector<std::unique_ptr<WavefrontIntegrator>> wavefronts; // one per thread
+    std::vector<RayStats> threadStats;
+
+    void renderMegakernelPass(const ImageRegion &region, uint32_t sampleIndex, AccumulationBuffer &target);
+
+    void renderWavefrontPass(const ImageRegion &region, uint32_t sampleIndex, AccumulationBuffer &target);
+};
+
+
+#endif //SMCODESRENDERENGINE_PATHTRACER_H
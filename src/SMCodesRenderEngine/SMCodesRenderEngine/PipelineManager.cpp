@@ -0,0 +1,442 @@
+#include "PipelineManager.h"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "Metrics.h"
+
+// #region Constants
+
+const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+// one cache file per kind of device, the driver would ignore another device's data anyway
+const char *const PIPELINE_CACHE_PREFIX = "pipeline_cache_";
+
+// #endregion
+
+// #region Private Methods
+
+static uint64_t getProcessId() {
+#ifdef _WIN32
+    return static_cast<uint64_t>(_getpid());
+#else
+    return static_cast<uint64_t>(getpid());
+#endif
+}
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+template<typename T>
+static uint64_t hashValue(uint64_t hash, const T &value) {
+    return hashBytes(hash, &value, sizeof(T));
+}
+
+template<typename T>
+static uint64_t hashVector(uint64_t hash, const std::vector<T> &values) {
+    // the size too, so moving a value from one vector to the next changes the hash
+    hash = hashValue(hash, values.size());
+    return hashBytes(hash, values.data(), values.size() * sizeof(T));
+}
+
+void PipelineManager::compileLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        Entry &entry = *entries[jobs.front()];
+        jobs.pop_front();
+        compilesInFlight++;
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        try {
+            pipeline = compile(entry.state, entry.flags);
+        } catch (const std::exception &e) {
+            // stays on its fallback for good
+            LOG_ERROR("failed to compile pipeline", {{"key", entry.key}, {"error", e.what()}});
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        compileSeconds->observe(seconds);
+        if (pipeline != VK_NULL_HANDLE) {
+            LOG_INFO("compiled pipeline", {{"key", entry.key}, {"milliseconds", seconds * 1000.0}});
+        }
+
+        lock.lock();
+        entry.pipeline = pipeline;
+        entry.ready = pipeline != VK_NULL_HANDLE;
+        entry.compileSeconds = seconds;
+        compilesInFlight--;
+        if (jobs.empty() && compilesInFlight == 0) {
+            idleCondition.notify_all();
+        }
+    }
+}
+
+VkPipeline PipelineManager::compile(const GraphicsPipelineState &state, VkPipelineCreateFlags flags) const {
+    VkShaderModule modules[2]{};
+    const std::vector<char> *code[2] = {&state.vertexShader, &state.fragmentShader};
+    for (uint32_t i = 0; i < 2; i++) {
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code[i]->size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t *>(code[i]->data());
+        if (vkCreateShaderModule(device, &moduleInfo, nullptr, &modules[i]) != VK_SUCCESS) {
+            if (i == 1) {
+                vkDestroyShaderModule(device, modules[0], nullptr);
+            }
+            throw std::runtime_error("failed to create shader module!");
+        }
+    }
+
+    std::vector<VkSpecializationMapEntry> mapEntries(state.specializationConstants.size());
+    for (uint32_t i = 0; i < static_cast<uint32_t>(mapEntries.size()); i++) {
+        mapEntries[i].constantID = i;
+        mapEntries[i].offset = i * sizeof(uint32_t);
+        mapEntries[i].size = sizeof(uint32_t);
+    }
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+    specializationInfo.pMapEntries = mapEntries.data();
+    specializationInfo.dataSize = state.specializationConstants.size() * sizeof(uint32_t);
+    specializationInfo.pData = state.specializationConstants.data();
+
+    VkPipelineShaderStageCreateInfo shaderStages[2]{};
+    VkShaderStageFlagBits stages[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+    for (uint32_t i = 0; i < 2; i++) {
+        shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[i].stage = stages[i];
+        shaderStages[i].module = modules[i];
+        shaderStages[i].pName = "main";
+        shaderStages[i].pSpecializationInfo = mapEntries.empty() ? nullptr : &specializationInfo;
+    }
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &state.vertexBinding;
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(state.vertexAttributes.size());
+    vertexInputInfo.pVertexAttributeDescriptions = state.vertexAttributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = state.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // viewport and scissor are dynamic, only the counts go in here
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = state.polygonMode;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = state.cullMode;
+    rasterizer.frontFace = state.frontFace;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+
+    // premultiplied alpha "over" when blending
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = state.blendEnable ? VK_TRUE : VK_FALSE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = state.depthTest ? VK_TRUE : VK_FALSE;
+    depthStencil.depthWriteEnable = state.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = state.depthCompareOp;
+    depthStencil.minDepthBounds = 0.0f;
+    depthStencil.maxDepthBounds = 1.0f;
+
+    VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.flags = flags;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = state.layout;
+    pipelineInfo.renderPass = state.renderPass;
+    pipelineInfo.subpass = state.subpass;
+    pipelineInfo.basePipelineIndex = -1;
+
+    // the cache is internally synchronised, every compile thread can go through it at once
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+
+    vkDestroyShaderModule(device, modules[0], nullptr);
+    vkDestroyShaderModule(device, modules[1], nullptr);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+    return pipeline;
+}
+
+uint32_t PipelineManager::findOrAdd(const GraphicsPipelineState &state, VkPipelineCreateFlags flags,
+                                    uint32_t fallback, bool &added) {
+    // 64 bits of hash, two different states colliding isn't worth comparing whole shaders over
+    uint64_t key = hashValue(state.getHash(), flags);
+    auto found = handles.find(key);
+    if (found != handles.end()) {
+        added = false;
+        deduplicated->add();
+        return found->second;
+    }
+
+    auto entry = std::make_unique<Entry>();
+    entry->state = state;
+    entry->key = key;
+    entry->flags = flags;
+    entry->fallback = fallback;
+
+    auto handle = static_cast<uint32_t>(entries.size());
+    entries.push_back(std::move(entry));
+    handles[key] = handle;
+    added = true;
+    return handle;
+}
+
+void PipelineManager::loadCache() {
+    std::vector<char> data;
+    std::ifstream file(cachePath, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file) {
+            data.clear();
+        }
+    }
+
+    // the driver checks the header itself and starts empty if the data came from another device or driver
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline cache!");
+    }
+
+    LOG_INFO("opened pipeline cache", {{"path", cachePath}, {"bytes", data.size()}});
+}
+
+void PipelineManager::saveCache() const {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    // written next to it and renamed over, a run killed half way leaves the old cache rather than half a new one.
+    // Every save gets a file of its own: managers for identical devices (in this process or another) share the
+    // cache path, and whichever renames last wins with a whole file
+    static std::atomic<uint32_t> saveCount{0};
+    std::string temporaryPath = cachePath + "." + std::to_string(getProcessId()) + "." +
+                                std::to_string(saveCount++) + ".tmp";
+    std::error_code error;
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(size));
+        if (!file) {
+            LOG_WARNING("failed to write pipeline cache", {{"path", temporaryPath}});
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporaryPath, cachePath, error);
+    if (error) {
+        LOG_WARNING("failed to write pipeline cache", {{"path", cachePath}, {"error", error.message()}});
+        std::filesystem::remove(temporaryPath, error);
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+uint64_t GraphicsPipelineState::getHash() const {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = hashVector(hash, vertexShader);
+    hash = hashVector(hash, fragmentShader);
+    hash = hashVector(hash, specializationConstants);
+    hash = hashValue(hash, vertexBinding);
+    hash = hashVector(hash, vertexAttributes);
+    hash = hashValue(hash, topology);
+    hash = hashValue(hash, polygonMode);
+    hash = hashValue(hash, cullMode);
+    hash = hashValue(hash, frontFace);
+    hash = hashValue(hash, blendEnable);
+    hash = hashValue(hash, depthTest);
+    hash = hashValue(hash, depthWrite);
+    hash = hashValue(hash, depthCompareOp);
+    hash = hashValue(hash, layout);
+    hash = hashValue(hash, renderPass);
+    hash = hashValue(hash, subpass);
+    return hash;
+}
+
+void PipelineManager::create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t threadCount) {
+    device = logicalDevice;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    cachePath = PIPELINE_CACHE_PREFIX + std::to_string(properties.vendorID) + "_" +
+                std::to_string(properties.deviceID) + ".bin";
+    loadCache();
+
+    compileSeconds = &Metrics::histogram("smcodes_pipeline_compile_seconds",
+                                         "Time to compile a graphics pipeline in the background",
+                                         Metrics::getLatencyBounds());
+    deduplicated = &Metrics::counter("smcodes_pipeline_deduplicated_total",
+                                     "Pipeline requests answered with a pipeline that already existed");
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+    }
+    stopping = false;
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threads.emplace_back(&PipelineManager::compileLoop, this);
+    }
+}
+
+void PipelineManager::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobCondition.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    double totalSeconds = 0.0;
+    uint32_t compiled = 0;
+    for (const auto &entry: entries) {
+        if (entry->pipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, entry->pipeline, nullptr);
+            totalSeconds += entry->compileSeconds;
+            compiled++;
+        }
+    }
+    LOG_INFO("pipelines", {{"compiled", compiled}, {"deduplicated", static_cast<uint64_t>(deduplicated->getValue())},
+                           {"compileSeconds", totalSeconds}});
+    entries.clear();
+    handles.clear();
+
+    saveCache();
+    vkDestroyPipelineCache(device, pipelineCache, nullptr);
+    pipelineCache = VK_NULL_HANDLE;
+}
+
+uint32_t PipelineManager::createFallback(const GraphicsPipelineState &state) {
+    std::unique_lock<std::mutex> lock(mutex);
+    bool added;
+    uint32_t handle = findOrAdd(state, VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT, 0, added);
+    if (!added) {
+        return handle;
+    }
+    Entry &entry = *entries[handle];
+    entry.fallback = handle;
+    lock.unlock();
+
+    // nothing to fall back on for the fallback itself, so a failure here is fatal
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = compile(entry.state, entry.flags);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("compiled fallback pipeline", {{"key", entry.key}, {"milliseconds", seconds * 1000.0}});
+
+    lock.lock();
+    entry.pipeline = pipeline;
+    entry.ready = true;
+    entry.compileSeconds = seconds;
+    return handle;
+}
+
+uint32_t PipelineManager::request(const GraphicsPipelineState &state, uint32_t fallback) {
+    std::unique_lock<std::mutex> lock(mutex);
+    bool added;
+    uint32_t handle = findOrAdd(state, 0, fallback, added);
+    if (added) {
+        jobs.push_back(handle);
+        lock.unlock();
+        jobCondition.notify_one();
+    }
+    return handle;
+}
+
+VkPipeline PipelineManager::getPipeline(uint32_t handle) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Entry &entry = *entries[handle];
+    return entry.ready ? entry.pipeline : entries[entry.fallback]->pipeline;
+}
+
+bool PipelineManager::isReady(uint32_t handle) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries[handle]->ready;
+}
+
+void PipelineManager::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idleCondition.wait(lock, [this] { return jobs.empty() && compilesInFlight == 0; });
+}
+
+// #endregion
@@ -0,0 +1,119 @@
+#ifndef SMCODESRENDERENGINE_PIPELINEMANAGER_H
+#define SMCODESRENDERENGINE_PIPELINEMANAGER_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Counter;
+class Histogram;
+
+// Everything that makes one graphics pipeline variant different from another, depth testing included. What isn't
+// in here (dynamic viewport and scissor, no multisampling, no stencil) is the same for every pipeline the manager
+// builds
+struct GraphicsPipelineState {
+    std::vector<char> vertexShader; // SPIR-V
+    std::vector<char> fragmentShader;
+    // constant_id i of both stages gets specializationConstants[i], ids a shader doesn't declare are ignored
+    std::vector<uint32_t> specializationConstants;
+    VkVertexInputBindingDescription vertexBinding{};
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    bool blendEnable = false;
+    // for render passes with a depth attachment, depthCompareOp passes fragments at least as near as what's there
+    bool depthTest = false;
+    bool depthWrite = false;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+
+    // FNV-1a over all of the above, shader code included
+    uint64_t getHash() const;
+};
+
+// Builds graphics pipelines off the render thread. Every variant is hashed and a state that was requested before
+// gets the handle of the existing pipeline rather than a second compile. Compiles run on a few threads of their
+// own, all through one VkPipelineCache that is read from disk at create() and written back at destroy(), so a
+// second run mostly just loads the driver's binaries.
+// Until a variant is ready getPipeline() hands out its fallback, a pipeline built right away on the calling thread
+// with optimisations off: much quicker to build, slower to draw with, and only around for the first few frames
+class PipelineManager {
+public:
+    // threadCount 0 uses half the hardware threads, the render thread still needs a core
+    void create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t threadCount = 0);
+
+    // waits for the compiles in flight (queued ones are dropped), destroys every pipeline and saves the cache.
+    // Nothing drawn with them can still be on the GPU
+    void destroy();
+
+    // builds state now on the calling thread with optimisations off, for request() to fall back on
+    uint32_t createFallback(const GraphicsPipelineState &state);
+
+    // queues state to be compiled in the background and returns a handle for getPipeline(). fallback is what gets
+    // drawn with until then, and for good if the compile fails, so it needs the same layout and render pass
+    uint32_t request(const GraphicsPipelineState &state, uint32_t fallback);
+
+    // doesn't block, the handle's own pipeline once it's ready and the fallback's until then
+    VkPipeline getPipeline(uint32_t handle) const;
+
+    bool isReady(uint32_t handle) const;
+
+    // blocks until every requested pipeline is compiled (or failed)
+    void waitIdle();
+
+private:
+    struct Entry {
+        GraphicsPipelineState state;
+        uint64_t key = 0; // state hash and create flags
+        VkPipelineCreateFlags flags = 0;
+        uint32_t fallback = 0;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        bool ready = false;
+        double compileSeconds = 0.0;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    std::string cachePath;
+
+    mutable std::mutex mutex;
+    std::condition_variable jobCondition;
+    std::condition_variable idleCondition;
+    std::vector<std::unique_ptr<Entry>> entries; // indexed by handle, pointers stay put while compiling
+    std::unordered_map<uint64_t, uint32_t> handles; // by key
+    std::deque<uint32_t> jobs;
+    uint32_t compilesInFlight = 0;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    Histogram *compileSeconds = nullptr;
+    Counter *deduplicated = nullptr;
+
+    void compileLoop();
+
+    // throws if the driver fails to build it
+    VkPipeline compile(const GraphicsPipelineState &state, VkPipelineCreateFlags flags) const;
+
+    // an existing entry with the same state and flags, or a new one
+    uint32_t findOrAdd(const GraphicsPipelineState &state, VkPipelineCreateFlags flags, uint32_t fallback,
+                       bool &added);
+
+    void loadCache();
+
+    void saveCache() const;
+};
+
+
+#endif //SMCODESRENDERENGINE_PIPELINEMANAGER_H
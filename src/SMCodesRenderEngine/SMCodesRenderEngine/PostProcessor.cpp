@@ -0,0 +1,373 @@
+#include "PostProcessor.h"
+
+#include <cstddef>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "VulkanUtils.h"
+
+// #region Constants
+
+// has to match local_size in post_process.comp
+const uint32_t POST_PROCESS_GROUP_SIZE = 8;
+
+const VkFormat POST_PROCESS_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+
+// #endregion
+
+// #region Private Methods
+
+bool PostProcessor::needsOwnershipTransfer() const {
+    return queues.computeFamily != queues.graphicsFamily;
+}
+
+void PostProcessor::createOutputImages(VkPhysicalDevice physicalDevice) {
+    outputImages.resize(inputImages.size());
+    outputImageMemories.resize(inputImages.size());
+    outputImageViews.resize(inputImages.size());
+
+    for (size_t i = 0; i < outputImages.size(); i++) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = POST_PROCESS_FORMAT;
+        imageInfo.extent = {outputExtent.width, outputExtent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        // written by the shader, then copied out for readback. Only the compute queue ever touches it
+        imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        createImage(physicalDevice, device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, outputImages[i],
+                    outputImageMemories[i]);
+        outputImageViews[i] = createImageView(device, outputImages[i], POST_PROCESS_FORMAT);
+    }
+}
+
+void PostProcessor::createDescriptorSets(const std::vector<VkImageView> &renderedViews) {
+    // binding 0 is the rendered image, binding 1 the output
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    for (uint32_t i = 0; i < 2; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-process descriptor set layout!");
+    }
+
+    auto setCount = static_cast<uint32_t>(inputImages.size());
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSize.descriptorCount = setCount * 2;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = setCount;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-process descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(setCount, descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = descriptorPool;
+    allocateInfo.descriptorSetCount = setCount;
+    allocateInfo.pSetLayouts = layouts.data();
+    descriptorSets.resize(setCount);
+    if (vkAllocateDescriptorSets(device, &allocateInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate post-process descriptor sets!");
+    }
+
+    // the sets never change, every frame in flight always uses the same pair of images
+    for (uint32_t i = 0; i < setCount; i++) {
+        VkDescriptorImageInfo imageInfos[2]{};
+        imageInfos[0].imageView = renderedViews[i];
+        imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageInfos[1].imageView = outputImageViews[i];
+        imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet writes[2]{};
+        for (uint32_t binding = 0; binding < 2; binding++) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = descriptorSets[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[binding].pImageInfo = &imageInfos[binding];
+        }
+        vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+    }
+}
+
+void PostProcessor::createPipeline(VkShaderModule shaderModule) {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-process pipeline layout!");
+    }
+
+    // the settings never change after create(), so they are baked into this pipeline variant instead of being
+    // branched on in the shader
+    SpecializationConstants constants{};
+    constants.downsample = settings.downsample;
+    constants.tonemap = settings.tonemap ? VK_TRUE : VK_FALSE;
+
+    VkSpecializationMapEntry mapEntries[2]{};
+    mapEntries[0].constantID = 0;
+    mapEntries[0].offset = offsetof(SpecializationConstants, downsample);
+    mapEntries[0].size = sizeof(constants.downsample);
+    mapEntries[1].constantID = 1;
+    mapEntries[1].offset = offsetof(SpecializationConstants, tonemap);
+    mapEntries[1].size = sizeof(constants.tonemap);
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 2;
+    specializationInfo.pMapEntries = mapEntries;
+    specializationInfo.dataSize = sizeof(constants);
+    specializationInfo.pData = &constants;
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+    pipelineInfo.layout = pipelineLayout;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-process pipeline!");
+    }
+}
+
+void PostProcessor::createCommandBuffers() {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queues.computeFamily;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-process command pool!");
+    }
+
+    commandBuffers.resize(inputImages.size());
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.commandPool = commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+    if (vkAllocateCommandBuffers(device, &allocateInfo, commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate post-process command buffers!");
+    }
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderedSemaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create post-process semaphore!");
+    }
+}
+
+void PostProcessor::recordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t slot, VkBuffer readbackBuffer) {
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(cmdBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording post-process command buffer");
+    }
+
+    // the semaphore wait already orders this after the render, barriers are only needed for the
+    // queue family acquire and to get the output image into GENERAL (its old contents don't matter)
+    VkImageMemoryBarrier barriers[2]{};
+    uint32_t barrierCount = 0;
+    if (needsOwnershipTransfer()) {
+        VkImageMemoryBarrier &acquire = barriers[barrierCount++];
+        acquire.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        acquire.srcAccessMask = 0;
+        acquire.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        acquire.oldLayout = VK_IMAGE_LAYOUT_GENERAL; // has to match the release exactly
+        acquire.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        acquire.srcQueueFamilyIndex = queues.graphicsFamily;
+        acquire.dstQueueFamilyIndex = queues.computeFamily;
+        acquire.image = inputImages[slot];
+        acquire.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    }
+
+    VkImageMemoryBarrier &output = barriers[barrierCount++];
+    output.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    output.srcAccessMask = 0;
+    output.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    output.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    output.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    output.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    output.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    output.image = outputImages[slot];
+    output.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr, 0, nullptr, barrierCount, barriers);
+
+    PushConstants constants{};
+    constants.exposure = settings.exposure;
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[slot],
+                            0, nullptr);
+    vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &constants);
+    vkCmdDispatch(cmdBuffer, (outputExtent.width + POST_PROCESS_GROUP_SIZE - 1) / POST_PROCESS_GROUP_SIZE,
+                  (outputExtent.height + POST_PROCESS_GROUP_SIZE - 1) / POST_PROCESS_GROUP_SIZE, 1);
+
+    if (readbackBuffer != VK_NULL_HANDLE) {
+        VkImageMemoryBarrier toTransfer{};
+        toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        toTransfer.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        toTransfer.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.image = outputImages[slot];
+        toTransfer.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &toTransfer);
+
+        recordReadbackCopy(cmdBuffer, outputImages[slot], outputExtent, readbackBuffer);
+    }
+
+    if (vkEndCommandBuffer(cmdBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record post-process command buffer");
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+void PostProcessor::create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice,
+                           const PostProcessQueues &postProcessQueues, const std::vector<VkImage> &renderedImages,
+                           const std::vector<VkImageView> &renderedViews, VkExtent2D renderedExtent,
+                           VkShaderModule shaderModule, const PostProcessSettings &postProcessSettings) {
+    if (postProcessSettings.downsample == 0) {
+        throw std::runtime_error("Downsample factor has to be at least 1!");
+    }
+
+    device = logicalDevice;
+    queues = postProcessQueues;
+    settings = postProcessSettings;
+    inputImages = renderedImages;
+    outputExtent.width = (renderedExtent.width + settings.downsample - 1) / settings.downsample;
+    outputExtent.height = (renderedExtent.height + settings.downsample - 1) / settings.downsample;
+
+    createOutputImages(physicalDevice);
+    createDescriptorSets(renderedViews);
+    createPipeline(shaderModule);
+    createCommandBuffers();
+
+    LOG_INFO("post-processing", {{"width", renderedExtent.width}, {"height", renderedExtent.height},
+                                 {"outputWidth", outputExtent.width}, {"outputHeight", outputExtent.height},
+                                 {"computeFamily", queues.computeFamily}, {"sharedQueue", queues.shared}});
+}
+
+void PostProcessor::destroy() {
+    vkDestroySemaphore(device, renderedSemaphore, nullptr);
+    vkDestroyCommandPool(device, commandPool, nullptr);
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr); // frees the sets too
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+
+    for (size_t i = 0; i < outputImages.size(); i++) {
+        vkDestroyImageView(device, outputImageViews[i], nullptr);
+        vkDestroyImage(device, outputImages[i], nullptr);
+        vkFreeMemory(device, outputImageMemories[i], nullptr);
+    }
+    outputImages.clear();
+    outputImageViews.clear();
+    outputImageMemories.clear();
+    descriptorSets.clear();
+    commandBuffers.clear();
+}
+
+void PostProcessor::recordRelease(VkCommandBuffer cmdBuffer, uint32_t slot) const {
+    if (!needsOwnershipTransfer()) {
+        return;
+    }
+
+    VkImageMemoryBarrier release{};
+    release.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    release.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    release.dstAccessMask = 0; // the acquire on the compute queue makes it visible
+    release.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    release.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    release.srcQueueFamilyIndex = queues.graphicsFamily;
+    release.dstQueueFamilyIndex = queues.computeFamily;
+    release.image = inputImages[slot];
+    release.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+}
+
+void PostProcessor::submit(uint32_t slot, uint64_t frame, VkSemaphore frameSemaphore, VkBuffer readbackBuffer) {
+    // the caller waited for the frame timeline before reusing this slot, so the command buffer is free
+    VkCommandBuffer cmdBuffer = commandBuffers[slot];
+    vkResetCommandBuffer(cmdBuffer, 0);
+    recordCommandBuffer(cmdBuffer, slot, readbackBuffer);
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &frame;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &frame;
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &renderedSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmdBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &frameSemaphore;
+
+    if (vkQueueSubmit(queues.computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit post-process command buffer");
+    }
+}
+
+VkSemaphore PostProcessor::getRenderedSemaphore() const {
+    return renderedSemaphore;
+}
+
+VkExtent2D PostProcessor::getOutputExtent() const {
+    return outputExtent;
+}
+
+// #endregion
@@ -0,0 +1,98 @@
+#ifndef SMCODESRENDERENGINE_POSTPROCESSOR_H
+#define SMCODESRENDERENGINE_POSTPROCESSOR_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <vector>
+
+struct PostProcessSettings {
+    float exposure = 1.0f;
+    uint32_t downsample = 1; // output is 1 / downsample the size of the render in each direction
+    bool tonemap = true;
+};
+
+// the queue post-processing runs on and the family the rendered images come from
+struct PostProcessQueues {
+    VkQueue computeQueue = VK_NULL_HANDLE;
+    uint32_t computeFamily = 0;
+    uint32_t graphicsFamily = 0;
+    bool shared = false; // computeQueue is the graphics queue itself, nothing can overlap
+};
+
+// Post-processing of headless frames (downsample, exposure and tonemap) in a compute shader on the compute
+// queue, so frame N is post-processed and read back while the graphics queue is already rendering frame N + 1.
+// Every frame in flight has its own rendered image, output image and command buffer.
+//  - The graphics submit signals the rendered semaphore (a timeline) to the frame number, the compute submit
+//    waits on that and signals the frame timeline, which then means post-processed and read back.
+//  - With separate queue families the rendered image gets released by the graphics queue and acquired by the
+//    compute queue. Ownership never goes back: the next render into it starts from UNDEFINED anyway
+class PostProcessor {
+public:
+    // renderedImages / renderedViews are in GENERAL once the render pass is done, one per frame in flight.
+    // shaderModule is only used during create()
+    void create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, const PostProcessQueues &postProcessQueues,
+                const std::vector<VkImage> &renderedImages, const std::vector<VkImageView> &renderedViews,
+                VkExtent2D renderedExtent, VkShaderModule shaderModule, const PostProcessSettings &postProcessSettings);
+
+    void destroy();
+
+    // records the release of slot's rendered image to the compute queue family at the end of the graphics
+    // command buffer. Nothing to do when both queues are of the same family
+    void recordRelease(VkCommandBuffer cmdBuffer, uint32_t slot) const;
+
+    // post-processes slot's image once the graphics queue signals the rendered semaphore to frame,
+    // then copies the result into readbackBuffer (if there is one) and signals frameSemaphore to frame
+    void submit(uint32_t slot, uint64_t frame, VkSemaphore frameSemaphore, VkBuffer readbackBuffer);
+
+    // timeline the graphics queue signals when it is done rendering a frame
+    VkSemaphore getRenderedSemaphore() const;
+
+    VkExtent2D getOutputExtent() const;
+
+private:
+    struct PushConstants {
+        float exposure;
+    };
+
+    // constant_id 0 and 1 of post_process.comp
+    struct SpecializationConstants {
+        uint32_t downsample;
+        VkBool32 tonemap;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    PostProcessQueues queues;
+    PostProcessSettings settings;
+    std::vector<VkImage> inputImages;
+    VkExtent2D outputExtent{};
+
+    std::vector<VkImage> outputImages;
+    std::vector<VkDeviceMemory> outputImageMemories;
+    std::vector<VkImageView> outputImageViews;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> descriptorSets;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> commandBuffers;
+    VkSemaphore renderedSemaphore = VK_NULL_HANDLE;
+
+    void createOutputImages(VkPhysicalDevice physicalDevice);
+
+    void createDescriptorSets(const std::vector<VkImageView> &renderedViews);
+
+    void createPipeline(VkShaderModule shaderModule);
+
+    void createCommandBuffers();
+
+    void recordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t slot, VkBuffer readbackBuffer);
+
+    bool needsOwnershipTransfer() const;
+};
+
+
+#endif //SMCODESRENDERENGINE_POSTPROCESSOR_H
@@ -0,0 +1,51 @@
+#ifndef SMCODESRENDERENGINE_RANDOM_H
+#define SMCODESRENDERENGINE_RANDOM_H
+
+
+#include <cstdint>
+
+// Hash used to turn (pixel, sample, seed) into independent generator seeds.
+// Every path gets its own seed so the image doesn't depend on which thread traced it
+inline uint32_t hashUInt(uint32_t value) {
+    // PCG hash from "Hash Functions for GPU Rendering" (Jarzynski, Olano)
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+inline uint32_t hashCombine(uint32_t seed, uint32_t value) {
+    return hashUInt(seed ^ (value + 0x9e3779b9u + (seed << 6u) + (seed >> 2u)));
+}
+
+// PCG32 random number generator (https://www.pcg-random.org)
+// small (16 bytes) so it can live inside every path state
+struct Pcg32 {
+    uint64_t state = 0;
+    uint64_t increment = 1;
+
+    Pcg32() = default;
+
+    Pcg32(uint64_t seed, uint64_t sequence) {
+        state = 0;
+        increment = (sequence << 1u) | 1u;
+        nextUInt();
+        state += seed;
+        nextUInt();
+    }
+
+    uint32_t nextUInt() {
+        uint64_t oldState = state;
+        state = oldState * 6364136223846793005ULL + increment;
+        auto xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+        auto rotation = static_cast<uint32_t>(oldState >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((~rotation + 1u) & 31u));
+    }
+
+    // uniform float in [0, 1)
+    float nextFloat() {
+        return static_cast<float>(nextUInt() >> 8) * 0x1p-24f;
+    }
+};
+
+
+#endif //SMCODESRENDERENGINE_RANDOM_H
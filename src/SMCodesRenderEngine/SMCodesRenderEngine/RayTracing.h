@@ -0,0 +1,76 @@
+#ifndef SMCODESRENDERENGINE_RAYTRACING_H
+#define SMCODESRENDERENGINE_RAYTRACING_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <limits>
+
+const float RAY_INFINITY = std::numeric_limits<float>::infinity();
+
+// offset used to push secondary ray origins off the surface they start on
+const float RAY_EPSILON = 1e-4f;
+
+const uint32_t INVALID_TRIANGLE = 0xffffffffu;
+
+struct Ray {
+    glm::vec3 origin;
+    float tMin = 0.0f;
+    glm::vec3 direction;
+    float tMax = RAY_INFINITY;
+};
+
+struct Hit {
+    float t = RAY_INFINITY;
+    float u = 0.0f; // barycentrics of the hit inside the triangle
+    float v = 0.0f;
+    uint32_t triangleIndex = INVALID_TRIANGLE;
+
+    bool isValid() const {
+        return triangleIndex != INVALID_TRIANGLE;
+    }
+};
+
+struct Aabb {
+    glm::vec3 min = glm::vec3(RAY_INFINITY);
+    glm::vec3 max = glm::vec3(-RAY_INFINITY);
+
+    void grow(const glm::vec3 &point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(const Aabb &other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 extent() const {
+        return max - min;
+    }
+
+    glm::vec3 centre() const {
+        return (min + max) * 0.5f;
+    }
+
+    float surfaceArea() const {
+        glm::vec3 e = extent();
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    bool isEmpty() const {
+        return min.x > max.x;
+    }
+};
+
+// direction reciprocal that never divides by zero, a huge value behaves the same in the slab test
+inline float safeReciprocal(float value) {
+    const float huge = 1e30f;
+    if (value > -1e-20f && value < 1e-20f) {
+        return value < 0.0f ? -huge : huge;
+    }
+    return 1.0f / value;
+}
+
+
+#endif //SMCODESRENDERENGINE_RAYTRACING_H
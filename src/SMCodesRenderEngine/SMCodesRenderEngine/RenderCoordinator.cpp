@@ -0,0 +1,386 @@
+#include "RenderCoordinator.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "ImageWriter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Scene.h"
+#include "Socket.h"
+
+// #region Constants
+
+const uint32_t ACCEPT_POLL_MS = 200;
+const uint32_t HELLO_TIMEOUT_MS = 10000;
+
+// #endregion
+
+// #region Private Methods
+
+struct RenderCoordinator::LocalWorker {
+#ifdef _WIN32
+    HANDLE process = nullptr;
+#else
+    pid_t pid = -1;
+#endif
+    bool exited = false;
+};
+
+#ifdef _WIN32
+static bool spawnProcess(const std::vector<std::string> &args, HANDLE &process) {
+    std::string commandLine;
+    for (const auto &arg: args) {
+        commandLine += (commandLine.empty() ? "\"" : " \"") + arg + "\"";
+    }
+
+    STARTUPINFOA startupInfo{};
+    startupInfo.cb = sizeof(startupInfo);
+    PROCESS_INFORMATION processInfo{};
+    if (!CreateProcessA(nullptr, commandLine.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr,
+                        &startupInfo, &processInfo)) {
+        return false;
+    }
+    CloseHandle(processInfo.hThread);
+    process = processInfo.hProcess;
+    return true;
+}
+#else
+static bool spawnProcess(const std::vector<std::string> &args, pid_t &pid) {
+    std::vector<char *> argv;
+    for (const auto &arg: args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    return posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) == 0;
+}
+#endif
+
+void RenderCoordinator::createWorkItems() {
+    uint32_t tileSize = std::max(1u, distributed.tileSize);
+    uint32_t samplesPerItem = distributed.samplesPerItem > 0 ? distributed.samplesPerItem : settings.samplesPerPixel;
+
+    // sample ranges on the outside, so the whole image fills in at low sample counts first
+    for (uint32_t firstSample = 0; firstSample < settings.samplesPerPixel; firstSample += samplesPerItem) {
+        for (uint32_t y = 0; y < settings.height; y += tileSize) {
+            for (uint32_t x = 0; x < settings.width; x += tileSize) {
+                WorkItem item;
+                item.id = static_cast<uint32_t>(workItems.size());
+                item.region = ImageRegion{x, y, std::min(tileSize, settings.width - x),
+                                          std::min(tileSize, settings.height - y)};
+                item.firstSample = firstSample;
+                item.sampleCount = std::min(samplesPerItem, settings.samplesPerPixel - firstSample);
+                workItems.push_back(item);
+                pendingItems.push_back(item.id);
+            }
+        }
+    }
+
+    tilesPerPass = ((settings.width + tileSize - 1) / tileSize) * ((settings.height + tileSize - 1) / tileSize);
+    tileSamples.assign(tilesPerPass, 0);
+    completedItems.assign(workItems.size(), false);
+    remainingItems = static_cast<uint32_t>(workItems.size());
+}
+
+void RenderCoordinator::startLocalWorkers(uint16_t port) {
+    if (distributed.localWorkers == 0) {
+        return;
+    }
+    if (distributed.workerExecutable.empty()) {
+        throw std::runtime_error("local workers need the path of the executable to start!");
+    }
+
+    uint32_t threads = distributed.localWorkerThreads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency() / distributed.localWorkers);
+    }
+
+    for (uint32_t i = 0; i < distributed.localWorkers; i++) {
+        std::vector<std::string> args = {distributed.workerExecutable, "--worker",
+                                         "--connect", "127.0.0.1:" + std::to_string(port),
+                                         "--threads", std::to_string(threads)};
+        if (i == 0 && distributed.localWorkerFailAfter > 0) {
+            args.emplace_back("--fail-after");
+            args.push_back(std::to_string(distributed.localWorkerFailAfter));
+        }
+
+        LocalWorker worker;
+#ifdef _WIN32
+        bool started = spawnProcess(args, worker.process);
+#else
+        bool started = spawnProcess(args, worker.pid);
+#endif
+        if (!started) {
+            throw std::runtime_error("failed to start local worker " + distributed.workerExecutable + "!");
+        }
+        localWorkers.push_back(worker);
+    }
+
+    LOG_INFO("started local workers", {{"workers", distributed.localWorkers}, {"threadsEach", threads}});
+}
+
+bool RenderCoordinator::haveLocalWorkersExited() {
+    for (auto &worker: localWorkers) {
+        if (worker.exited) {
+            continue;
+        }
+#ifdef _WIN32
+        worker.exited = WaitForSingleObject(worker.process, 0) == WAIT_OBJECT_0;
+#else
+        int status;
+        worker.exited = waitpid(worker.pid, &status, WNOHANG) == worker.pid;
+#endif
+        if (!worker.exited) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RenderCoordinator::waitForLocalWorkers() {
+    for (auto &worker: localWorkers) {
+#ifdef _WIN32
+        if (!worker.exited) {
+            WaitForSingleObject(worker.process, INFINITE);
+        }
+        CloseHandle(worker.process);
+#else
+        if (!worker.exited) {
+            int status;
+            waitpid(worker.pid, &status, 0);
+        }
+#endif
+        worker.exited = true;
+    }
+    localWorkers.clear();
+}
+
+void RenderCoordinator::serveWorker(Socket connection, uint32_t workerIndex) {
+    WorkItem item;
+    bool holdingItem = false;
+    bool joined = false;
+    uint32_t itemsRendered = 0;
+
+    try {
+        MessageType type;
+        std::vector<uint8_t> payload;
+        connection.setReceiveTimeout(HELLO_TIMEOUT_MS);
+        if (!receiveMessage(connection, type, payload) || type != MessageType::Hello) {
+            throw std::runtime_error("connection did not introduce itself as a worker");
+        }
+        uint32_t workerThreads = decodeHello(payload);
+        sendMessage(connection, MessageType::Job, jobPayload);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            connectedWorkers++;
+            workersGauge.set(connectedWorkers);
+        }
+        joined = true;
+        LOG_INFO("worker joined", {{"worker", workerIndex}, {"threads", workerThreads}});
+
+        connection.setReceiveTimeout(distributed.workTimeoutSeconds * 1000);
+        AccumulationBuffer tile;
+        while (takeWork(item)) {
+            holdingItem = true;
+            auto sent = std::chrono::steady_clock::now();
+            sendMessage(connection, MessageType::Work, encodeWork(item));
+
+            if (!receiveMessage(connection, type, payload)) {
+                throw std::runtime_error("worker disconnected");
+            }
+            if (type != MessageType::Result) {
+                throw std::runtime_error("worker sent something other than a result");
+            }
+            WorkItem result = decodeResult(payload, tile);
+            if (result.id != item.id || result.region.width != item.region.width ||
+                result.region.height != item.region.height) {
+                throw std::runtime_error("worker returned a different work item to the one it was given");
+            }
+
+            itemSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - sent).count());
+            completeWork(item, tile);
+            holdingItem = false;
+            itemsRendered++;
+        }
+
+        sendMessage(connection, MessageType::Shutdown, {});
+    } catch (const std::exception &e) {
+        LOG_WARNING("lost worker", {{"worker", workerIndex}, {"itemsRendered", itemsRendered}, {"error", e.what()}});
+        if (holdingItem) {
+            returnWork(item);
+        }
+    }
+
+    if (joined) {
+        std::lock_guard<std::mutex> lock(mutex);
+        connectedWorkers--;
+        workersGauge.set(connectedWorkers);
+    }
+}
+
+bool RenderCoordinator::takeWork(WorkItem &item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    workCondition.wait(lock, [this] { return finished || !pendingItems.empty(); });
+    if (finished) {
+        return false;
+    }
+
+    item = workItems[pendingItems.front()];
+    pendingItems.pop_front();
+    return true;
+}
+
+void RenderCoordinator::returnWork(const WorkItem &item) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (completedItems[item.id]) {
+            return;
+        }
+        // front of the queue, it has already been waiting longer than anything else
+        pendingItems.push_front(item.id);
+    }
+    workCondition.notify_one();
+    LOG_INFO("re-issuing work item", {{"item", item.id}});
+}
+
+void RenderCoordinator::completeWork(const WorkItem &item, const AccumulationBuffer &tile) {
+    bool done;
+    bool tileFinished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (completedItems[item.id]) {
+            return;
+        }
+        accumulation.addRegion(item.region, tile);
+        completedItems[item.id] = true;
+        remainingItems--;
+
+        // items are made one pass over the tiles at a time, so the id gives the tile
+        uint32_t tileIndex = item.id % tilesPerPass;
+        tileSamples[tileIndex] += item.sampleCount;
+        tileFinished = tileSamples[tileIndex] == settings.samplesPerPixel;
+
+        auto itemCount = static_cast<uint32_t>(workItems.size());
+        uint32_t completed = itemCount - remainingItems;
+        progressGauge.set(static_cast<double>(completed) / itemCount);
+        if (completed * 10 / itemCount != (completed - 1) * 10 / itemCount) {
+            LOG_INFO("distributed render progress", {{"percent", completed * 100 / itemCount},
+                                                     {"completed", completed}, {"items", itemCount}});
+        }
+
+        done = remainingItems == 0;
+        if (done) {
+            finished = true;
+        }
+    }
+
+    // nothing writes to a finished tile again, so it can be read without the lock
+    if (tileFinished && imageWriter != nullptr) {
+        std::vector<glm::vec3> pixels(item.region.getPixelCount());
+        for (uint32_t y = 0; y < item.region.height; y++) {
+            for (uint32_t x = 0; x < item.region.width; x++) {
+                uint32_t pixelIndex = (item.region.y + y) * settings.width + item.region.x + x;
+                pixels[y * item.region.width + x] = accumulation.getPixel(pixelIndex);
+            }
+        }
+        imageWriter->submitRegion(imageId, item.region, pixels.data());
+    }
+
+    if (done) {
+        workCondition.notify_all();
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+RenderCoordinator::RenderCoordinator(const Scene &scene, const RenderSettings &settings,
+                                     const DistributedSettings &distributed)
+        : scene(scene), settings(settings), distributed(distributed),
+          progressGauge(Metrics::gauge("smcodes_job_progress", "Fraction of the current render that is done")),
+          workersGauge(Metrics::gauge("smcodes_connected_workers", "Workers connected to the coordinator")),
+          itemSeconds(Metrics::histogram("smcodes_work_item_seconds",
+                                         "Time from handing out a work item to its result coming back",
+                                         Metrics::getLatencyBounds())) {
+    jobPayload = encodeJob(settings, scene);
+    accumulation.resize(settings.width, settings.height);
+    createWorkItems();
+}
+
+RenderCoordinator::~RenderCoordinator() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    workCondition.notify_all();
+    for (auto &thread: connectionThreads) {
+        thread.join();
+    }
+
+    // only left running when render() threw, the workers exit on their own once their connection closes
+    waitForLocalWorkers();
+}
+
+void RenderCoordinator::setImageOutput(ImageWriter &writer, uint32_t outputImageId) {
+    imageWriter = &writer;
+    imageId = outputImageId;
+}
+
+void RenderCoordinator::render() {
+    if (workItems.empty()) {
+        return;
+    }
+
+    Socket listener = Socket::listen(distributed.port);
+    uint16_t port = listener.getLocalPort();
+    LOG_INFO("coordinating", {{"items", workItems.size()}, {"width", settings.width}, {"height", settings.height},
+                              {"samplesPerPixel", settings.samplesPerPixel}, {"port", port}});
+
+    startLocalWorkers(port);
+
+    uint32_t workerCount = 0;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) {
+                break;
+            }
+            // with nothing connected and nothing left to connect, the queue would wait forever
+            if (!localWorkers.empty() && connectedWorkers == 0 && haveLocalWorkersExited()) {
+                throw std::runtime_error("every worker exited before the render finished!");
+            }
+        }
+
+        if (listener.waitReadable(ACCEPT_POLL_MS)) {
+            Socket connection = listener.accept();
+            connectionThreads.emplace_back(&RenderCoordinator::serveWorker, this, std::move(connection), workerCount);
+            workerCount++;
+        }
+    }
+
+    for (auto &thread: connectionThreads) {
+        thread.join();
+    }
+    connectionThreads.clear();
+    waitForLocalWorkers();
+}
+
+const AccumulationBuffer &RenderCoordinator::getAccumulation() const {
+    return accumulation;
+}
+
+// #endregion
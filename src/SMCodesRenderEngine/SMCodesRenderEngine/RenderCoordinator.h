@@ -0,0 +1,102 @@
+#ifndef SMCODESRENDERENGINE_RENDERCOORDINATOR_H
+#define SMCODESRENDERENGINE_RENDERCOORDINATOR_H
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AccumulationBuffer.h"
+#include "RenderProtocol.h"
+#include "RenderSettings.h"
+
+struct Scene;
+class Gauge;
+class Histogram;
+class ImageWriter;
+class Socket;
+
+struct DistributedSettings {
+    uint16_t port = DEFAULT_COORDINATOR_PORT; // 0 picks a free port, only useful with local workers
+    uint32_t localWorkers = 0; // worker processes started on this machine, remote ones can join too
+    uint32_t localWorkerThreads = 0; // 0 splits the hardware threads evenly between local workers
+    uint32_t localWorkerFailAfter = 0; // passed on to the first local worker, see RenderWorker::setFailAfter
+    std::string workerExecutable; // what gets started for local workers, normally this executable
+
+    uint32_t tileSize = 128;
+    uint32_t samplesPerItem = 0; // 0 renders every sample of a tile in one work item
+    uint32_t workTimeoutSeconds = 300; // a worker silent for longer than this on one item counts as dead
+};
+
+// Coordinator side of distributed rendering (Idea.md step 3 across several machines).
+// Splits the image into tiles and sample ranges, hands them out to connected workers one at a time
+// and merges the returned tiles into one accumulation buffer. A worker that disconnects, errors or
+// times out has its work item put back at the front of the queue for the next free worker.
+// Paths are seeded from pixel and sample index only, so the image doesn't depend on who rendered what
+class RenderCoordinator {
+public:
+    RenderCoordinator(const Scene &scene, const RenderSettings &settings, const DistributedSettings &distributed);
+
+    ~RenderCoordinator();
+
+    // tiles get handed to writer (as image imageId) the moment their last sample range comes back
+    void setImageOutput(ImageWriter &writer, uint32_t imageId);
+
+    // blocks until every work item has come back
+    void render();
+
+    const AccumulationBuffer &getAccumulation() const;
+
+private:
+    struct LocalWorker;
+
+    const Scene &scene;
+    RenderSettings settings;
+    DistributedSettings distributed;
+    std::vector<uint8_t> jobPayload; // encoded once, sent to every worker that connects
+
+    std::mutex mutex;
+    std::condition_variable workCondition;
+    std::vector<WorkItem> workItems;
+    std::vector<bool> completedItems;
+    std::deque<uint32_t> pendingItems;
+    uint32_t remainingItems = 0;
+    uint32_t connectedWorkers = 0;
+    uint32_t tilesPerPass = 0;
+    std::vector<uint32_t> tileSamples; // samples merged so far per tile
+    ImageWriter *imageWriter = nullptr;
+    uint32_t imageId = 0;
+    bool finished = false;
+    AccumulationBuffer accumulation;
+
+    Gauge &progressGauge;
+    Gauge &workersGauge;
+    Histogram &itemSeconds; // sent to result back, includes the time on the wire
+
+    std::vector<std::thread> connectionThreads;
+    std::vector<LocalWorker> localWorkers;
+
+    void createWorkItems();
+
+    void startLocalWorkers(uint16_t port);
+
+    void waitForLocalWorkers();
+
+    bool haveLocalWorkersExited();
+
+    void serveWorker(Socket connection, uint32_t workerIndex);
+
+    // blocks until there is an item to hand out, false once everything is done
+    bool takeWork(WorkItem &item);
+
+    void returnWork(const WorkItem &item);
+
+    void completeWork(const WorkItem &item, const AccumulationBuffer &tile);
+};
+
+
+#endif //SMCODESRENDERENGINE_RENDERCOORDINATOR_H
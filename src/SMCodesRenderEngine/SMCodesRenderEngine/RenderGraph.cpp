@@ -0,0 +1,673 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "VulkanUtils.h"
+
+// #region Constants
+
+// the access bits that make a later access need a barrier, reads alone never do
+const VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                   VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+// #endregion
+
+// #region Private Methods
+
+static bool isDepthFormat(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static VkImageAspectFlags getAspect(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+// graphics passes read and write images from the fragment shader, the rest from compute
+static ImageUsage getUsage(ImageAccess access, bool write, VkAttachmentLoadOp loadOp, bool graphics) {
+    VkPipelineStageFlags shaderStage = graphics ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+                                                : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    switch (access) {
+        case ImageAccess::ColorAttachment:
+            return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                    (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0u)};
+        case ImageAccess::DepthAttachment:
+            return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT};
+        case ImageAccess::Sampled:
+            return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shaderStage, VK_ACCESS_SHADER_READ_BIT};
+        case ImageAccess::Storage:
+            return {VK_IMAGE_LAYOUT_GENERAL, shaderStage,
+                    VK_ACCESS_SHADER_READ_BIT | (write ? VK_ACCESS_SHADER_WRITE_BIT : 0u)};
+        case ImageAccess::TransferSource:
+            return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT};
+        case ImageAccess::TransferDestination:
+            return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT};
+    }
+    return {};
+}
+
+static VkImageUsageFlags getImageUsageFlags(ImageAccess access) {
+    switch (access) {
+        case ImageAccess::ColorAttachment:
+            return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case ImageAccess::DepthAttachment:
+            return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case ImageAccess::Sampled:
+            return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case ImageAccess::Storage:
+            return VK_IMAGE_USAGE_STORAGE_BIT;
+        case ImageAccess::TransferSource:
+            return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case ImageAccess::TransferDestination:
+            return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    return 0;
+}
+
+static bool isAttachment(ImageAccess access) {
+    return access == ImageAccess::ColorAttachment || access == ImageAccess::DepthAttachment;
+}
+
+void RenderGraph::addUse(uint32_t pass, const Use &use) {
+    if (compiled) {
+        throw std::runtime_error("failed to add to render graph, it's already compiled!");
+    }
+    if (pass >= passes.size() || use.image >= resources.size()) {
+        throw std::runtime_error("failed to add to render graph, no such pass or image!");
+    }
+    for (const Use &existing: passes[pass].uses) {
+        if (existing.image == use.image) {
+            throw std::runtime_error("failed to add to render graph, " + passes[pass].name + " already uses " +
+                                     resources[use.image].name + "!");
+        }
+    }
+    passes[pass].uses.push_back(use);
+}
+
+void RenderGraph::cull() {
+    // walking backwards from what the frame has to produce: a pass is live when it writes something still needed.
+    // Attachments it clears (or doesn't care about) hide whatever earlier passes wrote there, what it reads or
+    // loads is needed from the passes before it
+    std::vector<bool> needed(resources.size(), false);
+    for (size_t i = 0; i < resources.size(); i++) {
+        needed[i] = resources[i].imported;
+    }
+
+    for (size_t p = passes.size(); p-- > 0;) {
+        Pass &pass = passes[p];
+        bool live = pass.kept;
+        for (const Use &use: pass.uses) {
+            live = live || (use.write && needed[use.image]);
+        }
+        pass.culled = !live;
+        if (!live) {
+            continue;
+        }
+
+        for (const Use &use: pass.uses) {
+            if (isAttachment(use.access) && use.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD) {
+                needed[use.image] = false;
+            }
+        }
+        for (const Use &use: pass.uses) {
+            bool overwrites = isAttachment(use.access) && use.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD;
+            if (!overwrites) {
+                needed[use.image] = true;
+            }
+        }
+    }
+
+    order.clear();
+    for (uint32_t p = 0; p < passes.size(); p++) {
+        if (passes[p].culled) {
+            LOG_DEBUG("render graph pass culled", {{"pass", passes[p].name}});
+            continue;
+        }
+
+        auto position = static_cast<uint32_t>(order.size());
+        order.push_back(p);
+        for (const Use &use: passes[p].uses) {
+            Resource &resource = resources[use.image];
+            resource.firstUse = std::min(resource.firstUse, position);
+            resource.lastUse = std::max(resource.lastUse, position);
+            resource.usage |= getImageUsageFlags(use.access);
+        }
+    }
+}
+
+void RenderGraph::createRenderPasses() {
+    for (uint32_t position = 0; position < order.size(); position++) {
+        Pass &pass = passes[order[position]];
+
+        std::vector<uint32_t> colours;
+        std::vector<uint32_t> depths;
+        for (uint32_t u = 0; u < pass.uses.size(); u++) {
+            if (pass.uses[u].access == ImageAccess::ColorAttachment) {
+                colours.push_back(u);
+            } else if (pass.uses[u].access == ImageAccess::DepthAttachment) {
+                depths.push_back(u);
+            }
+        }
+        if (colours.empty() && depths.empty()) {
+            continue;
+        }
+        if (depths.size() > 1) {
+            throw std::runtime_error("failed to compile render graph, " + pass.name +
+                                     " has more than one depth attachment!");
+        }
+
+        pass.attachments = colours;
+        pass.attachments.insert(pass.attachments.end(), depths.begin(), depths.end());
+
+        std::vector<VkAttachmentDescription> descriptions;
+        std::vector<VkAttachmentReference> colourReferences;
+        VkAttachmentReference depthReference{};
+        for (uint32_t u: pass.attachments) {
+            const Use &use = pass.uses[u];
+            const Resource &resource = resources[use.image];
+            ImageUsage usage = getUsage(use.access, true, use.loadOp, true);
+
+            // the graph's barriers do the layout changes, the render pass only loads and stores. Nobody after
+            // this pass looking at the attachment means its contents can stay in tile memory
+            bool readLater = resource.imported || resource.lastUse > position;
+            VkAttachmentDescription description{};
+            description.format = resource.format;
+            description.samples = VK_SAMPLE_COUNT_1_BIT;
+            description.loadOp = use.loadOp;
+            description.storeOp = readLater ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            description.initialLayout = usage.layout;
+            description.finalLayout = usage.layout;
+
+            VkAttachmentReference reference{};
+            reference.attachment = static_cast<uint32_t>(descriptions.size());
+            reference.layout = usage.layout;
+            if (use.access == ImageAccess::ColorAttachment) {
+                colourReferences.push_back(reference);
+            } else {
+                depthReference = reference;
+            }
+
+            descriptions.push_back(description);
+            pass.clearValues.push_back(use.clearValue);
+        }
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colourReferences.size());
+        subpass.pColorAttachments = colourReferences.data();
+        subpass.pDepthStencilAttachment = depths.empty() ? nullptr : &depthReference;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+        renderPassInfo.pAttachments = descriptions.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render pass for " + pass.name + "!");
+        }
+    }
+}
+
+void RenderGraph::createTransients() {
+    unaliasedBytes = 0;
+    memoryBlocks.clear();
+
+    std::vector<uint32_t> transients;
+    std::vector<VkMemoryRequirements> requirements(resources.size());
+    for (uint32_t r = 0; r < resources.size(); r++) {
+        Resource &resource = resources[r];
+        if (resource.imported) {
+            resource.extent = extent;
+            continue;
+        }
+        if (resource.firstUse == UINT32_MAX) {
+            continue;
+        }
+
+        resource.extent.width = std::max(1u, static_cast<uint32_t>(std::lround(extent.width * resource.scale)));
+        resource.extent.height = std::max(1u, static_cast<uint32_t>(std::lround(extent.height * resource.scale)));
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.format;
+        imageInfo.extent = {resource.extent.width, resource.extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render graph image " + resource.name + "!");
+        }
+
+        vkGetImageMemoryRequirements(device, resource.image, &requirements[r]);
+        unaliasedBytes += requirements[r].size;
+        transients.push_back(r);
+    }
+
+    // biggest first, each into the first block whose images are never alive at the same time as it. Blocks grow
+    // to their biggest image
+    std::sort(transients.begin(), transients.end(), [&](uint32_t a, uint32_t b) {
+        return requirements[a].size > requirements[b].size;
+    });
+    for (uint32_t r: transients) {
+        Resource &resource = resources[r];
+        for (uint32_t b = 0; b < memoryBlocks.size() && resource.memoryBlock == UINT32_MAX; b++) {
+            MemoryBlock &block = memoryBlocks[b];
+            if ((block.typeBits & requirements[r].memoryTypeBits) == 0) {
+                continue;
+            }
+            bool overlaps = std::any_of(block.images.begin(), block.images.end(), [&](uint32_t other) {
+                return resources[other].firstUse <= resource.lastUse && resource.firstUse <= resources[other].lastUse;
+            });
+            if (!overlaps) {
+                resource.memoryBlock = b;
+            }
+        }
+        if (resource.memoryBlock == UINT32_MAX) {
+            resource.memoryBlock = static_cast<uint32_t>(memoryBlocks.size());
+            memoryBlocks.emplace_back();
+        }
+
+        MemoryBlock &block = memoryBlocks[resource.memoryBlock];
+        block.size = std::max(block.size, requirements[r].size);
+        block.typeBits &= requirements[r].memoryTypeBits;
+        block.images.push_back(r);
+    }
+
+    for (MemoryBlock &block: memoryBlocks) {
+        int memoryType = findMemoryType(memoryProperties, block.typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (memoryType < 0) {
+            throw std::runtime_error("failed to find memory for render graph images!");
+        }
+
+        VkMemoryAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateInfo.allocationSize = block.size;
+        allocateInfo.memoryTypeIndex = static_cast<uint32_t>(memoryType);
+        if (vkAllocateMemory(device, &allocateInfo, nullptr, &block.memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate render graph memory!");
+        }
+
+        // in frame order, so each one knows whose contents it's throwing away. The first takes over from the last
+        // of the frame before, which can still be running when this one starts
+        std::sort(block.images.begin(), block.images.end(), [&](uint32_t a, uint32_t b) {
+            return resources[a].firstUse < resources[b].firstUse;
+        });
+        for (size_t i = 0; i < block.images.size(); i++) {
+            Resource &resource = resources[block.images[i]];
+            resource.previousAlias = block.images[(i + block.images.size() - 1) % block.images.size()];
+            vkBindImageMemory(device, resource.image, block.memory, 0);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.format;
+            viewInfo.subresourceRange = {getAspect(resource.format), 0, 1, 0, 1};
+            if (vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create render graph image view " + resource.name + "!");
+            }
+        }
+    }
+}
+
+void RenderGraph::destroyTransients() {
+    for (Pass &pass: passes) {
+        for (auto &[views, framebuffer]: pass.framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+        pass.framebuffers.clear();
+    }
+
+    for (Resource &resource: resources) {
+        if (resource.imported) {
+            continue;
+        }
+        vkDestroyImageView(device, resource.view, nullptr);
+        vkDestroyImage(device, resource.image, nullptr);
+        resource.view = VK_NULL_HANDLE;
+        resource.image = VK_NULL_HANDLE;
+        resource.memoryBlock = UINT32_MAX;
+        resource.previousAlias = UINT32_MAX;
+    }
+
+    for (MemoryBlock &block: memoryBlocks) {
+        vkFreeMemory(device, block.memory, nullptr);
+    }
+    memoryBlocks.clear();
+}
+
+void RenderGraph::planBarriers() {
+    std::vector<ImageUsage> states(resources.size());
+    std::vector<bool> touched(resources.size(), false);
+    // barriers of transients taking over their memory, the previous alias's final state isn't known until the end
+    std::vector<std::pair<Barrier *, uint32_t>> aliasBarriers;
+
+    for (uint32_t p: order) {
+        Pass &pass = passes[p];
+        pass.barriers.clear();
+        // aliasBarriers points into this, it can't move once the pass is done
+        pass.barriers.reserve(pass.uses.size());
+        bool graphics = !pass.attachments.empty();
+
+        for (const Use &use: pass.uses) {
+            const Resource &resource = resources[use.image];
+            ImageUsage wanted = getUsage(use.access, use.write, use.loadOp, graphics);
+            ImageUsage &state = states[use.image];
+
+            if (!touched[use.image]) {
+                touched[use.image] = true;
+                if (!resource.imported) {
+                    // contents are whatever the previous alias left, so UNDEFINED, but its accesses have to be done
+                    Barrier barrier{use.image, VK_IMAGE_LAYOUT_UNDEFINED, wanted.layout, 0, 0, wanted.stages,
+                                    wanted.access};
+                    pass.barriers.push_back(barrier);
+                    aliasBarriers.emplace_back(&pass.barriers.back(), resource.previousAlias);
+                    state = {wanted.layout, wanted.stages, wanted.access & WRITE_ACCESS};
+                    continue;
+                }
+                state = resource.before;
+            }
+
+            // a layout change, a write still to be made visible or a write that has to wait for earlier reads
+            bool writes = (wanted.access & WRITE_ACCESS) != 0;
+            if (state.layout != wanted.layout || (state.access & WRITE_ACCESS) != 0 || writes) {
+                pass.barriers.push_back({use.image, state.layout, wanted.layout, state.stages,
+                                         state.access & WRITE_ACCESS, wanted.stages, wanted.access});
+                state = {wanted.layout, wanted.stages, wanted.access & WRITE_ACCESS};
+            } else {
+                // another read in the same layout, a later write has to wait for this one too
+                state.stages |= wanted.stages;
+            }
+        }
+    }
+
+    finalBarriers.clear();
+    for (uint32_t r = 0; r < resources.size(); r++) {
+        Resource &resource = resources[r];
+        if (!resource.imported) {
+            resource.finalState = states[r];
+            continue;
+        }
+
+        // everything using it may have been culled, it still has to end up where the caller expects it
+        ImageUsage state = touched[r] ? states[r] : resource.before;
+        if (state.layout != resource.after.layout || (state.access & WRITE_ACCESS) != 0) {
+            finalBarriers.push_back({r, state.layout, resource.after.layout, state.stages,
+                                     state.access & WRITE_ACCESS, resource.after.stages, resource.after.access});
+        }
+    }
+
+    for (auto &[barrier, previous]: aliasBarriers) {
+        barrier->srcStages = resources[previous].finalState.stages;
+        barrier->srcAccess = resources[previous].finalState.access;
+    }
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(Pass &pass) {
+    std::vector<VkImageView> views;
+    for (uint32_t u: pass.attachments) {
+        views.push_back(resources[pass.uses[u].image].view);
+    }
+
+    auto found = pass.framebuffers.find(views);
+    if (found != pass.framebuffers.end()) {
+        return found->second;
+    }
+
+    const Resource &first = resources[pass.uses[pass.attachments[0]].image];
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = pass.renderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+    framebufferInfo.pAttachments = views.data();
+    framebufferInfo.width = first.extent.width;
+    framebufferInfo.height = first.extent.height;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create framebuffer for " + pass.name + "!");
+    }
+    pass.framebuffers[views] = framebuffer;
+    return framebuffer;
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer cmdBuffer, const std::vector<Barrier> &barriers) const {
+    if (barriers.empty()) {
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    for (const Barrier &barrier: barriers) {
+        const Resource &resource = resources[barrier.image];
+
+        VkImageMemoryBarrier imageBarrier{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcAccessMask = barrier.srcAccess;
+        imageBarrier.dstAccessMask = barrier.dstAccess;
+        imageBarrier.oldLayout = barrier.oldLayout;
+        imageBarrier.newLayout = barrier.newLayout;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = resource.image;
+        imageBarrier.subresourceRange = {getAspect(resource.format), 0, 1, 0, 1};
+        imageBarriers.push_back(imageBarrier);
+
+        srcStages |= barrier.srcStages;
+        dstStages |= barrier.dstStages;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer, srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         dstStages != 0 ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+// #endregion
+
+// #region Public Methods
+
+uint32_t RenderGraph::importImage(const std::string &name, VkFormat format, const ImageUsage &before,
+                                  const ImageUsage &after) {
+    Resource resource;
+    resource.name = name;
+    resource.format = format;
+    resource.imported = true;
+    resource.before = before;
+    resource.after = after;
+    resources.push_back(resource);
+    return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t RenderGraph::createImage(const std::string &name, VkFormat format, float scale) {
+    Resource resource;
+    resource.name = name;
+    resource.format = format;
+    resource.scale = scale;
+    resources.push_back(resource);
+    return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t RenderGraph::addPass(const std::string &name, RecordFunction record) {
+    Pass pass;
+    pass.name = name;
+    pass.record = std::move(record);
+    passes.push_back(std::move(pass));
+    return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void RenderGraph::writeAttachment(uint32_t pass, uint32_t image, VkAttachmentLoadOp loadOp, VkClearValue clearValue) {
+    Use use;
+    use.image = image;
+    use.access = isDepthFormat(resources.at(image).format) ? ImageAccess::DepthAttachment
+                                                           : ImageAccess::ColorAttachment;
+    use.write = true;
+    use.loadOp = loadOp;
+    use.clearValue = clearValue;
+    addUse(pass, use);
+}
+
+void RenderGraph::read(uint32_t pass, uint32_t image, ImageAccess access) {
+    if (access != ImageAccess::Sampled && access != ImageAccess::Storage && access != ImageAccess::TransferSource) {
+        throw std::runtime_error("failed to add read to render graph, not a read access!");
+    }
+    Use use;
+    use.image = image;
+    use.access = access;
+    addUse(pass, use);
+}
+
+void RenderGraph::write(uint32_t pass, uint32_t image, ImageAccess access) {
+    if (access != ImageAccess::Storage && access != ImageAccess::TransferDestination) {
+        throw std::runtime_error("failed to add write to render graph, attachments go through writeAttachment!");
+    }
+    Use use;
+    use.image = image;
+    use.access = access;
+    use.write = true;
+    addUse(pass, use);
+}
+
+void RenderGraph::keep(uint32_t pass) {
+    passes.at(pass).kept = true;
+}
+
+void RenderGraph::compile(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkExtent2D graphExtent) {
+    device = logicalDevice;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    extent = graphExtent;
+
+    cull();
+    createRenderPasses();
+    createTransients();
+    planBarriers();
+    compiled = true;
+
+    size_t barrierCount = finalBarriers.size();
+    for (uint32_t p: order) {
+        barrierCount += passes[p].barriers.size();
+    }
+    LOG_INFO("compiled render graph", {{"passes", order.size()}, {"culled", passes.size() - order.size()},
+                                       {"barriers", barrierCount}, {"transientBytes", getTransientBytes()},
+                                       {"unaliasedBytes", unaliasedBytes}});
+}
+
+void RenderGraph::resize(VkExtent2D graphExtent) {
+    destroyTransients();
+    extent = graphExtent;
+    createTransients();
+    planBarriers();
+}
+
+void RenderGraph::destroy() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    destroyTransients();
+    for (Pass &pass: passes) {
+        vkDestroyRenderPass(device, pass.renderPass, nullptr);
+    }
+    passes.clear();
+    resources.clear();
+    order.clear();
+    finalBarriers.clear();
+    compiled = false;
+}
+
+void RenderGraph::setImportedImage(uint32_t image, VkImage vkImage, VkImageView view) {
+    Resource &resource = resources.at(image);
+    if (!resource.imported) {
+        throw std::runtime_error("failed to set render graph image, " + resource.name + " isn't imported!");
+    }
+    resource.image = vkImage;
+    resource.view = view;
+}
+
+void RenderGraph::execute(VkCommandBuffer cmdBuffer) {
+    if (!compiled) {
+        throw std::runtime_error("failed to execute render graph, it isn't compiled!");
+    }
+
+    for (uint32_t p: order) {
+        Pass &pass = passes[p];
+        recordBarriers(cmdBuffer, pass.barriers);
+
+        if (pass.renderPass == VK_NULL_HANDLE) {
+            pass.record(cmdBuffer);
+            continue;
+        }
+
+        VkRenderPassBeginInfo renderPassBeginInfo{};
+        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassBeginInfo.renderPass = pass.renderPass;
+        renderPassBeginInfo.framebuffer = getFramebuffer(pass);
+        renderPassBeginInfo.renderArea.offset = {0, 0};
+        renderPassBeginInfo.renderArea.extent = resources[pass.uses[pass.attachments[0]].image].extent;
+        renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+        renderPassBeginInfo.pClearValues = pass.clearValues.data();
+
+        vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        pass.record(cmdBuffer);
+        vkCmdEndRenderPass(cmdBuffer);
+    }
+
+    recordBarriers(cmdBuffer, finalBarriers);
+}
+
+VkImageView RenderGraph::getImageView(uint32_t image) const {
+    return resources.at(image).view;
+}
+
+VkRenderPass RenderGraph::getRenderPass(uint32_t pass) const {
+    return passes.at(pass).renderPass;
+}
+
+bool RenderGraph::isCulled(uint32_t pass) const {
+    return passes.at(pass).culled;
+}
+
+VkDeviceSize RenderGraph::getTransientBytes() const {
+    VkDeviceSize bytes = 0;
+    for (const MemoryBlock &block: memoryBlocks) {
+        bytes += block.size;
+    }
+    return bytes;
+}
+
+VkDeviceSize RenderGraph::getUnaliasedTransientBytes() const {
+    return unaliasedBytes;
+}
+
+// #endregion
@@ -0,0 +1,179 @@
+#ifndef SMCODESRENDERENGINE_RENDERGRAPH_H
+#define SMCODESRENDERENGINE_RENDERGRAPH_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// what a pass does with an image, picks the layout, stages and access the graph synchronises on
+enum class ImageAccess {
+    ColorAttachment,
+    DepthAttachment,
+    Sampled,
+    Storage,
+    TransferSource,
+    TransferDestination
+};
+
+// the state an image is in at one point of the frame
+struct ImageUsage {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags access = 0;
+};
+
+// A frame as a list of passes that declare which images they read and write, instead of render passes, barriers
+// and image memory wired up by hand. compile() works out the rest once:
+// - passes whose writes nothing ends up reading are culled, an imported image or a pass marked with keep() is what
+//   counts as the end result
+// - every pass gets the fewest barriers that cover it: layout changes, reads after writes and writes after reads.
+//   Reads in the same layout after reads don't get one, and all of a pass's barriers go in a single call
+// - passes with attachments get a render pass of their own. Attachments are already in the right layout when it
+//   starts, and are only stored when a later pass or the caller looks at them again
+// - transient images (created by the graph, only alive for the frame) share memory when no pass has both alive,
+//   so a chain of full resolution passes needs about as much memory as its widest point rather than the total
+// The passes run in the order they were added, record functions are called while recording the frame
+class RenderGraph {
+public:
+    using RecordFunction = std::function<void(VkCommandBuffer cmdBuffer)>;
+
+    // an image from outside the graph, in before when the frame starts and left in after at the end.
+    // setImportedImage() says which one it is before each execute()
+    uint32_t importImage(const std::string &name, VkFormat format, const ImageUsage &before, const ImageUsage &after);
+
+    // owned by the graph, scale times the graph's extent. Contents don't survive from one frame to the next
+    uint32_t createImage(const std::string &name, VkFormat format, float scale = 1.0f);
+
+    uint32_t addPass(const std::string &name, RecordFunction record);
+
+    // colour or depth attachment depending on the format, colour attachments take locations in the order written
+    void writeAttachment(uint32_t pass, uint32_t image, VkAttachmentLoadOp loadOp, VkClearValue clearValue = {});
+
+    // Sampled, Storage or TransferSource
+    void read(uint32_t pass, uint32_t image, ImageAccess access);
+
+    // Storage or TransferDestination
+    void write(uint32_t pass, uint32_t image, ImageAccess access);
+
+    // never culled, for passes with effects outside the graph (a copy into a buffer)
+    void keep(uint32_t pass);
+
+    // the graph can't change after this
+    void compile(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkExtent2D extent);
+
+    // transient images and framebuffers again at the new size, render passes stay. Nothing using them can still be
+    // on the GPU
+    void resize(VkExtent2D extent);
+
+    void destroy();
+
+    void setImportedImage(uint32_t image, VkImage vkImage, VkImageView view);
+
+    void execute(VkCommandBuffer cmdBuffer);
+
+    // a transient's view for descriptors, the same until the next resize()
+    VkImageView getImageView(uint32_t image) const;
+
+    // for building pipelines against, VK_NULL_HANDLE for passes without attachments
+    VkRenderPass getRenderPass(uint32_t pass) const;
+
+    bool isCulled(uint32_t pass) const;
+
+    // device memory of the transient images, with and without aliasing
+    VkDeviceSize getTransientBytes() const;
+
+    VkDeviceSize getUnaliasedTransientBytes() const;
+
+private:
+    struct Resource {
+        std::string name;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        float scale = 1.0f;
+        bool imported = false;
+        ImageUsage before;
+        ImageUsage after;
+        VkImageUsageFlags usage = 0; // every way a live pass uses it
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkExtent2D extent{};
+        uint32_t firstUse = UINT32_MAX; // index into order
+        uint32_t lastUse = 0;
+        uint32_t memoryBlock = UINT32_MAX;
+        // the transient that had memoryBlock before it, in the frame before when it's the block's first
+        uint32_t previousAlias = UINT32_MAX;
+        ImageUsage finalState; // after its last use in the frame
+    };
+
+    struct Use {
+        uint32_t image = 0;
+        ImageAccess access = ImageAccess::Sampled;
+        bool write = false;
+        VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        VkClearValue clearValue{};
+    };
+
+    struct Barrier {
+        uint32_t image = 0;
+        VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags srcStages = 0;
+        VkAccessFlags srcAccess = 0;
+        VkPipelineStageFlags dstStages = 0;
+        VkAccessFlags dstAccess = 0;
+    };
+
+    struct Pass {
+        std::string name;
+        RecordFunction record;
+        std::vector<Use> uses;
+        bool kept = false;
+        bool culled = false;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        std::vector<uint32_t> attachments; // into uses, colour ones first and depth last
+        std::vector<VkClearValue> clearValues;
+        std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers; // by attachment views
+        std::vector<Barrier> barriers; // before the pass
+    };
+
+    // transients sharing one allocation, bound at offset 0 of it
+    struct MemoryBlock {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t typeBits = ~0u;
+        std::vector<uint32_t> images;
+    };
+
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDevice device = VK_NULL_HANDLE;
+    VkExtent2D extent{};
+    bool compiled = false;
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<uint32_t> order; // passes that survived culling
+    std::vector<MemoryBlock> memoryBlocks;
+    std::vector<Barrier> finalBarriers; // imported images into their after state
+    VkDeviceSize unaliasedBytes = 0;
+
+    void addUse(uint32_t pass, const Use &use);
+
+    void cull();
+
+    void createRenderPasses();
+
+    void createTransients();
+
+    void destroyTransients();
+
+    void planBarriers();
+
+    VkFramebuffer getFramebuffer(Pass &pass);
+
+    void recordBarriers(VkCommandBuffer cmdBuffer, const std::vector<Barrier> &barriers) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_RENDERGRAPH_H
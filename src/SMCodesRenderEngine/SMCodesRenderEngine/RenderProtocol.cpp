@@ -0,0 +1,449 @@
+#include "RenderProtocol.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "AccumulationBuffer.h"
+#include "EnvironmentMap.h"
+#include "Scene.h"
+#include "Socket.h"
+#include "Texture.h"
+
+// #region Constants
+
+const size_t MESSAGE_HEADER_SIZE = 5;
+
+// anything bigger is a corrupt header rather than a real tile
+const uint32_t MAX_PAYLOAD_SIZE = 1u << 30;
+
+const size_t WORK_ITEM_SIZE = 7 * sizeof(uint32_t);
+
+const size_t RESULT_BYTES_PER_PIXEL = 3 * sizeof(float) + 3 + 3 + sizeof(float);
+
+// what a job sends per vertex (position, uv), per triangle (indices, material) and per environment map pixel
+const size_t JOB_VERTEX_SIZE = 5 * sizeof(float);
+const size_t JOB_TRIANGLE_SIZE = 4 * sizeof(uint32_t);
+const size_t JOB_ENVIRONMENT_PIXEL_SIZE = 3 * sizeof(float);
+
+// #endregion
+
+// #region Private Methods
+
+static uint8_t encodeUnorm8(float value) {
+    return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+static float decodeUnorm8(uint8_t value) {
+    return static_cast<float>(value) / 255.0f;
+}
+
+static uint8_t encodeSnorm8(float value) {
+    auto signedValue = static_cast<int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+    return static_cast<uint8_t>(signedValue);
+}
+
+static float decodeSnorm8(uint8_t value) {
+    return std::max(static_cast<float>(static_cast<int8_t>(value)) / 127.0f, -1.0f);
+}
+
+static void writeWorkItem(MessageWriter &writer, const WorkItem &item) {
+    writer.writeUInt32(item.id);
+    writer.writeUInt32(item.region.x);
+    writer.writeUInt32(item.region.y);
+    writer.writeUInt32(item.region.width);
+    writer.writeUInt32(item.region.height);
+    writer.writeUInt32(item.firstSample);
+    writer.writeUInt32(item.sampleCount);
+}
+
+static WorkItem readWorkItem(MessageReader &reader) {
+    WorkItem item;
+    item.id = reader.readUInt32();
+    item.region.x = reader.readUInt32();
+    item.region.y = reader.readUInt32();
+    item.region.width = reader.readUInt32();
+    item.region.height = reader.readUInt32();
+    item.firstSample = reader.readUInt32();
+    item.sampleCount = reader.readUInt32();
+    return item;
+}
+
+// counts come straight off the wire, one that needs more bytes than are left is corrupt and must be caught before
+// anything gets reserved for it
+static void requireElements(const MessageReader &reader, uint64_t count, size_t elementSize, const std::string &what) {
+    if (count > reader.getRemaining() / elementSize) {
+        throw std::runtime_error("render job claims more " + what + " than it holds!");
+    }
+}
+
+MessageReader::MessageReader(const std::vector<uint8_t> &bytes) : bytes(bytes) {
+}
+
+void MessageReader::require(size_t size) const {
+    if (bytes.size() - offset < size) {
+        throw std::runtime_error("render message is truncated!");
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+void MessageWriter::writeUInt8(uint8_t value) {
+    bytes.push_back(value);
+}
+
+void MessageWriter::writeUInt32(uint32_t value) {
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        bytes.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void MessageWriter::writeFloat(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    writeUInt32(bits);
+}
+
+void MessageWriter::writeVec3(const glm::vec3 &value) {
+    writeFloat(value.x);
+    writeFloat(value.y);
+    writeFloat(value.z);
+}
+
+void MessageWriter::writeVec2(const glm::vec2 &value) {
+    writeFloat(value.x);
+    writeFloat(value.y);
+}
+
+void MessageWriter::writeString(const std::string &value) {
+    writeUInt32(static_cast<uint32_t>(value.size()));
+    bytes.insert(bytes.end(), value.begin(), value.end());
+}
+
+const std::vector<uint8_t> &MessageWriter::getBytes() const {
+    return bytes;
+}
+
+uint8_t MessageReader::readUInt8() {
+    require(1);
+    return bytes[offset++];
+}
+
+uint32_t MessageReader::readUInt32() {
+    require(4);
+    uint32_t value = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        value |= static_cast<uint32_t>(bytes[offset++]) << shift;
+    }
+    return value;
+}
+
+float MessageReader::readFloat() {
+    uint32_t bits = readUInt32();
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+glm::vec3 MessageReader::readVec3() {
+    float x = readFloat();
+    float y = readFloat();
+    float z = readFloat();
+    return {x, y, z};
+}
+
+glm::vec2 MessageReader::readVec2() {
+    float x = readFloat();
+    float y = readFloat();
+    return {x, y};
+}
+
+std::string MessageReader::readString() {
+    uint32_t length = readUInt32();
+    require(length);
+    std::string value(bytes.begin() + static_cast<std::ptrdiff_t>(offset),
+                      bytes.begin() + static_cast<std::ptrdiff_t>(offset + length));
+    offset += length;
+    return value;
+}
+
+size_t MessageReader::getRemaining() const {
+    return bytes.size() - offset;
+}
+
+void MessageReader::expectEnd() const {
+    if (offset != bytes.size()) {
+        throw std::runtime_error("render message has unexpected trailing bytes!");
+    }
+}
+
+void sendMessage(Socket &socket, MessageType type, const std::vector<uint8_t> &payload) {
+    MessageWriter header;
+    header.writeUInt8(static_cast<uint8_t>(type));
+    header.writeUInt32(static_cast<uint32_t>(payload.size()));
+
+    socket.sendAll(header.getBytes().data(), header.getBytes().size());
+    if (!payload.empty()) {
+        socket.sendAll(payload.data(), payload.size());
+    }
+}
+
+bool receiveMessage(Socket &socket, MessageType &type, std::vector<uint8_t> &payload) {
+    std::vector<uint8_t> header(MESSAGE_HEADER_SIZE);
+    if (!socket.receiveAll(header.data(), header.size())) {
+        return false;
+    }
+
+    MessageReader reader(header);
+    type = static_cast<MessageType>(reader.readUInt8());
+    uint32_t size = reader.readUInt32();
+    if (size > MAX_PAYLOAD_SIZE) {
+        throw std::runtime_error("render message payload is too large!");
+    }
+
+    payload.resize(size);
+    if (size > 0 && !socket.receiveAll(payload.data(), size)) {
+        throw std::runtime_error("connection closed part way through a message!");
+    }
+    return true;
+}
+
+std::vector<uint8_t> encodeHello(uint32_t threadCount) {
+    MessageWriter writer;
+    writer.writeUInt32(PROTOCOL_VERSION);
+    writer.writeUInt32(threadCount);
+    return writer.getBytes();
+}
+
+uint32_t decodeHello(const std::vector<uint8_t> &payload) {
+    MessageReader reader(payload);
+    uint32_t version = reader.readUInt32();
+    if (version != PROTOCOL_VERSION) {
+        throw std::runtime_error("worker speaks protocol version " + std::to_string(version) + ", expected " +
+                                 std::to_string(PROTOCOL_VERSION) + "!");
+    }
+    uint32_t threadCount = reader.readUInt32();
+    reader.expectEnd();
+    return threadCount;
+}
+
+std::vector<uint8_t> encodeJob(const RenderSettings &settings, const Scene &scene) {
+    MessageWriter writer;
+    writer.writeUInt32(settings.width);
+    writer.writeUInt32(settings.height);
+    writer.writeUInt32(settings.samplesPerPixel);
+    writer.writeUInt32(settings.maxDepth);
+    writer.writeUInt32(settings.seed);
+    writer.writeUInt8(static_cast<uint8_t>(settings.mode));
+    writer.writeUInt8(static_cast<uint8_t>(settings.sampler));
+    writer.writeUInt8(static_cast<uint8_t>(settings.bvhLayout));
+    // threadCount is left to the worker, it knows its own machine
+
+    writer.writeVec3(scene.camera.position);
+    writer.writeVec3(scene.camera.target);
+    writer.writeVec3(scene.camera.up);
+    writer.writeFloat(scene.camera.verticalFov);
+
+    writer.writeUInt32(static_cast<uint32_t>(scene.materials.size()));
+    for (const auto &material: scene.materials) {
+        writer.writeVec3(material.albedo);
+        writer.writeVec3(material.emission);
+        writer.writeUInt32(material.albedoTexture);
+        writer.writeUInt8(static_cast<uint8_t>(material.type));
+        writer.writeFloat(material.roughness);
+        writer.writeFloat(material.ior);
+    }
+
+    // paths only, textures are read from shared storage a tile at a time like on the coordinator
+    writer.writeUInt32(static_cast<uint32_t>(scene.textures.size()));
+    for (const auto &texture: scene.textures) {
+        writer.writeString(texture->getPath());
+    }
+
+    writer.writeUInt32(static_cast<uint32_t>(scene.vertices.size()));
+    for (size_t i = 0; i < scene.vertices.size(); i++) {
+        writer.writeVec3(scene.vertices[i]);
+        writer.writeVec2(scene.uvs[i]);
+    }
+
+    writer.writeUInt32(scene.getTriangleCount());
+    for (uint32_t i = 0; i < scene.getTriangleCount(); i++) {
+        writer.writeUInt32(scene.triangles[i].x);
+        writer.writeUInt32(scene.triangles[i].y);
+        writer.writeUInt32(scene.triangles[i].z);
+        writer.writeUInt32(scene.triangleMaterials[i]);
+    }
+
+    // the pixels only, every worker builds its own sampling tables
+    writer.writeUInt8(scene.environment ? 1 : 0);
+    if (scene.environment) {
+        writer.writeUInt32(scene.environment->getWidth());
+        writer.writeUInt32(scene.environment->getHeight());
+        for (const auto &pixel: scene.environment->getPixels()) {
+            writer.writeVec3(pixel);
+        }
+    }
+    return writer.getBytes();
+}
+
+void decodeJob(const std::vector<uint8_t> &payload, RenderSettings &settings, Scene &scene) {
+    MessageReader reader(payload);
+    settings.width = reader.readUInt32();
+    settings.height = reader.readUInt32();
+    settings.samplesPerPixel = reader.readUInt32();
+    settings.maxDepth = reader.readUInt32();
+    settings.seed = reader.readUInt32();
+    settings.mode = static_cast<RenderMode>(reader.readUInt8());
+    settings.sampler = static_cast<SamplerType>(reader.readUInt8());
+    settings.bvhLayout = static_cast<BvhLayout>(reader.readUInt8());
+
+    scene = Scene();
+    scene.camera.position = reader.readVec3();
+    scene.camera.target = reader.readVec3();
+    scene.camera.up = reader.readVec3();
+    scene.camera.verticalFov = reader.readFloat();
+
+    uint32_t materialCount = reader.readUInt32();
+    for (uint32_t i = 0; i < materialCount; i++) {
+        Material material;
+        material.albedo = reader.readVec3();
+        material.emission = reader.readVec3();
+        material.albedoTexture = reader.readUInt32();
+        material.type = static_cast<MaterialType>(reader.readUInt8());
+        material.roughness = reader.readFloat();
+        material.ior = reader.readFloat();
+        scene.addMaterial(material);
+    }
+
+    uint32_t textureCount = reader.readUInt32();
+    for (uint32_t i = 0; i < textureCount; i++) {
+        scene.addTexture(reader.readString());
+    }
+    for (const auto &material: scene.materials) {
+        if (material.albedoTexture != NO_TEXTURE && material.albedoTexture >= textureCount) {
+            throw std::runtime_error("render job references a texture that was not sent!");
+        }
+    }
+
+    uint32_t vertexCount = reader.readUInt32();
+    requireElements(reader, vertexCount, JOB_VERTEX_SIZE, "vertices");
+    scene.vertices.reserve(vertexCount);
+    scene.uvs.reserve(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        scene.vertices.push_back(reader.readVec3());
+        scene.uvs.push_back(reader.readVec2());
+    }
+
+    uint32_t triangleCount = reader.readUInt32();
+    requireElements(reader, triangleCount, JOB_TRIANGLE_SIZE, "triangles");
+    scene.triangles.reserve(triangleCount);
+    scene.triangleMaterials.reserve(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        glm::uvec3 triangle;
+        triangle.x = reader.readUInt32();
+        triangle.y = reader.readUInt32();
+        triangle.z = reader.readUInt32();
+        uint32_t materialIndex = reader.readUInt32();
+        if (triangle.x >= vertexCount || triangle.y >= vertexCount || triangle.z >= vertexCount ||
+            materialIndex >= materialCount) {
+            throw std::runtime_error("render job references a vertex or material that was not sent!");
+        }
+        scene.triangles.push_back(triangle);
+        scene.triangleMaterials.push_back(materialIndex);
+    }
+
+    if (reader.readUInt8() != 0) {
+        uint32_t width = reader.readUInt32();
+        uint32_t height = reader.readUInt32();
+        if (width == 0 || height == 0) {
+            throw std::runtime_error("render job has an empty environment map!");
+        }
+        requireElements(reader, static_cast<uint64_t>(width) * height, JOB_ENVIRONMENT_PIXEL_SIZE,
+                        "environment map pixels");
+        std::vector<glm::vec3> pixels;
+        pixels.reserve(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+            pixels.push_back(reader.readVec3());
+        }
+        scene.environment = std::make_shared<EnvironmentMap>(width, height, std::move(pixels));
+    }
+    reader.expectEnd();
+}
+
+std::vector<uint8_t> encodeWork(const WorkItem &item) {
+    MessageWriter writer;
+    writeWorkItem(writer, item);
+    return writer.getBytes();
+}
+
+WorkItem decodeWork(const std::vector<uint8_t> &payload) {
+    MessageReader reader(payload);
+    WorkItem item = readWorkItem(reader);
+    reader.expectEnd();
+    return item;
+}
+
+std::vector<uint8_t> encodeResult(const WorkItem &item, const AccumulationBuffer &tile) {
+    MessageWriter writer;
+    writeWorkItem(writer, item);
+
+    uint32_t pixelCount = item.region.getPixelCount();
+    for (uint32_t i = 0; i < pixelCount; i++) {
+        if (tile.sampleCounts[i] != item.sampleCount) {
+            throw std::runtime_error("tile has a pixel with a different sample count to its work item!");
+        }
+
+        writer.writeVec3(tile.radianceSum[i]);
+
+        glm::vec3 albedo = tile.getAlbedo(i);
+        writer.writeUInt8(encodeUnorm8(albedo.x));
+        writer.writeUInt8(encodeUnorm8(albedo.y));
+        writer.writeUInt8(encodeUnorm8(albedo.z));
+
+        glm::vec3 normal = tile.getNormal(i);
+        writer.writeUInt8(encodeSnorm8(normal.x));
+        writer.writeUInt8(encodeSnorm8(normal.y));
+        writer.writeUInt8(encodeSnorm8(normal.z));
+
+        writer.writeFloat(tile.getDepth(i));
+    }
+    return writer.getBytes();
+}
+
+WorkItem decodeResult(const std::vector<uint8_t> &payload, AccumulationBuffer &tile) {
+    MessageReader reader(payload);
+    WorkItem item = readWorkItem(reader);
+
+    uint32_t pixelCount = item.region.getPixelCount();
+    if (payload.size() != WORK_ITEM_SIZE + static_cast<size_t>(pixelCount) * RESULT_BYTES_PER_PIXEL) {
+        throw std::runtime_error("render result does not hold one entry per pixel of its region!");
+    }
+
+    tile.resize(item.region.width, item.region.height);
+    auto count = static_cast<float>(item.sampleCount);
+    for (uint32_t i = 0; i < pixelCount; i++) {
+        tile.radianceSum[i] = reader.readVec3();
+        tile.sampleCounts[i] = item.sampleCount;
+
+        glm::vec3 albedo;
+        albedo.x = decodeUnorm8(reader.readUInt8());
+        albedo.y = decodeUnorm8(reader.readUInt8());
+        albedo.z = decodeUnorm8(reader.readUInt8());
+        tile.albedoSum[i] = albedo * count;
+
+        glm::vec3 normal;
+        normal.x = decodeSnorm8(reader.readUInt8());
+        normal.y = decodeSnorm8(reader.readUInt8());
+        normal.z = decodeSnorm8(reader.readUInt8());
+        tile.normalSum[i] = normal * count;
+
+        tile.depthSum[i] = reader.readFloat() * count;
+    }
+    reader.expectEnd();
+    return item;
+}
+
+// #endregion
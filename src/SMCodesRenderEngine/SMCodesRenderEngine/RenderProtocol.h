@@ -0,0 +1,122 @@
+#ifndef SMCODESRENDERENGINE_RENDERPROTOCOL_H
+#define SMCODESRENDERENGINE_RENDERPROTOCOL_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "RenderSettings.h"
+
+struct AccumulationBuffer;
+struct Scene;
+class Socket;
+
+// Binary protocol between the render coordinator and its workers.
+// Every message is a 5 byte header (type, payload size) followed by the payload,
+// all integers and floats little endian.
+//  worker -> coordinator  Hello   protocol version, thread count
+//  coordinator -> worker  Job     render settings and the whole scene
+//  coordinator -> worker  Work    a region and a range of samples to render
+//  worker -> coordinator  Result  the work item plus the region's accumulated pixels
+//  coordinator -> worker  Shutdown
+
+const uint32_t PROTOCOL_VERSION = 6;
+const uint16_t DEFAULT_COORDINATOR_PORT = 47820;
+
+enum class MessageType : uint8_t {
+    Hello = 1,
+    Job = 2,
+    Work = 3,
+    Result = 4,
+    Shutdown = 5
+};
+
+struct WorkItem {
+    uint32_t id = 0;
+    ImageRegion region;
+    uint32_t firstSample = 0;
+    uint32_t sampleCount = 0;
+};
+
+// Appends little endian values to a payload
+class MessageWriter {
+public:
+    void writeUInt8(uint8_t value);
+
+    void writeUInt32(uint32_t value);
+
+    void writeFloat(float value);
+
+    void writeVec3(const glm::vec3 &value);
+
+    void writeVec2(const glm::vec2 &value);
+
+    // length prefixed
+    void writeString(const std::string &value);
+
+    const std::vector<uint8_t> &getBytes() const;
+
+private:
+    std::vector<uint8_t> bytes;
+};
+
+// Reads a payload back, throws when a message is shorter than what it claims to hold
+class MessageReader {
+public:
+    explicit MessageReader(const std::vector<uint8_t> &bytes);
+
+    uint8_t readUInt8();
+
+    uint32_t readUInt32();
+
+    float readFloat();
+
+    glm::vec3 readVec3();
+
+    glm::vec2 readVec2();
+
+    std::string readString();
+
+    // bytes not read yet, for checking a count against what the message can actually hold
+    size_t getRemaining() const;
+
+    // throws if anything is left over, catches both sides disagreeing on a layout
+    void expectEnd() const;
+
+private:
+    const std::vector<uint8_t> &bytes;
+    size_t offset = 0;
+
+    void require(size_t size) const;
+};
+
+void sendMessage(Socket &socket, MessageType type, const std::vector<uint8_t> &payload);
+
+// false when the connection was closed cleanly between messages
+bool receiveMessage(Socket &socket, MessageType &type, std::vector<uint8_t> &payload);
+
+std::vector<uint8_t> encodeHello(uint32_t threadCount);
+
+uint32_t decodeHello(const std::vector<uint8_t> &payload);
+
+std::vector<uint8_t> encodeJob(const RenderSettings &settings, const Scene &scene);
+
+void decodeJob(const std::vector<uint8_t> &payload, RenderSettings &settings, Scene &scene);
+
+std::vector<uint8_t> encodeWork(const WorkItem &item);
+
+WorkItem decodeWork(const std::vector<uint8_t> &payload);
+
+// Radiance sums go over the wire as full floats so merged images match a local render,
+// the feature buffers only feed the denoiser and are sent as per pixel averages in 8 bits
+// per channel. Every pixel of a work item has the same sample count, so that is sent once.
+// 22 bytes per pixel against the 44 the accumulation buffer holds
+std::vector<uint8_t> encodeResult(const WorkItem &item, const AccumulationBuffer &tile);
+
+// tile is resized to the item's region
+WorkItem decodeResult(const std::vector<uint8_t> &payload, AccumulationBuffer &tile);
+
+
+#endif //SMCODESRENDERENGINE_RENDERPROTOCOL_H
@@ -0,0 +1,81 @@
+#ifndef SMCODESRENDERENGINE_RENDERSETTINGS_H
+#define SMCODESRENDERENGINE_RENDERSETTINGS_H
+
+
+#include <cstdint>
+#include <string>
+
+enum class RenderMode {
+    // one thread follows one path through every bounce before moving to the next pixel
+    Megakernel,
+    // every path of a chunk advances one bounce at a time through generate/extend/shade/shadow queues
+    Wavefront
+};
+
+enum class SamplerType {
+    // every path draws from its own PCG stream, simple but clumps at low sample counts
+    Independent,
+    // Owen scrambled Sobol points handed out in a blue noise order over the screen (see Sampler)
+    Sobol
+};
+
+enum class BvhLayout {
+    // two children per node with float bounds, traced 4 rays at a time as packets by the wavefront
+    Binary,
+    // four children per 64 byte node with 8 bit bounds (see CompressedBvh), a third of the memory
+    Compressed
+};
+
+struct RenderSettings {
+    uint32_t width = 1200;
+    uint32_t height = 1000;
+    uint32_t samplesPerPixel = 64;
+    uint32_t maxDepth = 8;
+    uint32_t seed = 0;
+    RenderMode mode = RenderMode::Wavefront;
+    SamplerType sampler = SamplerType::Sobol;
+    BvhLayout bvhLayout = BvhLayout::Binary;
+
+    uint32_t threadCount = 0; // 0 = every hardware thread
+    uint32_t tileSize = 32; // megakernel tiles are tileSize x tileSize pixels
+    uint32_t wavefrontSize = 1u << 16; // paths kept in flight per wavefront queue
+
+    // progress is snapshotted here every checkpointInterval seconds and resumed from on the next run,
+    // empty turns checkpoints off
+    std::string checkpointPath;
+    uint32_t checkpointInterval = 60;
+
+    // when set the BVH is paged in from this file (written from the scene first if it isn't there) and at most
+    // geometryBudget bytes of it are kept in memory, see PagedBvh. Empty keeps the whole BVH in memory.
+    // Pages always hold binary trees, bvhLayout only applies to the in memory BVH
+    std::string geometryPagePath;
+    uint64_t geometryBudget = 256ull << 20;
+    uint32_t trianglesPerPage = 4096;
+
+    // meshes render at the coarsest level of detail whose error covers at most this many pixels, for quick previews
+    // (see Scene::selectLevelsOfDetail). 0 is full detail
+    float lodPixelError = 0.0f;
+
+    float getAspectRatio() const {
+        return static_cast<float>(width) / static_cast<float>(height);
+    }
+
+    uint32_t getPixelCount() const {
+        return width * height;
+    }
+};
+
+// Rectangle of the image in pixels, the unit of work handed to a worker when rendering distributed
+struct ImageRegion {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    uint32_t getPixelCount() const {
+        return width * height;
+    }
+};
+
+
+#endif //SMCODESRENDERENGINE_RENDERSETTINGS_H
@@ -0,0 +1,108 @@
+#include "RenderWorker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+
+#include "AccumulationBuffer.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "PathTracer.h"
+#include "RenderProtocol.h"
+#include "Scene.h"
+#include "Socket.h"
+#include "Texture.h"
+
+// #region Constants
+
+const uint32_t CONNECT_ATTEMPTS = 60;
+const std::chrono::milliseconds CONNECT_RETRY_DELAY(500);
+
+// #endregion
+
+// #region Private Methods
+
+Socket RenderWorker::connectWithRetry() const {
+    for (uint32_t attempt = 1;; attempt++) {
+        try {
+            return Socket::connect(host, port);
+        } catch (const std::runtime_error &) {
+            if (attempt == CONNECT_ATTEMPTS) {
+                throw;
+            }
+            std::this_thread::sleep_for(CONNECT_RETRY_DELAY);
+        }
+    }
+}
+
+// #endregion
+
+// #region Public Methods
+
+RenderWorker::RenderWorker(const std::string &host, uint16_t port, uint32_t threadCount)
+        : host(host), port(port), threadCount(threadCount) {
+}
+
+void RenderWorker::setFailAfter(uint32_t workItems) {
+    failAfter = workItems;
+}
+
+void RenderWorker::run() {
+    Socket socket = connectWithRetry();
+    uint32_t threads = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    sendMessage(socket, MessageType::Hello, encodeHello(threads));
+
+    MessageType type;
+    std::vector<uint8_t> payload;
+    if (!receiveMessage(socket, type, payload) || type != MessageType::Job) {
+        throw std::runtime_error("coordinator did not send a render job!");
+    }
+
+    RenderSettings settings;
+    Scene scene;
+    decodeJob(payload, settings, scene);
+    settings.threadCount = threads;
+
+    LOG_INFO("worker connected", {{"host", host}, {"port", port}, {"width", settings.width},
+                                  {"height", settings.height}, {"threads", threads}});
+
+    PathTracer pathTracer(scene, settings);
+    AccumulationBuffer tile;
+    uint32_t itemsRendered = 0;
+    Histogram &tileSeconds = Metrics::histogram("smcodes_tile_seconds", "Time a worker takes to render one work item",
+                                                Metrics::getLatencyBounds());
+
+    // a closed connection means the coordinator is gone, nothing left to do either way
+    while (receiveMessage(socket, type, payload)) {
+        if (type == MessageType::Shutdown) {
+            break;
+        }
+        if (type != MessageType::Work) {
+            throw std::runtime_error("worker got an unexpected message from the coordinator!");
+        }
+
+        WorkItem item = decodeWork(payload);
+        tile.resize(item.region.width, item.region.height);
+        auto start = std::chrono::steady_clock::now();
+        pathTracer.renderRegion(item.region, item.firstSample, item.sampleCount, tile);
+        tileSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        if (failAfter > 0 && itemsRendered == failAfter) {
+            LOG_WARNING("worker failing on purpose", {{"itemsRendered", itemsRendered}});
+            Logger::flush(); // _Exit doesn't run the logger's destructor
+            std::_Exit(EXIT_FAILURE);
+        }
+
+        sendMessage(socket, MessageType::Result, encodeResult(item, tile));
+        itemsRendered++;
+    }
+
+    LOG_INFO("worker finished", {{"itemsRendered", itemsRendered}});
+    if (!scene.textures.empty()) {
+        TextureCache::logStats();
+    }
+}
+
+// #endregion
@@ -0,0 +1,36 @@
+#ifndef SMCODESRENDERENGINE_RENDERWORKER_H
+#define SMCODESRENDERENGINE_RENDERWORKER_H
+
+
+#include <cstdint>
+#include <string>
+
+class Socket;
+
+// Worker side of distributed rendering. Connects to a coordinator, receives the job (settings and scene),
+// then renders whatever regions and sample ranges it is handed until the coordinator says it is done.
+// Run as its own process, either started by the coordinator for local workers or by hand on other machines
+class RenderWorker {
+public:
+    // threadCount of 0 uses every hardware thread
+    RenderWorker(const std::string &host, uint16_t port, uint32_t threadCount = 0);
+
+    // exits the process without a word after this many work items, for testing the coordinator
+    // picking work back up from workers that die. 0 never fails
+    void setFailAfter(uint32_t workItems);
+
+    // returns once the coordinator shuts the worker down
+    void run();
+
+private:
+    std::string host;
+    uint16_t port;
+    uint32_t threadCount;
+    uint32_t failAfter = 0;
+
+    // workers started by hand may well be up before the coordinator is listening
+    Socket connectWithRetry() const;
+};
+
+
+#endif //SMCODESRENDERENGINE_RENDERWORKER_H
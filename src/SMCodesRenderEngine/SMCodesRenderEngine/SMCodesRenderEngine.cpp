@@ -8,19 +8,453 @@
 #include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
+#include "CompressedBvh.h"
+#include "Denoiser.h"
+#include "EnvironmentMap.h"
 #include "HelloTriangleApplication.h"
+#include "ImageWriter.h"
+#include "LightSampler.h"
+#include "Logger.h"
+#include "MetricsServer.h"
+#include "MultiDeviceRenderer.h"
+#include "PathTracer.h"
+#include "Random.h"
+#include "RenderCoordinator.h"
+#include "RenderWorker.h"
+#include "Sampling.h"
+#include "Scene.h"
+#include "Texture.h"
 
 using namespace std;
 
-int main() {
-    HelloTriangleApplication app = HelloTriangleApplication();
+static bool hasFlag(const std::vector<std::string> &args, const std::string &flag) {
+    return std::find(args.begin(), args.end(), flag) != args.end();
+}
+
+static uint32_t getUIntOption(const std::vector<std::string> &args, const std::string &option, uint32_t fallback) {
+    auto it = std::find(args.begin(), args.end(), option);
+    if (it == args.end() || ++it == args.end()) {
+        return fallback;
+    }
+    return static_cast<uint32_t>(std::stoul(*it));
+}
+
+static std::string getStringOption(const std::vector<std::string> &args, const std::string &option,
+                                   const std::string &fallback) {
+    auto it = std::find(args.begin(), args.end(), option);
+    if (it == args.end() || ++it == args.end()) {
+        return fallback;
+    }
+    return *it;
+}
+
+static std::vector<glm::vec3> runDenoiser(ThreadPool &threadPool, const AccumulationBuffer &accumulation) {
+    Denoiser denoiser(threadPool);
+    std::vector<glm::vec3> denoised;
+
+    auto start = std::chrono::steady_clock::now();
+    denoiser.denoise(accumulation, denoised);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("denoised", {{"milliseconds", seconds * 1000.0}});
+    return denoised;
+}
+
+// hands the finished frame to the image writer, denoised first if asked for
+static void outputFrame(const std::vector<std::string> &args, ThreadPool &threadPool,
+                        const AccumulationBuffer &accumulation, ImageWriter &imageWriter, bool alreadyStreamed) {
+    std::string outputPath = getStringOption(args, "--output", "");
+    if (hasFlag(args, "--denoise")) {
+        std::vector<glm::vec3> denoised = runDenoiser(threadPool, accumulation);
+        if (!outputPath.empty()) {
+            imageWriter.writeImage(outputPath, accumulation.width, accumulation.height, denoised);
+        }
+    } else if (!outputPath.empty() && !alreadyStreamed) {
+        imageWriter.writeImage(outputPath, accumulation);
+    }
+
+    if (!outputPath.empty()) {
+        auto start = std::chrono::steady_clock::now();
+        imageWriter.flush();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("wrote image", {{"path", outputPath}, {"encoderWaitMilliseconds", seconds * 1000.0}});
+    }
+}
+
+// --trace renders the test scene on the CPU path tracer instead of opening the Vulkan window.
+// With --distributed the frame is split between worker processes, --local-workers N starts N of them
+// on this machine and others can join with --worker --connect <coordinator host>:<port>.
+// --output <file>.png / .exr writes the frame out on background encoder threads.
+// --environment <file>.hdr lights the scene with an HDR environment map, "sky" uses a procedural one.
+// --sampler independent swaps the blue noise Sobol samples for plain random ones.
+// --bvh compressed traces against the 4 wide, 8 bit quantised BVH instead of the binary one.
+// --texture <file>.smtx (made with --convert-texture) modulates the albedo of every surface
+// --geometry-pages <file> pages the BVH in from disk under a --geometry-budget-mb memory budget, the file is written
+// from the scene in pages of --page-triangles triangles if it doesn't exist yet
+// --preview-error <pixels> swaps meshes for simplified levels of detail whose error stays under that many pixels
+static void runCpuTracer(const std::string &executable, const std::vector<std::string> &args) {
+    RenderSettings settings;
+    settings.width = getUIntOption(args, "--width", settings.width);
+    settings.height = getUIntOption(args, "--height", settings.height);
+    settings.samplesPerPixel = getUIntOption(args, "--spp", settings.samplesPerPixel);
+    settings.maxDepth = getUIntOption(args, "--depth", settings.maxDepth);
+    settings.threadCount = getUIntOption(args, "--threads", settings.threadCount);
+    settings.mode = hasFlag(args, "--megakernel") ? RenderMode::Megakernel : RenderMode::Wavefront;
+    settings.sampler = getStringOption(args, "--sampler", "sobol") == "independent" ? SamplerType::Independent
+                                                                                  : SamplerType::Sobol;
+    settings.bvhLayout = getStringOption(args, "--bvh", "binary") == "compressed" ? BvhLayout::Compressed
+                                                                                 : BvhLayout::Binary;
+    settings.checkpointPath = getStringOption(args, "--checkpoint", settings.checkpointPath);
+    settings.checkpointInterval = getUIntOption(args, "--checkpoint-interval", settings.checkpointInterval);
+    settings.geometryPagePath = getStringOption(args, "--geometry-pages", settings.geometryPagePath);
+    if (hasFlag(args, "--geometry-budget-mb")) {
+        settings.geometryBudget = static_cast<uint64_t>(getUIntOption(args, "--geometry-budget-mb", 0)) << 20;
+    }
+    settings.trianglesPerPage = getUIntOption(args, "--page-triangles", settings.trianglesPerPage);
+    settings.lodPixelError = std::stof(getStringOption(args, "--preview-error", "0"));
+
+    // --lights N swaps the Cornell box for a floor under N small lights, --terrain N for hills of 2N^2 triangles,
+    // --materials for the version with metal, glass and clear coat
+    Scene scene = Scene::createCornellBox();
+    if (hasFlag(args, "--lights")) {
+        scene = Scene::createLightGrid(getUIntOption(args, "--lights", 1));
+    } else if (hasFlag(args, "--terrain")) {
+        scene = Scene::createTerrain(getUIntOption(args, "--terrain", 256));
+    } else if (hasFlag(args, "--materials")) {
+        scene = Scene::createMaterialShowcase();
+    }
+    if (settings.lodPixelError > 0.0f) {
+        uint32_t fullDetailTriangles = scene.getTriangleCount();
+        scene = scene.selectLevelsOfDetail(settings.lodPixelError, settings.height);
+        LOG_INFO("selected levels of detail", {{"triangles", scene.getTriangleCount()},
+                                               {"fullDetailTriangles", fullDetailTriangles}});
+    }
+    std::string environmentPath = getStringOption(args, "--environment", "");
+    if (environmentPath == "sky") {
+        scene.environment = EnvironmentMap::createSky(1024, 512, glm::vec3(0.5f, 0.7f, 0.3f));
+    } else if (!environmentPath.empty()) {
+        scene.environment = EnvironmentMap::load(environmentPath);
+    }
+    if (hasFlag(args, "--texture")) {
+        uint32_t texture = scene.addTexture(getStringOption(args, "--texture", ""));
+        for (auto &material: scene.materials) {
+            material.albedoTexture = texture;
+        }
+    }
+    ImageWriter imageWriter;
+
+    if (hasFlag(args, "--distributed")) {
+        DistributedSettings distributed;
+        distributed.port = static_cast<uint16_t>(getUIntOption(args, "--port", distributed.port));
+        distributed.localWorkers = getUIntOption(args, "--local-workers", distributed.localWorkers);
+        distributed.localWorkerThreads = settings.threadCount;
+        distributed.localWorkerFailAfter = getUIntOption(args, "--fail-after", distributed.localWorkerFailAfter);
+        distributed.workerExecutable = executable;
+        distributed.tileSize = getUIntOption(args, "--tile", distributed.tileSize);
+        distributed.samplesPerItem = getUIntOption(args, "--samples-per-item", distributed.samplesPerItem);
+
+        RenderCoordinator coordinator(scene, settings, distributed);
+
+        // without denoising, tiles can be encoded as they finish instead of waiting for the whole frame
+        std::string outputPath = getStringOption(args, "--output", "");
+        bool streamOutput = !outputPath.empty() && !hasFlag(args, "--denoise");
+        if (streamOutput) {
+            coordinator.setImageOutput(imageWriter, imageWriter.beginImage(outputPath, settings.width,
+                                                                           settings.height));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        coordinator.render();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("rendered distributed", {{"seconds", seconds}});
+
+        ThreadPool threadPool(settings.threadCount);
+        outputFrame(args, threadPool, coordinator.getAccumulation(), imageWriter, streamOutput);
+        return;
+    }
+
+    PathTracer pathTracer(scene, settings);
+
+    auto start = std::chrono::steady_clock::now();
+    pathTracer.render();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    RayStats stats = pathTracer.getStats();
+    double totalRays = static_cast<double>(stats.rays + stats.shadowRays);
+    LOG_INFO("rendered", {{"seconds", seconds}, {"megaRaysPerSecond", totalRays / seconds / 1e6}});
+    if (!scene.textures.empty()) {
+        TextureCache::logStats();
+    }
+
+    outputFrame(args, pathTracer.getThreadPool(), pathTracer.getAccumulation(), imageWriter, false);
+}
+
+// --light-benchmark times building the light BVH and picking lights with it for growing light counts
+// (up to --max-lights), next to uniform selection. relativeStdDev is the noise of one direct lighting sample
+// on the floor of Scene::createLightGrid(), it should stay flat for the BVH as the count grows
+static void runLightBenchmark(const std::vector<std::string> &args) {
+    const uint32_t pointCount = 256;
+    const uint32_t samplesPerPoint = 256;
+    uint32_t maxLights = getUIntOption(args, "--max-lights", 16384);
+
+    for (uint32_t lightCount = 1; lightCount <= maxLights; lightCount *= 4) {
+        Scene scene = Scene::createLightGrid(lightCount);
+        float halfSize = scene.getBounds().max.x;
+
+        for (LightSelection selection: {LightSelection::Uniform, LightSelection::Bvh}) {
+            auto buildStart = std::chrono::steady_clock::now();
+            LightSampler lightSampler(scene, selection);
+            auto buildEnd = std::chrono::steady_clock::now();
+            double buildSeconds = std::chrono::duration<double>(buildEnd - buildStart).count();
+
+            // unoccluded direct light on the floor, the floor only ever sees the lights
+            Pcg32 rng(lightCount, 0);
+            double relativeStdDevSum = 0.0;
+            uint32_t litPoints = 0;
+            auto sampleStart = std::chrono::steady_clock::now();
+            for (uint32_t point = 0; point < pointCount; point++) {
+                glm::vec3 position((rng.nextFloat() * 2.0f - 1.0f) * halfSize, 0.0f,
+                                   (rng.nextFloat() * 2.0f - 1.0f) * halfSize);
+                glm::vec3 normal(0.0f, 1.0f, 0.0f);
+
+                double sum = 0.0;
+                double sumSquared = 0.0;
+                for (uint32_t i = 0; i < samplesPerPoint; i++) {
+                    float u1 = rng.nextFloat();
+                    float u2 = rng.nextFloat();
+                    float u3 = rng.nextFloat();
+                    LightSample lightSample = lightSampler.sample(position, normal, u1, u2, u3);
+                    if (lightSample.pdfArea <= 0.0f) {
+                        continue;
+                    }
+                    glm::vec3 toLight = lightSample.position - position;
+                    float distanceSquared = glm::dot(toLight, toLight);
+                    glm::vec3 direction = toLight / std::sqrt(distanceSquared);
+                    float cosSurface = std::max(glm::dot(normal, direction), 0.0f);
+                    float cosLight = std::max(-glm::dot(lightSample.normal, direction), 0.0f);
+                    double value = luminance(lightSample.emission) * cosSurface * cosLight /
+                                   (distanceSquared * lightSample.pdfArea);
+                    sum += value;
+                    sumSquared += value * value;
+                }
+
+                double mean = sum / samplesPerPoint;
+                double variance = std::max(sumSquared / samplesPerPoint - mean * mean, 0.0);
+                if (mean > 0.0) {
+                    relativeStdDevSum += std::sqrt(variance) / mean;
+                    litPoints++;
+                }
+            }
+            auto sampleEnd = std::chrono::steady_clock::now();
+            double sampleSeconds = std::chrono::duration<double>(sampleEnd - sampleStart).count();
+
+            LOG_INFO("light sampling benchmark",
+                     {{"lights", lightSampler.getLightCount()},
+                      {"selection", selection == LightSelection::Bvh ? "bvh" : "uniform"},
+                      {"buildMilliseconds", buildSeconds * 1000.0},
+                      {"nodes", lightSampler.getLightBvh().getNodeCount()},
+                      {"nanosecondsPerSample", sampleSeconds * 1e9 / (pointCount * samplesPerPoint)},
+                      {"relativeStdDev", litPoints > 0 ? relativeStdDevSum / litPoints : 0.0}});
+        }
+    }
+}
+
+// --bvh-benchmark builds the binary and the compressed BVH over Scene::createTerrain() at growing resolutions
+// (up to --max-resolution) and traces the same rays through both, camera rays and one diffuse bounce from wherever
+// they hit. Logs the memory each tree takes and single ray throughput, mismatches counts rays the two disagree on
+static void runBvhBenchmark(const std::vector<std::string> &args) {
+    const uint32_t raysPerSide = 512;
+    uint32_t maxResolution = getUIntOption(args, "--max-resolution", 1024);
+
+    for (uint32_t resolution = 64; resolution <= maxResolution; resolution *= 4) {
+        Scene scene = Scene::createTerrain(resolution);
+
+        auto buildStart = std::chrono::steady_clock::now();
+        Bvh bvh(scene);
+        auto binaryEnd = std::chrono::steady_clock::now();
+        CompressedBvh compressedBvh(scene, bvh);
+        auto compressedEnd = std::chrono::steady_clock::now();
+
+        // the rays both trees trace, bounces leave from the binary tree's hits
+        std::vector<Ray> rays;
+        Pcg32 rng(resolution, 0);
+        for (uint32_t y = 0; y < raysPerSide; y++) {
+            for (uint32_t x = 0; x < raysPerSide; x++) {
+                float u = (static_cast<float>(x) + 0.5f) / raysPerSide;
+                float v = (static_cast<float>(y) + 0.5f) / raysPerSide;
+                rays.push_back(scene.camera.generateRay(u, v, 1.0f));
+            }
+        }
+        auto primaryCount = static_cast<uint32_t>(rays.size());
+        for (uint32_t i = 0; i < primaryCount; i++) {
+            Hit hit;
+            if (bvh.intersect(rays[i], hit)) {
+                glm::vec3 normal = scene.getTriangleNormal(hit.triangleIndex);
+                if (glm::dot(normal, rays[i].direction) > 0.0f) {
+                    normal = -normal;
+                }
+                Ray bounce;
+                bounce.origin = rays[i].origin + rays[i].direction * hit.t + normal * 1e-4f;
+                float u1 = rng.nextFloat();
+                float u2 = rng.nextFloat();
+                bounce.direction = sampleCosineHemisphere(normal, u1, u2);
+                rays.push_back(bounce);
+            }
+        }
+
+        std::vector<Hit> binaryHits(rays.size());
+        auto binaryTraceStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rays.size(); i++) {
+            bvh.intersect(rays[i], binaryHits[i]);
+        }
+        auto binaryTraceEnd = std::chrono::steady_clock::now();
+
+        std::vector<Hit> compressedHits(rays.size());
+        auto compressedTraceStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rays.size(); i++) {
+            compressedBvh.intersect(rays[i], compressedHits[i]);
+        }
+        auto compressedTraceEnd = std::chrono::steady_clock::now();
+
+        uint32_t mismatches = 0;
+        for (size_t i = 0; i < rays.size(); i++) {
+            if (binaryHits[i].triangleIndex != compressedHits[i].triangleIndex) {
+                mismatches++;
+            }
+        }
+
+        auto log = [&](const char *layout, size_t bytes, uint32_t nodes, std::chrono::steady_clock::duration build,
+                       std::chrono::steady_clock::duration trace) {
+            double traceSeconds = std::chrono::duration<double>(trace).count();
+            LOG_INFO("bvh benchmark", {{"triangles", scene.getTriangleCount()}, {"layout", layout},
+                                       {"nodes", nodes}, {"megabytes", bytes / 1048576.0},
+                                       {"bytesPerTriangle", static_cast<double>(bytes) / scene.getTriangleCount()},
+                                       {"buildMilliseconds", std::chrono::duration<double>(build).count() * 1000.0},
+                                       {"megaRaysPerSecond", rays.size() / traceSeconds / 1e6},
+                                       {"mismatches", mismatches}});
+        };
+        log("binary", bvh.getMemoryUsage(), bvh.getNodeCount(), binaryEnd - buildStart,
+            binaryTraceEnd - binaryTraceStart);
+        // its build time is only the collapse, on top of the binary build it starts from
+        log("compressed", compressedBvh.getMemoryUsage(), compressedBvh.getNodeCount(), compressedEnd - binaryEnd,
+            compressedTraceEnd - compressedTraceStart);
+    }
+}
+
+// --worker --connect <host>:<port> renders tiles for a coordinator until it is told to stop
+static void runRenderWorker(const std::vector<std::string> &args) {
+    std::string address = getStringOption(args, "--connect", "127.0.0.1:" + std::to_string(DEFAULT_COORDINATOR_PORT));
+    size_t separator = address.rfind(':');
+    if (separator == std::string::npos) {
+        throw std::runtime_error("--connect expects <host>:<port>, got " + address);
+    }
+
+    RenderWorker worker(address.substr(0, separator), static_cast<uint16_t>(std::stoul(address.substr(separator + 1))),
+                        getUIntOption(args, "--threads", 0));
+    worker.setFailAfter(getUIntOption(args, "--fail-after", 0));
+    worker.run();
+}
+
+// --headless renders the triangle offscreen as fast as the GPU goes, --frames-in-flight sets how far ahead
+// the CPU gets. --output <file>.png / .exr reads every frame back and writes it as <file>_0001.png and so on.
+// --post-process runs --downsample N, --exposure X and the tonemap (off with --no-tonemap) on the compute queue.
+// --devices all shares the frames out between every suitable GPU, --devices 0,0,1 opens exactly those
+// physical devices (twice on device 0) and --device N renders on just that one
+static void runHeadless(const std::vector<std::string> &args) {
+    HeadlessSettings settings;
+    settings.width = getUIntOption(args, "--width", settings.width);
+    settings.height = getUIntOption(args, "--height", settings.height);
+    settings.frameCount = getUIntOption(args, "--frames", settings.frameCount);
+    settings.outputPath = getStringOption(args, "--output", settings.outputPath);
+    settings.readbackBuffers = getUIntOption(args, "--readback-buffers", settings.readbackBuffers);
+    settings.postProcess = hasFlag(args, "--post-process");
+    settings.postProcessSettings.downsample = getUIntOption(args, "--downsample",
+                                                            settings.postProcessSettings.downsample);
+    settings.postProcessSettings.exposure = std::stof(getStringOption(args, "--exposure", std::to_string(
+            settings.postProcessSettings.exposure)));
+    settings.postProcessSettings.tonemap = !hasFlag(args, "--no-tonemap");
+    if (hasFlag(args, "--device")) {
+        settings.deviceIndex = getUIntOption(args, "--device", 0);
+    }
+    uint32_t framesInFlight = getUIntOption(args, "--frames-in-flight", DEFAULT_FRAMES_IN_FLIGHT);
+
+    ImageWriter imageWriter;
+    std::string devices = getStringOption(args, "--devices", "");
+    if (!devices.empty()) {
+        std::vector<uint32_t> deviceIndices;
+        if (devices != "all") {
+            size_t start = 0;
+            while (start <= devices.size()) {
+                size_t end = std::min(devices.find(',', start), devices.size());
+                deviceIndices.push_back(static_cast<uint32_t>(std::stoul(devices.substr(start, end - start))));
+                start = end + 1;
+            }
+        }
+
+        MultiDeviceRenderer renderer(settings, deviceIndices, framesInFlight);
+        renderer.render(imageWriter);
+    } else {
+        HelloTriangleApplication app(framesInFlight);
+        app.runHeadless(settings, imageWriter);
+    }
+    imageWriter.flush();
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
     
     try{
-       app.run(); 
+        // engine output is JSON lines on stdout, or appended to --log-file. --log-level trace .. error, or off
+        LoggerSettings logSettings;
+        logSettings.level = Logger::parseLevel(getStringOption(args, "--log-level", "info"));
+        logSettings.path = getStringOption(args, "--log-file", "");
+        Logger::configure(logSettings);
+
+        // --metrics-port <n> serves counters and latencies for Prometheus at http://host:n/metrics for the run
+        std::unique_ptr<MetricsServer> metricsServer;
+        if (hasFlag(args, "--metrics-port")) {
+            metricsServer = std::make_unique<MetricsServer>(
+                    static_cast<uint16_t>(getUIntOption(args, "--metrics-port", 0)));
+        }
+
+        // --texture-cache-mb <n> caps the memory texture tiles take, however many textures the scene has
+        if (hasFlag(args, "--texture-cache-mb")) {
+            TextureCache::setBudget(static_cast<uint64_t>(getUIntOption(args, "--texture-cache-mb", 0)) << 20);
+        }
+
+        // --convert-texture <image>.png <texture>.smtx tiles and mip maps an image for --texture
+        if (hasFlag(args, "--convert-texture")) {
+            auto option = std::find(args.begin(), args.end(), "--convert-texture");
+            if (args.end() - option < 3) {
+                throw std::runtime_error("--convert-texture expects <image>.png <texture>.smtx");
+            }
+            Texture::convert(option[1], option[2]);
+        } else if (hasFlag(args, "--worker")) {
+            runRenderWorker(args);
+        } else if (hasFlag(args, "--light-benchmark")) {
+            runLightBenchmark(args);
+        } else if (hasFlag(args, "--bvh-benchmark")) {
+            runBvhBenchmark(args);
+        } else if (hasFlag(args, "--trace")) {
+            runCpuTracer(argv[0], args);
+        } else if (hasFlag(args, "--headless")) {
+            runHeadless(args);
+        } else {
+            // --frames-in-flight <n> lets the CPU get further ahead of the GPU
+            HelloTriangleApplication app(getUIntOption(args, "--frames-in-flight", DEFAULT_FRAMES_IN_FLIGHT));
+            app.run();
+        }
     }
     catch (const std::exception& e){
+        LOG_ERROR("fatal error", {{"error", e.what()}});
+        Logger::flush();
         std::cerr << e.what() << std::endl;
         
         return EXIT_FAILURE;
@@ -0,0 +1,159 @@
+#include "Sampler.h"
+
+#include <algorithm>
+
+// #region Constants
+
+// every ordering of a base 4 digit, one is picked per Morton digit and dimension
+const uint8_t DIGIT_PERMUTATIONS[24][4] = {
+        {0, 1, 2, 3}, {0, 1, 3, 2}, {0, 2, 1, 3}, {0, 2, 3, 1}, {0, 3, 2, 1}, {0, 3, 1, 2},
+        {1, 0, 2, 3}, {1, 0, 3, 2}, {1, 2, 0, 3}, {1, 2, 3, 0}, {1, 3, 2, 0}, {1, 3, 0, 2},
+        {2, 1, 0, 3}, {2, 1, 3, 0}, {2, 0, 1, 3}, {2, 0, 3, 1}, {2, 3, 0, 1}, {2, 3, 1, 0},
+        {3, 1, 2, 0}, {3, 1, 0, 2}, {3, 2, 1, 0}, {3, 2, 0, 1}, {3, 0, 2, 1}, {3, 0, 1, 2}
+};
+
+// #endregion
+
+// #region Private Methods
+
+static uint32_t ceilLog2(uint32_t value) {
+    uint32_t log2 = 0;
+    while ((1ull << log2) < value) {
+        log2++;
+    }
+    return log2;
+}
+
+static uint32_t reverseBits(uint32_t value) {
+    value = (value << 16u) | (value >> 16u);
+    value = ((value & 0x00ff00ffu) << 8u) | ((value & 0xff00ff00u) >> 8u);
+    value = ((value & 0x0f0f0f0fu) << 4u) | ((value & 0xf0f0f0f0u) >> 4u);
+    value = ((value & 0x33333333u) << 2u) | ((value & 0xccccccccu) >> 2u);
+    value = ((value & 0x55555555u) << 1u) | ((value & 0xaaaaaaaau) >> 1u);
+    return value;
+}
+
+// spreads the low 16 bits out to the even bits
+static uint32_t spreadBits(uint32_t value) {
+    value &= 0x0000ffffu;
+    value = (value | (value << 8u)) & 0x00ff00ffu;
+    value = (value | (value << 4u)) & 0x0f0f0f0fu;
+    value = (value | (value << 2u)) & 0x33333333u;
+    value = (value | (value << 1u)) & 0x55555555u;
+    return value;
+}
+
+static uint64_t mixBits(uint64_t value) {
+    value ^= value >> 31u;
+    value *= 0x7fb5d329728ea185ULL;
+    value ^= value >> 27u;
+    value *= 0x81dadef4bc2dd44dULL;
+    value ^= value >> 33u;
+    return value;
+}
+
+// the first two Sobol dimensions, the first is the van der Corput sequence and the second has the Pascal
+// matrix as its generator
+static uint32_t sobolDimension0(uint32_t index) {
+    return reverseBits(index);
+}
+
+static uint32_t sobolDimension1(uint32_t index) {
+    uint32_t result = 0;
+    for (uint32_t direction = 1u << 31u; index != 0; index >>= 1u, direction ^= direction >> 1u) {
+        result ^= direction & (0u - (index & 1u));
+    }
+    return result;
+}
+
+// Laine-Karras style hash in its improved form from Burley's paper, flipping a bit only ever depends on the
+// bits above it, which is exactly a nested uniform (Owen) scramble
+static uint32_t owenScramble(uint32_t value, uint32_t seed) {
+    value = reverseBits(value);
+    value ^= value * 0x3d20adeau;
+    value += seed;
+    value *= (seed >> 16u) | 1u;
+    value ^= value * 0x05526c56u;
+    value ^= value * 0x53a22864u;
+    return reverseBits(value);
+}
+
+static float toFloat(uint32_t value) {
+    return static_cast<float>(value >> 8u) * 0x1p-24f;
+}
+
+uint64_t Sampler::getSobolIndex() const {
+    // with an odd power of two samples the lowest digit is a single bit, flipped rather than permuted
+    bool halfDigit = (log2SamplesPerPixel & 1u) != 0;
+    uint32_t lastDigit = halfDigit ? 1 : 0;
+
+    uint64_t index = 0;
+    for (uint32_t i = base4Digits; i-- > lastDigit;) {
+        uint32_t shift = 2 * i - (halfDigit ? 1 : 0);
+        uint64_t digit = (mortonIndex >> shift) & 3u;
+        // the permutation only depends on the digits above, pixels in the same quad share it
+        uint64_t higherDigits = mortonIndex >> (shift + 2);
+        uint64_t permutation = (mixBits(higherDigits ^ (0x55555555ULL * dimension)) >> 24u) % 24;
+        index |= static_cast<uint64_t>(DIGIT_PERMUTATIONS[permutation][digit]) << shift;
+    }
+    if (halfDigit) {
+        index |= (mortonIndex & 1u) ^ (mixBits((mortonIndex >> 1u) ^ (0x55555555ULL * dimension)) & 1u);
+    }
+    return index;
+}
+
+uint32_t Sampler::getScrambleSeed(uint64_t index) const {
+    // the Sobol points only see the low 32 bits of the index, the rest (very large images) goes into the
+    // scramble so those pixels don't end up with the same points
+    return hashCombine(hashCombine(seed, static_cast<uint32_t>(index >> 32u)), dimension);
+}
+
+// #endregion
+
+// #region Public Methods
+
+Sampler::Sampler(const RenderSettings &settings, uint32_t x, uint32_t y, uint32_t sampleIndex)
+        : type(settings.sampler) {
+    if (type == SamplerType::Independent) {
+        rng = Pcg32(hashCombine(settings.seed, y * settings.width + x), sampleIndex);
+        return;
+    }
+
+    seed = settings.seed;
+    log2SamplesPerPixel = getLog2SamplesPerPixel(settings);
+    uint32_t log2Resolution = ceilLog2(std::max(settings.width, settings.height));
+    base4Digits = log2Resolution + (log2SamplesPerPixel + 1) / 2;
+    uint64_t morton = spreadBits(x) | (spreadBits(y) << 1u);
+    mortonIndex = (morton << log2SamplesPerPixel) | sampleIndex;
+}
+
+float Sampler::get1D() {
+    if (type == SamplerType::Independent) {
+        return rng.nextFloat();
+    }
+
+    uint64_t index = getSobolIndex();
+    uint32_t scrambleSeed = getScrambleSeed(index);
+    dimension++;
+    return toFloat(owenScramble(sobolDimension0(static_cast<uint32_t>(index)), scrambleSeed));
+}
+
+glm::vec2 Sampler::get2D() {
+    if (type == SamplerType::Independent) {
+        float u = rng.nextFloat();
+        float v = rng.nextFloat();
+        return {u, v};
+    }
+
+    uint64_t index = getSobolIndex();
+    uint32_t scrambleSeed = getScrambleSeed(index);
+    dimension += 2;
+    return {toFloat(owenScramble(sobolDimension0(static_cast<uint32_t>(index)), scrambleSeed)),
+            toFloat(owenScramble(sobolDimension1(static_cast<uint32_t>(index)), hashUInt(scrambleSeed)))};
+}
+
+uint32_t Sampler::getLog2SamplesPerPixel(const RenderSettings &settings) {
+    return settings.sampler == SamplerType::Sobol ? ceilLog2(std::max(settings.samplesPerPixel, 1u)) : 0;
+}
+
+// #endregion
@@ -0,0 +1,58 @@
+#ifndef SMCODESRENDERENGINE_SAMPLER_H
+#define SMCODESRENDERENGINE_SAMPLER_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+#include "Random.h"
+#include "RenderSettings.h"
+
+// Hands out the random numbers of one path sample, one dimension at a time. A path always asks for its
+// dimensions in the same order (camera jitter, then per bounce light selection, bsdf direction and russian
+// roulette), which is what lets the Sobol sampler stratify each decision across samples.
+//
+// The Sobol sampler follows pbrt-v4's ZSobolSampler (Ahmed and Wonka, "Screen-Space Blue-Noise Diffusion of
+// Monte Carlo Sampling Error via Hierarchical Ordering of Pixels"): the samples of all pixels are one Sobol
+// sequence indexed by pixel Morton code and sample index, with the base 4 digits of the Morton code randomly
+// permuted per dimension. Neighbouring pixels then take well spread, non repeating parts of the sequence,
+// which spreads the error out as blue noise instead of white. Only the first two Sobol dimensions are used,
+// every dimension of the path gets its own hash based Owen scramble of them (Burley, "Practical Hash-based
+// Owen Scrambling"), so there are no tables and generation is a handful of integer multiplies.
+//
+// Everything is a function of the seed, pixel, sample index and image/sample count, so a sample comes out the
+// same no matter which thread, worker or resumed run takes it. The Sobol order depends on samplesPerPixel
+// through the power of two it rounds up to, counts that aren't one still work but stratify less well
+class Sampler {
+public:
+    Sampler() = default;
+
+    Sampler(const RenderSettings &settings, uint32_t x, uint32_t y, uint32_t sampleIndex);
+
+    // uniform in [0, 1)
+    float get1D();
+
+    glm::vec2 get2D();
+
+    // the power of two the sample count is rounded up to, 0 for the independent sampler. Part of what
+    // decides which samples a pixel gets
+    static uint32_t getLog2SamplesPerPixel(const RenderSettings &settings);
+
+private:
+    SamplerType type = SamplerType::Independent;
+    Pcg32 rng;
+
+    uint64_t mortonIndex = 0; // pixel Morton code followed by the sample index
+    uint32_t seed = 0;
+    uint32_t dimension = 0;
+    uint32_t log2SamplesPerPixel = 0;
+    uint32_t base4Digits = 0;
+
+    // index into the Sobol sequence of this sample for the current dimension
+    uint64_t getSobolIndex() const;
+
+    uint32_t getScrambleSeed(uint64_t index) const;
+};
+
+
+#endif //SMCODESRENDERENGINE_SAMPLER_H
@@ -0,0 +1,53 @@
+#ifndef SMCODESRENDERENGINE_SAMPLING_H
+#define SMCODESRENDERENGINE_SAMPLING_H
+
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+
+const float PI = 3.14159265358979323846f;
+const float INV_PI = 0.31830988618379067154f;
+
+// builds two tangents perpendicular to normal without branching on a "not parallel" axis
+// ("Building an Orthonormal Basis, Revisited", Duff et al. 2017)
+inline void buildOrthonormalBasis(const glm::vec3 &normal, glm::vec3 &tangent, glm::vec3 &bitangent) {
+    float sign = std::copysign(1.0f, normal.z);
+    float a = -1.0f / (sign + normal.z);
+    float b = normal.x * normal.y * a;
+    tangent = glm::vec3(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+    bitangent = glm::vec3(b, sign + normal.y * normal.y * a, -normal.y);
+}
+
+// cosine weighted direction around normal, pdf = cos(theta) / pi
+inline glm::vec3 sampleCosineHemisphere(const glm::vec3 &normal, float u1, float u2) {
+    float radius = std::sqrt(u1);
+    float phi = 2.0f * PI * u2;
+    float x = radius * std::cos(phi);
+    float y = radius * std::sin(phi);
+    float z = std::sqrt(std::max(0.0f, 1.0f - u1));
+
+    glm::vec3 tangent, bitangent;
+    buildOrthonormalBasis(normal, tangent, bitangent);
+    return tangent * x + bitangent * y + normal * z;
+}
+
+// uniformly distributed barycentrics over a triangle
+inline glm::vec2 sampleUniformTriangle(float u1, float u2) {
+    float root = std::sqrt(u1);
+    return {1.0f - root, u2 * root};
+}
+
+// multiple importance sampling weight, power heuristic with beta = 2 (Veach 1997)
+inline float powerHeuristic(float pdf, float otherPdf) {
+    float a = pdf * pdf;
+    float b = otherPdf * otherPdf;
+    return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
+
+inline float luminance(const glm::vec3 &colour) {
+    return 0.2126f * colour.x + 0.7152f * colour.y + 0.0722f * colour.z;
+}
+
+
+#endif //SMCODESRENDERENGINE_SAMPLING_H
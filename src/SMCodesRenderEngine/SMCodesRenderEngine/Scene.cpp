@@ -0,0 +1,330 @@
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Texture.h"
+
+// #region Public Methods
+
+Ray Camera::generateRay(float u, float v, float aspectRatio) const {
+    glm::vec3 forward = glm::normalize(target - position);
+    glm::vec3 right = glm::normalize(glm::cross(forward, up));
+    glm::vec3 cameraUp = glm::cross(right, forward);
+
+    float tanHalfFov = std::tan(glm::radians(verticalFov) * 0.5f);
+    float x = (2.0f * u - 1.0f) * tanHalfFov * aspectRatio;
+    float y = (1.0f - 2.0f * v) * tanHalfFov;
+
+    Ray ray{};
+    ray.origin = position;
+    ray.direction = glm::normalize(forward + right * x + cameraUp * y);
+    return ray;
+}
+
+uint32_t Scene::addMaterial(const Material &material) {
+    materials.push_back(material);
+    return static_cast<uint32_t>(materials.size() - 1);
+}
+
+uint32_t Scene::addTexture(const std::string &path) {
+    textures.push_back(Texture::open(path));
+    return static_cast<uint32_t>(textures.size() - 1);
+}
+
+void Scene::addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, uint32_t materialIndex) {
+    auto first = static_cast<uint32_t>(vertices.size());
+    vertices.push_back(a);
+    vertices.push_back(b);
+    vertices.push_back(c);
+    uvs.emplace_back(0.0f, 0.0f);
+    uvs.emplace_back(1.0f, 0.0f);
+    uvs.emplace_back(0.0f, 1.0f);
+    triangles.emplace_back(first, first + 1, first + 2);
+    triangleMaterials.push_back(materialIndex);
+}
+
+void Scene::addQuad(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, const glm::vec3 &d,
+                    uint32_t materialIndex) {
+    auto first = static_cast<uint32_t>(vertices.size());
+    vertices.push_back(a);
+    vertices.push_back(b);
+    vertices.push_back(c);
+    vertices.push_back(d);
+    uvs.emplace_back(0.0f, 0.0f);
+    uvs.emplace_back(1.0f, 0.0f);
+    uvs.emplace_back(1.0f, 1.0f);
+    uvs.emplace_back(0.0f, 1.0f);
+    triangles.emplace_back(first, first + 1, first + 2);
+    triangles.emplace_back(first, first + 2, first + 3);
+    triangleMaterials.push_back(materialIndex);
+    triangleMaterials.push_back(materialIndex);
+}
+
+void Scene::addBox(const glm::vec3 &min, const glm::vec3 &max, uint32_t materialIndex) {
+    glm::vec3 p[8];
+    for (int i = 0; i < 8; i++) {
+        p[i] = glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+    }
+
+    addQuad(p[0], p[4], p[6], p[2], materialIndex); // -x
+    addQuad(p[1], p[3], p[7], p[5], materialIndex); // +x
+    addQuad(p[0], p[1], p[5], p[4], materialIndex); // -y
+    addQuad(p[2], p[6], p[7], p[3], materialIndex); // +y
+    addQuad(p[0], p[2], p[3], p[1], materialIndex); // -z
+    addQuad(p[4], p[5], p[7], p[6], materialIndex); // +z
+}
+
+void Scene::addMesh(const MeshLevel &mesh) {
+    auto firstVertex = static_cast<uint32_t>(vertices.size());
+    SceneMesh sceneMesh;
+    sceneMesh.firstTriangle = getTriangleCount();
+    sceneMesh.triangleCount = mesh.getTriangleCount();
+
+    vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    uvs.insert(uvs.end(), mesh.uvs.begin(), mesh.uvs.end());
+    uvs.resize(vertices.size(), glm::vec2(0.0f));
+    for (const glm::uvec3 &triangle: mesh.triangles) {
+        triangles.push_back(triangle + firstVertex);
+    }
+    triangleMaterials.insert(triangleMaterials.end(), mesh.triangleMaterials.begin(), mesh.triangleMaterials.end());
+
+    sceneMesh.lods = buildLodChain(mesh);
+    meshes.push_back(std::move(sceneMesh));
+}
+
+Scene Scene::selectLevelsOfDetail(float pixelError, uint32_t imageHeight) const {
+    Scene selected;
+    selected.materials = materials;
+    selected.camera = camera;
+    selected.environment = environment;
+    selected.textures = textures;
+
+    // vertices come across as the triangles that use them do
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    auto copyTriangles = [&](uint32_t first, uint32_t end) {
+        for (uint32_t i = first; i < end; i++) {
+            glm::uvec3 triangle;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t vertex = triangles[i][corner];
+                if (remap[vertex] == UINT32_MAX) {
+                    remap[vertex] = static_cast<uint32_t>(selected.vertices.size());
+                    selected.vertices.push_back(vertices[vertex]);
+                    selected.uvs.push_back(uvs[vertex]);
+                }
+                triangle[corner] = remap[vertex];
+            }
+            selected.triangles.push_back(triangle);
+            selected.triangleMaterials.push_back(triangleMaterials[i]);
+        }
+    };
+
+    uint32_t next = 0;
+    for (const SceneMesh &mesh: meshes) {
+        copyTriangles(next, mesh.firstTriangle);
+        next = mesh.firstTriangle + mesh.triangleCount;
+
+        uint32_t level = mesh.lods.selectLevel(camera.position, camera.verticalFov, imageHeight, pixelError);
+        if (level == 0) {
+            copyTriangles(mesh.firstTriangle, next);
+            continue;
+        }
+        const MeshLevel &lod = mesh.lods.levels[level - 1];
+        auto firstVertex = static_cast<uint32_t>(selected.vertices.size());
+        selected.vertices.insert(selected.vertices.end(), lod.vertices.begin(), lod.vertices.end());
+        selected.uvs.insert(selected.uvs.end(), lod.uvs.begin(), lod.uvs.end());
+        for (const glm::uvec3 &triangle: lod.triangles) {
+            selected.triangles.push_back(triangle + firstVertex);
+        }
+        selected.triangleMaterials.insert(selected.triangleMaterials.end(), lod.triangleMaterials.begin(),
+                                          lod.triangleMaterials.end());
+    }
+    copyTriangles(next, getTriangleCount());
+    return selected;
+}
+
+uint32_t Scene::getTriangleCount() const {
+    return static_cast<uint32_t>(triangles.size());
+}
+
+glm::vec3 Scene::getTriangleVertex(uint32_t triangleIndex, uint32_t corner) const {
+    return vertices[triangles[triangleIndex][static_cast<int>(corner)]];
+}
+
+glm::vec3 Scene::getTriangleNormal(uint32_t triangleIndex) const {
+    glm::vec3 a = getTriangleVertex(triangleIndex, 0);
+    glm::vec3 b = getTriangleVertex(triangleIndex, 1);
+    glm::vec3 c = getTriangleVertex(triangleIndex, 2);
+    return glm::normalize(glm::cross(b - a, c - a));
+}
+
+float Scene::getTriangleArea(uint32_t triangleIndex) const {
+    glm::vec3 a = getTriangleVertex(triangleIndex, 0);
+    glm::vec3 b = getTriangleVertex(triangleIndex, 1);
+    glm::vec3 c = getTriangleVertex(triangleIndex, 2);
+    return 0.5f * glm::length(glm::cross(b - a, c - a));
+}
+
+glm::vec2 Scene::getTriangleUv(uint32_t triangleIndex, float u, float v) const {
+    const glm::uvec3 &triangle = triangles[triangleIndex];
+    return uvs[triangle.x] * (1.0f - u - v) + uvs[triangle.y] * u + uvs[triangle.z] * v;
+}
+
+float Scene::getTriangleUvScale(uint32_t triangleIndex) const {
+    const glm::uvec3 &triangle = triangles[triangleIndex];
+    glm::vec2 edge1 = uvs[triangle.y] - uvs[triangle.x];
+    glm::vec2 edge2 = uvs[triangle.z] - uvs[triangle.x];
+    float uvArea = 0.5f * std::abs(edge1.x * edge2.y - edge1.y * edge2.x);
+    float area = getTriangleArea(triangleIndex);
+    return area > 0.0f ? std::sqrt(uvArea / area) : 0.0f;
+}
+
+const Material &Scene::getTriangleMaterial(uint32_t triangleIndex) const {
+    return materials[triangleMaterials[triangleIndex]];
+}
+
+Aabb Scene::getBounds() const {
+    Aabb bounds;
+    for (const auto &vertex: vertices) {
+        bounds.grow(vertex);
+    }
+    return bounds;
+}
+
+Scene Scene::createCornellBox() {
+    Scene scene;
+
+    uint32_t white = scene.addMaterial({glm::vec3(0.73f), glm::vec3(0.0f)});
+    uint32_t red = scene.addMaterial({glm::vec3(0.65f, 0.05f, 0.05f), glm::vec3(0.0f)});
+    uint32_t green = scene.addMaterial({glm::vec3(0.12f, 0.45f, 0.15f), glm::vec3(0.0f)});
+    uint32_t light = scene.addMaterial({glm::vec3(0.0f), glm::vec3(17.0f, 12.0f, 4.0f)});
+
+    // walls face inwards, the box is open towards the camera at +z
+    scene.addQuad({-1, -1, -1}, {-1, -1, 1}, {1, -1, 1}, {1, -1, -1}, white); // floor
+    scene.addQuad({-1, 1, -1}, {1, 1, -1}, {1, 1, 1}, {-1, 1, 1}, white); // ceiling
+    scene.addQuad({-1, -1, -1}, {1, -1, -1}, {1, 1, -1}, {-1, 1, -1}, white); // back
+    scene.addQuad({-1, -1, -1}, {-1, 1, -1}, {-1, 1, 1}, {-1, -1, 1}, red); // left
+    scene.addQuad({1, -1, -1}, {1, -1, 1}, {1, 1, 1}, {1, 1, -1}, green); // right
+
+    // ceiling light sits just below the ceiling facing down
+    scene.addQuad({-0.25f, 0.99f, -0.25f}, {0.25f, 0.99f, -0.25f}, {0.25f, 0.99f, 0.25f}, {-0.25f, 0.99f, 0.25f},
+                  light);
+
+    scene.addBox({-0.6f, -1.0f, -0.6f}, {-0.05f, 0.2f, -0.05f}, white); // tall box
+    scene.addBox({0.1f, -1.0f, -0.1f}, {0.65f, -0.45f, 0.45f}, white); // short box
+
+    return scene;
+}
+
+Scene Scene::createMaterialShowcase() {
+    Scene scene;
+
+    uint32_t white = scene.addMaterial({glm::vec3(0.73f), glm::vec3(0.0f)});
+    uint32_t red = scene.addMaterial({glm::vec3(0.65f, 0.05f, 0.05f), glm::vec3(0.0f)});
+    uint32_t green = scene.addMaterial({glm::vec3(0.12f, 0.45f, 0.15f), glm::vec3(0.0f)});
+    uint32_t light = scene.addMaterial({glm::vec3(0.0f), glm::vec3(17.0f, 12.0f, 4.0f)});
+
+    Material coated{glm::vec3(0.73f), glm::vec3(0.0f)};
+    coated.type = MaterialType::Layered;
+    coated.roughness = 0.15f;
+    uint32_t floor = scene.addMaterial(coated);
+
+    Material gold{glm::vec3(1.0f, 0.71f, 0.29f), glm::vec3(0.0f)};
+    gold.type = MaterialType::Conductor;
+    gold.roughness = 0.3f;
+    uint32_t metal = scene.addMaterial(gold);
+
+    Material glass{glm::vec3(1.0f), glm::vec3(0.0f)};
+    glass.type = MaterialType::Dielectric;
+    uint32_t clear = scene.addMaterial(glass);
+
+    // the Cornell box's walls and light
+    scene.addQuad({-1, -1, -1}, {-1, -1, 1}, {1, -1, 1}, {1, -1, -1}, floor);
+    scene.addQuad({-1, 1, -1}, {1, 1, -1}, {1, 1, 1}, {-1, 1, 1}, white);
+    scene.addQuad({-1, -1, -1}, {1, -1, -1}, {1, 1, -1}, {-1, 1, -1}, white);
+    scene.addQuad({-1, -1, -1}, {-1, 1, -1}, {-1, 1, 1}, {-1, -1, 1}, red);
+    scene.addQuad({1, -1, -1}, {1, -1, 1}, {1, 1, 1}, {1, 1, -1}, green);
+    scene.addQuad({-0.25f, 0.99f, -0.25f}, {0.25f, 0.99f, -0.25f}, {0.25f, 0.99f, 0.25f}, {-0.25f, 0.99f, 0.25f},
+                  light);
+
+    scene.addBox({-0.6f, -1.0f, -0.6f}, {-0.05f, 0.2f, -0.05f}, metal);
+    // lifted off the floor a little, glass sitting flush on another surface has coplanar faces
+    scene.addBox({0.1f, -0.99f, -0.1f}, {0.65f, -0.45f, 0.45f}, clear);
+
+    return scene;
+}
+
+Scene Scene::createLightGrid(uint32_t lightCount) {
+    Scene scene;
+
+    uint32_t white = scene.addMaterial({glm::vec3(0.73f), glm::vec3(0.0f)});
+    uint32_t light = scene.addMaterial({glm::vec3(0.0f), glm::vec3(20.0f, 17.0f, 12.0f)});
+
+    // two units between lights, whatever the count the floor gets further from most of them
+    auto side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(std::max(lightCount, 1u)))));
+    float halfSize = static_cast<float>(side);
+    scene.addQuad({-halfSize, 0, -halfSize}, {-halfSize, 0, halfSize}, {halfSize, 0, halfSize},
+                  {halfSize, 0, -halfSize}, white);
+
+    for (uint32_t i = 0; i < lightCount; i++) {
+        float x = -halfSize + 1.0f + 2.0f * static_cast<float>(i % side);
+        float z = -halfSize + 1.0f + 2.0f * static_cast<float>(i / side);
+        scene.addQuad({x - 0.1f, 1.5f, z - 0.1f}, {x + 0.1f, 1.5f, z - 0.1f}, {x + 0.1f, 1.5f, z + 0.1f},
+                      {x - 0.1f, 1.5f, z + 0.1f}, light);
+    }
+
+    scene.camera.position = glm::vec3(0.0f, halfSize * 0.75f + 1.0f, halfSize * 1.5f + 2.0f);
+    scene.camera.target = glm::vec3(0.0f);
+    return scene;
+}
+
+Scene Scene::createTerrain(uint32_t resolution) {
+    Scene scene;
+
+    uint32_t ground = scene.addMaterial({glm::vec3(0.45f, 0.55f, 0.35f), glm::vec3(0.0f)});
+    uint32_t light = scene.addMaterial({glm::vec3(0.0f), glm::vec3(4.0f, 3.8f, 3.5f)});
+
+    const float halfSize = 5.0f;
+    resolution = std::max(resolution, 1u);
+    MeshLevel hills;
+    for (uint32_t j = 0; j <= resolution; j++) {
+        for (uint32_t i = 0; i <= resolution; i++) {
+            float u = static_cast<float>(i) / static_cast<float>(resolution);
+            float v = static_cast<float>(j) / static_cast<float>(resolution);
+            float x = (u * 2.0f - 1.0f) * halfSize;
+            float z = (v * 2.0f - 1.0f) * halfSize;
+            // a few octaves of sines, enough detail that every resolution up to millions of triangles is bumpy
+            float y = 0.6f * std::sin(1.3f * x) * std::cos(1.1f * z) +
+                      0.25f * std::sin(3.7f * x + 1.3f) * std::sin(2.9f * z) +
+                      0.08f * std::sin(11.0f * x) * std::cos(13.0f * z) +
+                      0.02f * std::sin(41.0f * x + 0.7f) * std::sin(37.0f * z);
+            hills.vertices.emplace_back(x, y, z);
+            hills.uvs.emplace_back(u * 8.0f, v * 8.0f);
+        }
+    }
+
+    // same winding as the light grid floor, so the terrain faces up
+    uint32_t rowLength = resolution + 1;
+    for (uint32_t j = 0; j < resolution; j++) {
+        for (uint32_t i = 0; i < resolution; i++) {
+            uint32_t a = j * rowLength + i;
+            uint32_t b = a + rowLength;
+            uint32_t c = b + 1;
+            uint32_t d = a + 1;
+            hills.triangles.emplace_back(a, b, c);
+            hills.triangles.emplace_back(a, c, d);
+            hills.triangleMaterials.push_back(ground);
+            hills.triangleMaterials.push_back(ground);
+        }
+    }
+    scene.addMesh(hills);
+
+    scene.addQuad({-halfSize, 6.0f, -halfSize}, {halfSize, 6.0f, -halfSize}, {halfSize, 6.0f, halfSize},
+                  {-halfSize, 6.0f, halfSize}, light);
+
+    scene.camera.position = glm::vec3(0.0f, 4.0f, 9.0f);
+    scene.camera.target = glm::vec3(0.0f, -0.5f, 0.0f);
+    return scene;
+}
+
+// #endregion
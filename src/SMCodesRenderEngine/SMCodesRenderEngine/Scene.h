@@ -0,0 +1,134 @@
+#ifndef SMCODESRENDERENGINE_SCENE_H
+#define SMCODESRENDERENGINE_SCENE_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MeshSimplifier.h"
+#include "RayTracing.h"
+
+class EnvironmentMap;
+class Texture;
+
+const uint32_t NO_TEXTURE = 0xffffffffu;
+
+// which BSDF kernel a material shades with (see Bsdf.h)
+enum class MaterialType {
+    // lambert, albedo is the reflectance
+    Diffuse,
+    // GGX metal, albedo is the reflectance at normal incidence
+    Conductor,
+    // smooth glass, reflects or refracts by the Fresnel term, albedo tints what gets through
+    Dielectric,
+    // GGX clear coat of index ior over a diffuse base of albedo
+    Layered
+};
+
+struct Material {
+    glm::vec3 albedo = glm::vec3(0.8f);
+    glm::vec3 emission = glm::vec3(0.0f);
+    uint32_t albedoTexture = NO_TEXTURE; // index into Scene::textures, multiplies albedo
+    MaterialType type = MaterialType::Diffuse;
+    float roughness = 0.5f; // GGX roughness of conductors and coats, alpha = roughness^2
+    float ior = 1.5f; // index of refraction of dielectrics and coats
+
+    bool isEmissive() const {
+        return emission.x > 0.0f || emission.y > 0.0f || emission.z > 0.0f;
+    }
+};
+
+// Pinhole camera, one of these per render the user sets up (Idea.md step 2.5)
+struct Camera {
+    glm::vec3 position = glm::vec3(0.0f, 0.0f, 3.5f);
+    glm::vec3 target = glm::vec3(0.0f);
+    glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+    float verticalFov = 40.0f; // degrees
+
+    // (u, v) in [0, 1] across the image, v = 0 is the top row
+    Ray generateRay(float u, float v, float aspectRatio) const;
+};
+
+// a mesh added with Scene::addMesh(), its full detail triangles are a range of the scene's arrays
+struct SceneMesh {
+    uint32_t firstTriangle = 0;
+    uint32_t triangleCount = 0;
+    LodChain lods;
+};
+
+// Triangle soup the CPU tracer renders. Meshes get flattened into one set of arrays
+// so the BVH and the shading code only ever deal with triangle indices
+struct Scene {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs; // one per vertex
+    std::vector<glm::uvec3> triangles;
+    std::vector<uint32_t> triangleMaterials; // material index per triangle
+    std::vector<Material> materials;
+    Camera camera;
+    std::shared_ptr<const EnvironmentMap> environment; // lights whatever rays escape to, none leaves it black
+    std::vector<std::shared_ptr<const Texture>> textures;
+    std::vector<SceneMesh> meshes; // in the order they were added, their triangle ranges don't overlap
+
+    uint32_t addMaterial(const Material &material);
+
+    // opens a converted texture (see Texture::convert) and returns its index for Material::albedoTexture
+    uint32_t addTexture(const std::string &path);
+
+    // uvs (0, 0), (1, 0) and (0, 1)
+    void addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, uint32_t materialIndex);
+
+    // quad from 4 corners in counter-clockwise order when looking at its front face, the corners get uvs
+    // (0, 0), (1, 0), (1, 1) and (0, 1)
+    void addQuad(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, const glm::vec3 &d,
+                 uint32_t materialIndex);
+
+    // axis aligned box with outward facing triangles
+    void addBox(const glm::vec3 &min, const glm::vec3 &max, uint32_t materialIndex);
+
+    // appends mesh at full detail and builds its LOD chain there and then, so picking a level later costs nothing.
+    // Vertices aren't shared with anything added before or after
+    void addMesh(const MeshLevel &mesh);
+
+    // a copy for previews where every mesh is swapped for the coarsest level of its chain whose error stays under
+    // pixelError pixels from the camera, in an image imageHeight rows tall. Triangles outside meshes are kept as they
+    // are, 0 keeps everything at full detail. The copy has no meshes of its own
+    Scene selectLevelsOfDetail(float pixelError, uint32_t imageHeight) const;
+
+    uint32_t getTriangleCount() const;
+
+    glm::vec3 getTriangleVertex(uint32_t triangleIndex, uint32_t corner) const;
+
+    // unit length geometric normal, facing the side the vertices wind counter-clockwise around
+    glm::vec3 getTriangleNormal(uint32_t triangleIndex) const;
+
+    float getTriangleArea(uint32_t triangleIndex) const;
+
+    // uv at barycentrics (u, v) of the hit
+    glm::vec2 getTriangleUv(uint32_t triangleIndex, float u, float v) const;
+
+    // how many uv units one unit of distance along the surface covers, the square root of the area ratio
+    float getTriangleUvScale(uint32_t triangleIndex) const;
+
+    const Material &getTriangleMaterial(uint32_t triangleIndex) const;
+
+    Aabb getBounds() const;
+
+    // the classic test scene, a closed box lit by a single ceiling light
+    static Scene createCornellBox();
+
+    // the Cornell box again with one of each MaterialType: a clear coated floor, a gold tall box and a glass short box
+    static Scene createMaterialShowcase();
+
+    // a wide floor under a grid of lightCount small ceiling lights, for many-light sampling
+    static Scene createLightGrid(uint32_t lightCount);
+
+    // rolling hills of resolution x resolution quads that share their corners, under one big light. 2 * resolution^2
+    // triangles, for when a test needs a lot of geometry. The hills are a mesh with a LOD chain
+    static Scene createTerrain(uint32_t resolution);
+};
+
+
+#endif //SMCODESRENDERENGINE_SCENE_H
@@ -0,0 +1,279 @@
+#include "Socket.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+// #region Private Methods
+
+#ifdef _WIN32
+// Winsock has to be started once per process before any other call
+static void initialiseSockets() {
+    struct WinsockStartup {
+        WinsockStartup() {
+            WSADATA data;
+            if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+                throw std::runtime_error("failed to start winsock!");
+            }
+        }
+
+        ~WinsockStartup() {
+            WSACleanup();
+        }
+    };
+    static WinsockStartup startup;
+}
+
+static int getLastSocketError() {
+    return WSAGetLastError();
+}
+
+static bool isTimeoutError(int error) {
+    return error == WSAETIMEDOUT || error == WSAEWOULDBLOCK;
+}
+
+static void closeHandle(uintptr_t handle) {
+    closesocket(static_cast<SOCKET>(handle));
+}
+
+static int pollHandle(uintptr_t handle, uint32_t timeoutMs) {
+    WSAPOLLFD descriptor{};
+    descriptor.fd = static_cast<SOCKET>(handle);
+    descriptor.events = POLLRDNORM;
+    return WSAPoll(&descriptor, 1, static_cast<INT>(timeoutMs));
+}
+#else
+static void initialiseSockets() {
+}
+
+static int getLastSocketError() {
+    return errno;
+}
+
+static bool isTimeoutError(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK;
+}
+
+static void closeHandle(int handle) {
+    ::close(handle);
+}
+
+static int pollHandle(int handle, uint32_t timeoutMs) {
+    pollfd descriptor{};
+    descriptor.fd = handle;
+    descriptor.events = POLLIN;
+    return poll(&descriptor, 1, static_cast<int>(timeoutMs));
+}
+#endif
+
+static void throwSocketError(const std::string &what) {
+    throw std::runtime_error(what + " (socket error " + std::to_string(getLastSocketError()) + ")");
+}
+
+Socket::Socket(Handle handle) : handle(handle) {
+}
+
+// #endregion
+
+// #region Public Methods
+
+Socket::~Socket() {
+    close();
+}
+
+Socket::Socket(Socket &&other) noexcept: handle(other.handle) {
+    other.handle = INVALID_HANDLE;
+}
+
+Socket &Socket::operator=(Socket &&other) noexcept {
+    if (this != &other) {
+        close();
+        handle = std::exchange(other.handle, INVALID_HANDLE);
+    }
+    return *this;
+}
+
+Socket Socket::listen(uint16_t port) {
+    initialiseSockets();
+
+    Socket listener(static_cast<Handle>(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)));
+    if (!listener.isValid()) {
+        throwSocketError("failed to create listening socket!");
+    }
+
+    // lets a restarted coordinator take the port straight back instead of waiting out TIME_WAIT
+    int reuse = 1;
+    setsockopt(listener.handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (::bind(listener.handle, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        throwSocketError("failed to bind port " + std::to_string(port) + "!");
+    }
+    if (::listen(listener.handle, SOMAXCONN) != 0) {
+        throwSocketError("failed to listen on port " + std::to_string(port) + "!");
+    }
+    return listener;
+}
+
+Socket Socket::connect(const std::string &host, uint16_t port) {
+    initialiseSockets();
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+        throw std::runtime_error("failed to resolve " + host + "!");
+    }
+
+    Socket connection;
+    for (addrinfo *address = addresses; address != nullptr; address = address->ai_next) {
+        Socket candidate(static_cast<Handle>(::socket(address->ai_family, address->ai_socktype, address->ai_protocol)));
+        if (candidate.isValid() &&
+            ::connect(candidate.handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0) {
+            connection = std::move(candidate);
+            break;
+        }
+    }
+    freeaddrinfo(addresses);
+
+    if (!connection.isValid()) {
+        throwSocketError("failed to connect to " + host + ":" + std::to_string(port) + "!");
+    }
+
+    // messages are written whole, no point waiting to coalesce them
+    int noDelay = 1;
+    setsockopt(connection.handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay),
+               sizeof(noDelay));
+    return connection;
+}
+
+Socket Socket::accept() const {
+    Socket connection(static_cast<Handle>(::accept(handle, nullptr, nullptr)));
+    if (!connection.isValid()) {
+        throwSocketError("failed to accept connection!");
+    }
+
+    int noDelay = 1;
+    setsockopt(connection.handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay),
+               sizeof(noDelay));
+    return connection;
+}
+
+bool Socket::waitReadable(uint32_t timeoutMs) const {
+    int result = pollHandle(handle, timeoutMs);
+    if (result < 0) {
+        throwSocketError("failed to poll socket!");
+    }
+    return result > 0;
+}
+
+void Socket::setReceiveTimeout(uint32_t timeoutMs) {
+#ifdef _WIN32
+    DWORD timeout = timeoutMs;
+#else
+    timeval timeout{};
+    timeout.tv_sec = static_cast<time_t>(timeoutMs / 1000);
+    timeout.tv_usec = static_cast<suseconds_t>((timeoutMs % 1000) * 1000);
+#endif
+    if (setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&timeout), sizeof(timeout)) != 0) {
+        throwSocketError("failed to set receive timeout!");
+    }
+}
+
+void Socket::sendAll(const void *data, size_t size) {
+#ifdef _WIN32
+    const int flags = 0;
+#else
+    const int flags = MSG_NOSIGNAL; // a dead peer should be an error, not SIGPIPE
+#endif
+
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        int chunk = static_cast<int>(std::min<size_t>(size, 1u << 30));
+        auto sent = ::send(handle, bytes, chunk, flags);
+        if (sent <= 0) {
+            throwSocketError("failed to send!");
+        }
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+bool Socket::receiveAll(void *data, size_t size) {
+    char *bytes = static_cast<char *>(data);
+    size_t received = 0;
+    while (received < size) {
+        int chunk = static_cast<int>(std::min<size_t>(size - received, 1u << 30));
+        auto count = ::recv(handle, bytes + received, chunk, 0);
+        if (count == 0) {
+            if (received == 0) {
+                return false;
+            }
+            throw std::runtime_error("connection closed part way through a message!");
+        }
+        if (count < 0) {
+            if (isTimeoutError(getLastSocketError())) {
+                throw std::runtime_error("timed out waiting on socket!");
+            }
+            throwSocketError("failed to receive!");
+        }
+        received += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+size_t Socket::receive(void *data, size_t size) {
+    int chunk = static_cast<int>(std::min<size_t>(size, 1u << 30));
+    auto count = ::recv(handle, static_cast<char *>(data), chunk, 0);
+    if (count < 0) {
+        if (isTimeoutError(getLastSocketError())) {
+            throw std::runtime_error("timed out waiting on socket!");
+        }
+        throwSocketError("failed to receive!");
+    }
+    return static_cast<size_t>(count);
+}
+
+uint16_t Socket::getLocalPort() const {
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    if (getsockname(handle, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+        throwSocketError("failed to read socket address!");
+    }
+    return ntohs(address.sin_port);
+}
+
+bool Socket::isValid() const {
+    return handle != INVALID_HANDLE;
+}
+
+void Socket::close() {
+    if (isValid()) {
+        closeHandle(handle);
+        handle = INVALID_HANDLE;
+    }
+}
+
+// #endregion
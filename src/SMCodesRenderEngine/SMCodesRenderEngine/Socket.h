@@ -0,0 +1,68 @@
+#ifndef SMCODESRENDERENGINE_SOCKET_H
+#define SMCODESRENDERENGINE_SOCKET_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Blocking TCP socket, Winsock on Windows and BSD sockets everywhere else.
+// Only as much as the coordinator and workers need, errors are thrown as std::runtime_error
+class Socket {
+public:
+    Socket() = default;
+
+    ~Socket();
+
+    Socket(Socket &&other) noexcept;
+
+    Socket &operator=(Socket &&other) noexcept;
+
+    Socket(const Socket &) = delete;
+
+    Socket &operator=(const Socket &) = delete;
+
+    // listens on every interface, port 0 lets the OS pick a free one (see getLocalPort())
+    static Socket listen(uint16_t port);
+
+    static Socket connect(const std::string &host, uint16_t port);
+
+    Socket accept() const;
+
+    // true when there is something to read (or a connection to accept) within timeoutMs
+    bool waitReadable(uint32_t timeoutMs) const;
+
+    // 0 waits forever, otherwise receiveAll() throws once nothing has arrived for timeoutMs
+    void setReceiveTimeout(uint32_t timeoutMs);
+
+    void sendAll(const void *data, size_t size);
+
+    // false when the other side closed the connection before anything was read
+    bool receiveAll(void *data, size_t size);
+
+    // whatever has arrived, up to size bytes. 0 when the other side has closed the connection
+    size_t receive(void *data, size_t size);
+
+    uint16_t getLocalPort() const;
+
+    bool isValid() const;
+
+    void close();
+
+private:
+#ifdef _WIN32
+    using Handle = uintptr_t; // SOCKET, without pulling winsock2.h into every header
+#else
+    using Handle = int;
+#endif
+
+    // INVALID_SOCKET on Windows and -1 elsewhere are both all bits set
+    static constexpr Handle INVALID_HANDLE = static_cast<Handle>(-1);
+
+    Handle handle = INVALID_HANDLE;
+
+    explicit Socket(Handle handle);
+};
+
+
+#endif //SMCODESRENDERENGINE_SOCKET_H
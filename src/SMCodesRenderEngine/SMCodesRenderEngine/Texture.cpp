@@ -0,0 +1,405 @@
+#include "Texture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+
+#include "ImageEncoding.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+// #region Constants
+
+const uint32_t TEXTURE_MAGIC = 0x58544D53; // "SMTX"
+const uint32_t TEXTURE_VERSION = 1;
+const uint32_t TEXTURE_BYTES_PER_TEXEL = 4;
+
+const uint64_t DEFAULT_TEXTURE_CACHE_BUDGET = 256ull << 20;
+
+// hits happen for nearly every texel fetch, so shards count them and only add to the shared counter in batches
+const uint64_t HIT_REPORT_BATCH = 1024;
+
+// #endregion
+
+// #region Private Methods
+
+static const float *getSrgbToLinearTable() {
+    static const auto table = [] {
+        std::array<float, 256> values{};
+        for (uint32_t i = 0; i < 256; i++) {
+            float srgb = static_cast<float>(i) / 255.0f;
+            values[i] = srgb <= 0.04045f ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+static uint8_t linearToSrgb8(float linear) {
+    float value = std::clamp(linear, 0.0f, 1.0f);
+    float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::lround(srgb * 255.0f));
+}
+
+// half the size (rounding down, never below 1), every texel the average of the 2x2 above it in linear space.
+// Odd sizes fold their last row and column into the texel before
+static std::vector<uint8_t> downsample(const std::vector<uint8_t> &texels, uint32_t width, uint32_t height,
+                                       uint32_t &newWidth, uint32_t &newHeight) {
+    const float *toLinear = getSrgbToLinearTable();
+    newWidth = std::max(width / 2, 1u);
+    newHeight = std::max(height / 2, 1u);
+
+    std::vector<uint8_t> result(static_cast<size_t>(newWidth) * newHeight * TEXTURE_BYTES_PER_TEXEL);
+    for (uint32_t y = 0; y < newHeight; y++) {
+        uint32_t y0 = std::min(y * 2, height - 1);
+        uint32_t y1 = y == newHeight - 1 ? height - 1 : std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < newWidth; x++) {
+            uint32_t x0 = std::min(x * 2, width - 1);
+            uint32_t x1 = x == newWidth - 1 ? width - 1 : std::min(x * 2 + 1, width - 1);
+
+            float sum[TEXTURE_BYTES_PER_TEXEL] = {};
+            uint32_t count = 0;
+            for (uint32_t sy = y0; sy <= y1; sy++) {
+                for (uint32_t sx = x0; sx <= x1; sx++) {
+                    const uint8_t *texel = &texels[(static_cast<size_t>(sy) * width + sx) * TEXTURE_BYTES_PER_TEXEL];
+                    for (uint32_t c = 0; c < 3; c++) {
+                        sum[c] += toLinear[texel[c]];
+                    }
+                    sum[3] += static_cast<float>(texel[3]); // alpha is linear already
+                    count++;
+                }
+            }
+
+            uint8_t *out = &result[(static_cast<size_t>(y) * newWidth + x) * TEXTURE_BYTES_PER_TEXEL];
+            for (uint32_t c = 0; c < 3; c++) {
+                out[c] = linearToSrgb8(sum[c] / static_cast<float>(count));
+            }
+            out[3] = static_cast<uint8_t>(std::lround(sum[3] / static_cast<float>(count)));
+        }
+    }
+    return result;
+}
+
+static void writeUInt32(std::ofstream &file, uint32_t value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static uint32_t readUInt32(std::ifstream &file, const std::string &path) {
+    uint32_t value;
+    file.read(reinterpret_cast<char *>(&value), sizeof(value));
+    if (!file) {
+        throw std::runtime_error(path + " is truncated!");
+    }
+    return value;
+}
+
+// key of a tile in the cache, the texture id, level and tile position packed into 64 bits
+static uint64_t getTileKey(uint32_t textureId, uint32_t level, uint32_t tileX, uint32_t tileY) {
+    return (static_cast<uint64_t>(textureId) << 40u) | (static_cast<uint64_t>(level) << 35u) |
+           (static_cast<uint64_t>(tileY) << 17u) | tileX;
+}
+
+glm::vec3 Texture::sampleBilinear(uint32_t level, const glm::vec2 &uv) const {
+    const Level &info = levels[level];
+    const float *toLinear = getSrgbToLinearTable();
+
+    // texel centres are at half integers, repeat addressing
+    float x = uv.x * static_cast<float>(info.width) - 0.5f;
+    float y = uv.y * static_cast<float>(info.height) - 0.5f;
+    float floorX = std::floor(x);
+    float floorY = std::floor(y);
+    float fractionX = x - floorX;
+    float fractionY = y - floorY;
+    auto wrap = [](float value, uint32_t size) {
+        auto wrapped = static_cast<int64_t>(value) % static_cast<int64_t>(size);
+        return static_cast<uint32_t>(wrapped < 0 ? wrapped + size : wrapped);
+    };
+    uint32_t x0 = wrap(floorX, info.width);
+    uint32_t y0 = wrap(floorY, info.height);
+    uint32_t x1 = x0 + 1 == info.width ? 0 : x0 + 1;
+    uint32_t y1 = y0 + 1 == info.height ? 0 : y0 + 1;
+
+    // the four texels are usually in the same tile, only go to the cache again when they aren't
+    TextureCache::Tile tile;
+    uint32_t tileX = UINT32_MAX;
+    uint32_t tileY = UINT32_MAX;
+    auto fetch = [&](uint32_t texelX, uint32_t texelY) {
+        if (texelX / tileSize != tileX || texelY / tileSize != tileY) {
+            tileX = texelX / tileSize;
+            tileY = texelY / tileSize;
+            tile = TextureCache::getTile(*this, level, tileX, tileY);
+        }
+        size_t index = (static_cast<size_t>(texelY % tileSize) * tileSize + texelX % tileSize) *
+                       TEXTURE_BYTES_PER_TEXEL;
+        const uint8_t *texel = &(*tile)[index];
+        return glm::vec3(toLinear[texel[0]], toLinear[texel[1]], toLinear[texel[2]]);
+    };
+
+    glm::vec3 top = fetch(x0, y0) * (1.0f - fractionX) + fetch(x1, y0) * fractionX;
+    glm::vec3 bottom = fetch(x0, y1) * (1.0f - fractionX) + fetch(x1, y1) * fractionX;
+    return top * (1.0f - fractionY) + bottom * fractionY;
+}
+
+TextureCache::TextureCache()
+        : budget(DEFAULT_TEXTURE_CACHE_BUDGET),
+          hits(Metrics::counter("smcodes_texture_tile_hits_total", "Texture tile lookups served from memory")),
+          misses(Metrics::counter("smcodes_texture_tile_misses_total", "Texture tile lookups that read from disk")),
+          evictions(Metrics::counter("smcodes_texture_tile_evictions_total",
+                                     "Texture tiles dropped to stay in the cache budget")),
+          bytes(Metrics::gauge("smcodes_texture_cache_bytes", "Memory held by cached texture tiles")) {
+}
+
+TextureCache &TextureCache::get() {
+    static TextureCache cache;
+    return cache;
+}
+
+// #endregion
+
+// #region Public Methods
+
+void Texture::convert(const std::string &imagePath, const std::string &texturePath) {
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream image(imagePath, std::ios::binary);
+    if (!image.is_open()) {
+        throw std::runtime_error("Failed to open image: " + imagePath);
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(image)), std::istreambuf_iterator<char>());
+
+    uint32_t width;
+    uint32_t height;
+    std::vector<std::vector<uint8_t>> levelTexels;
+    std::vector<glm::uvec2> levelSizes;
+    levelTexels.push_back(decodePng(bytes, width, height));
+    levelSizes.emplace_back(width, height);
+    while (levelSizes.back().x > 1 || levelSizes.back().y > 1) {
+        uint32_t newWidth;
+        uint32_t newHeight;
+        levelTexels.push_back(downsample(levelTexels.back(), levelSizes.back().x, levelSizes.back().y,
+                                         newWidth, newHeight));
+        levelSizes.emplace_back(newWidth, newHeight);
+    }
+
+    std::ofstream file(texturePath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to create texture: " + texturePath);
+    }
+    writeUInt32(file, TEXTURE_MAGIC);
+    writeUInt32(file, TEXTURE_VERSION);
+    writeUInt32(file, width);
+    writeUInt32(file, height);
+    writeUInt32(file, TEXTURE_TILE_SIZE);
+    writeUInt32(file, static_cast<uint32_t>(levelSizes.size()));
+    for (const auto &size: levelSizes) {
+        writeUInt32(file, size.x);
+        writeUInt32(file, size.y);
+    }
+
+    // edge tiles are padded out to full size so every tile sits at a computable offset
+    std::vector<uint8_t> tile(static_cast<size_t>(TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE * TEXTURE_BYTES_PER_TEXEL);
+    for (size_t level = 0; level < levelSizes.size(); level++) {
+        glm::uvec2 size = levelSizes[level];
+        for (uint32_t tileY = 0; tileY * TEXTURE_TILE_SIZE < size.y; tileY++) {
+            for (uint32_t tileX = 0; tileX * TEXTURE_TILE_SIZE < size.x; tileX++) {
+                std::fill(tile.begin(), tile.end(), 0);
+                for (uint32_t y = 0; y < TEXTURE_TILE_SIZE && tileY * TEXTURE_TILE_SIZE + y < size.y; y++) {
+                    uint32_t rowTexels = std::min(TEXTURE_TILE_SIZE, size.x - tileX * TEXTURE_TILE_SIZE);
+                    size_t source = ((static_cast<size_t>(tileY) * TEXTURE_TILE_SIZE + y) * size.x +
+                                     static_cast<size_t>(tileX) * TEXTURE_TILE_SIZE) * TEXTURE_BYTES_PER_TEXEL;
+                    std::copy_n(&levelTexels[level][source], rowTexels * TEXTURE_BYTES_PER_TEXEL,
+                                &tile[static_cast<size_t>(y) * TEXTURE_TILE_SIZE * TEXTURE_BYTES_PER_TEXEL]);
+                }
+                file.write(reinterpret_cast<const char *>(tile.data()), static_cast<std::streamsize>(tile.size()));
+            }
+        }
+    }
+    if (!file) {
+        throw std::runtime_error("failed to write texture " + texturePath + "!");
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("converted texture", {{"image", imagePath}, {"texture", texturePath}, {"width", width},
+                                   {"height", height}, {"levels", levelSizes.size()},
+                                   {"milliseconds", seconds * 1000.0}});
+}
+
+std::shared_ptr<const Texture> Texture::open(const std::string &path) {
+    static std::mutex cacheMutex;
+    static std::map<std::string, std::weak_ptr<const Texture>> cache;
+    static uint32_t nextId = 0;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (auto cached = cache[path].lock()) {
+        return cached;
+    }
+
+    auto texture = std::make_shared<Texture>();
+    texture->path = path;
+    // never reused, tiles of a texture that was closed may still be in the cache
+    texture->id = nextId++;
+    texture->file.open(path, std::ios::binary);
+    if (!texture->file.is_open()) {
+        throw std::runtime_error("Failed to open texture: " + path);
+    }
+    if (readUInt32(texture->file, path) != TEXTURE_MAGIC) {
+        throw std::runtime_error(path + " is not a texture, convert images with --convert-texture first!");
+    }
+    if (readUInt32(texture->file, path) != TEXTURE_VERSION) {
+        throw std::runtime_error(path + " was converted by a different version of the renderer!");
+    }
+    readUInt32(texture->file, path); // width and height are level 0's
+    readUInt32(texture->file, path);
+    texture->tileSize = readUInt32(texture->file, path);
+    uint32_t levelCount = readUInt32(texture->file, path);
+    if (texture->tileSize == 0 || levelCount == 0 || levelCount > 32) {
+        throw std::runtime_error(path + " has a corrupt header!");
+    }
+
+    uint64_t offset = 6 * sizeof(uint32_t) + levelCount * 2 * sizeof(uint32_t);
+    uint64_t tileBytes = static_cast<uint64_t>(texture->tileSize) * texture->tileSize * TEXTURE_BYTES_PER_TEXEL;
+    for (uint32_t i = 0; i < levelCount; i++) {
+        Level level{};
+        level.width = readUInt32(texture->file, path);
+        level.height = readUInt32(texture->file, path);
+        level.tilesX = (level.width + texture->tileSize - 1) / texture->tileSize;
+        level.tilesY = (level.height + texture->tileSize - 1) / texture->tileSize;
+        level.offset = offset;
+        offset += static_cast<uint64_t>(level.tilesX) * level.tilesY * tileBytes;
+        texture->levels.push_back(level);
+    }
+
+    cache[path] = texture;
+    return texture;
+}
+
+glm::vec3 Texture::sample(const glm::vec2 &uv, float footprint) const {
+    // texels the footprint covers on level 0, every level up halves that
+    float texels = footprint * static_cast<float>(std::max(levels[0].width, levels[0].height));
+    float level = std::clamp(std::log2(std::max(texels, 1e-8f)), 0.0f, static_cast<float>(levels.size() - 1));
+
+    auto lower = static_cast<uint32_t>(level);
+    float blend = level - static_cast<float>(lower);
+    glm::vec3 result = sampleBilinear(lower, uv);
+    if (blend > 0.0f && lower + 1 < levels.size()) {
+        result = result * (1.0f - blend) + sampleBilinear(lower + 1, uv) * blend;
+    }
+    return result;
+}
+
+void Texture::readTile(uint32_t level, uint32_t tileX, uint32_t tileY, uint8_t *texels) const {
+    const Level &info = levels[level];
+    uint64_t tileBytes = static_cast<uint64_t>(tileSize) * tileSize * TEXTURE_BYTES_PER_TEXEL;
+    uint64_t offset = info.offset + (static_cast<uint64_t>(tileY) * info.tilesX + tileX) * tileBytes;
+
+    std::lock_guard<std::mutex> lock(fileMutex);
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(reinterpret_cast<char *>(texels), static_cast<std::streamsize>(tileBytes));
+    if (!file) {
+        file.clear();
+        throw std::runtime_error("failed to read a tile of " + path + "!");
+    }
+}
+
+const std::string &Texture::getPath() const {
+    return path;
+}
+
+uint32_t Texture::getId() const {
+    return id;
+}
+
+uint32_t Texture::getWidth() const {
+    return levels[0].width;
+}
+
+uint32_t Texture::getHeight() const {
+    return levels[0].height;
+}
+
+uint32_t Texture::getLevelCount() const {
+    return static_cast<uint32_t>(levels.size());
+}
+
+uint32_t Texture::getTileSize() const {
+    return tileSize;
+}
+
+TextureCache::Tile TextureCache::getTile(const Texture &texture, uint32_t level, uint32_t tileX, uint32_t tileY) {
+    TextureCache &cache = get();
+    uint64_t key = getTileKey(texture.getId(), level, tileX, tileY);
+    Shard &shard = cache.shards[((key * 0x9e3779b97f4a7c15ULL) >> 32u) % SHARD_COUNT];
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.lookup.find(key);
+        if (it != shard.lookup.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            if (++shard.unreportedHits == HIT_REPORT_BATCH) {
+                cache.hits.add(static_cast<double>(HIT_REPORT_BATCH));
+                shard.unreportedHits = 0;
+            }
+            return it->second->tile;
+        }
+    }
+
+    uint32_t tileSize = texture.getTileSize();
+    auto texels = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(tileSize) * tileSize *
+                                                         TEXTURE_BYTES_PER_TEXEL);
+    texture.readTile(level, tileX, tileY, texels->data());
+    cache.misses.add();
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // another thread may have read the same tile in the meantime, keep theirs
+    auto it = shard.lookup.find(key);
+    if (it != shard.lookup.end()) {
+        return it->second->tile;
+    }
+    shard.entries.push_front({key, texels});
+    shard.lookup[key] = shard.entries.begin();
+    shard.bytes += texels->size();
+    cache.bytes.add(static_cast<double>(texels->size()));
+
+    // the tile just added always stays, even a budget too small for one tile per shard renders
+    uint64_t shardBudget = cache.budget.load(std::memory_order_relaxed) / SHARD_COUNT;
+    while (shard.bytes > shardBudget && shard.entries.size() > 1) {
+        const Entry &oldest = shard.entries.back();
+        shard.bytes -= oldest.tile->size();
+        cache.bytes.add(-static_cast<double>(oldest.tile->size()));
+        shard.lookup.erase(oldest.key);
+        shard.entries.pop_back();
+        cache.evictions.add();
+    }
+    return texels;
+}
+
+void TextureCache::setBudget(uint64_t bytes) {
+    get().budget.store(bytes, std::memory_order_relaxed);
+}
+
+TextureCacheStats TextureCache::getStats() {
+    TextureCache &cache = get();
+    TextureCacheStats stats;
+    stats.hits = static_cast<uint64_t>(cache.hits.getValue());
+    for (auto &shard: cache.shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.hits += shard.unreportedHits;
+    }
+    stats.misses = static_cast<uint64_t>(cache.misses.getValue());
+    stats.evictions = static_cast<uint64_t>(cache.evictions.getValue());
+    stats.bytes = static_cast<uint64_t>(cache.bytes.getValue());
+    stats.budget = cache.budget.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TextureCache::logStats() {
+    TextureCacheStats stats = getStats();
+    uint64_t lookups = stats.hits + stats.misses;
+    LOG_INFO("texture cache", {{"hits", stats.hits}, {"misses", stats.misses}, {"evictions", stats.evictions},
+                               {"hitRate", lookups > 0 ? static_cast<double>(stats.hits) / lookups : 0.0},
+                               {"megabytes", stats.bytes / 1048576.0}, {"budgetMegabytes", stats.budget / 1048576.0}});
+}
+
+// #endregion
@@ -0,0 +1,132 @@
+#ifndef SMCODESRENDERENGINE_TEXTURE_H
+#define SMCODESRENDERENGINE_TEXTURE_H
+
+
+#include <glm/glm.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Counter;
+class Gauge;
+
+// texels along each side of a tile, a 64x64 RGBA8 tile is 16KB
+const uint32_t TEXTURE_TILE_SIZE = 64;
+
+// Image texture in the renderer's own tiled format, made from a PNG once at import time by convert().
+// Every mip level is cut into square tiles of RGBA8 sRGB texels, stored level after level, row after row.
+// Opening one only reads the header, texels are paged in a tile at a time through the TextureCache, so a scene
+// can reference far more texture data than fits in memory.
+// File layout: magic, version, width, height, tile size, level count, the size of every level, then the tiles
+class Texture {
+public:
+    // decodes the PNG at imagePath, box filters the mip chain in linear space and writes it to texturePath
+    static void convert(const std::string &imagePath, const std::string &texturePath);
+
+    // shared between scenes that reference the same file, opened again once nothing uses it anymore
+    static std::shared_ptr<const Texture> open(const std::string &path);
+
+    // trilinear filtered linear RGB at uv, repeating outside [0, 1]. footprint is how much of the texture the
+    // lookup covers in uv units, from the ray's differential, and picks the mip levels
+    glm::vec3 sample(const glm::vec2 &uv, float footprint) const;
+
+    // reads one tile from disk into texels (tileSize^2 RGBA8), what the cache does on a miss
+    void readTile(uint32_t level, uint32_t tileX, uint32_t tileY, uint8_t *texels) const;
+
+    const std::string &getPath() const;
+
+    uint32_t getId() const;
+
+    uint32_t getWidth() const;
+
+    uint32_t getHeight() const;
+
+    uint32_t getLevelCount() const;
+
+    uint32_t getTileSize() const;
+
+private:
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        uint32_t tilesX;
+        uint32_t tilesY;
+        uint64_t offset; // of the level's first tile in the file
+    };
+
+    std::string path;
+    uint32_t id = 0; // tells textures apart in the cache keys
+    uint32_t tileSize = 0;
+    std::vector<Level> levels;
+
+    // tiles are read with a seek and a read, one at a time
+    mutable std::mutex fileMutex;
+    mutable std::ifstream file;
+
+    glm::vec3 sampleBilinear(uint32_t level, const glm::vec2 &uv) const;
+};
+
+struct TextureCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t bytes = 0;
+    uint64_t budget = 0;
+};
+
+// Process wide cache of texture tiles with a fixed memory budget, shared by every texture, so memory stays flat
+// however many textures a scene references. Split into shards by tile, each with its own lock and LRU list, so
+// render threads rarely wait on each other. Tiles are handed out as shared pointers, a tile evicted while a
+// thread still reads from it stays alive until that thread lets go. Misses read from disk outside the shard lock
+class TextureCache {
+public:
+    using Tile = std::shared_ptr<const std::vector<uint8_t>>;
+
+    static Tile getTile(const Texture &texture, uint32_t level, uint32_t tileX, uint32_t tileY);
+
+    // tiles over the new budget are evicted on the next misses
+    static void setBudget(uint64_t bytes);
+
+    static TextureCacheStats getStats();
+
+    // one log line with the stats and the hit rate, at the end of a render
+    static void logStats();
+
+private:
+    static const uint32_t SHARD_COUNT = 16;
+
+    struct Entry {
+        uint64_t key;
+        Tile tile;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> entries; // most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> lookup;
+        uint64_t bytes = 0;
+        uint64_t unreportedHits = 0;
+    };
+
+    std::array<Shard, SHARD_COUNT> shards;
+    std::atomic<uint64_t> budget;
+
+    Counter &hits;
+    Counter &misses;
+    Counter &evictions;
+    Gauge &bytes;
+
+    TextureCache();
+
+    static TextureCache &get();
+};
+
+
+#endif //SMCODESRENDERENGINE_TEXTURE_H
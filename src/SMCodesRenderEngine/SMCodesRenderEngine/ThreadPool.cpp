@@ -0,0 +1,108 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+// #region Public Methods
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // the calling thread is thread 0, so only spawn the rest
+    for (uint32_t i = 1; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(uint32_t count, const Task &task) {
+    if (count == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    currentTask = &task;
+    taskCount = count;
+    nextIndex.store(0);
+    busyWorkers = workers.size();
+    firstException = nullptr;
+    generation++;
+    lock.unlock();
+
+    wakeCondition.notify_all();
+
+    // help out rather than sit idle
+    runTasks(0);
+
+    lock.lock();
+    doneCondition.wait(lock, [this] { return busyWorkers == 0; });
+    currentTask = nullptr;
+
+    if (firstException) {
+        std::rethrow_exception(firstException);
+    }
+}
+
+uint32_t ThreadPool::getThreadCount() const {
+    return static_cast<uint32_t>(workers.size()) + 1;
+}
+
+// #endregion
+
+// #region Private Methods
+
+void ThreadPool::workerLoop(uint32_t threadIndex) {
+    uint64_t seenGeneration = 0;
+
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+        if (stopping) {
+            return;
+        }
+        seenGeneration = generation;
+        lock.unlock();
+
+        runTasks(threadIndex);
+
+        lock.lock();
+        if (--busyWorkers == 0) {
+            doneCondition.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runTasks(uint32_t threadIndex) {
+    while (true) {
+        uint32_t index = nextIndex.fetch_add(1);
+        if (index >= taskCount) {
+            break;
+        }
+
+        try {
+            (*currentTask)(index, threadIndex);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!firstException) {
+                firstException = std::current_exception();
+            }
+            // skip whatever is left, the caller is going to rethrow anyway
+            nextIndex.store(taskCount);
+        }
+    }
+}
+
+// #endregion
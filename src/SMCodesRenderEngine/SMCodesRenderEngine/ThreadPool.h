@@ -0,0 +1,56 @@
+#ifndef SMCODESRENDERENGINE_THREADPOOL_H
+#define SMCODESRENDERENGINE_THREADPOOL_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads used to spread CPU rendering work over every core.
+// The thread calling parallelFor() takes part in the work as thread index 0,
+// so a pool of N threads only spawns N - 1 workers.
+class ThreadPool {
+public:
+    using Task = std::function<void(uint32_t index, uint32_t threadIndex)>;
+
+    // threadCount of 0 uses every hardware thread
+    explicit ThreadPool(uint32_t threadCount = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // runs task for every index in [0, count) and blocks until all of them are done.
+    // Only one parallelFor can be in flight per pool at a time
+    void parallelFor(uint32_t count, const Task &task);
+
+    uint32_t getThreadCount() const;
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    const Task *currentTask = nullptr;
+    uint32_t taskCount = 0;
+    std::atomic<uint32_t> nextIndex{0};
+    uint64_t generation = 0;
+    size_t busyWorkers = 0;
+    bool stopping = false;
+    std::exception_ptr firstException;
+
+    void workerLoop(uint32_t threadIndex);
+
+    void runTasks(uint32_t threadIndex);
+};
+
+
+#endif //SMCODESRENDERENGINE_THREADPOOL_H
@@ -0,0 +1,106 @@
+#include "UniformRing.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "VulkanUtils.h"
+
+// #region Private Methods
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// #endregion
+
+// #region Public Methods
+
+void UniformRing::create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize bytesPerFrame,
+                         uint32_t frameCount) {
+    device = logicalDevice;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+    // every region starts on the alignment, so the offsets inside it line up too
+    regionSize = alignUp(bytesPerFrame, alignment);
+    regionStart = 0;
+    regionOffset = 0;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = regionSize * frameCount;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create uniform ring buffer!");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    // written once by the CPU and read by the GPU once per draw, device local memory the host can write to saves
+    // the GPU reading it over the bus. Coherent either way, so nothing needs flushing
+    int memoryType = findMemoryType(memoryProperties, requirements.memoryTypeBits,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (memoryType < 0) {
+        memoryType = findMemoryType(memoryProperties, requirements.memoryTypeBits,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+    if (memoryType < 0) {
+        throw std::runtime_error("failed to find host visible memory for the uniform ring!");
+    }
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = static_cast<uint32_t>(memoryType);
+    if (vkAllocateMemory(device, &allocateInfo, nullptr, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate uniform ring memory!");
+    }
+    vkBindBufferMemory(device, buffer, memory, 0);
+
+    // mapped for as long as the buffer lives
+    void *data = nullptr;
+    if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map uniform ring memory!");
+    }
+    mapped = static_cast<uint8_t *>(data);
+}
+
+void UniformRing::destroy() {
+    if (memory != VK_NULL_HANDLE) {
+        vkUnmapMemory(device, memory);
+        vkFreeMemory(device, memory, nullptr);
+    }
+    vkDestroyBuffer(device, buffer, nullptr);
+    memory = VK_NULL_HANDLE;
+    buffer = VK_NULL_HANDLE;
+    mapped = nullptr;
+}
+
+void UniformRing::beginFrame(uint32_t slot) {
+    regionStart = regionSize * slot;
+    regionOffset = 0;
+}
+
+uint32_t UniformRing::allocate(VkDeviceSize size, void *&data) {
+    VkDeviceSize offset = alignUp(regionOffset, alignment);
+    if (offset + size > regionSize) {
+        throw std::runtime_error("uniform ring is full!");
+    }
+    regionOffset = offset + size;
+
+    data = mapped + regionStart + offset;
+    return static_cast<uint32_t>(regionStart + offset);
+}
+
+VkBuffer UniformRing::getBuffer() const {
+    return buffer;
+}
+
+// #endregion
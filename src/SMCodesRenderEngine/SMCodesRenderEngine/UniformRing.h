@@ -0,0 +1,53 @@
+#ifndef SMCODESRENDERENGINE_UNIFORMRING_H
+#define SMCODESRENDERENGINE_UNIFORMRING_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+#include <cstring>
+
+// Per object uniform data for a dynamic uniform buffer descriptor. One buffer split into a region per frame in
+// flight, mapped once when it's created and left mapped, so filling in an object's uniforms is a bump of an offset
+// and a memcpy: no allocations, no map/unmap and no descriptor updates per frame. The descriptor set points at the
+// start of the buffer and every draw passes the offset allocate() returned as its dynamic offset.
+// A region is only reused once the frame that last wrote it is done on the GPU, the caller makes sure of that by
+// waiting on the frame timeline before beginFrame()
+class UniformRing {
+public:
+    // frameCount regions of at least bytesPerFrame each, in host visible coherent memory (device local too when
+    // the device has some that the host can see)
+    void create(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize bytesPerFrame,
+                uint32_t frameCount);
+
+    void destroy();
+
+    // starts allocating from the start of slot's region again
+    void beginFrame(uint32_t slot);
+
+    // size bytes out of the current region, on minUniformBufferOffsetAlignment. data points at the mapped memory
+    // to write them to, the return value is the dynamic offset to bind them with. Throws once the region is full
+    uint32_t allocate(VkDeviceSize size, void *&data);
+
+    template<typename T>
+    uint32_t push(const T &value) {
+        void *data;
+        uint32_t offset = allocate(sizeof(T), data);
+        std::memcpy(data, &value, sizeof(T));
+        return offset;
+    }
+
+    VkBuffer getBuffer() const;
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    uint8_t *mapped = nullptr;
+    VkDeviceSize alignment = 256;
+    VkDeviceSize regionSize = 0;
+    VkDeviceSize regionStart = 0;
+    VkDeviceSize regionOffset = 0; // next free byte of the current region
+};
+
+
+#endif //SMCODESRENDERENGINE_UNIFORMRING_H
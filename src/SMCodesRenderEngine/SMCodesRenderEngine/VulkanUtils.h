@@ -0,0 +1,34 @@
+#ifndef SMCODESRENDERENGINE_VULKANUTILS_H
+#define SMCODESRENDERENGINE_VULKANUTILS_H
+
+
+#include <vulkan/vulkan_core.h>
+#include <cstdint>
+
+// first memory type allowed by typeBits that has every one of properties, -1 if there isn't one
+int findMemoryType(const VkPhysicalDeviceMemoryProperties &memoryProperties, uint32_t typeBits,
+                   VkMemoryPropertyFlags properties);
+
+// creates image and binds it to a dedicated allocation of memory with properties, throws if either fails
+void createImage(VkPhysicalDevice physicalDevice, VkDevice device, const VkImageCreateInfo &imageInfo,
+                 VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &memory);
+
+// creates buffer and binds it to a dedicated allocation of memory with properties, throws if either fails
+void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage,
+                  VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &memory);
+
+// a device local buffer with size bytes of data in it, copied through a staging buffer by a command buffer from
+// commandPool and waited for on queue. For data written once at load time
+void createDeviceLocalBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue,
+                             VkCommandPool commandPool, const void *data, VkDeviceSize size, VkBufferUsageFlags usage,
+                             VkBuffer &buffer, VkDeviceMemory &memory);
+
+// a 2D view of every mip level and layer of image
+VkImageView createImageView(VkDevice device, VkImage image, VkFormat format);
+
+// copies all of image (in TRANSFER_SRC_OPTIMAL) tightly packed into buffer, then makes the copy visible to
+// the host. The CPU can read it once it knows the command buffer has finished
+void recordReadbackCopy(VkCommandBuffer cmdBuffer, VkImage image, VkExtent2D extent, VkBuffer buffer);
+
+
+#endif //SMCODESRENDERENGINE_VULKANUTILS_H
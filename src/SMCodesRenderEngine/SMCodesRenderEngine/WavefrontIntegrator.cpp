@@ -0,0 +1,221 @@
+#include "WavefrontIntegrator.h"
+
+#include <algorithm>
+
+#include "AccumulationBuffer.h"
+#include "Scene.h"
+
+// #region Constants
+
+const uint32_t MORTON_BITS_PER_AXIS = 9;
+const uint32_t RAY_KEY_BITS = 3 + 3 * MORTON_BITS_PER_AXIS;
+
+const uint32_t RADIX_BITS = 11;
+const uint32_t RADIX_BUCKETS = 1u << RADIX_BITS;
+
+// #endregion
+
+// #region Private Methods
+
+// spreads the low 10 bits of value out so there are two zero bits between each
+static uint32_t expandBits(uint32_t value) {
+    value = (value * 0x00010001u) & 0xFF0000FFu;
+    value = (value * 0x00000101u) & 0x0F00F00Fu;
+    value = (value * 0x00000011u) & 0xC30C30C3u;
+    value = (value * 0x00000005u) & 0x49249249u;
+    return value;
+}
+
+static uint32_t bitsNeeded(uint32_t value) {
+    uint32_t bits = 1;
+    while (bits < 32 && (value >> bits) != 0) {
+        bits++;
+    }
+    return bits;
+}
+
+uint32_t WavefrontIntegrator::getRayKey(const Ray &ray) const {
+    uint32_t octant = (ray.direction.x < 0.0f ? 1u : 0u) |
+                      (ray.direction.y < 0.0f ? 2u : 0u) |
+                      (ray.direction.z < 0.0f ? 4u : 0u);
+
+    const auto gridMax = static_cast<float>((1u << MORTON_BITS_PER_AXIS) - 1);
+    glm::vec3 cell = glm::clamp((ray.origin - boundsMin) * boundsScale, 0.0f, gridMax);
+    uint32_t morton = (expandBits(static_cast<uint32_t>(cell.x)) << 2) |
+                      (expandBits(static_cast<uint32_t>(cell.y)) << 1) |
+                      expandBits(static_cast<uint32_t>(cell.z));
+
+    return (octant << (3 * MORTON_BITS_PER_AXIS)) | morton;
+}
+
+void WavefrontIntegrator::sortByKey(uint32_t count, uint32_t keyBits) {
+    if (sortKeysScratch.size() < count) {
+        sortKeysScratch.resize(count);
+        sortValuesScratch.resize(count);
+    }
+
+    uint32_t *keysIn = sortKeys.data();
+    uint32_t *valuesIn = sortValues.data();
+    uint32_t *keysOut = sortKeysScratch.data();
+    uint32_t *valuesOut = sortValuesScratch.data();
+    bool inScratch = false;
+
+    for (uint32_t shift = 0; shift < keyBits; shift += RADIX_BITS) {
+        uint32_t offsets[RADIX_BUCKETS] = {};
+        for (uint32_t i = 0; i < count; i++) {
+            offsets[(keysIn[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        }
+
+        uint32_t sum = 0;
+        for (uint32_t &offset: offsets) {
+            uint32_t bucketCount = offset;
+            offset = sum;
+            sum += bucketCount;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t destination = offsets[(keysIn[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            keysOut[destination] = keysIn[i];
+            valuesOut[destination] = valuesIn[i];
+        }
+
+        std::swap(keysIn, keysOut);
+        std::swap(valuesIn, valuesOut);
+        inScratch = !inScratch;
+    }
+
+    if (inScratch) {
+        sortKeys.swap(sortKeysScratch);
+        sortValues.swap(sortValuesScratch);
+    }
+}
+
+void WavefrontIntegrator::generate(const ImageRegion &region, uint32_t firstPixel, uint32_t pixelCount,
+                                   uint32_t sampleIndex) {
+    paths.resize(pixelCount);
+    activePaths.resize(pixelCount);
+
+    for (uint32_t i = 0; i < pixelCount; i++) {
+        uint32_t pixel = firstPixel + i;
+        paths[i] = integrator.generatePath(region.x + pixel % region.width, region.y + pixel / region.width,
+                                           sampleIndex);
+        activePaths[i] = i;
+    }
+}
+
+void WavefrontIntegrator::extend(RayStats &stats) {
+    auto count = static_cast<uint32_t>(activePaths.size());
+    sortKeys.resize(count);
+    sortValues.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        sortKeys[i] = getRayKey(paths[activePaths[i]].ray);
+        sortValues[i] = activePaths[i];
+    }
+    sortByKey(count, RAY_KEY_BITS);
+
+    // gather into sorted order so the packets below read rays that are next to each other
+    rayQueue.resize(count);
+    hitQueue.assign(count, Hit{});
+    rayPaths.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        rayQueue[i] = paths[sortValues[i]].ray;
+        rayPaths[i] = sortValues[i];
+    }
+
+    integrator.intersect(rayQueue.data(), hitQueue.data(), count);
+    stats.rays += count;
+}
+
+void WavefrontIntegrator::shade() {
+    // paths that missed everything pick up the environment and are finished, the rest are grouped by material
+    auto materialCount = static_cast<uint32_t>(scene.materials.size());
+    uint32_t hitCount = 0;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(hitQueue.size()); i++) {
+        if (hitQueue[i].isValid()) {
+            sortKeys[hitCount] = scene.triangleMaterials[hitQueue[i].triangleIndex];
+            sortValues[hitCount] = i;
+            hitCount++;
+        } else {
+            integrator.miss(paths[rayPaths[i]]);
+        }
+    }
+    // stable, so inside a material the rays keep their spatial order
+    sortByKey(hitCount, bitsNeeded(materialCount));
+
+    shadowQueue.clear();
+    nextActivePaths.clear();
+
+    uint32_t runStart = 0;
+    while (runStart < hitCount) {
+        uint32_t materialIndex = sortKeys[runStart];
+        uint32_t runEnd = runStart;
+        while (runEnd < hitCount && sortKeys[runEnd] == materialIndex) {
+            runEnd++;
+        }
+
+        // one call per run, the kernel for the material is picked once rather than per hit
+        integrator.shadeBatch(materialIndex, &sortValues[runStart], runEnd - runStart, hitQueue.data(),
+                              rayPaths.data(), paths.data(), nextActivePaths, shadowQueue);
+
+        runStart = runEnd;
+    }
+}
+
+void WavefrontIntegrator::traceShadowRays(RayStats &stats) {
+    auto count = static_cast<uint32_t>(shadowQueue.size());
+    sortKeys.resize(count);
+    sortValues.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        sortKeys[i] = getRayKey(shadowQueue[i].ray);
+        sortValues[i] = i;
+    }
+    sortByKey(count, RAY_KEY_BITS);
+
+    rayQueue.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        rayQueue[i] = shadowQueue[sortValues[i]].ray;
+    }
+
+    occludedQueue.assign(count, 0);
+    integrator.occluded(rayQueue.data(), occludedQueue.data(), count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (occludedQueue[i] == 0) {
+            const ShadowRay &shadowRay = shadowQueue[sortValues[i]];
+            paths[shadowRay.pathIndex].radiance += shadowRay.contribution;
+        }
+    }
+    stats.shadowRays += count;
+}
+
+// #endregion
+
+// #region Public Methods
+
+WavefrontIntegrator::WavefrontIntegrator(const Scene &scene, const Integrator &integrator,
+                                         const RenderSettings &settings)
+        : scene(scene), integrator(integrator), settings(settings) {
+    Aabb bounds = scene.getBounds();
+    boundsMin = bounds.min;
+    glm::vec3 extent = glm::max(bounds.extent(), glm::vec3(1e-6f));
+    boundsScale = glm::vec3(static_cast<float>(1u << MORTON_BITS_PER_AXIS)) / extent;
+}
+
+void WavefrontIntegrator::trace(const ImageRegion &region, uint32_t firstPixel, uint32_t pixelCount,
+                                uint32_t sampleIndex, AccumulationBuffer &accumulation, RayStats &stats) {
+    generate(region, firstPixel, pixelCount, sampleIndex);
+
+    while (!activePaths.empty()) {
+        extend(stats);
+        shade();
+        traceShadowRays(stats);
+        activePaths.swap(nextActivePaths);
+    }
+
+    // path.pixelIndex is in the whole image, the accumulation only covers the region
+    for (uint32_t i = 0; i < pixelCount; i++) {
+        accumulation.addSample(firstPixel + i, paths[i].radiance, paths[i].features);
+    }
+}
+
+// #endregion
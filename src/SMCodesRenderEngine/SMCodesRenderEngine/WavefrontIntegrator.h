@@ -0,0 +1,74 @@
+#ifndef SMCODESRENDERENGINE_WAVEFRONTINTEGRATOR_H
+#define SMCODESRENDERENGINE_WAVEFRONTINTEGRATOR_H
+
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Integrator.h"
+#include "RayTracing.h"
+
+struct Scene;
+struct AccumulationBuffer;
+
+// Wavefront path tracing: rather than following one path at a time, a large batch of paths
+// advances one bounce per iteration through separate stages
+//  - generate: camera rays for every pixel of the batch
+//  - extend:   rays sorted by direction octant and origin, then traced 4 at a time as SSE packets (one at a
+//              time down the 4 wide CompressedBvh). Out of core the whole queue goes to the PagedBvh at once,
+//              which batches it by geometry page
+//  - shade:    hits sorted by material and shaded in one run per material, each with its own BSDF kernel
+//  - shadow:   next event estimation rays sorted the same way and traced as packets
+// Sorting between stages is what keeps secondary bounces coherent enough for packet traversal.
+// One instance per thread, the queues are reused between batches
+class WavefrontIntegrator {
+public:
+    WavefrontIntegrator(const Scene &scene, const Integrator &integrator, const RenderSettings &settings);
+
+    // traces one sample for pixels [firstPixel, firstPixel + pixelCount) of region, counted row by row
+    // inside the region, and adds them to accumulation which is the size of region
+    void trace(const ImageRegion &region, uint32_t firstPixel, uint32_t pixelCount, uint32_t sampleIndex,
+               AccumulationBuffer &accumulation, RayStats &stats);
+
+private:
+    const Scene &scene;
+    const Integrator &integrator;
+    const RenderSettings &settings;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsScale; // maps scene bounds onto the morton grid
+
+    std::vector<PathState> paths;
+    std::vector<uint32_t> activePaths; // paths waiting for the extend stage
+    std::vector<uint32_t> nextActivePaths;
+
+    // extend stage results, in sorted ray order
+    std::vector<Ray> rayQueue;
+    std::vector<Hit> hitQueue;
+    std::vector<uint32_t> rayPaths;
+
+    std::vector<ShadowRay> shadowQueue;
+    std::vector<uint8_t> occludedQueue; // in sorted shadow ray order
+
+    std::vector<uint32_t> sortKeys;
+    std::vector<uint32_t> sortValues;
+    std::vector<uint32_t> sortKeysScratch;
+    std::vector<uint32_t> sortValuesScratch;
+
+    void generate(const ImageRegion &region, uint32_t firstPixel, uint32_t pixelCount, uint32_t sampleIndex);
+
+    void extend(RayStats &stats);
+
+    void shade();
+
+    void traceShadowRays(RayStats &stats);
+
+    // direction octant in the top 3 bits, morton code of the origin in the rest
+    uint32_t getRayKey(const Ray &ray) const;
+
+    // stable LSD radix sort of the first count sortKeys/sortValues pairs
+    void sortByKey(uint32_t count, uint32_t keyBits);
+};
+
+
+#endif //SMCODESRENDERENGINE_WAVEFRONTINTEGRATOR_H
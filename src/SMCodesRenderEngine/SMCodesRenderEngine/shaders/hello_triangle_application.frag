@@ -1,10 +1,37 @@
 #version 450
 
 layout(location = 0) in vec3 fragColour;
+layout(location = 1) in vec2 fragUv;
+layout(location = 2) flat in uint fragMaterial;
 
 // no built-in variable to output a color, therefore just have to specify own variable where the layout location is 0
 layout(location = 0) out vec4 outColour;
 
+// sizes of the bindless arrays, smaller when the device fell back (see BindlessTable)
+layout(constant_id = 0) const uint IMAGE_CAPACITY = 1;
+layout(constant_id = 1) const uint BUFFER_CAPACITY = 1;
+
+struct MaterialRecord {
+    vec4 albedo;
+    uint albedoImage;
+};
+
+layout(push_constant) uniform Frame {
+    mat4 viewProjection;
+    uint materialBuffer;
+} frame;
+
+// the bindless table, bound once for the frame. The indices are the same for the whole draw, so plain dynamic
+// indexing is enough and nothing needs nonuniformEXT
+layout(set = 1, binding = 0) uniform texture2D images[IMAGE_CAPACITY];
+layout(set = 1, binding = 1) readonly buffer Materials {
+    MaterialRecord records[];
+} buffers[BUFFER_CAPACITY];
+layout(set = 1, binding = 2) uniform sampler linearSampler;
+
 void main() {
-    outColour = vec4(fragColour, 1.0);
-}
\ No newline at end of file
+    MaterialRecord material = buffers[frame.materialBuffer].records[fragMaterial];
+    vec3 albedo = material.albedo.rgb * texture(sampler2D(images[material.albedoImage], linearSampler), fragUv).rgb;
+
+    outColour = vec4(fragColour * albedo, 1.0);
+}
@@ -4,9 +4,33 @@ layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColour;
 
 layout(location = 0) out vec3 fragColour;
+layout(location = 1) out vec2 fragUv;
+layout(location = 2) flat out uint fragMaterial;
+
+// changes once per frame, pushed straight into the command buffer
+layout(push_constant) uniform Frame {
+    mat4 viewProjection;
+    uint materialBuffer;
+} frame;
+
+struct ObjectUniforms {
+    mat4 model;
+    vec4 tint;
+    uint materialIndex;
+};
+
+// every object of the frame, out of the uniform ring at the dynamic offset. Draws (direct or written by the
+// occlusion culler) pass the object's index as their first instance
+const uint OBJECT_CAPACITY = 128;
+layout(set = 0, binding = 0) uniform Objects {
+    ObjectUniforms objects[OBJECT_CAPACITY];
+};
 
 void main() {
-    gl_Position = vec4(inPosition, 0.0, 1.0);
+    ObjectUniforms object = objects[gl_InstanceIndex];
+    gl_Position = frame.viewProjection * object.model * vec4(inPosition, 0.0, 1.0);
 
-    fragColour = inColour;
-}
\ No newline at end of file
+    fragColour = inColour * object.tint.rgb;
+    fragUv = inPosition + 0.5;
+    fragMaterial = object.materialIndex;
+}
@@ -9,11 +9,12 @@ set GLSLC=C:\Program Files\VulkanSDK\1.3.283.0\Bin\glslc.exe
 set SHADERS_DIR=SMCodesRenderEngine\shaders
 
 :: Loop through all shader files in the shaders folder
-for %%f in (%SHADERS_DIR%\*.frag %SHADERS_DIR%\*.vert) do (
+for %%f in (%SHADERS_DIR%\*.frag %SHADERS_DIR%\*.vert %SHADERS_DIR%\*.comp) do (
     :: Determine the shader stage based on the file extension
     set STAGE=
     if "%%~xf"==".vert" set STAGE=vertex
     if "%%~xf"==".frag" set STAGE=fragment
+    if "%%~xf"==".comp" set STAGE=compute
 
     if defined STAGE (
         
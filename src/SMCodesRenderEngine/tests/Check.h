@@ -0,0 +1,38 @@
+#ifndef SMCODESRENDERENGINE_CHECK_H
+#define SMCODESRENDERENGINE_CHECK_H
+
+
+#include <cstdio>
+#include <exception>
+
+// Just enough of a test framework for ctest. Every test is an executable whose main runs its checks and
+// returns getCheckFailures() != 0, a failed check prints where it was and the rest still run
+inline int &getCheckFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                       \
+    do {                                                                                       \
+        if (!(condition)) {                                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            getCheckFailures()++;                                                              \
+        }                                                                                      \
+    } while (false)
+
+#define CHECK_THROWS(expression)                                                               \
+    do {                                                                                       \
+        bool threw = false;                                                                    \
+        try {                                                                                  \
+            expression;                                                                        \
+        } catch (const std::exception &) {                                                     \
+            threw = true;                                                                      \
+        }                                                                                      \
+        if (!threw) {                                                                          \
+            std::fprintf(stderr, "%s:%d: %s didn't throw\n", __FILE__, __LINE__, #expression); \
+            getCheckFailures()++;                                                              \
+        }                                                                                      \
+    } while (false)
+
+
+#endif //SMCODESRENDERENGINE_CHECK_H
@@ -0,0 +1,108 @@
+#include "Check.h"
+
+#include <thread>
+#include <vector>
+
+#include "DeviceScheduler.h"
+
+static void testCalibration() {
+    DeviceScheduler scheduler(100, 2);
+    WorkRange first = scheduler.next(0);
+    WorkRange second = scheduler.next(1);
+    CHECK(first.first == 0);
+    CHECK(first.count == 4);
+    CHECK(second.first == 4);
+    CHECK(second.count == 4);
+    CHECK(scheduler.getThroughput(0) == 0.0);
+
+    // a batch smaller than the calibration range
+    DeviceScheduler small(2, 1);
+    CHECK(small.next(0).count == 2);
+    CHECK(small.next(0).count == 0);
+}
+
+static void testFasterDeviceGetsMore() {
+    DeviceScheduler scheduler(1000, 2);
+    scheduler.next(0);
+    scheduler.next(1);
+    scheduler.report(0, 4, 1.0);
+    scheduler.report(1, 4, 4.0);
+    CHECK(scheduler.getThroughput(0) == 4.0);
+    CHECK(scheduler.getThroughput(1) == 1.0);
+
+    WorkRange fast = scheduler.next(0);
+    WorkRange slow = scheduler.next(1);
+    CHECK(fast.count > slow.count);
+    CHECK(slow.count >= 1);
+
+    // ranges shrink towards the end
+    WorkRange later = scheduler.next(0);
+    CHECK(later.count < fast.count);
+}
+
+static void testEveryItemOnce() {
+    const uint32_t itemCount = 10000;
+    const uint32_t deviceCount = 4;
+    DeviceScheduler scheduler(itemCount, deviceCount);
+
+    std::vector<std::vector<WorkRange>> ranges(deviceCount);
+    std::vector<std::thread> threads;
+    for (uint32_t device = 0; device < deviceCount; device++) {
+        threads.emplace_back([&, device]() {
+            uint64_t done = 0;
+            while (true) {
+                WorkRange range = scheduler.next(device);
+                if (range.count == 0) {
+                    break;
+                }
+                ranges[device].push_back(range);
+                done += range.count;
+                // device n runs n + 1 times as fast as device 0
+                scheduler.report(device, done, static_cast<double>(done) / (device + 1));
+            }
+        });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+
+    std::vector<uint32_t> handedOut(itemCount, 0);
+    uint32_t assigned = 0;
+    for (uint32_t device = 0; device < deviceCount; device++) {
+        for (const WorkRange &range: ranges[device]) {
+            for (uint32_t item = range.first; item < range.first + range.count && item < itemCount; item++) {
+                handedOut[item]++;
+            }
+        }
+        assigned += scheduler.getItemsAssigned(device);
+    }
+    CHECK(assigned == itemCount);
+    bool everyItemOnce = true;
+    for (uint32_t count: handedOut) {
+        everyItemOnce = everyItemOnce && count == 1;
+    }
+    CHECK(everyItemOnce);
+}
+
+static void testCancel() {
+    DeviceScheduler scheduler(100, 2);
+    CHECK(scheduler.next(0).count == 4);
+    scheduler.cancel();
+    CHECK(scheduler.next(0).count == 0);
+    CHECK(scheduler.next(1).count == 0);
+    CHECK(scheduler.getItemsAssigned(0) == 4);
+    CHECK(scheduler.getItemsAssigned(1) == 0);
+}
+
+static void testNoDevices() {
+    CHECK_THROWS(DeviceScheduler(10, 0));
+}
+
+int main() {
+    testCalibration();
+    testFasterDeviceGetsMore();
+    testEveryItemOnce();
+    testCancel();
+    testNoDevices();
+    return getCheckFailures() != 0;
+}
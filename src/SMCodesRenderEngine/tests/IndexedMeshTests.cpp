@@ -0,0 +1,148 @@
+#include "Check.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "IndexedMesh.h"
+
+struct Vertex {
+    float position[3];
+    float uv[2];
+};
+
+static Vertex createVertex(uint32_t x, uint32_t y, uint32_t resolution) {
+    float u = static_cast<float>(x) / static_cast<float>(resolution);
+    float v = static_cast<float>(y) / static_cast<float>(resolution);
+    return {{u, 0.0f, v}, {u, v}};
+}
+
+// a grid of resolution x resolution quads as a triangle soup, 3 vertices per triangle and nothing shared, with the
+// triangles in a scrambled order the way some exporters leave them
+static std::vector<Vertex> createGridSoup(uint32_t resolution) {
+    std::vector<std::array<Vertex, 3>> triangles;
+    for (uint32_t y = 0; y < resolution; y++) {
+        for (uint32_t x = 0; x < resolution; x++) {
+            triangles.push_back({createVertex(x, y, resolution), createVertex(x, y + 1, resolution),
+                                 createVertex(x + 1, y, resolution)});
+            triangles.push_back({createVertex(x + 1, y, resolution), createVertex(x, y + 1, resolution),
+                                 createVertex(x + 1, y + 1, resolution)});
+        }
+    }
+    uint32_t state = 12345;
+    for (size_t i = triangles.size() - 1; i > 0; i--) {
+        state = state * 1664525u + 1013904223u;
+        std::swap(triangles[i], triangles[state % (i + 1)]);
+    }
+
+    std::vector<Vertex> soup;
+    for (const std::array<Vertex, 3> &triangle: triangles) {
+        soup.insert(soup.end(), triangle.begin(), triangle.end());
+    }
+    return soup;
+}
+
+// a triangle as its corners' positions, rotated so the smallest comes first, which keeps the winding
+using TriangleKey = std::array<std::array<float, 3>, 3>;
+
+static TriangleKey getTriangleKey(const Vertex &a, const Vertex &b, const Vertex &c) {
+    TriangleKey key;
+    const Vertex *corners[3] = {&a, &b, &c};
+    for (uint32_t corner = 0; corner < 3; corner++) {
+        std::memcpy(key[corner].data(), corners[corner]->position, sizeof(key[corner]));
+    }
+    std::rotate(key.begin(), std::min_element(key.begin(), key.end()), key.end());
+    return key;
+}
+
+static void testGrid() {
+    const uint32_t resolution = 24;
+    std::vector<Vertex> soup = createGridSoup(resolution);
+    auto soupCount = static_cast<uint32_t>(soup.size());
+    IndexedMesh mesh = buildIndexedMesh(soup.data(), soupCount, sizeof(Vertex));
+
+    // every grid point once
+    CHECK(mesh.vertexSize == sizeof(Vertex));
+    CHECK(mesh.getVertexCount() == (resolution + 1) * (resolution + 1));
+    CHECK(mesh.indices.size() == soup.size());
+
+    // the same triangles, wound the same way
+    std::vector<Vertex> vertices(mesh.getVertexCount());
+    std::memcpy(vertices.data(), mesh.vertices.data(), mesh.vertices.size());
+    std::vector<TriangleKey> before;
+    std::vector<TriangleKey> after;
+    for (uint32_t i = 0; i + 2 < soupCount; i += 3) {
+        before.push_back(getTriangleKey(soup[i], soup[i + 1], soup[i + 2]));
+        after.push_back(getTriangleKey(vertices[mesh.indices[i]], vertices[mesh.indices[i + 1]],
+                                       vertices[mesh.indices[i + 2]]));
+    }
+    std::sort(before.begin(), before.end());
+    std::sort(after.begin(), after.end());
+    CHECK(before == after);
+
+    // vertices come in the order the triangles first use them
+    uint32_t nextVertex = 0;
+    bool inFetchOrder = true;
+    for (uint32_t index: mesh.indices) {
+        inFetchOrder = inFetchOrder && index <= nextVertex;
+        nextVertex = std::max(nextVertex, index + 1);
+    }
+    CHECK(inFetchOrder);
+
+    // welded but left in the scrambled order, against reordered
+    std::vector<uint32_t> scrambled;
+    for (uint32_t i = 0; i < soupCount; i++) {
+        for (uint32_t vertex = 0; vertex < mesh.getVertexCount(); vertex++) {
+            if (std::memcmp(&vertices[vertex], &soup[i], sizeof(Vertex)) == 0) {
+                scrambled.push_back(vertex);
+                break;
+            }
+        }
+    }
+    CHECK(scrambled.size() == soup.size());
+    float scrambledRatio = getAverageCacheMissRatio(scrambled, mesh.getVertexCount());
+    float orderedRatio = getAverageCacheMissRatio(mesh.indices, mesh.getVertexCount());
+    CHECK(orderedRatio < scrambledRatio);
+    CHECK(orderedRatio < 1.0f);
+
+    // the same input always gives the same buffers
+    IndexedMesh again = buildIndexedMesh(soup.data(), soupCount, sizeof(Vertex));
+    CHECK(again.indices == mesh.indices);
+    CHECK(again.vertices == mesh.vertices);
+}
+
+static void testIndexedInput() {
+    // a quad given with indices, plus a triangle that welding collapses onto two vertices
+    Vertex corners[5] = {{{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+                         {{1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
+                         {{1.0f, 1.0f, 0.0f}, {1.0f, 1.0f}},
+                         {{0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},
+                         {{1.0f, 1.0f, 0.0f}, {1.0f, 1.0f}}};
+    std::vector<uint32_t> indices = {0, 1, 2, 0, 2, 3, 2, 4, 1};
+    IndexedMesh mesh = buildIndexedMesh(corners, 5, sizeof(Vertex), indices);
+    CHECK(mesh.getVertexCount() == 4);
+    CHECK(mesh.indices.size() == 6);
+    CHECK(mesh.hasShortIndices());
+    CHECK(mesh.packIndices().size() == mesh.indices.size() * sizeof(uint16_t));
+
+    IndexedMesh empty = buildIndexedMesh(corners, 0, sizeof(Vertex));
+    CHECK(empty.getVertexCount() == 0);
+    CHECK(empty.indices.empty());
+}
+
+static void testCacheMissRatio() {
+    // no reuse at all
+    std::vector<uint32_t> separate = {0, 1, 2, 3, 4, 5};
+    CHECK(getAverageCacheMissRatio(separate, 6) == 3.0f);
+    // the second triangle only brings one new vertex
+    std::vector<uint32_t> strip = {0, 1, 2, 2, 1, 3};
+    CHECK(getAverageCacheMissRatio(strip, 4) == 2.0f);
+}
+
+int main() {
+    testGrid();
+    testIndexedInput();
+    testCacheMissRatio();
+    return getCheckFailures() != 0;
+}
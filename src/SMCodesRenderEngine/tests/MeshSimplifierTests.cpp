@@ -0,0 +1,100 @@
+#include "Check.h"
+
+#include "MeshSimplifier.h"
+
+// resolution x resolution quads over the unit square, a gentle bump in the middle so collapses cost something
+static MeshLevel createGrid(uint32_t resolution) {
+    MeshLevel mesh;
+    for (uint32_t y = 0; y <= resolution; y++) {
+        for (uint32_t x = 0; x <= resolution; x++) {
+            float u = static_cast<float>(x) / static_cast<float>(resolution);
+            float v = static_cast<float>(y) / static_cast<float>(resolution);
+            float height = 0.1f * (u * (1.0f - u) + v * (1.0f - v));
+            mesh.vertices.emplace_back(u, height, v);
+            mesh.uvs.emplace_back(u, v);
+        }
+    }
+    for (uint32_t y = 0; y < resolution; y++) {
+        for (uint32_t x = 0; x < resolution; x++) {
+            uint32_t corner = y * (resolution + 1) + x;
+            mesh.triangles.emplace_back(corner, corner + resolution + 1, corner + 1);
+            mesh.triangles.emplace_back(corner + 1, corner + resolution + 1, corner + resolution + 2);
+        }
+    }
+    mesh.triangleMaterials.assign(mesh.triangles.size(), 0);
+    return mesh;
+}
+
+static bool isValid(const MeshLevel &mesh) {
+    if (mesh.triangleMaterials.size() != mesh.triangles.size() || mesh.uvs.size() != mesh.vertices.size()) {
+        return false;
+    }
+    auto vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    for (const glm::uvec3 &triangle: mesh.triangles) {
+        if (triangle.x >= vertexCount || triangle.y >= vertexCount || triangle.z >= vertexCount ||
+            triangle.x == triangle.y || triangle.y == triangle.z || triangle.z == triangle.x) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testHalves() {
+    MeshLevel mesh = createGrid(16);
+    MeshLevel simplified = simplifyMesh(mesh, mesh.getTriangleCount() / 2);
+    CHECK(isValid(simplified));
+    CHECK(simplified.getTriangleCount() <= mesh.getTriangleCount() / 2);
+    CHECK(simplified.getTriangleCount() > 0);
+    CHECK(simplified.vertices.size() < mesh.vertices.size());
+    CHECK(simplified.error >= 0.0f);
+}
+
+static void testDegenerateTriangles() {
+    MeshLevel mesh = createGrid(16);
+    uint32_t validCount = mesh.getTriangleCount();
+    // repeated indices, both all three the same and two the same, ahead of and mixed in with the real ones
+    for (uint32_t i = 0; i < 100; i++) {
+        mesh.triangles.emplace_back(0, 0, 0);
+        mesh.triangles.emplace_back(i, i, i + 1);
+        mesh.triangles.emplace_back(i + 2, i + 1, i + 2);
+    }
+    mesh.triangleMaterials.assign(mesh.triangles.size(), 0);
+
+    MeshLevel simplified = simplifyMesh(mesh, validCount / 2);
+    CHECK(isValid(simplified));
+    CHECK(simplified.getTriangleCount() <= validCount / 2);
+    CHECK(simplified.getTriangleCount() > 0);
+
+    // nothing to collapse, only the degenerate triangles go
+    MeshLevel unchanged = simplifyMesh(mesh, mesh.getTriangleCount());
+    CHECK(isValid(unchanged));
+    CHECK(unchanged.getTriangleCount() == validCount);
+
+    // a mesh of nothing but degenerate triangles
+    MeshLevel empty;
+    empty.vertices.assign(3, glm::vec3(0.0f));
+    empty.triangles.assign(10, glm::uvec3(1, 1, 1));
+    empty.triangleMaterials.assign(10, 0);
+    CHECK(simplifyMesh(empty, 2).getTriangleCount() == 0);
+}
+
+static void testLodChain() {
+    MeshLevel mesh = createGrid(32);
+    LodChain chain = buildLodChain(mesh);
+    CHECK(chain.getLevelCount() > 2);
+    uint32_t previousCount = mesh.getTriangleCount();
+    for (uint32_t level = 1; level < chain.getLevelCount(); level++) {
+        const MeshLevel &simplified = chain.levels[level - 1];
+        CHECK(isValid(simplified));
+        CHECK(simplified.getTriangleCount() < previousCount);
+        CHECK(chain.getError(level) >= chain.getError(level - 1));
+        previousCount = simplified.getTriangleCount();
+    }
+}
+
+int main() {
+    testHalves();
+    testDegenerateTriangles();
+    testLodChain();
+    return getCheckFailures() != 0;
+}
@@ -0,0 +1,175 @@
+#include "Check.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "AccumulationBuffer.h"
+#include "RenderProtocol.h"
+#include "Scene.h"
+
+static void testHello() {
+    CHECK(decodeHello(encodeHello(12)) == 12);
+}
+
+static void testJob() {
+    RenderSettings settings;
+    settings.width = 320;
+    settings.height = 240;
+    settings.samplesPerPixel = 16;
+    settings.maxDepth = 5;
+    settings.seed = 1234;
+    settings.mode = RenderMode::Megakernel;
+    settings.sampler = SamplerType::Independent;
+    settings.bvhLayout = BvhLayout::Compressed;
+    Scene scene = Scene::createCornellBox();
+
+    RenderSettings decodedSettings;
+    Scene decodedScene;
+    decodeJob(encodeJob(settings, scene), decodedSettings, decodedScene);
+
+    CHECK(decodedSettings.width == settings.width);
+    CHECK(decodedSettings.height == settings.height);
+    CHECK(decodedSettings.samplesPerPixel == settings.samplesPerPixel);
+    CHECK(decodedSettings.maxDepth == settings.maxDepth);
+    CHECK(decodedSettings.seed == settings.seed);
+    CHECK(decodedSettings.mode == settings.mode);
+    CHECK(decodedSettings.sampler == settings.sampler);
+    CHECK(decodedSettings.bvhLayout == settings.bvhLayout);
+
+    CHECK(decodedScene.vertices == scene.vertices);
+    CHECK(decodedScene.uvs == scene.uvs);
+    CHECK(decodedScene.triangles == scene.triangles);
+    CHECK(decodedScene.triangleMaterials == scene.triangleMaterials);
+    CHECK(decodedScene.materials.size() == scene.materials.size());
+    for (size_t i = 0; i < scene.materials.size() && i < decodedScene.materials.size(); i++) {
+        CHECK(decodedScene.materials[i].albedo == scene.materials[i].albedo);
+        CHECK(decodedScene.materials[i].emission == scene.materials[i].emission);
+        CHECK(decodedScene.materials[i].type == scene.materials[i].type);
+    }
+    CHECK(decodedScene.camera.position == scene.camera.position);
+    CHECK(decodedScene.camera.target == scene.camera.target);
+    CHECK(decodedScene.camera.verticalFov == scene.camera.verticalFov);
+}
+
+static void testWork() {
+    WorkItem item;
+    item.id = 7;
+    item.region = {32, 64, 16, 8};
+    item.firstSample = 128;
+    item.sampleCount = 4;
+
+    WorkItem decoded = decodeWork(encodeWork(item));
+    CHECK(decoded.id == item.id);
+    CHECK(decoded.region.x == item.region.x);
+    CHECK(decoded.region.y == item.region.y);
+    CHECK(decoded.region.width == item.region.width);
+    CHECK(decoded.region.height == item.region.height);
+    CHECK(decoded.firstSample == item.firstSample);
+    CHECK(decoded.sampleCount == item.sampleCount);
+}
+
+static void testResult() {
+    WorkItem item;
+    item.id = 3;
+    item.region = {0, 0, 4, 2};
+    item.sampleCount = 2;
+
+    AccumulationBuffer tile;
+    tile.resize(item.region.width, item.region.height);
+    for (uint32_t i = 0; i < item.region.width * item.region.height; i++) {
+        FeatureSample features;
+        features.albedo = glm::vec3(1.0f, 0.5f, 0.0f);
+        features.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        features.depth = 2.0f + static_cast<float>(i);
+        for (uint32_t sample = 0; sample < item.sampleCount; sample++) {
+            tile.addSample(i, glm::vec3(0.1f * static_cast<float>(i), 3.0f, 0.25f), features);
+        }
+    }
+
+    AccumulationBuffer decodedTile;
+    WorkItem decoded = decodeResult(encodeResult(item, tile), decodedTile);
+    CHECK(decoded.id == item.id);
+    CHECK(decodedTile.width == tile.width);
+    CHECK(decodedTile.height == tile.height);
+    // radiance goes over exactly, the features are quantised
+    CHECK(decodedTile.radianceSum == tile.radianceSum);
+    CHECK(decodedTile.sampleCounts == tile.sampleCounts);
+    for (size_t i = 0; i < tile.depthSum.size() && i < decodedTile.depthSum.size(); i++) {
+        CHECK(std::abs(decodedTile.depthSum[i] - tile.depthSum[i]) < 1e-4f);
+        for (int channel = 0; channel < 3; channel++) {
+            CHECK(std::abs(decodedTile.albedoSum[i][channel] - tile.albedoSum[i][channel]) < 0.02f);
+            CHECK(std::abs(decodedTile.normalSum[i][channel] - tile.normalSum[i][channel]) < 0.02f);
+        }
+    }
+
+    // every pixel of an item has to hold the item's sample count
+    tile.addSample(0, glm::vec3(1.0f), FeatureSample());
+    CHECK_THROWS(encodeResult(item, tile));
+}
+
+static void testMalformedPayloads() {
+    std::vector<uint8_t> work = encodeWork(WorkItem());
+    std::vector<uint8_t> truncated(work.begin(), work.end() - 1);
+    CHECK_THROWS(decodeWork(truncated));
+
+    std::vector<uint8_t> padded = work;
+    padded.push_back(0);
+    CHECK_THROWS(decodeWork(padded));
+
+    std::vector<uint8_t> job = encodeJob(RenderSettings(), Scene::createCornellBox());
+    job.resize(job.size() / 2);
+    RenderSettings settings;
+    Scene scene;
+    CHECK_THROWS(decodeJob(job, settings, scene));
+}
+
+// decodeJob has to turn a corrupt job down with a runtime_error like any other bad message, not run out of memory
+static bool rejectsJob(const std::vector<uint8_t> &payload) {
+    RenderSettings settings;
+    Scene scene;
+    try {
+        decodeJob(payload, settings, scene);
+    } catch (const std::runtime_error &) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+    return false;
+}
+
+static void testOversizedCounts() {
+    // a job with an empty scene ends in the material, texture, vertex and triangle counts and the environment flag
+    std::vector<uint8_t> job = encodeJob(RenderSettings(), Scene());
+    size_t vertexCountOffset = job.size() - 9;
+    size_t triangleCountOffset = job.size() - 5;
+    const uint32_t huge = 0xFFFFFFFF;
+
+    std::vector<uint8_t> vertices = job;
+    std::memcpy(vertices.data() + vertexCountOffset, &huge, sizeof(huge));
+    CHECK(rejectsJob(vertices));
+
+    std::vector<uint8_t> triangles = job;
+    std::memcpy(triangles.data() + triangleCountOffset, &huge, sizeof(huge));
+    CHECK(rejectsJob(triangles));
+
+    // an environment map of 0xFFFFFFFF x 0xFFFFFFFF pixels, then one of 0 x 16
+    std::vector<uint8_t> environment = job;
+    environment.back() = 1;
+    environment.insert(environment.end(), 8, 0xFF);
+    CHECK(rejectsJob(environment));
+    std::vector<uint8_t> empty = job;
+    empty.back() = 1;
+    empty.insert(empty.end(), {0, 0, 0, 0, 16, 0, 0, 0});
+    CHECK(rejectsJob(empty));
+}
+
+int main() {
+    testHello();
+    testJob();
+    testWork();
+    testResult();
+    testMalformedPayloads();
+    testOversizedCounts();
+    return getCheckFailures() != 0;
+}